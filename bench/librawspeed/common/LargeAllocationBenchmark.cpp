@@ -0,0 +1,130 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/Common.h"          // for ushort16
+#include "common/LargeAllocation.h" // for largeMallocArray, largeFree
+#include "common/TaskScheduler.h"   // for Parallelism
+#include <benchmark/benchmark.h>    // for State, Benchmark, BENCHMARK_TEMPLATE
+#include <cstddef>                  // for size_t
+#include <cstring>                  // for memset
+#include <string>                   // for string, operator+
+
+using rawspeed::largeFree;
+using rawspeed::LargeAllocation;
+using rawspeed::LargeAllocationPolicy;
+using rawspeed::largeMallocArray;
+using rawspeed::Parallelism;
+using rawspeed::ushort16;
+
+namespace {
+
+// A 16-bit image of the given total size, 8192 pixels wide.
+constexpr int width = 8192;
+constexpr size_t pitch = width * sizeof(ushort16);
+
+LargeAllocation allocate(benchmark::State& state,
+                         LargeAllocationPolicy policy) {
+  const auto rows = static_cast<size_t>(state.range(0)) / pitch;
+  LargeAllocation a = largeMallocArray(rows, pitch, policy);
+  if (state.range(1))
+    rawspeed::prefault(a, Parallelism());
+  return a;
+}
+
+void setCounters(benchmark::State& state, const LargeAllocation& a) {
+  state.SetLabel(std::string("alloc:") +
+                 rawspeed::getLargeAllocationPolicyName(a.policy) +
+                 (state.range(1) ? "/prefault" : ""));
+  state.SetBytesProcessed(state.range(0) * state.iterations());
+}
+
+} // namespace
+
+// Allocate, (maybe) prefault, and write the image once, row by row, on one
+// thread, like a single-threaded decompressor would. Includes the page faults.
+template <LargeAllocationPolicy policy>
+static inline void BM_FirstTouch(benchmark::State& state) {
+  LargeAllocation used;
+  for (auto _ : state) {
+    LargeAllocation a = allocate(state, policy);
+    if (!a.ptr) {
+      state.SkipWithError("allocation failed");
+      return;
+    }
+    memset(a.ptr, 1, a.size);
+    benchmark::ClobberMemory();
+    used = a;
+    largeFree(a);
+  }
+  setCounters(state, used);
+}
+
+// Walk the already faulted-in image column by column, like the vertical
+// passes (e.g. the Fuji rotation, the column-wise DNG opcodes) do.
+// Each step goes to the next row, i.e. (usually) to the next normal page.
+template <LargeAllocationPolicy policy>
+static inline void BM_ColumnPass(benchmark::State& state) {
+  LargeAllocation a = allocate(state, policy);
+  if (!a.ptr) {
+    state.SkipWithError("allocation failed");
+    return;
+  }
+  memset(a.ptr, 1, a.size);
+
+  const auto* data = static_cast<const ushort16*>(a.ptr);
+  const size_t rows = a.size / pitch;
+  for (auto _ : state) {
+    unsigned sum = 0;
+    // One cache line (32 pixels) of each row at a time.
+    for (int col = 0; col < width; col += 32) {
+      for (size_t row = 0; row < rows; ++row)
+        sum += data[row * width + col];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  setCounters(state, a);
+  largeFree(a);
+}
+
+static inline void CustomArguments(benchmark::internal::Benchmark* b) {
+  // ~256 MiB, without and with prefaulting.
+  b->Args({256 << 20, 0});
+  b->Args({256 << 20, 1});
+  b->Unit(benchmark::kMillisecond);
+  b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_FirstTouch, LargeAllocationPolicy::Default)
+    ->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_FirstTouch, LargeAllocationPolicy::TransparentHugePages)
+    ->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_FirstTouch, LargeAllocationPolicy::HugeTLB)
+    ->Apply(CustomArguments);
+
+BENCHMARK_TEMPLATE(BM_ColumnPass, LargeAllocationPolicy::Default)
+    ->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_ColumnPass, LargeAllocationPolicy::TransparentHugePages)
+    ->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_ColumnPass, LargeAllocationPolicy::HugeTLB)
+    ->Apply(CustomArguments);
+
+BENCHMARK_MAIN();
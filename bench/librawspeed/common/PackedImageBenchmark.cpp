@@ -0,0 +1,103 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "bench/Common.h"         // for areaToRectangle
+#include "common/Common.h"        // for ushort16
+#include "common/PackedImage.h"   // for PackedImage
+#include "common/Point.h"         // for iPoint2D
+#include "common/RawImage.h"      // for RawImage, RawImageData, TYPE_USH...
+#include "common/TaskScheduler.h" // for Parallelism
+#include <benchmark/benchmark.h>  // for State, Benchmark, BENCHMARK_TEMPLATE
+#include <random>                 // for minstd_rand, uniform_int_distribution
+
+using rawspeed::iPoint2D;
+using rawspeed::PackedImage;
+using rawspeed::Parallelism;
+using rawspeed::RawImage;
+using rawspeed::TYPE_USHORT16;
+using rawspeed::ushort16;
+
+namespace {
+
+RawImage makeImage(const iPoint2D& dim, int bits) {
+  RawImage img = RawImage::create(dim, TYPE_USHORT16);
+
+  std::minstd_rand gen(dim.area());
+  std::uniform_int_distribution<int> dist(0, (1 << bits) - 1);
+  for (int y = 0; y < dim.y; y++) {
+    auto* row = reinterpret_cast<ushort16*>(img->getData(0, y));
+    for (int x = 0; x < dim.x; x++)
+      row[x] = dist(gen);
+  }
+  return img;
+}
+
+// The (un)packing itself, on one thread.
+const Parallelism singleThread(1);
+
+} // namespace
+
+template <int bits> static inline void BM_Pack(benchmark::State& state) {
+  const auto dim = areaToRectangle(state.range(0));
+  const RawImage img = makeImage(dim, bits);
+
+  for (auto _ : state) {
+    PackedImage packed = PackedImage::pack(img, bits, singleThread);
+    benchmark::DoNotOptimize(packed.getRow(0));
+  }
+
+  state.SetComplexityN(dim.area());
+  state.SetItemsProcessed(state.complexity_length_n() * state.iterations());
+  state.SetBytesProcessed(sizeof(ushort16) * state.items_processed());
+}
+
+template <int bits> static inline void BM_Unpack(benchmark::State& state) {
+  const auto dim = areaToRectangle(state.range(0));
+  const PackedImage packed =
+      PackedImage::pack(makeImage(dim, bits), bits, singleThread);
+
+  for (auto _ : state) {
+    RawImage img = packed.unpack(singleThread);
+    benchmark::DoNotOptimize(img);
+  }
+
+  state.SetComplexityN(dim.area());
+  state.SetItemsProcessed(state.complexity_length_n() * state.iterations());
+  state.SetBytesProcessed(sizeof(ushort16) * state.items_processed());
+}
+
+static inline void CustomArguments(benchmark::internal::Benchmark* b) {
+  b->RangeMultiplier(2);
+#if 1
+  b->Arg(24 << 20);
+#else
+  b->Range(1, 256 << 20)->Complexity(benchmark::oN);
+#endif
+  b->Unit(benchmark::kMillisecond);
+  b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_Pack, 12)->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_Pack, 14)->Apply(CustomArguments);
+
+BENCHMARK_TEMPLATE(BM_Unpack, 12)->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_Unpack, 14)->Apply(CustomArguments);
+
+BENCHMARK_MAIN();
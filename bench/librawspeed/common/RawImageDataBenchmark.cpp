@@ -0,0 +1,110 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "bench/Common.h"        // for areaToRectangle
+#include "common/Common.h"       // for ushort16
+#include "common/Point.h"        // for iPoint2D
+#include "common/RawImage.h"     // for RawImage, RawImageData, RawImageType
+#include <benchmark/benchmark.h> // for State, Benchmark, BENCHMARK_TEMPLATE
+#include <random>                // for minstd_rand, uniform_int_distribution
+
+using rawspeed::iPoint2D;
+using rawspeed::RawImage;
+using rawspeed::RawImageType;
+using rawspeed::TYPE_FLOAT32;
+using rawspeed::TYPE_USHORT16;
+using rawspeed::ushort16;
+
+namespace {
+
+template <RawImageType type> RawImage makeImage(const iPoint2D& dim) {
+  RawImage img = RawImage::create(dim, type);
+
+  std::minstd_rand gen(dim.area());
+  std::uniform_int_distribution<int> dist(64, 4095);
+  for (int y = 0; y < dim.y; y++) {
+    for (int x = 0; x < dim.x; x++) {
+      if (type == TYPE_USHORT16)
+        reinterpret_cast<ushort16*>(img->getData(0, y))[x] = dist(gen);
+      else
+        reinterpret_cast<float*>(img->getData(0, y))[x] = dist(gen) / 4095.0F;
+    }
+  }
+  return img;
+}
+
+} // namespace
+
+// Only the scaling, the black and white levels are known.
+template <RawImageType type>
+static inline void BM_ScaleValues(benchmark::State& state) {
+  const auto dim = areaToRectangle(state.range(0));
+  RawImage img = makeImage<type>(dim);
+
+  for (auto _ : state) {
+    img->blackLevelSeparate.fill(64);
+    img->whitePoint = 4095;
+    img->scaleBlackWhite();
+  }
+
+  state.SetComplexityN(dim.area());
+  state.SetItemsProcessed(state.complexity_length_n() * state.iterations());
+  state.SetBytesProcessed(img->getBpp() * state.items_processed());
+}
+
+// The black and white levels are estimated from the image first.
+template <RawImageType type>
+static inline void BM_EstimateAndScaleValues(benchmark::State& state) {
+  const auto dim = areaToRectangle(state.range(0));
+  RawImage img = makeImage<type>(dim);
+
+  for (auto _ : state) {
+    img->blackLevel = -1;
+    img->blackLevelSeparate.fill(-1);
+    img->whitePoint = 65536;
+    img->scaleBlackWhite();
+  }
+
+  state.SetComplexityN(dim.area());
+  state.SetItemsProcessed(state.complexity_length_n() * state.iterations());
+  state.SetBytesProcessed(img->getBpp() * state.items_processed());
+}
+
+static inline void CustomArguments(benchmark::internal::Benchmark* b) {
+  b->RangeMultiplier(2);
+#if 1
+  b->Arg(24 << 20);
+#else
+  b->Range(1, 256 << 20)->Complexity(benchmark::oN);
+#endif
+  b->Unit(benchmark::kMillisecond);
+  b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_ScaleValues, TYPE_USHORT16)->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_ScaleValues, TYPE_FLOAT32)->Apply(CustomArguments);
+
+BENCHMARK_TEMPLATE(BM_EstimateAndScaleValues, TYPE_USHORT16)
+    ->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_EstimateAndScaleValues, TYPE_FLOAT32)
+    ->Apply(CustomArguments);
+
+BENCHMARK_MAIN();
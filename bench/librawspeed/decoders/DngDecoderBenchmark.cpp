@@ -0,0 +1,122 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "bench/Common.h"            // for areaToRectangle
+#include "common/Common.h"           // for rawspeed_get_number_of_process...
+#include "common/Point.h"            // for iPoint2D
+#include "common/RawImage.h"         // for RawImage, RawImageData
+#include "common/TaskScheduler.h"    // for ThreadPool, setExecutor
+#include "decoders/RawDecoder.h"     // for RawDecoder
+#include "encoders/DngWriter.h"      // for DngWriter
+#include "io/Buffer.h"               // for Buffer
+#include "metadata/CameraMetaData.h" // for CameraMetaData
+#include "parsers/RawParser.h"       // for RawParser
+#include <algorithm>                 // for max
+#include <benchmark/benchmark.h>     // for State, RegisterBenchmark, Ini...
+#include <memory>                    // for make_shared
+#include <random>                    // for minstd_rand
+#include <string>                    // for string, to_string
+#include <vector>                    // for vector
+
+using rawspeed::DngWriter;
+
+namespace {
+
+// Synthetic 14-bit CFA data: a gradient plus some noise, so that the LJpeg
+// frames compress roughly like the real ones do.
+rawspeed::RawImage genImage(const rawspeed::iPoint2D& dim) {
+  auto mRaw = rawspeed::RawImage::create(dim);
+  std::minstd_rand gen(dim.area());
+  for (int y = 0; y < dim.y; ++y) {
+    auto* row = reinterpret_cast<rawspeed::ushort16*>(mRaw->getData(0, y));
+    for (int x = 0; x < dim.x; ++x)
+      row[x] = ((x + y) + (gen() & 255)) & ((1 << 14) - 1);
+  }
+  return mRaw;
+}
+
+} // namespace
+
+static inline void BM_DngDecoder(benchmark::State& state,
+                                 DngWriter::Compression compression,
+                                 bool tiled, int threads) {
+  const auto dim = areaToRectangle(state.range(0), {3, 2});
+
+  DngWriter writer;
+  writer.compression = compression;
+  writer.bitsPerSample = compression == DngWriter::Compression::LJpeg ? 14 : 16;
+  if (tiled) {
+    writer.tileWidth = 256;
+    writer.tileHeight = 256;
+  } else
+    writer.rowsPerStrip = 256;
+
+  const std::vector<rawspeed::uchar8> dng = writer.write(genImage(dim));
+  const rawspeed::Buffer buf(dng.data(), dng.size());
+  const rawspeed::CameraMetaData meta;
+
+  rawspeed::setExecutor(std::make_shared<rawspeed::ThreadPool>(threads));
+
+  for (auto _ : state) {
+    rawspeed::RawParser parser(&buf);
+    auto decoder = parser.getDecoder(&meta);
+    decoder->failOnUnknown = false;
+    decoder->checkSupport(&meta);
+    const auto mRaw = decoder->decodeRaw();
+    benchmark::DoNotOptimize(mRaw->getData());
+  }
+
+  rawspeed::setExecutor(nullptr);
+
+  state.SetComplexityN(dim.area());
+  state.SetItemsProcessed(state.complexity_length_n() * state.iterations());
+  state.SetBytesProcessed(buf.getSize() * state.iterations());
+}
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+
+  const auto threadsMax =
+      std::max(1, rawspeed_get_number_of_processor_cores());
+
+  for (const auto compression : {DngWriter::Compression::Uncompressed,
+                                 DngWriter::Compression::LJpeg}) {
+    for (const bool tiled : {false, true}) {
+      std::string name = "BM_DngDecoder/";
+      name += compression == DngWriter::Compression::LJpeg ? "LJpeg"
+                                                           : "Uncompressed";
+      name += tiled ? "/Tiles" : "/Strips";
+      name += "/threads:";
+
+      for (int threads = 1; threads <= threadsMax; threads *= 2) {
+        auto* b = benchmark::RegisterBenchmark(
+            (name + std::to_string(threads)).c_str(), &BM_DngDecoder,
+            compression, tiled, threads);
+        for (const int mpix : {24, 50, 100, 150})
+          b->Arg(mpix * 1000 * 1000);
+        b->Unit(benchmark::kMillisecond);
+        b->UseRealTime();
+      }
+    }
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,398 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+// The benchmark of one decompressor. It is built once per decompressor,
+// together with the decompressor's fuzzer (fuzz/librawspeed/decompressors/),
+// and times that fuzzer's entry point on the given inputs. So the inputs are
+// in the same format as the fuzzer's corpus, and should actually decode
+// without errors, else it is the error path that is benchmarked.
+//
+// The corpus inputs are tiny though, so with -s <megapixels> the benchmark
+// also generates a synthetic input of that size, for the decompressors that
+// there is an encoder for (see genSyntheticInput()).
+
+#include "bench/Common.h"                    // for areaToRectangle
+#include "common/Common.h"                   // for roundUp, roundDown
+#include "common/Point.h"                    // for iPoint2D
+#include "common/RawImage.h"                 // for RawImageType::TYPE_USHORT16
+#include "common/RawspeedException.h"        // for RawspeedException, ThrowRSE
+#include "common/TaskScheduler.h"            // for ThreadPool, setExecutor
+#include "decompressors/NikonDecompressor.h" // for NikonDecompressor
+#include "encoders/BitPumpWriter.h"          // for BitPumpMSBWriter
+#include "encoders/LJpegEncoder.h"           // for LJpegEncoder
+#include "io/Buffer.h"                       // for Buffer
+#include "io/ByteStream.h"                   // for ByteStream
+#include "io/Endianness.h"                   // for Endianness, Endianness::l...
+#include "io/FileReader.h"                   // for FileReader
+#include <algorithm>                         // for max, find_if
+#include <array>                             // for array
+#include <benchmark/benchmark.h>             // for State, RegisterBenchmark,...
+#include <chrono>                            // for duration, steady_clock
+#include <cstddef>                           // for size_t
+#include <cstdint>                           // for uint8_t
+#include <ctime>                             // for clock, CLOCKS_PER_SEC
+#include <iostream>                          // for cerr, endl
+#include <list>                              // for list
+#include <memory>                            // for make_shared, unique_ptr
+#include <random>                            // for minstd_rand
+#include <stdexcept>                         // for logic_error
+#include <string>                            // for string, to_string
+#include <vector>                            // for vector
+
+#ifndef DECOMPRESSOR
+#error DECOMPRESSOR must be defined to the name of the benchmarked decompressor
+#endif
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* Data, size_t Size);
+
+using rawspeed::Buffer;
+using rawspeed::FileReader;
+using rawspeed::iPoint2D;
+using rawspeed::LJpegEncoder;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+using rawspeed::ushort16;
+
+namespace {
+
+// The pixel count of the image, from the input's CreateRawImage() header.
+uint64_t getPixelCount(const Buffer& input) {
+  const rawspeed::DataBuffer db(input, rawspeed::Endianness::little);
+  rawspeed::ByteStream bs(db);
+
+  const uint64_t width = bs.getU32();
+  const uint64_t height = bs.getU32();
+  return width * height;
+}
+
+// Little-endian, as the fuzzers read them.
+void putU16(std::vector<uchar8>* out, uint32 v) {
+  out->push_back(static_cast<uchar8>(v));
+  out->push_back(static_cast<uchar8>(v >> 8));
+}
+
+void putU32(std::vector<uchar8>* out, uint32 v) {
+  putU16(out, v & 0xFFFF);
+  putU16(out, v >> 16);
+}
+
+// The CreateRawImage() header of a 16-bit single-component CFA image.
+void putImageHeader(std::vector<uchar8>* out, const iPoint2D& dim) {
+  putU32(out, dim.x);
+  putU32(out, dim.y);
+  putU32(out, rawspeed::TYPE_USHORT16);
+  putU32(out, 1); // cpp
+  putU32(out, 1); // isCFA
+}
+
+// Synthetic 14-bit CFA data: a gradient plus some noise, so that the frames
+// compress roughly like the real ones do. Same as in DngDecoderBenchmark.
+std::vector<ushort16> genPixels(const iPoint2D& dim) {
+  std::vector<ushort16> pixels(dim.area());
+  std::minstd_rand gen(dim.area());
+  for (int y = 0; y < dim.y; ++y) {
+    for (int x = 0; x < dim.x; ++x) {
+      pixels[static_cast<size_t>(y) * dim.x + x] =
+          ((x + y) + (gen() & 255)) & ((1 << 14) - 1);
+    }
+  }
+  return pixels;
+}
+
+// One DNG-style tile covering the whole image, with two components per
+// LJpeg pixel, as the DNG converters write the CFA data.
+std::vector<uchar8> genLJpeg(const iPoint2D& dim) {
+  std::vector<uchar8> out;
+  putImageHeader(&out, dim);
+  putU32(&out, 0);     // offsetX
+  putU32(&out, 0);     // offsetY
+  putU32(&out, dim.x); // width
+  putU32(&out, dim.y); // height
+  putU32(&out, 0);     // fixDng16Bug
+
+  LJpegEncoder encoder;
+  encoder.precision = 14;
+  encoder.encode(&out, genPixels(dim).data(), dim.x, dim.x / 2, dim.y, 2);
+  return out;
+}
+
+// Three vertical slices and two components per LJpeg pixel, as in most of
+// the CR2's. The LJpeg frame is the slices one after another, each one from
+// the top to the bottom, re-wrapped into the rows as wide as the image.
+std::vector<uchar8> genCr2(const iPoint2D& dim) {
+  const int sliceWidth = rawspeed::roundDown(dim.x / 3, 2);
+  const int lastSliceWidth = dim.x - 2 * sliceWidth;
+
+  const std::vector<ushort16> pixels = genPixels(dim);
+  std::vector<ushort16> frame;
+  frame.reserve(pixels.size());
+  for (int slice = 0; slice < 3; ++slice) {
+    const int sliceX = slice * sliceWidth;
+    const int width = slice == 2 ? lastSliceWidth : sliceWidth;
+    for (int y = 0; y < dim.y; ++y) {
+      const auto* row = &pixels[static_cast<size_t>(y) * dim.x + sliceX];
+      frame.insert(frame.end(), row, row + width);
+    }
+  }
+
+  std::vector<uchar8> out;
+  putImageHeader(&out, dim);
+  putU16(&out, 3); // numSlices
+  putU16(&out, sliceWidth);
+  putU16(&out, lastSliceWidth);
+
+  LJpegEncoder encoder;
+  encoder.precision = 14;
+  encoder.encode(&out, frame.data(), dim.x, dim.x / 2, dim.y, 2);
+  return out;
+}
+
+// 14-bit lossless NEF: no curve, and each of the two interleaved columns is
+// predicted from the previous pixel of the same color.
+std::vector<uchar8> genNikon(const iPoint2D& dim) {
+  // See NikonDecompressor::NikonDecompressor(): version 70 is lossless,
+  // initial predictors, and the empty curve, which is the identity one.
+  std::vector<uchar8> metadata = {70, 0};
+  for (int i = 0; i < 4; ++i)
+    putU16(&metadata, 0); // pUp1[], pUp2[]
+  putU16(&metadata, 0);   // csize
+
+  std::vector<uchar8> out;
+  putImageHeader(&out, dim);
+  putU32(&out, 14); // bitsPS
+  putU32(&out, 0);  // uncorrectedRawValues
+  putU32(&out, metadata.size());
+  out.insert(out.end(), metadata.begin(), metadata.end());
+
+  // The canonical codes of the 14-bit lossless table, by the diff length.
+  struct Code final {
+    uint32 code = 0;
+    int len = 0;
+  };
+  const auto& table = rawspeed::NikonDecompressor::nikon_tree[5];
+  std::array<Code, 17> codes;
+  uint32 code = 0;
+  for (int len = 1, i = 0; len <= 16; ++len, code <<= 1) {
+    for (int n = 0; n < table[0][len - 1]; ++n, ++i, ++code)
+      codes[table[1][i]] = {code, len};
+  }
+
+  rawspeed::BitPumpMSBWriter bits(&out);
+  const auto putDiff = [&bits, &codes](int diff) {
+    int diffLen = 0;
+    for (int magnitude = diff < 0 ? -diff : diff; magnitude; magnitude >>= 1)
+      diffLen++;
+    bits.put(codes[diffLen].code, codes[diffLen].len);
+    if (diffLen > 0)
+      bits.put((diff < 0 ? diff - 1 : diff) & ((1 << diffLen) - 1), diffLen);
+  };
+
+  const std::vector<ushort16> pixels = genPixels(dim);
+  std::array<std::array<int, 2>, 2> pUp = {};
+  for (int y = 0; y < dim.y; ++y) {
+    const ushort16* row = &pixels[static_cast<size_t>(y) * dim.x];
+    for (int c = 0; c < 2; ++c) {
+      putDiff(row[c] - pUp[c][y & 1]);
+      pUp[c][y & 1] = row[c];
+    }
+    for (int x = 2; x < dim.x; ++x)
+      putDiff(row[x] - row[x - 2]);
+  }
+  bits.flush();
+  return out;
+}
+
+// Random ARW2 blocks, that are all valid, i.e. their min and max pixels
+// differ. Same as in SonyArw2DecompressorTest.
+std::vector<uchar8> genSonyArw2(const iPoint2D& dim) {
+  std::vector<uchar8> out;
+  putImageHeader(&out, dim);
+
+  const size_t begin = out.size();
+  out.resize(begin + dim.area());
+  std::minstd_rand gen(dim.area());
+  for (size_t i = begin; i < out.size(); ++i)
+    out[i] = gen();
+
+  for (size_t block = begin; block < out.size(); block += 16) {
+    const int imax = gen() % 16;
+    const int imin = (imax + 1 + gen() % 15) % 16;
+    // Bits 22..25 and 26..29.
+    out[block + 2] = (out[block + 2] & 0x3f) | (imax & 3) << 6;
+    out[block + 3] = (out[block + 3] & 0xc0) | imax >> 2 | imin << 2;
+  }
+  return out;
+}
+
+struct SyntheticInputGenerator final {
+  const char* decompressor;
+  iPoint2D maxDim; // The largest image the decompressor accepts.
+  std::vector<uchar8> (*generate)(const iPoint2D& dim);
+};
+
+const std::array<SyntheticInputGenerator, 4> syntheticInputGenerators = {{
+    {"Cr2Decompressor", {8896, 5920}, &genCr2},
+    {"LJpegDecompressor", {2 * 65535, 65535}, &genLJpeg},
+    {"NikonDecompressor", {8288, 5520}, &genNikon},
+    {"SonyArw2Decompressor", {9600, 6376}, &genSonyArw2},
+}};
+
+// An input of the DECOMPRESSOR's fuzzer of (at least) the given size, 3:2.
+// The width is a multiple of 32, which all of the generators are fine with.
+std::vector<uchar8> genSyntheticInput(double megapixels) {
+  const auto generator = std::find_if(
+      syntheticInputGenerators.begin(), syntheticInputGenerators.end(),
+      [](const SyntheticInputGenerator& g) {
+        return std::string(g.decompressor) == DECOMPRESSOR;
+      });
+  if (generator == syntheticInputGenerators.end())
+    ThrowRSE("No synthetic inputs for %s, there is no encoder for it",
+             DECOMPRESSOR);
+
+  if (megapixels <= 0)
+    ThrowRSE("Bad image size: %g megapixels", megapixels);
+
+  iPoint2D dim = areaToRectangle(megapixels * 1000 * 1000, {3, 2});
+  dim.x = rawspeed::roundUp(dim.x, 32);
+  if (dim.x > generator->maxDim.x || dim.y > generator->maxDim.y) {
+    ThrowRSE("%g megapixels (%i x %i) is more than %s supports (%i x %i)",
+             megapixels, dim.x, dim.y, DECOMPRESSOR, generator->maxDim.x,
+             generator->maxDim.y);
+  }
+
+  return generator->generate(dim);
+}
+
+} // namespace
+
+static inline void BM_Decompressor(benchmark::State& state, const Buffer* input,
+                                   uint64_t pixels, int threads) {
+  // The fuzzers create the image with the default parallelism, i.e. they run
+  // on the process-wide executor, so that is what has the wanted size.
+  rawspeed::setExecutor(std::make_shared<rawspeed::ThreadPool>(threads));
+
+  const auto wallStart = std::chrono::steady_clock::now();
+  const std::clock_t cpuStart = std::clock();
+
+  for (auto _ : state) {
+    const int ret = LLVMFuzzerTestOneInput(input->begin(), input->getSize());
+    benchmark::DoNotOptimize(ret);
+  }
+
+  const std::chrono::duration<double> wall =
+      std::chrono::steady_clock::now() - wallStart;
+  const double cpu = static_cast<double>(std::clock() - cpuStart) /
+                     static_cast<double>(CLOCKS_PER_SEC);
+
+  rawspeed::setExecutor(nullptr);
+
+  state.SetItemsProcessed(pixels * state.iterations());
+  state.SetBytesProcessed(input->getSize() * state.iterations());
+
+  // For each iteration:
+  state.counters.insert({
+      {"CPUTime,s", cpu / state.iterations()},
+      {"WallTime,s", wall.count() / state.iterations()},
+      {"CPUTime/WallTime", cpu / wall.count()}, // 'Threading factor'
+      {"Pixels", pixels},
+      {"Pixels/WallTime", (state.iterations() * pixels) / wall.count()},
+      {"Bytes", input->getSize()},
+      {"Bytes/WallTime",
+       (state.iterations() * input->getSize()) / wall.count()},
+  });
+}
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+
+  // Like rsbench: with -t, each input is benchmarked with 1 ... all threads,
+  // else only with all of them.
+  bool threading = false;
+  std::vector<std::string> fileNames;
+  std::vector<std::string> megapixels;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "-t")
+      threading = true;
+    else if (std::string(argv[i]) == "-s") {
+      if (++i == argc) {
+        std::cerr << "-s needs the size of the image, in megapixels"
+                  << std::endl;
+        return 1;
+      }
+      megapixels.emplace_back(argv[i]);
+    } else
+      fileNames.emplace_back(argv[i]);
+  }
+
+  const auto threadsMax =
+      std::max(1, rawspeed_get_number_of_processor_cores());
+  const auto threadsMin = threading ? 1 : threadsMax;
+
+  // The inputs are read (or generated) once, and live until the end.
+  std::vector<std::unique_ptr<const Buffer>> inputs;
+  std::list<std::vector<uchar8>> syntheticInputs;
+  std::vector<std::string> inputNames;
+  for (const auto& fileName : fileNames) {
+    try {
+      inputs.emplace_back(FileReader(fileName.c_str()).readFile());
+    } catch (rawspeed::RawspeedException& e) {
+      std::cerr << fileName << ": " << e.what() << std::endl;
+      return 1;
+    }
+    inputNames.emplace_back(fileName);
+  }
+  for (const auto& mpix : megapixels) {
+    try {
+      syntheticInputs.emplace_back(genSyntheticInput(std::stod(mpix)));
+    } catch (rawspeed::RawspeedException& e) {
+      std::cerr << "-s " << mpix << ": " << e.what() << std::endl;
+      return 1;
+    } catch (std::logic_error&) { // from std::stod()
+      std::cerr << "-s " << mpix << ": not a number" << std::endl;
+      return 1;
+    }
+    const auto& input = syntheticInputs.back();
+    inputs.emplace_back(std::make_unique<Buffer>(input.data(), input.size()));
+    inputNames.emplace_back("synthetic:" + mpix + "MP");
+  }
+
+  for (size_t i = 0; i < inputs.size(); i++) {
+    uint64_t pixels;
+    try {
+      pixels = getPixelCount(*inputs[i]);
+    } catch (rawspeed::RawspeedException& e) {
+      std::cerr << inputNames[i] << ": " << e.what() << std::endl;
+      return 1;
+    }
+
+    const std::string name =
+        std::string(DECOMPRESSOR) + "/" + inputNames[i] + "/threads:";
+    for (auto threads = threadsMin; threads <= threadsMax; threads++) {
+      auto* b = benchmark::RegisterBenchmark(
+          (name + std::to_string(threads)).c_str(), &BM_Decompressor,
+          inputs[i].get(), pixels, threads);
+      b->Unit(benchmark::kMillisecond);
+      b->UseRealTime();
+    }
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,239 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/Common.h"                    // for uchar8
+#include "common/RawspeedException.h"         // for RawspeedException
+#include "decompressors/HuffmanTableLUT.h"    // for HuffmanTableLUT
+#include "decompressors/HuffmanTableLookup.h" // for HuffmanTableLookup
+#include "decompressors/HuffmanTableTree.h"   // for HuffmanTableTree
+#include "decompressors/HuffmanTableVector.h" // for HuffmanTableVector
+#include "decompressors/NikonDecompressor.h"  // for NikonDecompressor
+#include "decompressors/PentaxDecompressor.h" // for PentaxDecompressor
+#include "encoders/BitPumpWriter.h"           // for BitPumpMSBWriter
+#include "io/BitPumpMSB.h"                    // for BitPumpMSB
+#include "io/Buffer.h"                        // for Buffer, DataBuffer
+#include "io/ByteStream.h"                    // for ByteStream
+#include "io/Endianness.h"                    // for Endianness
+#include "io/FileReader.h"                    // for FileReader
+#include <array>                              // for array
+#include <benchmark/benchmark.h>              // for State, RegisterBenchmark
+#include <iostream>                           // for cerr, endl
+#include <numeric>                            // for accumulate
+#include <random>                             // for minstd_rand
+#include <string>                             // for string, to_string
+#include <utility>                            // for move
+#include <vector>                             // for vector
+
+using rawspeed::Buffer;
+using rawspeed::uchar8;
+
+namespace {
+
+// The contents of one DHT table.
+struct Table final {
+  std::string name;
+  std::vector<uchar8> nCodesPerLength; // 16 entries
+  std::vector<uchar8> codeValues;
+};
+
+template <typename T, size_t N>
+Table makeTable(std::string name, const T& nCodesPerLength,
+                const std::array<uchar8, N>& codeValues) {
+  Table t;
+  t.name = std::move(name);
+  t.nCodesPerLength.assign(nCodesPerLength.begin(), nCodesPerLength.end());
+  t.nCodesPerLength.resize(16);
+  const int nCodes = std::accumulate(t.nCodesPerLength.begin(),
+                                     t.nCodesPerLength.end(), 0);
+  t.codeValues.assign(codeValues.begin(), codeValues.begin() + nCodes);
+  return t;
+}
+
+std::vector<Table> getBuiltinTables() {
+  std::vector<Table> tables;
+
+  // ITU T.81 Annex K.3, table K.3, typical of the generic LJpeg encoders.
+  tables.emplace_back(makeTable(
+      "JPEG-K3", std::array<uchar8, 16>{{0, 1, 5, 1, 1, 1, 1, 1, 1}},
+      std::array<uchar8, 12>{{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}}));
+
+  const auto& nikon = rawspeed::NikonDecompressor::nikon_tree;
+  tables.emplace_back(makeTable("Nikon-12bit-lossy", nikon[0][0], nikon[0][1]));
+  tables.emplace_back(
+      makeTable("Nikon-12bit-lossless", nikon[2][0], nikon[2][1]));
+  tables.emplace_back(makeTable("Nikon-14bit-lossy", nikon[3][0], nikon[3][1]));
+  tables.emplace_back(
+      makeTable("Nikon-14bit-lossless", nikon[5][0], nikon[5][1]));
+
+  const auto& pentax = rawspeed::PentaxDecompressor::pentax_tree;
+  tables.emplace_back(makeTable("Pentax-legacy", pentax[0][0], pentax[0][1]));
+
+  return tables;
+}
+
+// All the DHT tables of all the JPEG streams in the file, wherever they are.
+std::vector<Table> getTablesFromFile(const std::string& fileName) {
+  const auto file = rawspeed::FileReader(fileName.c_str()).readFile();
+
+  std::vector<Table> tables;
+  for (Buffer::size_type pos = 0; pos + 4 < file->getSize(); ++pos) {
+    if ((*file)[pos] != 0xFF || (*file)[pos + 1] != 0xC4)
+      continue;
+
+    try {
+      rawspeed::ByteStream bs(
+          rawspeed::DataBuffer(*file, rawspeed::Endianness::big));
+      bs.setPosition(pos + 2);
+      rawspeed::ByteStream dht = bs.getStream(bs.getU16() - 2);
+      while (dht.getRemainSize() > 0) {
+        const uchar8 tcth = dht.getByte();
+        Table t;
+        t.name = fileName + "@" + std::to_string(pos) + "/" +
+                 std::to_string(tcth & 0xF);
+        const Buffer ncpl = dht.getBuffer(16);
+        t.nCodesPerLength.assign(ncpl.begin(), ncpl.end());
+        const int nCodes = std::accumulate(t.nCodesPerLength.begin(),
+                                           t.nCodesPerLength.end(), 0);
+        const Buffer values = dht.getBuffer(nCodes);
+        t.codeValues.assign(values.begin(), values.end());
+        tables.emplace_back(std::move(t));
+      }
+    } catch (rawspeed::RawspeedException&) {
+      // Not a DHT after all, just these two bytes.
+    }
+  }
+  return tables;
+}
+
+// Random symbols, each one with the probability the code length implies
+// (i.e. as if the table was optimal), and random difference bits.
+std::vector<uchar8> genStream(const Table& t, int count) {
+  struct Code final {
+    unsigned code;
+    int len;
+    int diffLen;
+  };
+  std::vector<Code> codes;
+  unsigned code = 0;
+  for (int len = 1, i = 0; len <= 16; ++len, code <<= 1) {
+    for (int n = 0; n < t.nCodesPerLength[len - 1]; ++n, ++i, ++code) {
+      // 16-bit differences have no bits, see HuffmanTable*::decode()
+      const int diffLen = t.codeValues[i] == 16 ? 0 : t.codeValues[i];
+      codes.push_back({code, len, diffLen});
+    }
+  }
+
+  std::vector<unsigned> weights;
+  for (const auto& c : codes)
+    weights.push_back(1U << (16 - c.len));
+  std::discrete_distribution<int> pick(weights.begin(), weights.end());
+  std::minstd_rand gen(count);
+
+  std::vector<uchar8> data;
+  rawspeed::BitPumpMSBWriter bits(&data);
+  for (int i = 0; i < count; ++i) {
+    const Code& c = codes[pick(gen)];
+    bits.put(c.code, c.len);
+    if (c.diffLen)
+      bits.put(gen() & ((1U << c.diffLen) - 1), c.diffLen);
+  }
+  bits.flush();
+  // The pumps may read a few bytes past the end.
+  data.resize(data.size() + 8);
+  return data;
+}
+
+template <typename HT> void setup(HT* ht, unsigned /*lookupDepth*/) {
+  ht->setup(true, false);
+}
+
+void setup(rawspeed::HuffmanTableLUT* ht, unsigned lookupDepth) {
+  ht->setup(true, false, lookupDepth);
+}
+
+} // namespace
+
+template <typename HT>
+static inline void BM_HuffmanTable(benchmark::State& state, const Table* t,
+                                   unsigned lookupDepth) {
+  const int count = state.range(0);
+  const std::vector<uchar8> data = genStream(*t, count);
+  const rawspeed::DataBuffer db(Buffer(data.data(), data.size()),
+                                rawspeed::Endianness::big);
+  const rawspeed::ByteStream bs(db);
+
+  HT ht;
+  ht.setNCodesPerLength(
+      Buffer(t->nCodesPerLength.data(), t->nCodesPerLength.size()));
+  ht.setCodeValues(Buffer(t->codeValues.data(), t->codeValues.size()));
+  setup(&ht, lookupDepth);
+
+  for (auto _ : state) {
+    rawspeed::BitPumpMSB pump(bs);
+    int sum = 0;
+    for (int i = 0; i < count; ++i)
+      sum += ht.decodeNext(pump);
+    benchmark::DoNotOptimize(sum);
+  }
+
+  state.SetItemsProcessed(int64_t(count) * state.iterations());
+  state.SetBytesProcessed(int64_t(data.size()) * state.iterations());
+}
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+
+  // The tables from the files given on the command line (e.g. LJpeg, Cr2,
+  // DNG, Crw/Cr2 etc. raws) are benchmarked too, in addition to the builtin
+  // ones.
+  std::vector<Table> tables = getBuiltinTables();
+  for (int i = 1; i < argc; i++) {
+    try {
+      for (auto& t : getTablesFromFile(argv[i]))
+        tables.emplace_back(std::move(t));
+    } catch (rawspeed::RawspeedException& e) {
+      std::cerr << argv[i] << ": " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  for (const auto& t : tables) {
+    const auto reg = [&t](const std::string& backend, auto fn,
+                          unsigned lookupDepth) {
+      const std::string name = "BM_HuffmanTable/" + t.name + "/" + backend;
+      auto* b =
+          benchmark::RegisterBenchmark(name.c_str(), fn, &t, lookupDepth);
+      b->Arg(1 << 20);
+      b->Unit(benchmark::kMicrosecond);
+    };
+
+    reg("LUT", &BM_HuffmanTable<rawspeed::HuffmanTableLUT>, 0);
+    for (unsigned depth = 8; depth <= 15; ++depth) {
+      reg("LUT<" + std::to_string(depth) + ">",
+          &BM_HuffmanTable<rawspeed::HuffmanTableLUT>, depth);
+    }
+    reg("Lookup", &BM_HuffmanTable<rawspeed::HuffmanTableLookup>, 0);
+    reg("Tree", &BM_HuffmanTable<rawspeed::HuffmanTableTree>, 0);
+    reg("Vector", &BM_HuffmanTable<rawspeed::HuffmanTableVector>, 0);
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,100 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "bench/Common.h"                          // for areaToRectangle
+#include "common/Common.h"                         // for rawspeed_get_numb...
+#include "common/Point.h"                          // for iPoint2D
+#include "common/RawImage.h"                       // for RawImage, RawImag...
+#include "common/TaskScheduler.h"                  // for ThreadPool, setEx...
+#include "decompressors/PanasonicDecompressorV5.h" // for PanasonicDecompre...
+#include "io/Buffer.h"                             // for Buffer, DataBuffer
+#include "io/ByteStream.h"                         // for ByteStream
+#include "io/Endianness.h"                         // for Endianness
+#include <algorithm>                               // for max
+#include <benchmark/benchmark.h>                   // for State, RegisterBe...
+#include <memory>                                  // for make_shared
+#include <random>                                  // for minstd_rand
+#include <string>                                  // for string, to_string
+#include <vector>                                  // for vector
+
+// The packet unpacking of PanasonicDecompressorV5 on synthetic input.
+// The SSSE3/AVX2 unpackers are chosen at runtime, the CPU permitting;
+// configure with -DWITH_AVX2=OFF and/or -DWITH_SSSE3=OFF to compare them.
+
+static inline void BM_PanasonicDecompressorV5(benchmark::State& state, int bps,
+                                              int threads) {
+  const int pixelsPerPacket = 128 / bps;
+  auto dim = areaToRectangle(state.range(0), {4, 3});
+  dim.x = std::max(1, dim.x / pixelsPerPacket) * pixelsPerPacket;
+
+  // Any bits are valid.
+  constexpr int BlockSize = 0x4000;
+  const int packetsPerBlock = BlockSize / 16;
+  const int numPackets = dim.area() / pixelsPerPacket;
+  std::vector<rawspeed::uchar8> input(
+      (numPackets + packetsPerBlock - 1) / packetsPerBlock * BlockSize);
+  std::minstd_rand gen(dim.area());
+  for (auto& byte : input)
+    byte = gen();
+
+  const rawspeed::ByteStream bs(rawspeed::DataBuffer(
+      rawspeed::Buffer(input.data(), input.size()),
+      rawspeed::Endianness::little));
+  rawspeed::RawImage mRaw = rawspeed::RawImage::create(dim);
+
+  rawspeed::setExecutor(std::make_shared<rawspeed::ThreadPool>(threads));
+
+  for (auto _ : state) {
+    const rawspeed::PanasonicDecompressorV5 d(mRaw, bs, bps);
+    d.decompress();
+    benchmark::DoNotOptimize(mRaw->getData());
+  }
+
+  rawspeed::setExecutor(nullptr);
+
+  state.SetComplexityN(dim.area());
+  state.SetItemsProcessed(state.complexity_length_n() * state.iterations());
+  state.SetBytesProcessed(input.size() * state.iterations());
+}
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+
+  const auto threadsMax =
+      std::max(1, rawspeed_get_number_of_processor_cores());
+
+  for (const int bps : {12, 14}) {
+    const std::string name =
+        "BM_PanasonicDecompressorV5/bps:" + std::to_string(bps) + "/threads:";
+
+    for (int threads = 1; threads <= threadsMax; threads *= 2) {
+      auto* b = benchmark::RegisterBenchmark(
+          (name + std::to_string(threads)).c_str(),
+          &BM_PanasonicDecompressorV5, bps, threads);
+      for (const int mpix : {20, 50, 100})
+        b->Arg(mpix * 1000 * 1000);
+      b->Unit(benchmark::kMillisecond);
+      b->UseRealTime();
+    }
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+}
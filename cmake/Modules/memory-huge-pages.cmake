@@ -0,0 +1,11 @@
+include(CheckCXXSymbolExists)
+
+# For the huge page-backed allocations, see LargeAllocationPolicy.
+
+CHECK_CXX_SYMBOL_EXISTS(mmap sys/mman.h HAVE_MMAP)
+if(NOT HAVE_MMAP)
+  return()
+endif()
+
+CHECK_CXX_SYMBOL_EXISTS(MADV_HUGEPAGE sys/mman.h HAVE_MADV_HUGEPAGE)
+CHECK_CXX_SYMBOL_EXISTS(MAP_HUGETLB sys/mman.h HAVE_MAP_HUGETLB)
@@ -16,6 +16,20 @@ if(BUILD_BENCHMARKING)
   add_dependencies(dependencies benchmark)
 endif()
 
+message(STATUS "Looking for Threads")
+set(THREADS_PREFER_PTHREAD_FLAG ON)
+find_package(Threads)
+if(NOT Threads_FOUND)
+  message(SEND_ERROR "Did not find Threads! The threading library is required.")
+else()
+  message(STATUS "Looking for Threads - found")
+endif()
+target_link_libraries(rawspeed PUBLIC Threads::Threads)
+set_package_properties(Threads PROPERTIES
+                       TYPE REQUIRED
+                       DESCRIPTION "the system threading library"
+                       PURPOSE "Used for the built-in thread pool")
+
 unset(HAVE_OPENMP)
 if(WITH_OPENMP)
   message(STATUS "Looking for OpenMP")
@@ -30,6 +30,7 @@
 #include "common/Point.h"
 #include "common/RawImage.h"
 #include "common/RawspeedException.h"
+#include "decoders/BatchDecoder.h"
 #include "decoders/RawDecoder.h"
 #include "io/Buffer.h"
 #include "io/Endianness.h"
@@ -38,6 +39,7 @@
 #include "metadata/Camera.h"
 #include "metadata/CameraMetaData.h"
 #include "metadata/ColorFilterArray.h"
+#include "parsers/PreviewParser.h"
 #include "parsers/RawParser.h"
 
 // IWYU pragma: end_exports
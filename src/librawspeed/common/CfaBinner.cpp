@@ -0,0 +1,88 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/CfaBinner.h"
+#include "decoders/RawDecoderException.h" // for ThrowRDE
+#include <algorithm>                      // for min
+#include <cassert>                        // for assert
+
+namespace rawspeed {
+
+bool CfaBinner::canBin(const iPoint2D& dim, int factor) {
+  return factor >= minFactor && factor <= maxFactor &&
+         getBinnedDim(dim, factor).hasPositiveArea();
+}
+
+iRectangle2D CfaBinner::getBinnedRect(const iRectangle2D& rect, int factor) {
+  const iPoint2D topLeft(getBinnedPos(rect.getLeft(), factor),
+                         getBinnedPos(rect.getTop(), factor));
+  const iPoint2D bottomRight(getBinnedPos(rect.getRight(), factor),
+                             getBinnedPos(rect.getBottom(), factor));
+  return {topLeft, bottomRight - topLeft};
+}
+
+CfaBinner::CfaBinner(const RawImage& img, int offX_, int width_)
+    : mRaw(&*img), factor(img->binning), bandHeight(2 * factor),
+      offX(offX_), width(width_) {
+  if (!mRaw->isBinned())
+    ThrowRDE("The image is not binned");
+  if (offX < 0 || offX % bandHeight != 0 || width <= 0 ||
+      offX + width > mRaw->getUnbinnedDim().x)
+    ThrowRDE("Bad stripe to bin: %i, width %i", offX, width);
+
+  band.resize(static_cast<size_t>(bandHeight) * width);
+}
+
+void CfaBinner::binBand(int bandIndex) {
+  const int outY = 2 * bandIndex;
+  if (outY + 2 > mRaw->getUncroppedDim().y)
+    return;
+
+  // The whole blocks of 2 * factor columns, clipped to the binned image.
+  const int outX = offX / factor;
+  const int outWidth = std::min(2 * (width / bandHeight),
+                                mRaw->getUncroppedDim().x - outX);
+  if (outWidth <= 0)
+    return;
+  const int divisor = factor * factor;
+
+  for (int py = 0; py < 2; py++) {
+    auto* out = reinterpret_cast<ushort16*>(
+        mRaw->getDataUncropped(outX, outY + py));
+    for (int x = 0; x < outWidth; x++) {
+      // The first full-resolution pixel of the block of this colour.
+      const ushort16* in = &band[static_cast<size_t>(py) * width +
+                                 bandHeight * (x / 2) + x % 2];
+      unsigned sum = 0;
+      for (int j = 0; j < factor; j++) {
+        for (int i = 0; i < factor; i++)
+          sum += in[2 * i];
+        in += 2 * width;
+      }
+      out[x] = (sum + divisor / 2) / divisor;
+    }
+
+    if (outX == 0 && outWidth == mRaw->getUncroppedDim().x)
+      mRaw->pixelStatistics.addRow(outY + py, out);
+  }
+}
+
+} // namespace rawspeed
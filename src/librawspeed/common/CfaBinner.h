@@ -0,0 +1,95 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#pragma once
+
+#include "common/Common.h"   // for ushort16
+#include "common/Point.h"    // for iPoint2D, iRectangle2D
+#include "common/RawImage.h" // for RawImage, RawImageData
+#include <vector>            // for vector
+
+namespace rawspeed {
+
+// Bins a 2x2 CFA image while it is being decompressed, for quick previews:
+// each binned pixel is the average of factor x factor pixels of its colour,
+// so the binned image has the same CFA as the full-resolution one.
+// The decompressor stores the full-resolution rows into a band of
+// 2 * factor of them, which gets binned into the image as soon as it is
+// complete. Whatever does not make up a whole band (or a whole column of
+// blocks) at the bottom (right) of the image, is dropped.
+// NOTE: each binner only handles a horizontal stripe of the image, and the
+// rows of each of its bands must be completed in order. Different binners
+// may be used concurrently, as long as their stripes do not share bands.
+class CfaBinner final {
+public:
+  static constexpr int minFactor = 2;
+  static constexpr int maxFactor = 4;
+
+  static bool __attribute__((pure)) canBin(const iPoint2D& dim, int factor);
+
+  static iPoint2D __attribute__((pure))
+  getBinnedDim(const iPoint2D& dim, int factor) {
+    return {2 * (dim.x / (2 * factor)), 2 * (dim.y / (2 * factor))};
+  }
+
+  // Where the full-resolution position ends up, keeping the CFA phase.
+  static int __attribute__((const)) getBinnedPos(int pos, int factor) {
+    return 2 * (pos / (2 * factor)) + pos % 2;
+  }
+
+  static iRectangle2D __attribute__((pure))
+  getBinnedRect(const iRectangle2D& rect, int factor);
+
+private:
+  RawImageData* const mRaw;
+  const int factor;
+  const int bandHeight;
+
+  // The full-resolution columns [offX, offX + width) of the image.
+  const int offX;
+  const int width;
+
+  std::vector<ushort16> band;
+
+  void binBand(int bandIndex);
+
+public:
+  // For an image that was created binned, see RawImageData::binning.
+  // offX must be a multiple of 2 * factor.
+  CfaBinner(const RawImage& img, int offX_, int width_);
+  explicit CfaBinner(const RawImage& img)
+      : CfaBinner(img, 0, img->getUnbinnedDim().x) {}
+
+  int getBandHeight() const { return bandHeight; }
+
+  // Where to store the full-resolution row (of the whole image).
+  ushort16* getRow(int row) {
+    return &band[static_cast<size_t>(row % bandHeight) * width];
+  }
+
+  // All of the row was stored.
+  void rowDone(int row) {
+    if (row % bandHeight == bandHeight - 1)
+      binBand(row / bandHeight);
+  }
+};
+
+} // namespace rawspeed
@@ -21,7 +21,7 @@
 #include "common/Cpuid.h"
 
 #if defined(__i386__) || defined(__x86_64__)
-#include <cpuid.h> // for __get_cpuid, bit_SSE2
+#include <cpuid.h> // for __get_cpuid, bit_SSE2, bit_SSSE3..., __cpuid_count
 #endif
 
 namespace rawspeed {
@@ -40,10 +40,77 @@ bool Cpuid::SSE2() {
   return edx & bit_SSE2;
 }
 
+bool Cpuid::SSSE3() {
+  unsigned int eax;
+  unsigned int ebx;
+  unsigned int ecx;
+  unsigned int edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+
+  return ecx & bit_SSSE3;
+}
+
+bool Cpuid::AVX2() {
+  unsigned int eax;
+  unsigned int ebx;
+  unsigned int ecx;
+  unsigned int edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+
+  // The OS must be saving the AVX state, see XGETBV.
+  if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+    return false;
+
+  unsigned int xcr0;
+  __asm__("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+  if ((xcr0 & 0x6) != 0x6) // XMM and YMM state
+    return false;
+
+  if (__get_cpuid_max(0, nullptr) < 7)
+    return false;
+
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return ebx & bit_AVX2;
+}
+
+bool Cpuid::AVX512F() {
+  unsigned int eax;
+  unsigned int ebx;
+  unsigned int ecx;
+  unsigned int edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+
+  if (!(ecx & bit_OSXSAVE))
+    return false;
+
+  unsigned int xcr0;
+  __asm__("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+  if ((xcr0 & 0xe6) != 0xe6) // XMM, YMM, opmask and both halves of ZMM state
+    return false;
+
+  if (__get_cpuid_max(0, nullptr) < 7)
+    return false;
+
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return ebx & bit_AVX512F;
+}
+
 #else
 
 bool Cpuid::SSE2() { return false; }
 
+bool Cpuid::SSSE3() { return false; }
+
+bool Cpuid::AVX2() { return false; }
+
+bool Cpuid::AVX512F() { return false; }
+
 #endif
 
 } // namespace rawspeed
@@ -25,6 +25,13 @@ namespace rawspeed {
 class Cpuid final {
 public:
   static bool __attribute__((const)) SSE2();
+  static bool __attribute__((const)) SSSE3();
+
+  // Both the CPU and the OS (i.e. it saves the YMM registers) support it.
+  static bool __attribute__((const)) AVX2();
+
+  // Both the CPU and the OS (i.e. it saves the ZMM and mask registers).
+  static bool __attribute__((const)) AVX512F();
 };
 
 } // namespace rawspeed
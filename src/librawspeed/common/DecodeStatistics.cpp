@@ -0,0 +1,87 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "common/DecodeStatistics.h"
+
+namespace rawspeed {
+
+const char* getDecodeStageName(DecodeStage stage) {
+  switch (stage) {
+  case DecodeStage::Parse:
+    return "Parse";
+  case DecodeStage::Decompress:
+    return "Decompress";
+  case DecodeStage::DngOpcodes:
+    return "DngOpcodes";
+  case DecodeStage::SixteenBitLookup:
+    return "SixteenBitLookup";
+  case DecodeStage::Crop:
+    return "Crop";
+  case DecodeStage::FujiRotate:
+    return "FujiRotate";
+  case DecodeStage::FixBadPixels:
+    return "FixBadPixels";
+  case DecodeStage::ScaleBlackWhite:
+    return "ScaleBlackWhite";
+  case DecodeStage::CalculateBlackAreas:
+    return "CalculateBlackAreas";
+  }
+  __builtin_unreachable();
+}
+
+double DecodeStatistics::getWallSeconds() const {
+  double total = 0;
+  for (const auto& stage : stages)
+    total += stage.wallSeconds;
+  return total;
+}
+
+#ifdef WITH_STAGE_TIMING
+
+StageTimer::StageTimer(DecodeStatistics* statistics_, DecodeStage stage_,
+                       uint64 bytes_)
+    : statistics(statistics_), stage(stage_), bytes(bytes_),
+      parent(statistics_->current),
+      wallStart(std::chrono::steady_clock::now()), cpuStart(std::clock()) {
+  statistics->current = this;
+}
+
+StageTimer::~StageTimer() {
+  const std::chrono::duration<double> wall =
+      std::chrono::steady_clock::now() - wallStart;
+  const double cpu = static_cast<double>(std::clock() - cpuStart) /
+                     static_cast<double>(CLOCKS_PER_SEC);
+
+  StageStatistics& s = statistics->stages[static_cast<int>(stage)];
+  s.calls++;
+  s.wallSeconds += wall.count() - nestedWallSeconds;
+  s.cpuSeconds += cpu - nestedCpuSeconds;
+  s.bytes += bytes;
+
+  if (parent) {
+    parent->nestedWallSeconds += wall.count();
+    parent->nestedCpuSeconds += cpu;
+  }
+  statistics->current = parent;
+}
+
+#endif
+
+} // namespace rawspeed
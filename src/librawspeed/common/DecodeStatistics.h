@@ -0,0 +1,128 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#pragma once
+
+#include "rawspeedconfig.h" // for WITH_STAGE_TIMING
+#include "common/Common.h"  // for uint64
+#include <array>            // for array
+#include <chrono>           // for steady_clock
+#include <ctime>            // for clock_t
+
+namespace rawspeed {
+
+// The distinct parts of a decode, that are worth timing on their own.
+enum class DecodeStage {
+  Parse,               // TIFF/CIFF/FIFF/... structure, finding the decoder
+  Decompress,          // decodeRawInternal(), minus the stages below
+  DngOpcodes,          // DngOpcodes::applyOpCodes()
+  SixteenBitLookup,    // RawImageData::sixteenBitLookup()
+  Crop,                // RawImageData::subFrame()
+  FujiRotate,          // RafDecoder's rotation of the image by 45 degrees
+  FixBadPixels,        // RawImageData::fixBadPixels()
+  ScaleBlackWhite,     // RawImageData::scaleBlackWhite()
+  CalculateBlackAreas, // RawImageData::calculateBlackAreas()
+};
+
+static constexpr int numDecodeStages =
+    static_cast<int>(DecodeStage::CalculateBlackAreas) + 1;
+
+const char* getDecodeStageName(DecodeStage stage);
+
+struct StageStatistics final {
+  int calls = 0;
+
+  // Excluding the time spent in the nested stages.
+  double wallSeconds = 0;
+
+  // CPU time of the whole process (i.e. of all the threads) during the stage.
+  // Only meaningful if nothing else was running in the process at that time.
+  double cpuSeconds = 0;
+
+  // How many bytes were consumed (for Parse and Decompress, of the input)
+  // or processed (of the image), whatever makes sense for the stage.
+  uint64 bytes = 0;
+};
+
+class StageTimer;
+
+// Per-stage timings and counters of one decode. When built without
+// WITH_STAGE_TIMING, nothing is recorded and everything is always zero.
+// NOTE: only the thread driving the decode may record into it, the stages
+// themselves are free to run their work in parallel though.
+class DecodeStatistics final {
+  friend class StageTimer;
+
+  std::array<StageStatistics, numDecodeStages> stages;
+
+  // The innermost stage that is currently being timed, if any.
+  StageTimer* current = nullptr;
+
+public:
+  const StageStatistics& get(DecodeStage stage) const {
+    return stages[static_cast<int>(stage)];
+  }
+
+  // Total wall time of all the stages.
+  double getWallSeconds() const;
+
+  void reset() { *this = DecodeStatistics(); }
+};
+
+#ifdef WITH_STAGE_TIMING
+
+// Times one stage, from construction until destruction. Stages may nest,
+// the time spent in the inner one is then not counted for the outer one.
+class StageTimer final {
+  DecodeStatistics* const statistics;
+  const DecodeStage stage;
+  uint64 bytes;
+
+  StageTimer* const parent;
+  const std::chrono::steady_clock::time_point wallStart;
+  const std::clock_t cpuStart;
+  double nestedWallSeconds = 0;
+  double nestedCpuSeconds = 0;
+
+public:
+  StageTimer(DecodeStatistics* statistics_, DecodeStage stage_,
+             uint64 bytes_ = 0);
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+  ~StageTimer();
+
+  void addBytes(uint64 bytes_) { bytes += bytes_; }
+};
+
+#else
+
+class StageTimer final {
+public:
+  StageTimer(DecodeStatistics* /*statistics*/, DecodeStage /*stage*/,
+             uint64 /*bytes*/ = 0) {}
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+
+  void addBytes(uint64 /*bytes*/) {}
+};
+
+#endif
+
+} // namespace rawspeed
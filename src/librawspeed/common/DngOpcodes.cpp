@@ -22,6 +22,7 @@
 
 #include "common/DngOpcodes.h"
 #include "common/Common.h"                // for uint32, ushort16, clampBits
+#include "common/DecodeStatistics.h"      // for StageTimer, DecodeStage
 #include "common/Mutex.h"                 // for MutexLocker
 #include "common/Point.h"                 // for iRectangle2D, iPoint2D
 #include "common/RawImage.h"              // for RawImage, RawImageData
@@ -535,6 +536,12 @@ DngOpcodes::DngOpcodes(const RawImage& ri, TiffEntry* entry) {
 DngOpcodes::~DngOpcodes() = default;
 
 void DngOpcodes::applyOpCodes(const RawImage& ri) {
+  StageTimer timer(ri->statistics.get(), DecodeStage::DngOpcodes,
+                   static_cast<uint64>(ri->pitch) * ri->getUncroppedDim().y);
+
+  if (!opcodes.empty())
+    ri->pixelStatistics.invalidate();
+
   for (const auto& code : opcodes) {
     code->setup(ri);
     code->apply(ri);
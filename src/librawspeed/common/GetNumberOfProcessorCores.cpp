@@ -23,6 +23,9 @@
 
 #ifdef HAVE_OPENMP
 #include <omp.h>
+#else
+#include <algorithm> // for max
+#include <thread>    // for thread
 #endif
 
 // define this function, it is only declared in rawspeed:
@@ -32,8 +35,9 @@ rawspeed_get_number_of_processor_cores() {
   return omp_get_max_threads();
 }
 #else
-extern "C" int __attribute__((const, visibility("default")))
+extern "C" int __attribute__((visibility("default")))
 rawspeed_get_number_of_processor_cores() {
-  return 1;
+  // NOTE: may return 0 if the value is not computable.
+  return std::max(1U, std::thread::hardware_concurrency());
 }
 #endif
@@ -0,0 +1,56 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#pragma once
+
+#include "common/Common.h" // for uchar8, uint32
+#include "common/Point.h"  // for iPoint2D
+#include <functional>      // for function
+
+namespace rawspeed {
+
+// Memory for the pixels of an image, that is owned by the application,
+// e.g. a staging buffer for the GPU, or shared memory. The decoders then
+// write the image straight into it.
+struct ImageBuffer final {
+  // Every row must start at an address that is a multiple of this.
+  static constexpr uint32 alignment = 16;
+
+  // Where the first row starts. nullptr means no buffer.
+  uchar8* data = nullptr;
+
+  // Bytes between the starts of two consecutive rows. A multiple of
+  // alignment, and at least width * bytes per pixel.
+  uint32 pitch = 0;
+
+  // Called once the image does not use the buffer anymore, e.g. so that
+  // it can be handed out for the next image of the same shape.
+  // Must not throw.
+  std::function<void()> release;
+};
+
+// Asked for the buffer of an image of dim.x * dim.y pixels of bpp bytes each,
+// i.e. for at least pitch * dim.y bytes. It may return an empty ImageBuffer,
+// and then the memory is allocated by the image itself, as usual.
+using ImageBufferProvider =
+    std::function<ImageBuffer(const iPoint2D& dim, uint32 bpp)>;
+
+} // namespace rawspeed
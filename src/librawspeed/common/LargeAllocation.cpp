@@ -0,0 +1,192 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "rawspeedconfig.h"
+
+#include "common/LargeAllocation.h"
+#include "common/Common.h"            // for roundUp, roundUpDivision, uchar8
+#include "common/Memory.h"            // for alignedMalloc, alignedFree
+#include "common/RawspeedException.h" // for ThrowRSE
+#include "common/TaskScheduler.h"     // for Parallelism, parallelFor, para...
+#include <algorithm>                  // for min
+#include <cassert>                    // for assert
+#include <cstddef>                    // for size_t
+#include <cstdint>                    // for SIZE_MAX
+#include <string>                     // for string
+
+#if defined(HAVE_MMAP)
+#include <sys/mman.h> // for mmap, munmap, madvise, MAP_FAILED
+#include <unistd.h>   // for sysconf, _SC_PAGESIZE
+#endif
+
+namespace rawspeed {
+
+const char* getLargeAllocationPolicyName(LargeAllocationPolicy policy) {
+  switch (policy) {
+  case LargeAllocationPolicy::Default:
+    return "default";
+  case LargeAllocationPolicy::TransparentHugePages:
+    return "thp";
+  case LargeAllocationPolicy::HugeTLB:
+    return "hugetlb";
+  }
+  __builtin_unreachable();
+}
+
+LargeAllocationPolicy parseLargeAllocationPolicy(const std::string& name) {
+  for (auto policy : {LargeAllocationPolicy::Default,
+                      LargeAllocationPolicy::TransparentHugePages,
+                      LargeAllocationPolicy::HugeTLB}) {
+    if (name == getLargeAllocationPolicyName(policy))
+      return policy;
+  }
+
+  ThrowRSE("Unknown allocation policy \"%s\".", name.c_str());
+}
+
+namespace {
+
+// The huge page size on all the platforms where they are likely to be used.
+constexpr size_t hugePageSize = 2UL << 20UL;
+
+size_t getPageSize() {
+#if defined(HAVE_MMAP)
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+  return pageSize;
+#else
+  // Touching more often than necessary is harmless.
+  return 4096;
+#endif
+}
+
+#if defined(HAVE_MMAP)
+void* mapAnonymous(size_t size, int flags) {
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return ptr != MAP_FAILED ? ptr : nullptr;
+}
+#endif
+
+} // namespace
+
+LargeAllocation largeMallocArray(size_t nmemb, size_t size,
+                                 LargeAllocationPolicy policy) {
+  LargeAllocation a;
+
+  // Check for size_t overflow
+  if (size && nmemb > SIZE_MAX / size)
+    return a;
+  size *= nmemb;
+
+#ifdef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
+  // Same as in alignedMalloc(), let's not bypass its limits.
+  policy = LargeAllocationPolicy::Default;
+#endif
+
+#if defined(HAVE_MMAP) && defined(HAVE_MAP_HUGETLB)
+  if (policy == LargeAllocationPolicy::HugeTLB && size <= SIZE_MAX / 2) {
+    a.size = roundUp(size, hugePageSize);
+    a.ptr = mapAnonymous(a.size, MAP_HUGETLB);
+    if (a.ptr) {
+      a.policy = LargeAllocationPolicy::HugeTLB;
+      return a;
+    }
+  }
+#endif
+
+#if defined(HAVE_MMAP) && defined(HAVE_MADV_HUGEPAGE)
+  if (policy != LargeAllocationPolicy::Default && size <= SIZE_MAX / 2) {
+    // Only the whole huge pages within the mapping can be backed by them,
+    // so let's have as many of those as possible.
+    a.size = roundUp(size, hugePageSize);
+    a.ptr = mapAnonymous(a.size, 0);
+    if (a.ptr) {
+      // Even if the kernel says no, this is still a perfectly usable mapping.
+      (void)madvise(a.ptr, a.size, MADV_HUGEPAGE);
+      a.policy = LargeAllocationPolicy::TransparentHugePages;
+      return a;
+    }
+  }
+#endif
+
+  a.size = roundUp(size, 16);
+  a.ptr = alignedMalloc<uchar8, 16>(a.size);
+  a.policy = LargeAllocationPolicy::Default;
+  return a;
+}
+
+void largeFree(const LargeAllocation& allocation) {
+  if (!allocation.ptr)
+    return;
+
+  if (allocation.policy == LargeAllocationPolicy::Default) {
+    alignedFree(allocation.ptr);
+    return;
+  }
+
+#if defined(HAVE_MMAP)
+  munmap(allocation.ptr, allocation.size);
+#else
+  __builtin_unreachable();
+#endif
+}
+
+void prefault(const LargeAllocation& allocation,
+              const Parallelism& parallelism) {
+#if defined(HAVE_MMAP)
+  if (!allocation.ptr || !allocation.isZeroed())
+    return;
+
+  // One chunk per huge page, so that no two threads fault in the same one.
+  auto* const data = static_cast<volatile char*>(allocation.ptr);
+  const size_t size = allocation.size;
+  const size_t pageSize = getPageSize();
+  const int chunks = roundUpDivision(size, hugePageSize);
+  parallelFor(parallelism, 0, chunks, [data, size, pageSize](int chunk) {
+    const size_t begin = chunk * hugePageSize;
+    const size_t end = std::min(begin + hugePageSize, size);
+    for (size_t offset = begin; offset < end; offset += pageSize)
+      data[offset] = 0;
+  });
+#endif
+}
+
+void prefaultRows(const LargeAllocation& allocation, int rows, size_t pitch,
+                  const Parallelism& parallelism) {
+  if (!allocation.ptr || rows <= 0)
+    return;
+
+  assert(static_cast<size_t>(rows) * pitch <= allocation.size);
+
+  auto* const data = static_cast<volatile char*>(allocation.ptr);
+  const size_t pageSize = getPageSize();
+  parallelForChunks(parallelism, 0, rows,
+                    [data, pitch, pageSize](int rowBegin, int rowEnd) {
+                      const size_t begin = rowBegin * pitch;
+                      const size_t end = rowEnd * pitch;
+                      // The first page may be shared with the previous chunk.
+                      data[begin] = 0;
+                      for (size_t offset = roundUp(begin + 1, pageSize);
+                           offset < end; offset += pageSize)
+                        data[offset] = 0;
+                    });
+}
+
+} // namespace rawspeed
@@ -0,0 +1,90 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#pragma once
+
+#include <cstddef> // for size_t
+#include <string>  // for string
+
+namespace rawspeed {
+
+struct Parallelism;
+
+// How the large, long-lived buffers (the pixels of an image, its bad pixel
+// map) are allocated. Backing them by huge (usually 2 MiB) pages avoids most
+// of the TLB misses of the column-wise passes over them, and makes faulting
+// them in much cheaper.
+enum class LargeAllocationPolicy {
+  // alignedMalloc(), i.e. whatever the C library does.
+  Default,
+  // Transparent huge pages, mmap() + madvise(MADV_HUGEPAGE). The kernel may
+  // still back (parts of) it by normal pages.
+  TransparentHugePages,
+  // mmap(MAP_HUGETLB), i.e. from the pool of huge pages that was reserved
+  // beforehand (vm.nr_hugepages). Fails if there are not enough of them.
+  HugeTLB,
+};
+
+const char* getLargeAllocationPolicyName(LargeAllocationPolicy policy);
+
+// The inverse of getLargeAllocationPolicyName().
+LargeAllocationPolicy parseLargeAllocationPolicy(const std::string& name);
+
+struct LargeAllocation final {
+  // At least 16-byte aligned. nullptr if the allocation failed.
+  void* ptr = nullptr;
+
+  // What was actually allocated, may be rounded up to the page size.
+  size_t size = 0;
+
+  // What was actually used, see largeMallocArray().
+  LargeAllocationPolicy policy = LargeAllocationPolicy::Default;
+
+  // The mmap()-backed allocations are zero-initialized, the others are not.
+  bool isZeroed() const { return policy != LargeAllocationPolicy::Default; }
+};
+
+// If the requested policy is not available (not supported by the platform,
+// or the kernel refuses), falls back to the previous one, down to Default.
+LargeAllocation largeMallocArray(size_t nmemb, size_t size,
+                                 LargeAllocationPolicy policy);
+
+void largeFree(const LargeAllocation& allocation);
+
+// Writes (zero) to each page of a zero-initialized allocation, in parallel,
+// so that the page faults happen now, on all the threads, and not later, on
+// whichever (maybe single) thread touches the memory first. Does nothing to
+// the other allocations, their contents would not be preserved.
+void prefault(const LargeAllocation& allocation,
+              const Parallelism& parallelism);
+
+// Like prefault(), but the rows of the image that is going to be stored in the
+// allocation are split among the threads exactly like parallelForChunks() over
+// [0, rows) splits them. With an executor that is pinned to some NUMA node(s),
+// that puts the pages on the nodes of the executor's threads. They only match
+// the nodes of the writers for the passes that split the rows the same way
+// (e.g. the parallelForChunks() post-processing). The decompressors mostly
+// don't: some are single-threaded, others go per slice/tile, or schedule the
+// rows dynamically. Works for all the policies, but only before anything was
+// stored into the allocation.
+void prefaultRows(const LargeAllocation& allocation, int rows, size_t pitch,
+                  const Parallelism& parallelism);
+
+} // namespace rawspeed
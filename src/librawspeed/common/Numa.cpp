@@ -0,0 +1,191 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "common/Numa.h"
+#include "common/RawspeedException.h" // for ThrowRSE
+#include <algorithm>                  // for max, sort, unique
+#include <cerrno>                     // for errno
+#include <cstdint>                    // for uintptr_t
+#include <cstdlib>                    // for strtol
+#include <fstream>                    // for ifstream
+#include <string>                     // for string, getline, to_string
+#include <thread>                     // for thread
+#include <vector>                     // for vector
+
+#if defined(__linux__)
+#include <sched.h>       // for cpu_set_t, CPU_SET, CPU_ZERO, sched_setaff...
+#include <sys/syscall.h> // for SYS_move_pages
+#include <unistd.h>      // for syscall, sysconf, _SC_PAGESIZE
+#endif
+
+namespace rawspeed {
+
+std::vector<int> parseIndexList(const std::string& list) {
+  std::vector<int> indexes;
+
+  const char* str = list.c_str();
+  auto parseIndex = [&str, &list]() {
+    char* end;
+    errno = 0;
+    const long index = strtol(str, &end, 10);
+    if (end == str || errno || index < 0 || index > (1 << 16))
+      ThrowRSE("Malformed index list \"%s\".", list.c_str());
+    str = end;
+    return static_cast<int>(index);
+  };
+
+  while (*str && *str != '\n') {
+    const int first = parseIndex();
+    int last = first;
+    if (*str == '-') {
+      ++str;
+      last = parseIndex();
+      if (last < first)
+        ThrowRSE("Malformed index list \"%s\".", list.c_str());
+    }
+
+    for (int i = first; i <= last; ++i)
+      indexes.emplace_back(i);
+
+    if (*str == ',')
+      ++str;
+    else if (*str && *str != '\n')
+      ThrowRSE("Malformed index list \"%s\".", list.c_str());
+  }
+
+  std::sort(indexes.begin(), indexes.end());
+  indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+  return indexes;
+}
+
+namespace {
+
+// Empty if the file does not exist or is malformed.
+std::vector<int> readIndexList(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  if (!file || !std::getline(file, line))
+    return {};
+
+  try {
+    return parseIndexList(line);
+  } catch (RawspeedException&) {
+    return {};
+  }
+}
+
+std::vector<int> getAllCpus() {
+  std::vector<int> cpus(std::max(1U, std::thread::hardware_concurrency()));
+  for (int i = 0; i < static_cast<int>(cpus.size()); ++i)
+    cpus[i] = i;
+  return cpus;
+}
+
+} // namespace
+
+int getNumaNodeCount() {
+  static const int count = []() {
+    const std::vector<int> nodes =
+        readIndexList("/sys/devices/system/node/online");
+    return nodes.empty() ? 1 : nodes.back() + 1;
+  }();
+  return count;
+}
+
+std::vector<int> getNumaNodeCpus(int node) {
+  if (node < 0 || node >= getNumaNodeCount())
+    ThrowRSE("There is no NUMA node %i.", node);
+
+  std::vector<int> cpus = readIndexList("/sys/devices/system/node/node" +
+                                        std::to_string(node) + "/cpulist");
+  if (cpus.empty() && getNumaNodeCount() == 1)
+    cpus = getAllCpus();
+  return cpus;
+}
+
+std::vector<int> getNumaNodeCpus(const std::vector<int>& nodes) {
+  std::vector<int> cpus;
+  for (int node : nodes) {
+    const std::vector<int> nodeCpus = getNumaNodeCpus(node);
+    cpus.insert(cpus.end(), nodeCpus.begin(), nodeCpus.end());
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  }
+  if (!CPU_COUNT(&set))
+    return false;
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+std::vector<uint64> getNumaNodePageCounts(const void* ptr, size_t size) {
+#if defined(__linux__) && defined(SYS_move_pages)
+  const auto pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(ptr) & ~(pageSize - 1);
+  const uintptr_t end = reinterpret_cast<uintptr_t>(ptr) + size;
+
+  std::vector<uint64> counts(getNumaNodeCount());
+
+  // Without the target nodes, move_pages() just reports where they are.
+  static constexpr size_t batchSize = 1024;
+  std::vector<void*> pages;
+  std::vector<int> status;
+  pages.reserve(batchSize);
+  status.reserve(batchSize);
+
+  for (uintptr_t page = begin; page < end;) {
+    pages.clear();
+    for (; page < end && pages.size() < batchSize; page += pageSize)
+      pages.emplace_back(reinterpret_cast<void*>(page));
+    status.assign(pages.size(), -1);
+
+    if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr,
+                status.data(), 0) != 0)
+      return {};
+
+    for (int node : status) {
+      // Negative is an error code, e.g. -ENOENT for the untouched pages.
+      if (node >= 0 && node < static_cast<int>(counts.size()))
+        counts[node]++;
+    }
+  }
+
+  return counts;
+#else
+  (void)ptr;
+  (void)size;
+  return {};
+#endif
+}
+
+} // namespace rawspeed
@@ -0,0 +1,52 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#pragma once
+
+#include "common/Common.h" // for uint64
+#include <cstddef>         // for size_t
+#include <string>          // for string
+#include <vector>          // for vector
+
+namespace rawspeed {
+
+// The NUMA topology, as far as it matters for placing the threads of a decode
+// and the memory of its image on the same node(s). Where it is not known
+// (other platforms, no sysfs), there is exactly one node with all the CPUs.
+
+// Parses a list of indexes in the sysfs/taskset format, i.e. "0-3,8,10-11".
+std::vector<int> parseIndexList(const std::string& list);
+
+int getNumaNodeCount();
+
+// The CPUs of the given node(s), in ascending order.
+std::vector<int> getNumaNodeCpus(int node);
+std::vector<int> getNumaNodeCpus(const std::vector<int>& nodes);
+
+// Pins the calling thread to the given CPUs. Returns false if that did not
+// work (or is not supported), the thread then just floats.
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+// How many of the pages of [ptr, ptr + size) are currently on each node,
+// indexed by the node. The pages that were not faulted in yet are not counted.
+// Empty if that can not be queried.
+std::vector<uint64> getNumaNodePageCounts(const void* ptr, size_t size);
+
+} // namespace rawspeed
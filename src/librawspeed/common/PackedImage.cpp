@@ -0,0 +1,258 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "rawspeedconfig.h"
+#include "common/PackedImage.h"
+#include "common/Cpuid.h"             // for Cpuid
+#include "common/RawspeedException.h" // for ThrowRSE
+#include "common/TaskScheduler.h"     // for parallelFor
+#include <cassert>                    // for assert
+
+#ifdef WITH_SSSE3
+#include <immintrin.h> // for __m128i, _mm_shuffle_epi8, _mm_madd_epi16
+#endif
+
+namespace rawspeed {
+
+namespace {
+
+template <int bits> constexpr uint64 sampleMask() { return (1U << bits) - 1U; }
+
+// 8 samples take exactly `bits` bytes, so the rows are processed in such
+// groups, and whatever does not fit the SIMD code is handled by these.
+
+template <int bits>
+void packSamples(const ushort16* src, int n, uchar8* dst) {
+  uint64 cache = 0;
+  int fill = 0;
+  for (int i = 0; i < n; i++) {
+    cache |= (src[i] & sampleMask<bits>()) << fill;
+    fill += bits;
+    for (; fill >= 8; fill -= 8) {
+      *dst++ = static_cast<uchar8>(cache);
+      cache >>= 8;
+    }
+  }
+  if (fill > 0)
+    *dst = static_cast<uchar8>(cache);
+}
+
+template <int bits>
+void unpackSamples(const uchar8* src, int n, ushort16* dst) {
+  uint64 cache = 0;
+  int fill = 0;
+  for (int i = 0; i < n; i++) {
+    for (; fill < bits; fill += 8)
+      cache |= static_cast<uint64>(*src++) << fill;
+    dst[i] = static_cast<ushort16>(cache & sampleMask<bits>());
+    cache >>= bits;
+    fill -= bits;
+  }
+}
+
+template <int bits>
+void packRow(const ushort16* src, int n, uchar8* dst, size_t /*dstSize*/) {
+  packSamples<bits>(src, n, dst);
+}
+
+template <int bits>
+void unpackRow(const uchar8* src, size_t /*srcSize*/, int n, ushort16* dst) {
+  unpackSamples<bits>(src, n, dst);
+}
+
+#ifdef WITH_SSSE3
+
+// The 8 samples are (un)packed in three steps, from/to 16-bit lanes to 32-bit
+// lanes with 2 samples each, to 64-bit lanes with 4 samples each (48 or 56
+// bits, i.e. 6 or 7 bytes), and those bytes are then (un)shuffled into place.
+template <int bits> struct PackedGroup final {
+  static constexpr int halfBytes = bits / 2; // bytes per 4 samples
+
+  static constexpr char byte(int lane, int i) {
+    return i < halfBytes ? static_cast<char>(lane * halfBytes + i) : -128;
+  }
+
+  static constexpr char packedByte(int i) {
+    return i < halfBytes ? static_cast<char>(i)
+                         : i < 2 * halfBytes
+                               ? static_cast<char>(8 + i - halfBytes)
+                               : -128;
+  }
+};
+
+#define RAWSPEED_GROUP_LANE(LANE)                                              \
+  G::byte(LANE, 0), G::byte(LANE, 1), G::byte(LANE, 2), G::byte(LANE, 3),      \
+      G::byte(LANE, 4), G::byte(LANE, 5), G::byte(LANE, 6), G::byte(LANE, 7)
+#define RAWSPEED_GROUP_PACKED                                                  \
+  G::packedByte(0), G::packedByte(1), G::packedByte(2), G::packedByte(3),      \
+      G::packedByte(4), G::packedByte(5), G::packedByte(6), G::packedByte(7),  \
+      G::packedByte(8), G::packedByte(9), G::packedByte(10),                   \
+      G::packedByte(11), G::packedByte(12), G::packedByte(13),                 \
+      G::packedByte(14), G::packedByte(15)
+
+template <int bits>
+__attribute__((target("ssse3"))) void
+packRow_SSSE3(const ushort16* src, int n, uchar8* dst, size_t dstSize) {
+  using G = PackedGroup<bits>;
+
+  const __m128i mask16 = _mm_set1_epi16(sampleMask<bits>());
+  // s0 * 1 + s1 * 2^bits, for each pair of the 16-bit lanes.
+  const __m128i pairMul = _mm_set1_epi32((1U << (16 + bits)) | 1U);
+  const __m128i low32 = _mm_set1_epi64x(0xFFFFFFFFULL);
+  const __m128i compact = _mm_setr_epi8(RAWSPEED_GROUP_PACKED);
+
+  int i = 0;
+  size_t offset = 0;
+  for (; i + 8 <= n && offset + 16 <= dstSize; i += 8, offset += bits) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    v = _mm_and_si128(v, mask16);
+
+    // 2 samples in each 32-bit lane.
+    v = _mm_madd_epi16(v, pairMul);
+    // 4 samples in each 64-bit lane.
+    v = _mm_or_si128(_mm_and_si128(v, low32),
+                     _mm_srli_epi64(_mm_andnot_si128(low32, v), 32 - 2 * bits));
+    v = _mm_shuffle_epi8(v, compact);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + offset), v);
+  }
+
+  packSamples<bits>(src + i, n - i, dst + offset);
+}
+
+template <int bits>
+__attribute__((target("ssse3"))) void
+unpackRow_SSSE3(const uchar8* src, size_t srcSize, int n, ushort16* dst) {
+  using G = PackedGroup<bits>;
+
+  const __m128i expand =
+      _mm_setr_epi8(RAWSPEED_GROUP_LANE(0), RAWSPEED_GROUP_LANE(1));
+  const __m128i mask64 = _mm_set1_epi64x((1ULL << (2 * bits)) - 1ULL);
+  const __m128i mask32 = _mm_set1_epi32(sampleMask<bits>());
+
+  int i = 0;
+  size_t offset = 0;
+  for (; i + 8 <= n && offset + 16 <= srcSize; i += 8, offset += bits) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + offset));
+
+    // 4 samples in each 64-bit lane.
+    v = _mm_shuffle_epi8(v, expand);
+    // 2 samples in each 32-bit lane.
+    v = _mm_or_si128(_mm_and_si128(v, mask64),
+                     _mm_slli_epi64(_mm_srli_epi64(v, 2 * bits), 32));
+    // 1 sample in each 16-bit lane.
+    v = _mm_or_si128(_mm_and_si128(v, mask32),
+                     _mm_slli_epi32(_mm_srli_epi32(v, bits), 16));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+  }
+
+  unpackSamples<bits>(src + offset, n - i, dst + i);
+}
+
+#undef RAWSPEED_GROUP_PACKED
+#undef RAWSPEED_GROUP_LANE
+
+#endif
+
+template <int bits> PackedImage::RowPacker getRowPackerImpl() {
+#ifdef WITH_SSSE3
+  if (Cpuid::SSSE3())
+    return &packRow_SSSE3<bits>;
+#endif
+  return &packRow<bits>;
+}
+
+template <int bits> PackedImage::RowUnpacker getRowUnpackerImpl() {
+#ifdef WITH_SSSE3
+  if (Cpuid::SSSE3())
+    return &unpackRow_SSSE3<bits>;
+#endif
+  return &unpackRow<bits>;
+}
+
+} // namespace
+
+PackedImage::RowPacker PackedImage::getRowPacker(int bitsPerSample) {
+  switch (bitsPerSample) {
+  case 12:
+    return getRowPackerImpl<12>();
+  case 14:
+    return getRowPackerImpl<14>();
+  default:
+    ThrowRSE("Unsupported bits per sample: %i", bitsPerSample);
+  }
+}
+
+PackedImage::RowUnpacker PackedImage::getRowUnpacker(int bitsPerSample) {
+  switch (bitsPerSample) {
+  case 12:
+    return getRowUnpackerImpl<12>();
+  case 14:
+    return getRowUnpackerImpl<14>();
+  default:
+    ThrowRSE("Unsupported bits per sample: %i", bitsPerSample);
+  }
+}
+
+PackedImage::PackedImage(const iPoint2D& dim_, int cpp_, int bitsPerSample_)
+    : dim(dim_), cpp(cpp_), bitsPerSample(bitsPerSample_),
+      packer(getRowPacker(bitsPerSample_)),
+      unpacker(getRowUnpacker(bitsPerSample_)) {
+  if (!dim.hasPositiveArea() || cpp < 1 || cpp > 4)
+    ThrowRSE("Bad image: %i x %i, %i components", dim.x, dim.y, cpp);
+
+  const auto samples = static_cast<size_t>(dim.x) * cpp;
+  pitch = roundUp(roundUpDivision(samples * bitsPerSample, 8), 16);
+  storage.resize(pitch * dim.y);
+}
+
+void PackedImage::packRow(int y, const ushort16* src) {
+  assert(y >= 0 && y < dim.y);
+  packer(src, dim.x * cpp, &storage[y * pitch], pitch);
+}
+
+void PackedImage::unpackRow(int y, ushort16* dst) const {
+  assert(y >= 0 && y < dim.y);
+  unpacker(getRow(y), pitch, dim.x * cpp, dst);
+}
+
+PackedImage PackedImage::pack(const RawImage& image, int bitsPerSample,
+                              const Parallelism& parallelism) {
+  if (image->getDataType() != TYPE_USHORT16)
+    ThrowRSE("Only 16-bit integer images can be packed");
+
+  PackedImage packed(image->dim, image->getCpp(), bitsPerSample);
+  parallelFor(parallelism, 0, packed.dim.y, [&packed, &image](int y) {
+    packed.packRow(
+        y, reinterpret_cast<const ushort16*>(image->getData(0, y)));
+  });
+  return packed;
+}
+
+RawImage PackedImage::unpack(const Parallelism& parallelism) const {
+  RawImage image = RawImage::create(dim, TYPE_USHORT16, cpp);
+  parallelFor(parallelism, 0, dim.y, [this, &image](int y) {
+    unpackRow(y, reinterpret_cast<ushort16*>(image->getData(0, y)));
+  });
+  return image;
+}
+
+} // namespace rawspeed
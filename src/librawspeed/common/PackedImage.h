@@ -0,0 +1,98 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#pragma once
+
+#include "common/Common.h"                      // for uchar8, ushort16
+#include "common/DefaultInitAllocatorAdaptor.h" // for DefaultInitAllocat...
+#include "common/Point.h"                       // for iPoint2D
+#include "common/RawImage.h"                    // for RawImage
+#include <cstddef>                              // for size_t
+#include <vector>                               // for vector
+
+namespace rawspeed {
+
+struct Parallelism;
+
+// A compact in-memory copy of the pixels of a 16-bit image whose samples only
+// use the low 12 (or 14) bits, e.g. for keeping many decoded frames around.
+// The samples of each row are bit-packed, LSB first, i.e. in the order of
+// BitPumpLSB: 8 samples take 12 (or 14) bytes instead of 16.
+// Only the pixels are kept, the rest of the image (CFA, black and white
+// levels, ...) is the business of whoever keeps the frames.
+class PackedImage final {
+public:
+  // How one row of n samples is converted from/to the packed representation.
+  // The SIMD ones may access up to 16 bytes past the end of each 8 samples,
+  // so they are only used while that is within the (padded) row.
+  using RowPacker = void (*)(const ushort16* src, int n, uchar8* dst,
+                             size_t dstSize);
+  using RowUnpacker = void (*)(const uchar8* src, size_t srcSize, int n,
+                               ushort16* dst);
+
+  static bool __attribute__((const)) isSupported(int bitsPerSample) {
+    return bitsPerSample == 12 || bitsPerSample == 14;
+  }
+
+private:
+  iPoint2D dim;
+  int cpp = 1;
+  int bitsPerSample = 0;
+  size_t pitch = 0; // bytes, multiple of 16
+
+  RowPacker packer = nullptr;
+  RowUnpacker unpacker = nullptr;
+
+  std::vector<uchar8, DefaultInitAllocatorAdaptor<uchar8>> storage;
+
+public:
+  PackedImage() = default;
+
+  // Uninitialized, to be filled by packRow().
+  PackedImage(const iPoint2D& dim_, int cpp_, int bitsPerSample_);
+
+  // Packs the (cropped) pixels of a TYPE_USHORT16 image, in parallel.
+  // The bits above bitsPerSample are silently dropped, so whoever picks it,
+  // should go by the white level of the image, after scaleBlackWhite().
+  static PackedImage pack(const RawImage& image, int bitsPerSample,
+                          const Parallelism& parallelism);
+
+  // Back to a new TYPE_USHORT16 image, in parallel.
+  RawImage unpack(const Parallelism& parallelism) const;
+
+  const iPoint2D& getDim() const { return dim; }
+  int getCpp() const { return cpp; }
+  int getBitsPerSample() const { return bitsPerSample; }
+  size_t getPitch() const { return pitch; }
+  size_t getSizeInBytes() const { return storage.size(); }
+
+  const uchar8* getRow(int y) const { return &storage[y * pitch]; }
+
+  // The rows may be packed (and unpacked) concurrently, and in any order.
+  // Each row is dim.x * cpp samples.
+  void packRow(int y, const ushort16* src);
+  void unpackRow(int y, ushort16* dst) const;
+
+  // Picked once, for the best available instruction set.
+  static RowPacker getRowPacker(int bitsPerSample);
+  static RowUnpacker getRowUnpacker(int bitsPerSample);
+};
+
+} // namespace rawspeed
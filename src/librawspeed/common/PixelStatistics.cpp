@@ -0,0 +1,70 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/PixelStatistics.h"
+#include <algorithm> // for all_of, fill, max, min
+#include <cassert>   // for assert
+
+namespace rawspeed {
+
+void PixelStatistics::init(int width_, int height) {
+  assert(width_ >= 0);
+  assert(height >= 0);
+
+  width = width_;
+  tilesPerRow = (width + tileSize - 1) / tileSize;
+  tiles.resize(static_cast<size_t>(tilesPerRow) * height);
+  recorded.assign(height, false);
+}
+
+void PixelStatistics::invalidate() {
+  std::fill(recorded.begin(), recorded.end(), false);
+}
+
+void PixelStatistics::addRow(int row, const ushort16* values) {
+  assert(row >= 0);
+  assert(row < static_cast<int>(recorded.size()));
+
+  Tile* tile = &tiles[row * tilesPerRow];
+  for (int begin = 0; begin < width; begin += tileSize, ++tile) {
+    const int end = std::min(begin + tileSize, width);
+    ushort16 lo = values[begin];
+    ushort16 hi = values[begin];
+    for (int x = begin + 1; x < end; x++) {
+      lo = std::min(lo, values[x]);
+      hi = std::max(hi, values[x]);
+    }
+    *tile = {lo, hi};
+  }
+
+  recorded[row] = true;
+}
+
+bool PixelStatistics::haveRows(int rowBegin, int rowEnd) const {
+  assert(rowBegin >= 0);
+  assert(rowBegin <= rowEnd);
+  assert(rowEnd <= static_cast<int>(recorded.size()));
+
+  return std::all_of(recorded.begin() + rowBegin, recorded.begin() + rowEnd,
+                     [](uchar8 r) { return r; });
+}
+
+} // namespace rawspeed
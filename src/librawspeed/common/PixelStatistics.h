@@ -0,0 +1,73 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#pragma once
+
+#include "common/Common.h" // for ushort16, uchar8
+#include <vector>          // for vector
+
+namespace rawspeed {
+
+// Summaries of the values of the rows of an (uncropped) 16-bit image, that
+// are recorded by whoever stores the rows anyway, e.g. the decompressors,
+// so that the later passes do not need to re-read the whole image.
+// Each row is split into tiles of tileSize values (pixels times components),
+// and the minimum and the maximum of each tile are kept.
+// NOTE: the rows may be recorded concurrently, by different threads, as long
+// as each row is recorded by one thread. Reading must happen after that.
+class PixelStatistics final {
+public:
+  static constexpr int tileSize = 64;
+
+  struct Tile final {
+    ushort16 min;
+    ushort16 max;
+  };
+
+private:
+  int width = 0; // in values
+  int tilesPerRow = 0;
+  std::vector<Tile> tiles;
+
+  // Whether the row was recorded since the image was last modified.
+  // One byte per row, so that different threads may set different rows.
+  std::vector<uchar8> recorded;
+
+public:
+  // Forgets everything, and prepares for an image of the given size.
+  void init(int width_, int height);
+
+  // The image was modified, forget all the rows.
+  void invalidate();
+
+  void addRow(int row, const ushort16* values);
+
+  // Were all the rows in [rowBegin, rowEnd) recorded?
+  bool __attribute__((pure)) haveRows(int rowBegin, int rowEnd) const;
+
+  // The summary of the values [tile * tileSize, (tile + 1) * tileSize)
+  // of the recorded row. The last tile of the row may be shorter.
+  const Tile& getTile(int row, int tile) const {
+    return tiles[row * tilesPerRow + tile];
+  }
+};
+
+} // namespace rawspeed
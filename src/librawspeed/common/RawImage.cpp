@@ -21,7 +21,10 @@
 #include "rawspeedconfig.h"
 #include "common/RawImage.h"
 #include "MemorySanitizer.h"              // for MSan
-#include "common/Memory.h"                // for alignedFree, alignedMalloc...
+#include "common/CfaBinner.h"             // for CfaBinner
+#include "common/DecodeStatistics.h"      // for StageTimer, DecodeStage
+#include "common/LargeAllocation.h"       // for largeMallocArray, largeFree
+#include "common/TaskScheduler.h"         // for parallelForChunks
 #include "decoders/RawDecoderException.h" // for ThrowRDE, RawDecoderException
 #include "io/IOException.h"               // for IOException
 #include "parsers/TiffParserException.h"  // for TiffParserException
@@ -84,31 +87,63 @@ void RawImageData::createData() {
   if (data)
     ThrowRDE("Duplicate data allocation in createData.");
 
-  // want each line to start at 16-byte aligned address
-  pitch = roundUp(static_cast<size_t>(dim.x) * bpp, alignment);
-  assert(isAligned(pitch, alignment));
+  static_assert(ImageBuffer::alignment == alignment, "");
+
+  if (bufferProvider)
+    externalBuffer = bufferProvider(dim, bpp);
+
+  if (externalBuffer.data) {
+    // The rows are still required to be just as aligned as our own ones.
+    if (!isAligned(externalBuffer.data, alignment) ||
+        !isAligned(externalBuffer.pitch, alignment) ||
+        externalBuffer.pitch < static_cast<size_t>(dim.x) * bpp) {
+      const uint32 badPitch = externalBuffer.pitch;
+      releaseExternalBuffer();
+      ThrowRDE("Provided buffer (pitch %u) is unusable for a %i x %i image "
+               "with %u bytes per pixel.",
+               badPitch, dim.x, dim.y, bpp);
+    }
+    pitch = externalBuffer.pitch;
+  } else {
+    externalBuffer = ImageBuffer();
+
+    // want each line to start at 16-byte aligned address
+    pitch = roundUp(static_cast<size_t>(dim.x) * bpp, alignment);
+    assert(isAligned(pitch, alignment));
 
 #if defined(DEBUG) || __has_feature(address_sanitizer) ||                      \
     defined(__SANITIZE_ADDRESS__)
-  // want to ensure that we have some padding
-  pitch += alignment * alignment;
-  assert(isAligned(pitch, alignment));
+    // want to ensure that we have some padding
+    pitch += alignment * alignment;
+    assert(isAligned(pitch, alignment));
 #endif
+  }
 
   padding = pitch - dim.x * bpp;
 
 #if defined(DEBUG) || __has_feature(address_sanitizer) ||                      \
     defined(__SANITIZE_ADDRESS__)
-  assert(padding > 0);
+  // (but whoever provided the buffer, decided on the padding themselves)
+  assert(padding > 0 || externalBuffer.data);
 #endif
 
-  data = alignedMallocArray<uchar8, alignment>(dim.y, pitch);
+  if (externalBuffer.data)
+    data = externalBuffer.data;
+  else {
+    static_assert(alignment <= 16, "LargeAllocation is only 16-byte aligned");
+    dataAllocation = largeMallocArray(dim.y, pitch, allocationPolicy);
+    data = static_cast<uchar8*>(dataAllocation.ptr);
+    if (data && prefaultData)
+      prefaultRows(dataAllocation, dim.y, pitch, parallelism);
+  }
 
   if (!data)
     ThrowRDE("Memory Allocation failed.");
 
   uncropped_dim = dim;
 
+  pixelStatistics.init(dim.x * cpp, dim.y);
+
 #ifndef NDEBUG
   if (dim.y > 1) {
     // padding is the size of the area after last pixel of line n
@@ -126,6 +161,30 @@ void RawImageData::createData() {
   poisonPadding();
 }
 
+// For the decoders whose decompressor stores the rows via a CfaBinner, if
+// binning was requested and is possible. The decompressor must then produce
+// the getUnbinnedDim() image.
+void RawImageData::createBinnedData() {
+  const iPoint2D cfaSize = cfa.getSize();
+  if (binning > 1 && !data && isCFA && cpp == 1 &&
+      dataType == TYPE_USHORT16 &&
+      (!cfaSize.hasPositiveArea() || cfaSize == iPoint2D(2, 2)) &&
+      CfaBinner::canBin(dim, binning)) {
+    binnedFrom = dim;
+    dim = CfaBinner::getBinnedDim(dim, binning);
+  }
+
+  createData();
+}
+
+iRectangle2D RawImageData::getBinnedRect(const iRectangle2D& rect) const {
+  if (!isBinned())
+    return rect;
+
+  const iRectangle2D image({0, 0}, getUncroppedDim());
+  return CfaBinner::getBinnedRect(rect, binning).getOverlap(image);
+}
+
 #if __has_feature(address_sanitizer) || defined(__SANITIZE_ADDRESS__)
 void RawImageData::poisonPadding() {
   if (padding <= 0)
@@ -191,13 +250,26 @@ void RawImageData::checkMemIsInitialized() {
 }
 #endif
 
+void RawImageData::releaseExternalBuffer() noexcept {
+  ImageBuffer buf;
+  std::swap(buf, externalBuffer);
+  if (buf.release)
+    buf.release();
+}
+
 void RawImageData::destroyData() {
-  if (data)
-    alignedFree(data);
+  if (data && externalBuffer.data) {
+    // It will outlive us, so the padding must not stay poisoned.
+    unpoisonPadding();
+    releaseExternalBuffer();
+  } else if (data)
+    largeFree(dataAllocation);
   if (mBadPixelMap)
-    alignedFree(mBadPixelMap);
+    largeFree(badPixelMapAllocation);
   data = nullptr;
+  dataAllocation = LargeAllocation();
   mBadPixelMap = nullptr;
+  badPixelMapAllocation = LargeAllocation();
 }
 
 void RawImageData::setCpp(uint32 val) {
@@ -256,6 +328,8 @@ iPoint2D __attribute__((pure)) RawImageData::getCropOffset() const {
 }
 
 void RawImageData::subFrame(iRectangle2D crop) {
+  StageTimer timer(statistics.get(), DecodeStage::Crop);
+
   if (!crop.dim.isThisInside(dim - crop.pos)) {
     writeLog(DEBUG_PRIO_WARNING, "WARNING: RawImageData::subFrame - Attempted "
                                  "to create new subframe larger than original "
@@ -283,12 +357,15 @@ void RawImageData::createBadPixelMap()
   if (!isAllocated())
     ThrowRDE("(internal) Bad pixel map cannot be allocated before image.");
   mBadPixelMapPitch = roundUp(roundUpDivision(uncropped_dim.x, 8), 16);
-  mBadPixelMap =
-      alignedMallocArray<uchar8, 16>(uncropped_dim.y, mBadPixelMapPitch);
-  memset(mBadPixelMap, 0,
-         static_cast<size_t>(mBadPixelMapPitch) * uncropped_dim.y);
+  badPixelMapAllocation =
+      largeMallocArray(uncropped_dim.y, mBadPixelMapPitch, allocationPolicy);
+  mBadPixelMap = static_cast<uchar8*>(badPixelMapAllocation.ptr);
   if (!mBadPixelMap)
     ThrowRDE("Memory Allocation failed.");
+  if (!badPixelMapAllocation.isZeroed()) {
+    memset(mBadPixelMap, 0,
+           static_cast<size_t>(mBadPixelMapPitch) * uncropped_dim.y);
+  }
 }
 
 RawImage::RawImage(RawImageData* p) : p_(p) {
@@ -338,6 +415,9 @@ void RawImageData::transferBadPixelsToMap()
 
 void RawImageData::fixBadPixels()
 {
+  StageTimer timer(statistics.get(), DecodeStage::FixBadPixels,
+                   static_cast<uint64>(pitch) * uncropped_dim.y);
+
 #if !defined (EMULATE_DCRAW_BAD_PIXELS)
 
   /* Transfer if not already done */
@@ -354,8 +434,10 @@ void RawImageData::fixBadPixels()
 #endif
 
   /* Process bad pixels, if any */
-  if (mBadPixelMap)
+  if (mBadPixelMap) {
+    pixelStatistics.invalidate();
     startWorker(RawImageWorker::FIX_BAD_PIXELS, false);
+  }
 
 #else  // EMULATE_DCRAW_BAD_PIXELS - not recommended, testing purposes only
 
@@ -394,20 +476,10 @@ void RawImageData::startWorker(const RawImageWorker::RawImageWorkerTask task,
     return h;
   }();
 
-  const int threads = rawspeed_get_number_of_processor_cores();
-  const int y_per_thread = (height + threads - 1) / threads;
-
-#ifdef HAVE_OPENMP
-#pragma omp parallel for default(none)                                         \
-    OMPFIRSTPRIVATECLAUSE(threads, y_per_thread, height, task)                 \
-        num_threads(threads) schedule(static)
-#endif
-  for (int i = 0; i < threads; i++) {
-    int y_offset = std::min(i * y_per_thread, height);
-    int y_end = std::min((i + 1) * y_per_thread, height);
-
-    RawImageWorker worker(this, task, y_offset, y_end);
-  }
+  parallelForChunks(parallelism, 0, height,
+                    [this, task](int y_offset, int y_end) {
+                      RawImageWorker worker(this, task, y_offset, y_end);
+                    });
 }
 
 void RawImageData::fixBadPixelsThread(int start_y, int end_y) {
@@ -445,6 +517,8 @@ void RawImageData::blitFrom(const RawImage& src, const iPoint2D& srcPos,
   if (blitsize.area() <= 0)
     return;
 
+  pixelStatistics.invalidate();
+
   // TODO: Move offsets after crop.
   copyPixels(getData(dest_rect.pos.x, dest_rect.pos.y), pitch,
              src->getData(src_rect.pos.x, src_rect.pos.y), src->pitch,
@@ -455,6 +529,7 @@ void RawImageData::blitFrom(const RawImage& src, const iPoint2D& srcPos,
 void RawImageData::expandBorder(iRectangle2D validData)
 {
   validData = validData.getOverlap(iRectangle2D(0,0,dim.x, dim.y));
+  pixelStatistics.invalidate();
   if (validData.pos.x > 0) {
     for (int y = 0; y < dim.y; y++ ) {
       uchar8* src_pos = getData(validData.pos.x, y);
@@ -505,6 +580,8 @@ void RawImageData::clearArea( iRectangle2D area, uchar8 val /*= 0*/ )
   if (area.area() <= 0)
     return;
 
+  pixelStatistics.invalidate();
+
   for (int y = area.getTop(); y < area.getBottom(); y++)
     memset(getData(area.getLeft(), y), val,
            static_cast<size_t>(area.getWidth()) * bpp);
@@ -564,6 +641,8 @@ void RawImageData::sixteenBitLookup() {
   if (table == nullptr) {
     return;
   }
+  StageTimer timer(statistics.get(), DecodeStage::SixteenBitLookup,
+                   static_cast<uint64>(pitch) * dim.y);
   startWorker(RawImageWorker::APPLY_LOOKUP, true);
 }
 
@@ -23,15 +23,21 @@
 #include "rawspeedconfig.h"
 #include "ThreadSafetyAnalysis.h"      // for GUARDED_BY, REQUIRES
 #include "common/Common.h"             // for uint32, uchar8, ushort16, wri...
+#include "common/DecodeStatistics.h"   // for DecodeStatistics
 #include "common/ErrorLog.h"           // for ErrorLog
+#include "common/ImageBuffer.h"        // for ImageBuffer, ImageBufferProvider
+#include "common/LargeAllocation.h"    // for LargeAllocation, LargeAllocati...
 #include "common/Mutex.h"              // for Mutex
+#include "common/PixelStatistics.h"    // for PixelStatistics
 #include "common/Point.h"              // for iPoint2D, iRectangle2D (ptr o...
 #include "common/TableLookUp.h"        // for TableLookUp
+#include "common/TaskScheduler.h"      // for Parallelism
 #include "metadata/BlackArea.h"        // for BlackArea
 #include "metadata/ColorFilterArray.h" // for ColorFilterArray
 #include <array>                       // for array
-#include <memory>                      // for unique_ptr, operator==
+#include <memory>                      // for unique_ptr, shared_ptr
 #include <string>                      // for string
+#include <utility>                     // for move
 #include <vector>                      // for vector
 
 namespace rawspeed {
@@ -99,6 +105,7 @@ public:
   uint32 getBpp() const { return bpp; }
   void setCpp(uint32 val);
   void createData();
+  void createBinnedData();
   void poisonPadding();
   void unpoisonPadding();
   void checkRowIsInitialized(int row);
@@ -114,6 +121,12 @@ public:
   void clearArea(iRectangle2D area, uchar8 value = 0);
   iPoint2D __attribute__((pure)) getUncroppedDim() const;
   iPoint2D __attribute__((pure)) getCropOffset() const;
+  bool isBinned() const { return binnedFrom.hasPositiveArea(); }
+  // What the decompressor produces, i.e. the dimensions before the binning.
+  iPoint2D getUnbinnedDim() const { return isBinned() ? binnedFrom : dim; }
+  // Where the full-resolution (uncropped) area ended up, clipped to the image.
+  iRectangle2D __attribute__((pure))
+  getBinnedRect(const iRectangle2D& rect) const;
   virtual void scaleBlackWhite() = 0;
   virtual void calculateBlackAreas() = 0;
   virtual void setWithLookUp(ushort16 value, uchar8* dst, uint32* random) = 0;
@@ -123,6 +136,8 @@ public:
   void expandBorder(iRectangle2D validData);
   void setTable(const std::vector<ushort16>& table_, bool dither);
   void setTable(std::unique_ptr<TableLookUp> t);
+  // The lookup table setWithLookUp() uses, if any.
+  const TableLookUp* getTable() const { return table.get(); }
 
   bool isAllocated() {return !!data;}
   void createBadPixelMap();
@@ -150,6 +165,44 @@ public:
       true; // Should upscaling be done with dither to minimize banding?
   ImageMetaData metadata;
 
+  // The thread budget for all of the parallel work on this image.
+  Parallelism parallelism;
+
+  // Should the decompressors store the raw codes, and the curves (see
+  // RawImageCurveGuard) be applied to the whole image afterwards, in parallel?
+  // The dithering then differs from the one done while decompressing.
+  bool deferCurves = false;
+
+  // Where the time went. Shared with the image this one was derived from.
+  std::shared_ptr<DecodeStatistics> statistics =
+      std::make_shared<DecodeStatistics>();
+
+  // For previews: the decoders that support it (see createBinnedData()) bin
+  // the image by this factor (2 to 4) while decompressing, see CfaBinner.
+  int binning = 1;
+
+  // If set, createData() asks it for the memory of the pixels first.
+  ImageBufferProvider bufferProvider;
+
+  // Otherwise, how createData() (and createBadPixelMap()) allocate the memory.
+  LargeAllocationPolicy allocationPolicy = LargeAllocationPolicy::Default;
+
+  // Should createData() fault in the pages right away, using the parallelism,
+  // instead of leaving it to whoever writes into them first? The rows are
+  // split among the threads like parallelForChunks() does, so with a NUMA-
+  // pinned executor the pages end up spread over its nodes, though not
+  // necessarily on the node of the decompressor's thread that writes them.
+  bool prefaultData = false;
+
+  // What createData() actually ended up using, see largeMallocArray().
+  LargeAllocationPolicy getAllocationPolicy() const {
+    return dataAllocation.policy;
+  }
+
+  // Summaries of the rows, recorded by whoever stored them, if they did.
+  // Whoever modifies the recorded rows afterwards must invalidate them.
+  PixelStatistics pixelStatistics;
+
   Mutex mBadPixelMutex; // Mutex for 'mBadPixelPositions, must be used if more
                         // than 1 thread is accessing vector
 
@@ -164,13 +217,18 @@ protected:
   virtual void doLookup(int start_y, int end_y) = 0;
   virtual void fixBadPixel( uint32 x, uint32 y, int component = 0) = 0;
   void fixBadPixelsThread(int start_y, int end_y);
+  void releaseExternalBuffer() noexcept;
   void startWorker(RawImageWorker::RawImageWorkerTask task, bool cropped );
   uchar8* data = nullptr;
+  LargeAllocation dataAllocation; // if data is ours
+  ImageBuffer externalBuffer; // if data is not ours, whom it came from
+  LargeAllocation badPixelMapAllocation;
   uint32 cpp = 1; // Components per pixel
   uint32 bpp = 0; // Bytes per pixel.
   friend class RawImage;
   iPoint2D mOffset;
   iPoint2D uncropped_dim;
+  iPoint2D binnedFrom; // the full dimensions, if binned
   std::unique_ptr<TableLookUp> table;
   Mutex mymutex;
 };
@@ -187,8 +245,12 @@ protected:
   void scaleValues_SSE2(int start_y, int end_y);
 #endif
   void scaleValues(int start_y, int end_y) override;
+  bool estimateFromStatistics(int skipBorder, int* b, int* m);
   void fixBadPixel(uint32 x, uint32 y, int component = 0) override;
   void doLookup(int start_y, int end_y) override;
+#ifdef WITH_AVX2
+  int doLookup_AVX2(int start_y, int end_y);
+#endif
 
   RawImageDataU16();
   explicit RawImageDataU16(const iPoint2D& dim_, uint32 cpp_ = 1);
@@ -213,6 +275,9 @@ protected:
  class RawImage {
  public:
    static RawImage create(RawImageType type = TYPE_USHORT16);
+   static RawImage create(const iPoint2D& dim, RawImageType type,
+                          uint32 componentsPerPixel,
+                          ImageBufferProvider bufferProvider);
    static RawImage create(const iPoint2D &dim,
                           RawImageType type = TYPE_USHORT16,
                           uint32 componentsPerPixel = 1);
@@ -255,6 +320,18 @@ inline RawImage RawImage::create(const iPoint2D& dim, RawImageType type, uint32
   }
 }
 
+inline RawImage RawImage::create(const iPoint2D& dim, RawImageType type,
+                                 uint32 componentsPerPixel,
+                                 ImageBufferProvider bufferProvider) {
+  RawImage img = create(type);
+  img->dim = dim;
+  img->isCFA = componentsPerPixel == 1;
+  img->setCpp(componentsPerPixel);
+  img->bufferProvider = std::move(bufferProvider);
+  img->createData();
+  return img;
+}
+
 // setWithLookUp will set a single pixel by using the lookup table if supplied,
 // You must supply the destination where the value should be written, and a pointer to
 // a value that will be used to store a random counter that can be reused between calls.
@@ -285,16 +362,39 @@ class RawImageCurveGuard final {
   const std::vector<ushort16>& curve;
   const bool uncorrectedRawValues;
 
+  // If the image defers the curves, the table to apply once the decompressor
+  // has stored all the raw codes. Built upfront, so that can not fail.
+  std::unique_ptr<TableLookUp> deferred;
+
 public:
+  // canDefer should be false if the decompressor does not store the looked-up
+  // values as they are, but computes something else from them.
   RawImageCurveGuard(RawImage* raw, const std::vector<ushort16>& curve_,
-                     bool uncorrectedRawValues_)
+                     bool uncorrectedRawValues_, bool canDefer = true)
       : mRaw(raw), curve(curve_), uncorrectedRawValues(uncorrectedRawValues_) {
     if (uncorrectedRawValues)
       return;
 
+    if ((*mRaw)->deferCurves && canDefer) {
+      deferred = std::make_unique<TableLookUp>(1, true);
+      deferred->setTable(0, curve);
+      return;
+    }
+
     (*mRaw)->setTable(curve, true);
   }
 
+  // To be called once the decompressor has successfully stored all the rows.
+  // Applies the deferred curve, if any. Not done by the destructor, there is
+  // no point in that if the decompressor threw, and it must not throw itself.
+  void finish() {
+    if (!deferred)
+      return;
+
+    (*mRaw)->setTable(std::move(deferred));
+    (*mRaw)->sixteenBitLookup();
+  }
+
   ~RawImageCurveGuard() {
     // Set the table, if it should be needed later.
     if (uncorrectedRawValues)
@@ -18,21 +18,178 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include "rawspeedconfig.h"               // for WITH_AVX2, WITH_AVX512
+#include "common/Cpuid.h"                 // for Cpuid
+#include "common/DecodeStatistics.h"      // for StageTimer, DecodeStage
 #include "common/RawImage.h"              // for RawImageDataFloat, TYPE_FL...
 #include "common/Common.h"                // for uchar8, uint32, writeLog
+#include "common/Mutex.h"                 // for Mutex, MutexLocker
 #include "common/Point.h"                 // for iPoint2D
+#include "common/TaskScheduler.h"         // for parallelFor, parallelForCh...
 #include "decoders/RawDecoderException.h" // for ThrowRDE
 #include "metadata/BlackArea.h"           // for BlackArea
-#include <algorithm>                      // for max, min
+#include <algorithm>                      // for max, min, nth_element
 #include <array>                          // for array
+#include <cmath>                          // for isnan
 #include <memory>                         // for operator==, unique_ptr
 #include <vector>                         // for vector
 
+#if defined(WITH_AVX2) || defined(WITH_AVX512)
+#include <immintrin.h> // for __m256, _mm256_loadu_ps, __m512, ...
+#endif
+
 using std::min;
 using std::max;
 
 namespace rawspeed {
 
+namespace {
+
+// The per-row kernels of scaleValues() and of the estimation in
+// scaleBlackWhite(). The vectorized ones produce exactly the same result.
+
+// The value x of the row gets sub[x & 1] subtracted, and is multiplied by
+// mul[x & 1].
+using ScaleRow = void (*)(float* pixel, int width, const float* sub,
+                          const float* mul);
+
+// NaN values are ignored.
+using MinMaxRow = void (*)(const float* pixel, int width, float* b, float* m);
+
+void scaleRow(float* pixel, int width, const float* sub, const float* mul) {
+  for (int x = 0; x < width; x++)
+    pixel[x] = (pixel[x] - sub[x & 1]) * mul[x & 1];
+}
+
+void minMaxRow(const float* pixel, int width, float* b, float* m) {
+  for (int x = 0; x < width; x++) {
+    *b = min(*b, pixel[x]);
+    *m = max(*m, pixel[x]);
+  }
+}
+
+#ifdef WITH_AVX2
+
+__attribute__((target("avx2"))) void
+scaleRow_AVX2(float* pixel, int width, const float* sub, const float* mul) {
+  const __m256 s = _mm256_setr_ps(sub[0], sub[1], sub[0], sub[1], sub[0],
+                                  sub[1], sub[0], sub[1]);
+  const __m256 m = _mm256_setr_ps(mul[0], mul[1], mul[0], mul[1], mul[0],
+                                  mul[1], mul[0], mul[1]);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m256 p = _mm256_loadu_ps(pixel + x);
+    _mm256_storeu_ps(pixel + x, _mm256_mul_ps(_mm256_sub_ps(p, s), m));
+  }
+  scaleRow(pixel + x, width - x, sub, mul);
+}
+
+__attribute__((target("avx2"))) void
+minMaxRow_AVX2(const float* pixel, int width, float* b, float* m) {
+  // NOTE: minps/maxps return the second operand if either one is NaN.
+  __m256 vb = _mm256_set1_ps(*b);
+  __m256 vm = _mm256_set1_ps(*m);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m256 p = _mm256_loadu_ps(pixel + x);
+    vb = _mm256_min_ps(p, vb);
+    vm = _mm256_max_ps(p, vm);
+  }
+
+  float lanes[8];
+  _mm256_storeu_ps(lanes, vb);
+  for (float v : lanes)
+    *b = min(*b, v);
+  _mm256_storeu_ps(lanes, vm);
+  for (float v : lanes)
+    *m = max(*m, v);
+
+  minMaxRow(pixel + x, width - x, b, m);
+}
+
+#endif
+
+#ifdef WITH_AVX512
+
+__attribute__((target("avx512f"))) void
+scaleRow_AVX512(float* pixel, int width, const float* sub, const float* mul) {
+  const __m512 s = _mm512_setr_ps(sub[0], sub[1], sub[0], sub[1], sub[0],
+                                  sub[1], sub[0], sub[1], sub[0], sub[1],
+                                  sub[0], sub[1], sub[0], sub[1], sub[0],
+                                  sub[1]);
+  const __m512 m = _mm512_setr_ps(mul[0], mul[1], mul[0], mul[1], mul[0],
+                                  mul[1], mul[0], mul[1], mul[0], mul[1],
+                                  mul[0], mul[1], mul[0], mul[1], mul[0],
+                                  mul[1]);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const __m512 p = _mm512_loadu_ps(pixel + x);
+    _mm512_storeu_ps(pixel + x, _mm512_mul_ps(_mm512_sub_ps(p, s), m));
+  }
+  scaleRow(pixel + x, width - x, sub, mul);
+}
+
+__attribute__((target("avx512f"))) void
+minMaxRow_AVX512(const float* pixel, int width, float* b, float* m) {
+  // NOTE: minps/maxps return the second operand if either one is NaN.
+  // The masked variants are used (with all lanes enabled) because GCC warns
+  // about the undefined passthrough operand of the plain ones.
+  static constexpr __mmask16 all = 0xffff;
+  __m512 vb = _mm512_set1_ps(*b);
+  __m512 vm = _mm512_set1_ps(*m);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const __m512 p = _mm512_loadu_ps(pixel + x);
+    vb = _mm512_mask_min_ps(vb, all, p, vb);
+    vm = _mm512_mask_max_ps(vm, all, p, vm);
+  }
+
+  float lanes[16];
+  _mm512_storeu_ps(lanes, vb);
+  for (float v : lanes)
+    *b = min(*b, v);
+  _mm512_storeu_ps(lanes, vm);
+  for (float v : lanes)
+    *m = max(*m, v);
+
+  minMaxRow(pixel + x, width - x, b, m);
+}
+
+#endif
+
+ScaleRow getScaleRow() {
+#ifdef WITH_AVX512
+  if (Cpuid::AVX512F())
+    return &scaleRow_AVX512;
+#endif
+#ifdef WITH_AVX2
+  if (Cpuid::AVX2())
+    return &scaleRow_AVX2;
+#endif
+  return &scaleRow;
+}
+
+MinMaxRow getMinMaxRow() {
+#ifdef WITH_AVX512
+  if (Cpuid::AVX512F())
+    return &minMaxRow_AVX512;
+#endif
+#ifdef WITH_AVX2
+  if (Cpuid::AVX2())
+    return &minMaxRow_AVX2;
+#endif
+  return &minMaxRow;
+}
+
+// A run of consecutive values of one row of a black area.
+struct BlackAreaSpan final {
+  int x;
+  int y;
+  int width;
+};
+
+} // namespace
+
 RawImageDataFloat::RawImageDataFloat() {
   bpp = 4;
   dataType = TYPE_FLOAT32;
@@ -45,9 +202,9 @@ RawImageDataFloat::RawImageDataFloat() {
 
 
   void RawImageDataFloat::calculateBlackAreas() {
-    std::array<float, 4> accPixels;
-    accPixels.fill(0);
-    int totalpixels = 0;
+    StageTimer timer(statistics.get(), DecodeStage::CalculateBlackAreas);
+
+    std::vector<BlackAreaSpan> spans;
 
     for (auto area : blackAreas) {
       /* Make sure area sizes are multiple of two,
@@ -59,16 +216,8 @@ RawImageDataFloat::RawImageDataFloat() {
         if (static_cast<int>(area.offset) + static_cast<int>(area.size) >
             uncropped_dim.y)
           ThrowRDE("Offset + size is larger than height of image");
-        for (uint32 y = area.offset; y < area.offset+area.size; y++) {
-          auto* pixel =
-              reinterpret_cast<float*>(getDataUncropped(mOffset.x, y));
-
-          for (int x = mOffset.x; x < dim.x + mOffset.x; x++) {
-            accPixels[((y & 1) << 1) | (x & 1)] += *pixel;
-            pixel++;
-          }
-        }
-        totalpixels += area.size * dim.x;
+        for (uint32 y = area.offset; y < area.offset+area.size; y++)
+          spans.push_back({mOffset.x, static_cast<int>(y), dim.x});
       }
 
       /* Process vertical area */
@@ -77,32 +226,50 @@ RawImageDataFloat::RawImageDataFloat() {
             uncropped_dim.x)
           ThrowRDE("Offset + size is larger than width of image");
         for (int y = mOffset.y; y < dim.y+mOffset.y; y++) {
-          auto* pixel =
-              reinterpret_cast<float*>(getDataUncropped(area.offset, y));
-
-          for (uint32 x = area.offset; x < area.size + area.offset; x++) {
-            accPixels[((y & 1) << 1) | (x & 1)] += *pixel;
-            pixel++;
-          }
+          spans.push_back({static_cast<int>(area.offset), y,
+                           static_cast<int>(area.size)});
         }
-        totalpixels += area.size * dim.y;
       }
     }
 
-    if (!totalpixels) {
+    /* Gather the values of the black areas for each component */
+    std::array<std::vector<float>, 4> values;
+    Mutex valuesMutex;
+    const auto gather = [&](int begin, int end) {
+      std::array<std::vector<float>, 4> local;
+      for (int i = begin; i < end; i++) {
+        const BlackAreaSpan& span = spans[i];
+        const auto* pixel =
+            reinterpret_cast<float*>(getDataUncropped(span.x, span.y));
+        for (int x = span.x; x < span.x + span.width; x++, pixel++) {
+          if (!std::isnan(*pixel))
+            local[((span.y & 1) << 1) | (x & 1)].push_back(*pixel);
+        }
+      }
+
+      MutexLocker guard(&valuesMutex);
+      for (int i = 0; i < 4; i++)
+        values[i].insert(values[i].end(), local[i].begin(), local[i].end());
+    };
+    parallelForChunks(parallelism, 0, static_cast<int>(spans.size()), gather);
+
+    if (spans.empty()) {
       for (int &i : blackLevelSeparate)
         i = blackLevel;
       return;
     }
 
     /* Calculate median value of black areas for each component */
-    /* Adjust the number of total pixels so it is the same as the median of each histogram */
-    totalpixels /= 4;
-
-    for (int i = 0 ; i < 4; i++) {
-      blackLevelSeparate[i] =
-          static_cast<int>(65535.0F * accPixels[i] / totalpixels);
-    }
+    parallelFor(parallelism, 0, 4, [this, &values](int i) {
+      std::vector<float>& v = values[i];
+      if (v.empty()) {
+        blackLevelSeparate[i] = blackLevel;
+        return;
+      }
+      const auto median = v.begin() + v.size() / 2;
+      std::nth_element(v.begin(), median, v.end());
+      blackLevelSeparate[i] = static_cast<int>(65535.0F * *median);
+    });
 
     /* If this is not a CFA image, we do not use separate blacklevels, use average */
     if (!isCFA) {
@@ -115,18 +282,36 @@ RawImageDataFloat::RawImageDataFloat() {
   }
 
   void RawImageDataFloat::scaleBlackWhite() {
+    StageTimer timer(statistics.get(), DecodeStage::ScaleBlackWhite,
+                     static_cast<uint64>(pitch) * dim.y);
+
     const int skipBorder = 150;
     int gw = (dim.x - skipBorder) * cpp;
     if ((blackAreas.empty() && blackLevelSeparate[0] < 0 && blackLevel < 0) || whitePoint == 65536) {  // Estimate
-      float b = 100000000;
-      float m = -10000000;
-      for (int row = skipBorder*cpp;row < (dim.y - skipBorder);row++) {
-        auto* pixel = reinterpret_cast<float*>(getData(skipBorder, row));
-        for (int col = skipBorder ; col < gw ; col++) {
-          b = min(*pixel, b);
-          m = max(*pixel, m);
-          pixel++;
-        }
+      static constexpr float initialB = 100000000;
+      static constexpr float initialM = -10000000;
+      float b = initialB;
+      float m = initialM;
+      const int firstRow = skipBorder * static_cast<int>(cpp);
+      const int lastRow = dim.y - skipBorder;
+      const int width = gw - skipBorder;
+      if (width > 0 && firstRow < lastRow) {
+        const MinMaxRow minMax = getMinMaxRow();
+        Mutex mutex;
+        const auto estimate = [&](int begin, int end) {
+          float localB = initialB;
+          float localM = initialM;
+          for (int row = begin; row < end; row++) {
+            const auto* pixel =
+                reinterpret_cast<float*>(getData(skipBorder, row));
+            minMax(pixel, width, &localB, &localM);
+          }
+
+          MutexLocker guard(&mutex);
+          b = min(b, localB);
+          m = max(m, localM);
+        };
+        parallelForChunks(parallelism, firstRow, lastRow, estimate);
       }
       if (blackLevel < 0)
         blackLevel = static_cast<int>(b);
@@ -272,13 +457,10 @@ RawImageDataFloat::RawImageDataFloat() {
           65535.0F / static_cast<float>(whitePoint - blackLevelSeparate[v]);
       sub[i] = static_cast<float>(blackLevelSeparate[v]);
     }
+    const ScaleRow scale = getScaleRow();
     for (int y = start_y; y < end_y; y++) {
       auto* pixel = reinterpret_cast<float*>(getData(0, y));
-      float *mul_local = &mul[2*(y&1)];
-      float *sub_local = &sub[2*(y&1)];
-      for (int x = 0 ; x < gw; x++) {
-        pixel[x] = (pixel[x] - sub_local[x&1]) * mul_local[x&1];
-      }
+      scale(pixel, gw, &sub[2 * (y & 1)], &mul[2 * (y & 1)]);
     }
   }
 
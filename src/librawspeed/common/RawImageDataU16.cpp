@@ -19,9 +19,11 @@
 */
 
 #include "rawspeedconfig.h"               // for WITH_SSE2
+#include "common/DecodeStatistics.h"      // for StageTimer, DecodeStage
 #include "common/RawImage.h"              // for RawImageDataU16, TableLookUp
 #include "common/Common.h"                // for ushort16, uint32, uchar8
 #include "common/Memory.h"                // for alignedFree, alignedMalloc...
+#include "common/PixelStatistics.h"       // for PixelStatistics
 #include "common/Point.h"                 // for iPoint2D
 #include "common/TableLookUp.h"           // for TableLookUp
 #include "decoders/RawDecoderException.h" // for ThrowRDE
@@ -38,6 +40,11 @@
 #include <xmmintrin.h> // for _MM_HINT_T0, _mm_prefetch
 #endif
 
+#ifdef WITH_AVX2
+#include "common/Cpuid.h" // for Cpuid
+#include <immintrin.h>    // for __m256i, _mm256_i32gather_epi32, ...
+#endif
+
 using std::vector;
 using std::min;
 using std::max;
@@ -57,6 +64,8 @@ RawImageDataU16::RawImageDataU16(const iPoint2D &_dim, uint32 _cpp)
 
 
 void RawImageDataU16::calculateBlackAreas() {
+  StageTimer timer(statistics.get(), DecodeStage::CalculateBlackAreas);
+
   vector<unsigned int> histogram(4 * 65536);
   fill(histogram.begin(), histogram.end(), 0);
 
@@ -134,17 +143,22 @@ void RawImageDataU16::calculateBlackAreas() {
 }
 
 void RawImageDataU16::scaleBlackWhite() {
+  StageTimer timer(statistics.get(), DecodeStage::ScaleBlackWhite,
+                   static_cast<uint64>(pitch) * dim.y);
+
   const int skipBorder = 250;
   int gw = (dim.x - skipBorder) * cpp;
   if ((blackAreas.empty() && blackLevelSeparate[0] < 0 && blackLevel < 0) || whitePoint >= 65536) {  // Estimate
     int b = 65536;
     int m = 0;
-    for (int row = skipBorder; row < (dim.y - skipBorder);row++) {
-      auto* pixel = reinterpret_cast<ushort16*>(getData(skipBorder, row));
-      for (int col = skipBorder ; col < gw ; col++) {
-        b = min(static_cast<int>(*pixel), b);
-        m = max(static_cast<int>(*pixel), m);
-        pixel++;
+    if (!estimateFromStatistics(skipBorder, &b, &m)) {
+      for (int row = skipBorder; row < (dim.y - skipBorder);row++) {
+        auto* pixel = reinterpret_cast<ushort16*>(getData(skipBorder, row));
+        for (int col = skipBorder ; col < gw ; col++) {
+          b = min(static_cast<int>(*pixel), b);
+          m = max(static_cast<int>(*pixel), m);
+          pixel++;
+        }
       }
     }
     if (blackLevel < 0)
@@ -166,6 +180,46 @@ void RawImageDataU16::scaleBlackWhite() {
     calculateBlackAreas();
 
   startWorker(RawImageWorker::SCALE_VALUES, true);
+  pixelStatistics.invalidate();
+}
+
+// Same as the estimation loop of scaleBlackWhite(), but only the ends of each
+// row are read, for the rest the summaries that were recorded are used.
+bool RawImageDataU16::estimateFromStatistics(int skipBorder, int* b, int* m) {
+  // The rows, and the values within the rows, of the uncropped image.
+  const int firstRow = mOffset.y + skipBorder;
+  const int lastRow = mOffset.y + dim.y - skipBorder;
+  const int begin = (mOffset.x + skipBorder) * cpp;
+  const int end = begin + (dim.x - skipBorder) * cpp - skipBorder;
+
+  if (firstRow >= lastRow || begin >= end ||
+      !pixelStatistics.haveRows(firstRow, lastRow))
+    return false;
+
+  const int tileSize = PixelStatistics::tileSize;
+  const int tileBegin = static_cast<int>(roundUpDivision(begin, tileSize));
+  const int tileEnd = std::max(tileBegin, end / tileSize);
+
+  for (int row = firstRow; row < lastRow; row++) {
+    const auto* pixel =
+        reinterpret_cast<const ushort16*>(getDataUncropped(0, row));
+    const auto scan = [b, m, pixel](int from, int to) {
+      for (int x = from; x < to; x++) {
+        *b = min(static_cast<int>(pixel[x]), *b);
+        *m = max(static_cast<int>(pixel[x]), *m);
+      }
+    };
+
+    scan(begin, min(end, tileBegin * tileSize));
+    for (int tile = tileBegin; tile < tileEnd; tile++) {
+      const PixelStatistics::Tile& t = pixelStatistics.getTile(row, tile);
+      *b = min(static_cast<int>(t.min), *b);
+      *m = max(static_cast<int>(t.max), *m);
+    }
+    scan(max(begin, tileEnd * tileSize), end);
+  }
+
+  return true;
 }
 
 void RawImageDataU16::scaleValues(int start_y, int end_y) {
@@ -472,25 +526,46 @@ void RawImageDataU16::fixBadPixel( uint32 x, uint32 y, int component )
 }
 
 // TODO: Could be done with SSE2
+namespace {
+
+// The dither's random number generator is restarted for each row, so that
+// the result does not depend on how the rows are split between the threads.
+inline uint32 getDitherSeed(int width, int row) {
+  return (width + row * 13) ^ 0x45694584;
+}
+
+// Looks up one pixel in the dithering table, the lower 16 bits of each entry
+// are the base value, and the upper 16 bits the delta to the next one.
+inline ushort16 ditherLookup(const uint32* t, ushort16 p, uint32* v) {
+  uint32 lookup = t[p];
+  uint32 base = lookup & 0xffff;
+  uint32 delta = lookup >> 16;
+  *v = 15700 * (*v & 65535) + (*v >> 16);
+  uint32 pix = base + ((delta * (*v & 2047) + 1024) >> 12);
+  return clampBits(pix, 16);
+}
+
+} // namespace
+
 void RawImageDataU16::doLookup( int start_y, int end_y )
 {
   if (table->ntables == 1) {
+#ifdef WITH_AVX2
+    if (Cpuid::AVX2())
+      start_y = doLookup_AVX2(start_y, end_y);
+#endif
+
     if (table->dither) {
       int gw = uncropped_dim.x * cpp;
       auto* t = reinterpret_cast<uint32*>(table->getTable(0));
       for (int y = start_y; y < end_y; y++) {
-        uint32 v = (uncropped_dim.x + y * 13) ^ 0x45694584;
+        uint32 v = getDitherSeed(uncropped_dim.x, y);
         auto* pixel = reinterpret_cast<ushort16*>(getDataUncropped(0, y));
         for (int x = 0 ; x < gw; x++) {
-          ushort16 p = *pixel;
-          uint32 lookup = t[p];
-          uint32 base = lookup & 0xffff;
-          uint32 delta = lookup >> 16;
-          v = 15700 *(v & 65535) + (v >> 16);
-          uint32 pix = base + ((delta * (v & 2047) + 1024) >> 12);
-          *pixel = clampBits(pix, 16);
+          *pixel = ditherLookup(t, *pixel, &v);
           pixel++;
         }
+        pixelStatistics.addRow(y, pixel - gw);
       }
       return;
     }
@@ -503,10 +578,147 @@ void RawImageDataU16::doLookup( int start_y, int end_y )
         *pixel = t[*pixel];
         pixel ++;
       }
+      pixelStatistics.addRow(y, pixel - gw);
     }
     return;
   }
   ThrowRDE("Table lookup with multiple components not implemented");
 }
 
+#ifdef WITH_AVX2
+
+namespace {
+
+// Transposes the 8x8 block of 16-bit values, given as 8 rows, in place.
+__attribute__((target("avx2"))) inline void transpose8x8(__m128i* r) {
+  const __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+  const __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+  const __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+  const __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+  const __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+  const __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+  const __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+  const __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+  const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+  const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+  const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+  const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+  const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+  const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+  const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+  const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+  r[0] = _mm_unpacklo_epi64(b0, b4);
+  r[1] = _mm_unpackhi_epi64(b0, b4);
+  r[2] = _mm_unpacklo_epi64(b1, b5);
+  r[3] = _mm_unpackhi_epi64(b1, b5);
+  r[4] = _mm_unpacklo_epi64(b2, b6);
+  r[5] = _mm_unpackhi_epi64(b2, b6);
+  r[6] = _mm_unpacklo_epi64(b3, b7);
+  r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+} // namespace
+
+// Exactly the same as doLookup(). Without the dithering, 16 pixels of a row
+// are looked up at a time. With it, each row's random numbers are sequential,
+// so instead 8 rows are done at once, one lane per row, a column at a time.
+// Returns the first row that is left for doLookup() to do.
+__attribute__((target("avx2"))) int
+RawImageDataU16::doLookup_AVX2(int start_y, int end_y) {
+  assert(table->ntables == 1);
+
+  const int gw = uncropped_dim.x * cpp;
+  // NOTE: each gather loads 32 bits. Without the dithering, that is also the
+  // entry after the looked up one, which is still within the table.
+  const auto* t = reinterpret_cast<const int*>(table->getTable(0));
+  const __m256i lowMask = _mm256_set1_epi32(0xffff);
+
+  if (!table->dither) {
+    const ushort16* t16 = table->getTable(0);
+    for (int y = start_y; y < end_y; y++) {
+      auto* pixel = reinterpret_cast<ushort16*>(getDataUncropped(0, y));
+      int x = 0;
+      for (; x + 16 <= gw; x += 16) {
+        const auto* src = reinterpret_cast<const __m128i*>(pixel + x);
+        __m256i lo = _mm256_cvtepu16_epi32(_mm_loadu_si128(src));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm_loadu_si128(src + 1));
+        lo = _mm256_and_si256(_mm256_i32gather_epi32(t, lo, 2), lowMask);
+        hi = _mm256_and_si256(_mm256_i32gather_epi32(t, hi, 2), lowMask);
+        // packus works within the 128-bit halves, restore the order.
+        const __m256i out =
+            _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixel + x), out);
+      }
+      for (; x < gw; x++)
+        pixel[x] = t16[pixel[x]];
+      pixelStatistics.addRow(y, pixel);
+    }
+    return end_y;
+  }
+
+  const auto* t32 = reinterpret_cast<const uint32*>(t);
+  const __m256i mul = _mm256_set1_epi32(15700);
+  const __m256i ditherMask = _mm256_set1_epi32(2047);
+  const __m256i round = _mm256_set1_epi32(1024);
+
+  int y = start_y;
+  for (; y + 8 <= end_y; y += 8) {
+    std::array<ushort16*, 8> rows;
+    uint32 seeds[8];
+    for (int i = 0; i < 8; i++) {
+      rows[i] = reinterpret_cast<ushort16*>(getDataUncropped(0, y + i));
+      seeds[i] = getDitherSeed(uncropped_dim.x, y + i);
+    }
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(seeds));
+
+    int x = 0;
+    for (; x + 8 <= gw; x += 8) {
+      __m128i block[8];
+      for (int i = 0; i < 8; i++)
+        block[i] = _mm_loadu_si128(reinterpret_cast<__m128i*>(rows[i] + x));
+
+      // Now block[c] holds the pixels of column x + c of the 8 rows.
+      transpose8x8(block);
+
+      for (auto& column : block) {
+        const __m256i lookup =
+            _mm256_i32gather_epi32(t, _mm256_cvtepu16_epi32(column), 4);
+        const __m256i base = _mm256_and_si256(lookup, lowMask);
+        const __m256i delta = _mm256_srli_epi32(lookup, 16);
+
+        v = _mm256_add_epi32(
+            _mm256_mullo_epi32(mul, _mm256_and_si256(v, lowMask)),
+            _mm256_srli_epi32(v, 16));
+
+        __m256i pix =
+            _mm256_mullo_epi32(delta, _mm256_and_si256(v, ditherMask));
+        pix = _mm256_srli_epi32(_mm256_add_epi32(pix, round), 12);
+        pix = _mm256_min_epu32(_mm256_add_epi32(base, pix), lowMask);
+
+        column = _mm256_castsi256_si128(
+            _mm256_permute4x64_epi64(_mm256_packus_epi32(pix, pix), 0x08));
+      }
+
+      transpose8x8(block);
+
+      for (int i = 0; i < 8; i++)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rows[i] + x), block[i]);
+    }
+
+    // The rest of the columns, continuing each row's random numbers.
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(seeds), v);
+    for (int i = 0; i < 8; i++) {
+      for (int col = x; col < gw; col++)
+        rows[i][col] = ditherLookup(t32, rows[i][col], &seeds[i]);
+      pixelStatistics.addRow(y + i, rows[i]);
+    }
+  }
+
+  return y;
+}
+
+#endif
+
 } // namespace rawspeed
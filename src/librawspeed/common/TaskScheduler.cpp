@@ -0,0 +1,407 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "common/TaskScheduler.h"
+#include "common/Common.h" // for rawspeed_get_number_of_processor_cores
+#include <algorithm>       // for max, min, find
+#include <cassert>         // for assert
+#include <utility>         // for move
+
+#if defined(__linux__)
+#include <pthread.h> // for pthread_setaffinity_np
+#include <sched.h>   // for cpu_set_t, CPU_SET, CPU_ZERO
+#endif
+
+namespace rawspeed {
+
+namespace {
+
+void pinThread(std::thread* thread, int cpu) {
+#if defined(__linux__)
+  if (cpu < 0 || cpu >= CPU_SETSIZE)
+    return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  // Failure is not fatal, the thread will just float.
+  (void)pthread_setaffinity_np(thread->native_handle(), sizeof(set), &set);
+#else
+  // Not supported, the thread will just float.
+  (void)thread;
+  (void)cpu;
+#endif
+}
+
+} // namespace
+
+struct ThreadPool::Batch {
+  const std::function<void(int)>* const task;
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int remaining; // guarded by mutex
+
+  Batch(const std::function<void(int)>* task_, int numTasks)
+      : task(task_), remaining(numTasks) {}
+};
+
+ThreadPool::ThreadPool(int concurrency_, const std::vector<int>& cpus)
+    : concurrency(std::max(1, concurrency_)) {
+  // The thread calling execute() is the "last" worker.
+  const int numThreads = concurrency - 1;
+
+  queues.reserve(numThreads + 1);
+  for (int i = 0; i < numThreads + 1; ++i)
+    queues.emplace_back(std::make_unique<Queue>());
+
+  threads.reserve(numThreads);
+  for (int i = 0; i < numThreads; ++i) {
+    threads.emplace_back([this, i]() { workerLoop(i); });
+
+    if (!cpus.empty())
+      pinThread(&threads.back(), cpus[i % cpus.size()]);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(sleepMutex);
+    shuttingDown = true;
+  }
+  wakeup.notify_all();
+
+  for (auto& thread : threads)
+    thread.join();
+}
+
+int ThreadPool::getQueueIndex() const {
+  const auto id = std::this_thread::get_id();
+  for (int i = 0; i < static_cast<int>(threads.size()); ++i) {
+    if (threads[i].get_id() == id)
+      return i;
+  }
+  // Not one of ours, use the shared queue.
+  return static_cast<int>(threads.size());
+}
+
+bool ThreadPool::pop(int self, Task* task) {
+  const int numQueues = queues.size();
+
+  // LIFO from our own queue, that is what is most likely to be in cache.
+  {
+    Queue& q = *queues[self];
+    std::lock_guard<std::mutex> guard(q.mutex);
+    if (!q.tasks.empty()) {
+      *task = q.tasks.back();
+      q.tasks.pop_back();
+      --pending;
+      return true;
+    }
+  }
+
+  // FIFO from everyone else's.
+  for (int i = 1; i < numQueues; ++i) {
+    Queue& q = *queues[(self + i) % numQueues];
+    std::lock_guard<std::mutex> guard(q.mutex);
+    if (!q.tasks.empty()) {
+      *task = q.tasks.front();
+      q.tasks.pop_front();
+      --pending;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::run(const Task& task) {
+  Batch& batch = *task.batch;
+
+  (*batch.task)(task.index);
+
+  // NOTE: the notification must happen with the mutex held, the batch lives
+  // on the stack of the thread that is waiting for it.
+  std::lock_guard<std::mutex> guard(batch.mutex);
+  if (--batch.remaining == 0)
+    batch.done.notify_all();
+}
+
+void ThreadPool::workerLoop(int self) {
+  while (true) {
+    Task task;
+    if (pop(self, &task)) {
+      run(task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wakeup.wait(lock, [this]() { return shuttingDown || pending > 0; });
+    if (shuttingDown)
+      return;
+  }
+}
+
+void ThreadPool::execute(int numTasks, const std::function<void(int)>& task) {
+  assert(numTasks >= 0);
+
+  if (numTasks <= 1 || threads.empty()) {
+    for (int i = 0; i < numTasks; ++i)
+      task(i);
+    return;
+  }
+
+  Batch batch(&task, numTasks);
+
+  const int self = getQueueIndex();
+  const int numQueues = queues.size();
+
+  // Deal the tasks round-robin, starting with our own queue. We pop our own
+  // queue from the back, so put the tasks in there in the reverse order.
+  for (int i = numTasks - 1; i >= 0; --i) {
+    Queue& q = *queues[(self + i) % numQueues];
+    std::lock_guard<std::mutex> guard(q.mutex);
+    q.tasks.push_back({&batch, i});
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(sleepMutex);
+    pending += numTasks;
+  }
+  wakeup.notify_all();
+
+  // Help out while our batch is not done. We may end up running tasks from
+  // some other batches, that is fine, they need to be run anyway.
+  while (true) {
+    {
+      std::lock_guard<std::mutex> guard(batch.mutex);
+      if (batch.remaining == 0)
+        return;
+    }
+
+    Task t;
+    if (!pop(self, &t))
+      break;
+    run(t);
+  }
+
+  // Nothing left to steal, all the remaining tasks of this batch are being run
+  // by the other threads right now.
+  std::unique_lock<std::mutex> lock(batch.mutex);
+  batch.done.wait(lock, [&batch]() { return batch.remaining == 0; });
+}
+
+namespace {
+
+// The LimitedExecutors whose slots the current thread is holding, innermost
+// last.
+thread_local std::vector<const LimitedExecutor*> heldSlots;
+
+} // namespace
+
+LimitedExecutor::LimitedExecutor(std::shared_ptr<Executor> parent_,
+                                 int limit_)
+    : parent(std::move(parent_)), limit(std::max(1, limit_)),
+      available(limit) {
+  assert(parent);
+}
+
+int LimitedExecutor::getConcurrency() const {
+  return std::min(limit, parent->getConcurrency());
+}
+
+bool LimitedExecutor::isHeldByCurrentThread() const {
+  return std::find(heldSlots.begin(), heldSlots.end(), this) !=
+         heldSlots.end();
+}
+
+bool LimitedExecutor::tryAcquire() {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (available == 0)
+      return false;
+    --available;
+  }
+  heldSlots.push_back(this);
+  return true;
+}
+
+void LimitedExecutor::acquire() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [this]() { return available > 0; });
+    --available;
+  }
+  heldSlots.push_back(this);
+}
+
+void LimitedExecutor::release() {
+  assert(!heldSlots.empty() && heldSlots.back() == this);
+  heldSlots.pop_back();
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    ++available;
+  }
+  released.notify_one();
+}
+
+void LimitedExecutor::drain(int numTasks, const std::function<void(int)>& task,
+                            std::atomic<int>* next) {
+  for (int i = (*next)++; i < numTasks; i = (*next)++)
+    task(i);
+}
+
+void LimitedExecutor::execute(int numTasks,
+                              const std::function<void(int)>& task) {
+  assert(numTasks >= 0);
+
+  // Each runner takes a slot, unless its thread already holds one, and then
+  // keeps taking the next task until there are none left. The runners that
+  // find no free slot just return.
+  std::atomic<int> next{0};
+  parent->execute(std::min(numTasks, limit),
+                  [this, numTasks, &task, &next](int /*runner*/) {
+                    const bool held = isHeldByCurrentThread();
+                    if (!held && !tryAcquire())
+                      return;
+                    drain(numTasks, task, &next);
+                    if (!held)
+                      release();
+                  });
+
+  if (next >= numTasks)
+    return;
+
+  // All the runners found the slots taken by the other calls. Those make
+  // progress on their own, so waiting for one of their slots can't deadlock.
+  if (isHeldByCurrentThread()) {
+    drain(numTasks, task, &next);
+    return;
+  }
+  acquire();
+  drain(numTasks, task, &next);
+  release();
+}
+
+namespace {
+
+std::mutex executorMutex;
+std::shared_ptr<Executor> executorInstance;
+bool executorIsDefault = false;
+
+} // namespace
+
+void setExecutor(std::shared_ptr<Executor> executor) {
+  std::lock_guard<std::mutex> guard(executorMutex);
+  executorInstance = std::move(executor);
+  executorIsDefault = false;
+}
+
+std::shared_ptr<Executor> getExecutor() {
+  std::lock_guard<std::mutex> guard(executorMutex);
+
+  if (executorInstance && !executorIsDefault)
+    return executorInstance;
+
+  // The default pool follows rawspeed_get_number_of_processor_cores(),
+  // which is allowed to change over time (e.g. rsbench does that).
+  const int cores = std::max(1, rawspeed_get_number_of_processor_cores());
+  if (!executorInstance || executorInstance->getConcurrency() != cores) {
+    executorInstance = std::make_shared<ThreadPool>(cores);
+    executorIsDefault = true;
+  }
+
+  return executorInstance;
+}
+
+int Parallelism::getNumThreads(int n) const {
+  if (n <= 1 || maxThreads == 1)
+    return std::max(0, std::min(n, 1));
+
+  int threads =
+      executor ? executor->getConcurrency() : getExecutor()->getConcurrency();
+  if (maxThreads > 0)
+    threads = std::min(threads, maxThreads);
+  return std::max(1, std::min(threads, n));
+}
+
+Parallelism Parallelism::getLimited() const {
+  if (maxThreads <= 0)
+    return *this;
+
+  std::shared_ptr<Executor> base = executor ? executor : getExecutor();
+
+  // Already limited to no more than that?
+  const auto* limited = dynamic_cast<const LimitedExecutor*>(base.get());
+  if (limited && limited->getLimit() <= maxThreads)
+    return *this;
+
+  return Parallelism(maxThreads,
+                     std::make_shared<LimitedExecutor>(std::move(base),
+                                                       maxThreads));
+}
+
+void parallelForImpl(const Parallelism& parallelism, int begin, int end,
+                     Schedule schedule,
+                     const std::function<void(int, int)>& body) {
+  const int size = end - begin;
+  if (size <= 0)
+    return;
+
+  if (size == 1 || parallelism.maxThreads == 1) {
+    body(begin, end);
+    return;
+  }
+
+  const std::shared_ptr<Executor> executor =
+      parallelism.executor ? parallelism.executor : getExecutor();
+  int threads = std::min(executor->getConcurrency(), size);
+  if (parallelism.maxThreads > 0)
+    threads = std::min(threads, parallelism.maxThreads);
+  if (threads <= 1) {
+    body(begin, end);
+    return;
+  }
+
+  switch (schedule) {
+  case Schedule::Static: {
+    const int perThread = static_cast<int>(roundUpDivision(size, threads));
+    const int numChunks = static_cast<int>(roundUpDivision(size, perThread));
+    executor->execute(numChunks, [begin, end, perThread, &body](int i) {
+      const int chunkBegin = begin + i * perThread;
+      const int chunkEnd = std::min(chunkBegin + perThread, end);
+      body(chunkBegin, chunkEnd);
+    });
+    break;
+  }
+  case Schedule::Dynamic: {
+    // Exactly `threads` tasks, each of which keeps grabbing the next
+    // iteration until there are none left.
+    std::atomic<int> next{begin};
+    executor->execute(threads, [end, &next, &body](int /*task*/) {
+      for (int i = next++; i < end; i = next++)
+        body(i, i + 1);
+    });
+    break;
+  }
+  }
+}
+
+} // namespace rawspeed
@@ -0,0 +1,193 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#pragma once
+
+#include <atomic>             // for atomic
+#include <condition_variable> // for condition_variable
+#include <deque>              // for deque
+#include <functional>         // for function
+#include <memory>             // for unique_ptr, shared_ptr
+#include <mutex>              // for mutex
+#include <thread>             // for thread
+#include <utility>            // for move
+#include <vector>             // for vector
+
+namespace rawspeed {
+
+// The interface through which all of the library's parallel work is run.
+// An embedder (e.g. one that already has a TBB arena) may supply its own
+// implementation via setExecutor(); otherwise the built-in ThreadPool is used.
+class Executor {
+public:
+  virtual ~Executor() = default;
+
+  // How many tasks can usefully run at the same time.
+  virtual int getConcurrency() const = 0;
+
+  // Run task(0) ... task(numTasks - 1), each exactly once, in any order and
+  // possibly concurrently. Must not return until all of them have finished.
+  // The tasks never throw. Calls may nest: a task may call execute() again.
+  virtual void execute(int numTasks, const std::function<void(int)>& task) = 0;
+};
+
+// A persistent pool of worker threads. Each worker (and the external callers,
+// collectively) owns a task deque; idle threads steal from the others' deques.
+// The thread that called execute() participates until its batch is done,
+// so nested parallelism does not deadlock, nor does it spawn new threads.
+// If a CPU set is given, the worker threads are pinned to it, round-robin.
+class ThreadPool final : public Executor {
+  struct Batch;
+
+  struct Task {
+    Batch* batch;
+    int index;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  const int concurrency;
+
+  // One per worker thread, and the last one is shared by external callers.
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+
+  std::mutex sleepMutex;
+  std::condition_variable wakeup;
+  std::atomic<int> pending{0}; // number of queued, not yet taken tasks.
+  bool shuttingDown = false;
+
+  int getQueueIndex() const;
+  bool pop(int self, Task* task);
+  static void run(const Task& task);
+  void workerLoop(int self);
+
+public:
+  explicit ThreadPool(int concurrency_, const std::vector<int>& cpus = {});
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool() override;
+
+  int getConcurrency() const override { return concurrency; }
+
+  void execute(int numTasks, const std::function<void(int)>& task) override;
+};
+
+// Runs the tasks on another executor, but on at most `limit` threads at once,
+// for all of its execute() calls together, nested or concurrent. A thread that
+// is already running one of its tasks does not take another slot when it calls
+// execute() again. See Parallelism::getLimited().
+class LimitedExecutor final : public Executor {
+  const std::shared_ptr<Executor> parent;
+  const int limit;
+
+  std::mutex mutex;
+  std::condition_variable released;
+  int available; // guarded by mutex
+
+  bool isHeldByCurrentThread() const;
+  bool tryAcquire();
+  void acquire();
+  void release();
+
+  // Runs the tasks that are not yet taken, on the calling thread.
+  static void drain(int numTasks, const std::function<void(int)>& task,
+                    std::atomic<int>* next);
+
+public:
+  LimitedExecutor(std::shared_ptr<Executor> parent_, int limit_);
+
+  int getLimit() const { return limit; }
+
+  int getConcurrency() const override;
+
+  void execute(int numTasks, const std::function<void(int)>& task) override;
+};
+
+// Replace the process-wide executor. Passing nullptr reverts to the default
+// ThreadPool, sized by rawspeed_get_number_of_processor_cores().
+void setExecutor(std::shared_ptr<Executor> executor);
+
+std::shared_ptr<Executor> getExecutor();
+
+// How much of the machine one decode (or any other job) may use. This is what
+// allows running many decodes concurrently in one process, each with a small
+// budget, while an interactive one gets all of the cores.
+struct Parallelism final {
+  // Use at most this many threads at once, see getLimited(). 0 means no limit
+  // beyond the concurrency of the executor.
+  int maxThreads = 0;
+
+  // Where to run. nullptr means the process-wide executor, see getExecutor().
+  // To keep a decode on a specific set of CPUs, give it a ThreadPool that
+  // was constructed with that CPU set.
+  std::shared_ptr<Executor> executor;
+
+  Parallelism() = default;
+  explicit Parallelism(int maxThreads_,
+                       std::shared_ptr<Executor> executor_ = nullptr)
+      : maxThreads(maxThreads_), executor(std::move(executor_)) {}
+
+  // How many threads would actually be used for n independent iterations.
+  int getNumThreads(int n) const;
+
+  // On its own, maxThreads only limits how many tasks each parallel loop
+  // creates; the loops that are nested in them, or run concurrently, each get
+  // as many again. The copies of the returned Parallelism share one
+  // LimitedExecutor, so maxThreads holds for all of their loops together.
+  Parallelism getLimited() const;
+};
+
+enum class Schedule {
+  // Contiguous, equally-sized chunks, one per thread.
+  Static,
+  // Iterations are handed out one by one, for iterations of wildly varying
+  // cost.
+  Dynamic,
+};
+
+void parallelForImpl(const Parallelism& parallelism, int begin, int end,
+                     Schedule schedule,
+                     const std::function<void(int, int)>& body);
+
+// Splits [begin, end) into contiguous chunks, and calls body(chunkBegin,
+// chunkEnd) for each of them, in parallel. Useful when some state (a scratch
+// buffer, a list of bad pixels, ...) is needed per thread.
+inline void parallelForChunks(const Parallelism& parallelism, int begin,
+                              int end,
+                              const std::function<void(int, int)>& body) {
+  parallelForImpl(parallelism, begin, end, Schedule::Static, body);
+}
+
+// Calls body(i) for each i in [begin, end), in parallel.
+template <typename Body>
+inline void parallelFor(const Parallelism& parallelism, int begin, int end,
+                        Body body, Schedule schedule = Schedule::Static) {
+  parallelForImpl(parallelism, begin, end, schedule,
+                  [&body](int chunkBegin, int chunkEnd) {
+                    for (int i = chunkBegin; i < chunkEnd; ++i)
+                      body(i);
+                  });
+}
+
+} // namespace rawspeed
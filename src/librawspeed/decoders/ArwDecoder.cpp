@@ -208,7 +208,9 @@ RawImage ArwDecoder::decodeRawInternal() {
     for (uint32 j = sony_curve[i] + 1; j <= sony_curve[i+1]; j++)
       curve[j] = curve[j-1] + (1 << i);
 
-  RawImageCurveGuard curveHandler(&mRaw, curve, uncorrectedRawValues);
+  // If binned, the pixels are the averages of the looked-up values.
+  RawImageCurveGuard curveHandler(&mRaw, curve, uncorrectedRawValues,
+                                  /*canDefer=*/mRaw->binning <= 1);
 
   uint32 c2 = counts->getU32();
   uint32 off = offsets->getU32();
@@ -228,6 +230,8 @@ RawImage ArwDecoder::decodeRawInternal() {
   } else
     DecodeARW2(input, width, height, bitPerPixel);
 
+  curveHandler.finish();
+
   return mRaw;
 }
 
@@ -262,7 +266,7 @@ void ArwDecoder::DecodeARW2(const ByteStream& input, uint32 w, uint32 h,
 
   if (bpp == 8) {
     SonyArw2Decompressor a2(mRaw, input);
-    mRaw->createData();
+    mRaw->createBinnedData();
     a2.decompress();
     return;
   } // End bpp = 8
@@ -44,6 +44,7 @@ public:
 
   RawImage decodeRawInternal() override;
   void decodeMetaDataInternal(const CameraMetaData* meta) override;
+  bool isIntraFileParallel() const override { return true; }
 
 protected:
   void ParseA100WB();
@@ -0,0 +1,181 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "decoders/BatchDecoder.h"
+#include "common/Point.h"         // for iPoint2D
+#include "decoders/RawDecoder.h"  // for RawDecoder
+#include "io/Buffer.h"            // for Buffer
+#include "io/FileReader.h"        // for FileReader
+#include "parsers/RawParser.h"    // for RawParser
+#include <algorithm>              // for stable_sort
+#include <cassert>                // for assert
+#include <exception>              // for exception
+#include <limits>                 // for numeric_limits
+#include <memory>                 // for unique_ptr
+#include <utility>                // for move
+
+namespace rawspeed {
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+} // namespace
+
+std::vector<BatchDecodeResult>
+BatchDecoder::decodeAll(const std::vector<const Buffer*>& inputs,
+                        std::vector<BatchDecodeResult> results,
+                        std::chrono::steady_clock::time_point start) {
+  assert(inputs.size() == results.size());
+  const int numFiles = inputs.size();
+
+  // One limit for all of the files together, and all of their threads, see
+  // Parallelism::getLimited(). With no explicit limit, that is the executor.
+  const Parallelism budget =
+      Parallelism(parallelism.getNumThreads(std::numeric_limits<int>::max()),
+                  parallelism.executor)
+          .getLimited();
+
+  // First, figure out what each of the files is. That only parses the headers.
+  std::vector<std::unique_ptr<RawDecoder>> decoders(numFiles);
+  parallelFor(
+      budget, 0, numFiles,
+      [this, &inputs, &results, &decoders](int i) {
+        if (!inputs[i])
+          return;
+
+        // Non-raw files are rejected without throwing.
+        RawParser parser(inputs[i]);
+        RawParser::Status status;
+        decoders[i] = parser.tryGetDecoder(meta, &status, &results[i].error);
+        results[i].unknownFormat = status == RawParser::Status::UnknownFormat;
+        assert((status == RawParser::Status::OK) == bool(decoders[i]));
+      },
+      Schedule::Dynamic);
+
+  // The serial formats first, largest first, so that the threads that get the
+  // last ones of those don't finish much later than the rest. The parallel
+  // formats come last: each file holds one thread of the budget for as long
+  // as it is being decoded, and their parallel loops get whichever threads of
+  // the budget are not busy with the other files.
+  std::vector<int> order;
+  order.reserve(numFiles);
+  for (int i = 0; i < numFiles; ++i) {
+    if (decoders[i])
+      order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&inputs, &decoders](int a, int b) {
+                     const bool parallelA = decoders[a]->isIntraFileParallel();
+                     const bool parallelB = decoders[b]->isIntraFileParallel();
+                     if (parallelA != parallelB)
+                       return parallelB;
+                     return inputs[a]->getSize() > inputs[b]->getSize();
+                   });
+
+  const Parallelism serial(1, budget.executor);
+
+  parallelFor(
+      budget, 0, order.size(),
+      [this, &order, &results, &decoders, &budget, &serial](int k) {
+        const int i = order[k];
+        BatchDecodeResult& result = results[i];
+        std::unique_ptr<RawDecoder> decoder = std::move(decoders[i]);
+
+        const auto begin = std::chrono::steady_clock::now();
+        try {
+          decoder->parallelism =
+              decoder->isIntraFileParallel() ? budget : serial;
+          decoder->failOnUnknown = failOnUnknown;
+          decoder->interpolateBadPixels = interpolateBadPixels;
+          decoder->applyCrop = applyCrop;
+          decoder->uncorrectedRawValues = uncorrectedRawValues;
+          decoder->fujiRotate = fujiRotate;
+
+          decoder->checkSupport(meta);
+          decoder->decodeRaw();
+          decoder->decodeMetaData(meta);
+          result.image = decoder->mRaw;
+        } catch (std::exception& e) {
+          result.error = e.what();
+        }
+        result.seconds = secondsSince(begin);
+      },
+      Schedule::Dynamic);
+
+  stats = BatchDecodeStatistics();
+  stats.files = numFiles;
+  for (int i = 0; i < numFiles; ++i) {
+    if (inputs[i])
+      stats.bytes += inputs[i]->getSize();
+
+    if (!results[i].isOk()) {
+      stats.failed++;
+      if (results[i].unknownFormat)
+        stats.unknownFormat++;
+      continue;
+    }
+
+    stats.pixels += results[i].image->getUncroppedDim().area();
+  }
+  stats.seconds = secondsSince(start);
+
+  return results;
+}
+
+std::vector<BatchDecodeResult>
+BatchDecoder::decode(const std::vector<const Buffer*>& inputs) {
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<BatchDecodeResult> results(inputs.size());
+  return decodeAll(inputs, std::move(results), start);
+}
+
+std::vector<BatchDecodeResult>
+BatchDecoder::decode(const std::vector<std::string>& fileNames) {
+  const auto start = std::chrono::steady_clock::now();
+  const int numFiles = fileNames.size();
+
+  std::vector<BatchDecodeResult> results(numFiles);
+  std::vector<std::unique_ptr<const Buffer>> buffers(numFiles);
+  parallelFor(
+      parallelism, 0, numFiles,
+      [&fileNames, &results, &buffers](int i) {
+        try {
+          FileReader reader(fileNames[i].c_str());
+          buffers[i] = reader.readFile();
+        } catch (std::exception& e) {
+          results[i].error = e.what();
+        }
+      },
+      Schedule::Dynamic);
+
+  std::vector<const Buffer*> inputs(numFiles);
+  for (int i = 0; i < numFiles; ++i)
+    inputs[i] = buffers[i].get();
+
+  return decodeAll(inputs, std::move(results), start);
+}
+
+} // namespace rawspeed
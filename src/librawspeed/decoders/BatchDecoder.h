@@ -0,0 +1,118 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#pragma once
+
+#include "common/Common.h"        // for uint64
+#include "common/RawImage.h"      // for RawImage
+#include "common/TaskScheduler.h" // for Parallelism
+#include <chrono>                 // for steady_clock
+#include <string>                 // for string
+#include <vector>                 // for vector
+
+namespace rawspeed {
+
+class Buffer;
+
+class CameraMetaData;
+
+struct BatchDecodeResult final {
+  // Only meaningful if the decode succeeded.
+  RawImage image = RawImage::create();
+
+  // Empty if the decode succeeded, the exception message otherwise.
+  std::string error;
+
+  // The decode failed because the file is not a raw at all, see
+  // RawParser::tryGetDecoder().
+  bool unknownFormat = false;
+
+  // Wall time spent decoding this file.
+  double seconds = 0;
+
+  bool isOk() const { return error.empty(); }
+};
+
+struct BatchDecodeStatistics final {
+  int files = 0;
+  int failed = 0;
+  int unknownFormat = 0; // of the failed ones, how many were not raws at all
+
+  uint64 bytes = 0;  // total size of the inputs
+  uint64 pixels = 0; // total uncropped area of the successfully decoded images
+
+  double seconds = 0; // wall time for the whole batch
+
+  double getFilesPerSecond() const { return seconds > 0 ? files / seconds : 0; }
+  double getBytesPerSecond() const { return seconds > 0 ? bytes / seconds : 0; }
+  double getPixelsPerSecond() const {
+    return seconds > 0 ? pixels / seconds : 0;
+  }
+};
+
+// Decodes many images at once, balancing between decoding several files at
+// the same time, and decoding each one of them with several threads.
+//
+// Formats that can only be decoded by one thread (see
+// RawDecoder::isIntraFileParallel()) are scheduled first, largest first, one
+// thread each. The rest come last, and share the whole budget, so that the
+// threads that are done with the serial ones help out with their loops.
+class BatchDecoder final {
+  const CameraMetaData* meta;
+
+  BatchDecodeStatistics stats;
+
+  // The inputs that are nullptr already have an error in their result.
+  std::vector<BatchDecodeResult>
+  decodeAll(const std::vector<const Buffer*>& inputs,
+            std::vector<BatchDecodeResult> results,
+            std::chrono::steady_clock::time_point start);
+
+public:
+  // The metadata is shared between all the decodes, and must outlive this.
+  explicit BatchDecoder(const CameraMetaData* meta_) : meta(meta_) {}
+
+  // The total budget for the whole batch: no more threads than that are used
+  // at once, however many files are decoded at the same time.
+  Parallelism parallelism;
+
+  // These are passed on to each RawDecoder, see there.
+  bool failOnUnknown = false;
+  bool interpolateBadPixels = true;
+  bool applyCrop = true;
+  bool uncorrectedRawValues = false;
+  bool fujiRotate = true;
+
+  // The results are in the same order as the inputs. A failure to decode one
+  // of the files does not affect the others. The buffers must stay valid until
+  // this returns.
+  std::vector<BatchDecodeResult>
+  decode(const std::vector<const Buffer*>& inputs);
+
+  // Same, but the files are read first. NOTE: all of them are kept in memory
+  // for the duration of the batch.
+  std::vector<BatchDecodeResult>
+  decode(const std::vector<std::string>& fileNames);
+
+  // Of the last batch.
+  const BatchDecodeStatistics& getStatistics() const { return stats; }
+};
+
+} // namespace rawspeed
@@ -104,6 +104,7 @@ RawImage Cr2Decoder::decodeOldFormat() {
     // Apply table
     if (!uncorrectedRawValues)
       mRaw->sixteenBitLookup();
+    curveHandler.finish();
   }
 
   return mRaw;
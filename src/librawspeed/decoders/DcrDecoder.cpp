@@ -107,6 +107,8 @@ RawImage DcrDecoder::decodeRawInternal() {
   KodakDecompressor k(mRaw, input, bps, uncorrectedRawValues);
   k.decompress();
 
+  curveHandler.finish();
+
   return mRaw;
 }
 
@@ -67,6 +67,8 @@ RawImage DcsDecoder::decodeRawInternal() {
   else
     u.decode8BitRaw<false>(width, height);
 
+  curveHandler.finish();
+
   return mRaw;
 }
 
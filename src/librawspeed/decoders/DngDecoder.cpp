@@ -20,6 +20,7 @@
 
 #include "rawspeedconfig.h" // for HAVE_JPEG, HAVE_ZLIB
 #include "decoders/DngDecoder.h"
+#include "common/CfaBinner.h"                      // for CfaBinner
 #include "common/Common.h"                         // for uint32, roundUpDi...
 #include "common/DngOpcodes.h"                     // for DngOpcodes
 #include "common/NORangesSet.h"                    // for set
@@ -37,7 +38,7 @@
 #include "tiff/TiffEntry.h"                        // for TiffEntry, TIFF_LONG
 #include "tiff/TiffIFD.h"                          // for TiffIFD, TiffRootIFD
 #include "tiff/TiffTag.h"                          // for ACTIVEAREA, TILEO...
-#include <algorithm>                               // for any_of
+#include <algorithm>                               // for any_of, all_of
 #include <array>                                   // for array, array<>::v...
 #include <cassert>                                 // for assert
 #include <limits>                                  // for numeric_limits
@@ -267,6 +268,26 @@ DngTilingDescription DngDecoder::getTilingDescription(const TiffIFD* raw) {
   return {mRaw->dim, static_cast<uint32>(mRaw->dim.x), yPerSlice};
 }
 
+// Only some of the decompressors can store the rows via a CfaBinner, and
+// the opcodes and the linearization are defined on the full-resolution image.
+bool DngDecoder::canBin(const TiffIFD* raw,
+                        const AbstractDngDecompressor& slices) const {
+  if (mRaw->binning <= 1 || (compression != 1 && compression != 7))
+    return false;
+
+  for (const TiffTag tag : {OPCODELIST1, OPCODELIST2, LINEARIZATIONTABLE}) {
+    if (raw->hasEntry(tag) && raw->getEntry(tag)->count > 0)
+      return false;
+  }
+
+  // Each tile must start at a band of the binner.
+  const auto bandSize = 2U * mRaw->binning;
+  return std::all_of(slices.slices.cbegin(), slices.slices.cend(),
+                     [bandSize](const DngSliceElement& e) {
+                       return e.offX % bandSize == 0 && e.offY % bandSize == 0;
+                     });
+}
+
 void DngDecoder::decodeData(const TiffIFD* raw, uint32 sample_format) {
   if (compression == 8 && sample_format != 3) {
     ThrowRDE("Only float format is supported for "
@@ -328,7 +349,10 @@ void DngDecoder::decodeData(const TiffIFD* raw, uint32 sample_format) {
 
   // FIXME: should we sort the tiles, to linearize the input reading?
 
-  mRaw->createData();
+  if (canBin(raw, slices))
+    mRaw->createBinnedData();
+  else
+    mRaw->createData();
 
   slices.decompress();
 }
@@ -360,6 +384,7 @@ RawImage DngDecoder::decodeRawInternal() {
 
   compression = raw->getEntry(COMPRESSION)->getU16();
 
+  auto statistics = mRaw->statistics;
   switch (sample_format) {
   case 1:
     mRaw = RawImage::create(TYPE_USHORT16);
@@ -372,6 +397,13 @@ RawImage DngDecoder::decodeRawInternal() {
              "format %u is not supported.",
              sample_format);
   }
+  mRaw->parallelism = parallelism;
+  mRaw->deferCurves = deferCurves;
+  mRaw->binning = binning;
+  mRaw->bufferProvider = bufferProvider;
+  mRaw->allocationPolicy = allocationPolicy;
+  mRaw->prefaultData = prefaultData;
+  mRaw->statistics = std::move(statistics);
 
   mRaw->isCFA = (raw->getEntry(PHOTOMETRICINTERPRETATION)->getU16() == 32803);
 
@@ -420,13 +452,17 @@ RawImage DngDecoder::decodeRawInternal() {
 }
 
 void DngDecoder::handleMetadata(const TiffIFD* raw) {
+  // The crops are specified in full-resolution pixels.
+  const iPoint2D fullDim = mRaw->getUnbinnedDim();
+  iRectangle2D activeArea(0, 0, fullDim.x, fullDim.y);
+
   // Crop
   if (raw->hasEntry(ACTIVEAREA)) {
     TiffEntry *active_area = raw->getEntry(ACTIVEAREA);
     if (active_area->count != 4)
       ThrowRDE("active area has %d values instead of 4", active_area->count);
 
-    const iRectangle2D fullImage(0, 0, mRaw->dim.x, mRaw->dim.y);
+    const iRectangle2D fullImage(0, 0, fullDim.x, fullDim.y);
 
     const auto corners = active_area->getU32Array(4);
     const iPoint2D topLeft(corners[1], corners[0]);
@@ -445,12 +481,13 @@ void DngDecoder::handleMetadata(const TiffIFD* raw) {
     crop.setTopLeft(topLeft);
     crop.setBottomRightAbsolute(bottomRight);
     assert(fullImage.isThisInside(fullImage));
+    activeArea = crop;
 
-    mRaw->subFrame(crop);
+    mRaw->subFrame(mRaw->getBinnedRect(crop));
   }
 
   if (raw->hasEntry(DEFAULTCROPORIGIN) && raw->hasEntry(DEFAULTCROPSIZE)) {
-    iRectangle2D cropped(0, 0, mRaw->dim.x, mRaw->dim.y);
+    iRectangle2D cropped(0, 0, activeArea.dim.x, activeArea.dim.y);
     TiffEntry *origin_entry = raw->getEntry(DEFAULTCROPORIGIN);
     TiffEntry *size_entry = raw->getEntry(DEFAULTCROPSIZE);
 
@@ -466,7 +503,7 @@ void DngDecoder::handleMetadata(const TiffIFD* raw) {
     if (cropped.isPointInsideInclusive(cropOrigin))
       cropped = iRectangle2D(cropOrigin, {0, 0});
 
-    cropped.dim = mRaw->dim - cropped.pos;
+    cropped.dim = activeArea.dim - cropped.pos;
 
     /* Read size (sometimes is rational so use float) */
     const auto sz = size_entry->getFloatArray(2);
@@ -477,12 +514,19 @@ void DngDecoder::handleMetadata(const TiffIFD* raw) {
       ThrowRDE("Error decoding default crop size");
 
     iPoint2D size(sz[0], sz[1]);
-    if ((size + cropped.pos).isThisInside(mRaw->dim))
+    if ((size + cropped.pos).isThisInside(activeArea.dim))
       cropped.dim = size;
 
     if (!cropped.hasPositiveArea())
       ThrowRDE("No positive crop area");
 
+    if (mRaw->isBinned()) {
+      // Relative to the (binned) active area.
+      cropped =
+          mRaw->getBinnedRect({activeArea.pos + cropped.pos, cropped.dim});
+      cropped.pos -= mRaw->getCropOffset();
+    }
+
     mRaw->subFrame(cropped);
   }
   if (mRaw->dim.area() <= 0)
@@ -512,6 +556,7 @@ void DngDecoder::handleMetadata(const TiffIFD* raw) {
     RawImageCurveGuard curveHandler(&mRaw, table, uncorrectedRawValues);
     if (!uncorrectedRawValues)
       mRaw->sixteenBitLookup();
+    curveHandler.finish();
   }
 
   if (mRaw->getDataType() == TYPE_USHORT16) {
@@ -648,8 +693,9 @@ bool DngDecoder::decodeMaskedAreas(const TiffIFD* raw) {
   /* Since we may both have short or int, copy it to int array. */
   auto rects = masked->getU32Array(nrects*4);
 
-  const iRectangle2D fullImage(0, 0, mRaw->getUncroppedDim().x,
-                               mRaw->getUncroppedDim().y);
+  const iPoint2D fullDim = mRaw->isBinned() ? mRaw->getUnbinnedDim()
+                                            : mRaw->getUncroppedDim();
+  const iRectangle2D fullImage(0, 0, fullDim.x, fullDim.y);
   const iPoint2D top = mRaw->getCropOffset();
 
   for (uint32 i = 0; i < nrects; i++) {
@@ -661,6 +707,16 @@ bool DngDecoder::decodeMaskedAreas(const TiffIFD* raw) {
           (topleft < bottomright)))
       ThrowRDE("Bad masked area.");
 
+    if (mRaw->isBinned()) {
+      iRectangle2D area;
+      area.setAbsolute(topleft, bottomright);
+      area = mRaw->getBinnedRect(area);
+      if (!area.hasPositiveArea())
+        continue;
+      topleft = area.getTopLeft();
+      bottomright = area.getBottomRight();
+    }
+
     // Is this a horizontal box, only add it if it covers the active width of the image
     if (topleft.x <= top.x && bottomright.x >= (mRaw->dim.x + top.x)) {
       mRaw->blackAreas.emplace_back(topleft.y, bottomright.y - topleft.y,
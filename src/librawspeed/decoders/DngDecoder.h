@@ -32,6 +32,7 @@ class CameraMetaData;
 
 class Buffer;
 
+class AbstractDngDecompressor;
 struct DngTilingDescription;
 
 class DngDecoder final : public AbstractTiffDecoder
@@ -43,6 +44,7 @@ public:
 
   RawImage decodeRawInternal() override;
   void decodeMetaDataInternal(const CameraMetaData* meta) override;
+  bool isIntraFileParallel() const override { return true; }
   void checkSupportInternal(const CameraMetaData* meta) override;
 
 protected:
@@ -51,6 +53,7 @@ protected:
   void dropUnsuportedChunks(std::vector<const TiffIFD*>* data);
   void parseCFA(const TiffIFD* raw);
   DngTilingDescription getTilingDescription(const TiffIFD* raw);
+  bool canBin(const TiffIFD* raw, const AbstractDngDecompressor& slices) const;
   void decodeData(const TiffIFD* raw, uint32 sample_format);
   void handleMetadata(const TiffIFD* raw);
   bool decodeMaskedAreas(const TiffIFD* raw);
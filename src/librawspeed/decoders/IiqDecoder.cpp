@@ -26,6 +26,7 @@
 #include "common/Common.h"                      // for uint32, ushort16
 #include "common/Point.h"                       // for iPoint2D
 #include "common/Spline.h"                      // for Spline, Spline<>::va...
+#include "common/TaskScheduler.h"               // for parallelFor
 #include "decoders/RawDecoder.h"                // for RawDecoder::(anonymous)
 #include "decoders/RawDecoderException.h"       // for ThrowRDE
 #include "decompressors/PhaseOneDecompressor.h" // for PhaseOneStrip, Phase...
@@ -43,13 +44,50 @@
 #include <iterator>                             // for advance, next, begin
 #include <memory>                               // for unique_ptr
 #include <string>                               // for operator==, string
-#include <utility>                              // for move
+#include <utility>                              // for move, pair
 #include <vector>                               // for vector
 
 namespace rawspeed {
 
 class CameraMetaData;
 
+namespace {
+
+// The columns that IiqDecoder::correctBadColumn() reads or writes,
+// as sorted, disjoint [begin, end) ranges.
+std::vector<std::pair<int, int>>
+getBadColumnsNeighbourhood(std::vector<ushort16> badColumns, int width) {
+  std::sort(badColumns.begin(), badColumns.end());
+
+  std::vector<std::pair<int, int>> ranges;
+  for (const int col : badColumns) {
+    const int begin = std::max(0, col - 2);
+    const int end = std::min(width, col + 3);
+    if (!ranges.empty() && begin <= ranges.back().second)
+      ranges.back().second = std::max(ranges.back().second, end);
+    else
+      ranges.emplace_back(begin, end);
+  }
+  return ranges;
+}
+
+// The columns [0, width) that are not within the sorted, disjoint ranges.
+std::vector<std::pair<int, int>>
+getComplement(const std::vector<std::pair<int, int>>& ranges, int width) {
+  std::vector<std::pair<int, int>> complement;
+  int begin = 0;
+  for (const auto& range : ranges) {
+    if (begin < range.first)
+      complement.emplace_back(begin, range.first);
+    begin = range.second;
+  }
+  if (begin < width)
+    complement.emplace_back(begin, width);
+  return complement;
+}
+
+} // namespace
+
 bool IiqDecoder::isAppropriateDecoder(const Buffer* file) {
   assert(file);
 
@@ -213,10 +251,38 @@ RawImage IiqDecoder::decodeRawInternal() {
 
   PhaseOneDecompressor p(mRaw, std::move(strips));
   mRaw->createData();
-  p.decompress();
 
+  CorrectionEntries corrections;
   if (correction_meta_data.getSize() != 0 && iiq)
-    CorrectPhaseOneC(correction_meta_data, split_row, split_col);
+    corrections = getCorrectionEntries(correction_meta_data);
+
+  const std::vector<ushort16> badColumns =
+      handleSensorDefects(corrections.sensorDefects);
+
+  // The quadrant multipliers are applied by the decompressor, right as the
+  // rows are decoded. But if the bad columns are to be corrected first,
+  // the columns that the correction reads or writes are done afterwards.
+  PhaseOneQuadrantCurves curves;
+  std::vector<std::pair<int, int>> laterColumns;
+  if (corrections.haveQuadrantMultipliers) {
+    curves = getQuadrantCurves(corrections.quadrantMultipliers, split_row,
+                               split_col);
+    if (corrections.sensorDefectsFirst)
+      laterColumns = getBadColumnsNeighbourhood(badColumns, width);
+    p.setQuadrantCurves(&curves, getComplement(laterColumns, width));
+  }
+
+  p.decompress();
+
+  for (const ushort16 col : badColumns)
+    correctBadColumn(col);
+
+  if (!laterColumns.empty()) {
+    parallelFor(mRaw->parallelism, 0, mRaw->dim.y, [&](int row) {
+      for (const auto& range : laterColumns)
+        curves.apply(mRaw, row, range.first, range.second);
+    });
+  }
 
   for (int i = 0; i < 3; i++)
     mRaw->metadata.wbCoeffs[i] = wb.getFloat();
@@ -224,8 +290,8 @@ RawImage IiqDecoder::decodeRawInternal() {
   return mRaw;
 }
 
-void IiqDecoder::CorrectPhaseOneC(ByteStream meta_data, uint32 split_row,
-                                  uint32 split_col) {
+IiqDecoder::CorrectionEntries
+IiqDecoder::getCorrectionEntries(ByteStream meta_data) const {
   meta_data.skipBytes(8);
   const uint32 bytes_to_entries = meta_data.getU32();
   meta_data.setPosition(bytes_to_entries);
@@ -236,6 +302,7 @@ void IiqDecoder::CorrectPhaseOneC(ByteStream meta_data, uint32 split_row,
   ByteStream entries(meta_data.getStream(entries_count, 12));
   meta_data.setPosition(0);
 
+  CorrectionEntries corrections;
   bool QuadrantMultipliersSeen = false;
   bool SensorDefectsSeen = false;
 
@@ -248,21 +315,25 @@ void IiqDecoder::CorrectPhaseOneC(ByteStream meta_data, uint32 split_row,
     case 0x400: // Sensor Defects
       if (SensorDefectsSeen)
         ThrowRDE("Second sensor defects entry seen. Unexpected.");
-      correctSensorDefects(meta_data.getSubStream(offset, len));
+      corrections.sensorDefects = meta_data.getSubStream(offset, len);
+      corrections.sensorDefectsFirst = !QuadrantMultipliersSeen;
       SensorDefectsSeen = true;
       break;
     case 0x431:
       if (QuadrantMultipliersSeen)
         ThrowRDE("Second quadrant multipliers entry seen. Unexpected.");
-      if (iiq.quadrantMultipliers)
-        CorrectQuadrantMultipliersCombined(meta_data.getSubStream(offset, len),
-                                           split_row, split_col);
+      if (iiq.quadrantMultipliers) {
+        corrections.quadrantMultipliers = meta_data.getSubStream(offset, len);
+        corrections.haveQuadrantMultipliers = true;
+      }
       QuadrantMultipliersSeen = true;
       break;
     default:
       break;
     }
   }
+
+  return corrections;
 }
 
 // This method defines a correction that compensates for the fact that
@@ -273,9 +344,9 @@ void IiqDecoder::CorrectPhaseOneC(ByteStream meta_data, uint32 split_row,
 // together smoothly.  The correction factor is not a single
 // multiplier, but a curve defined by seven control points.  Each
 // curve's control points share the same seven X-coordinates.
-void IiqDecoder::CorrectQuadrantMultipliersCombined(ByteStream data,
-                                                    uint32 split_row,
-                                                    uint32 split_col) {
+PhaseOneQuadrantCurves IiqDecoder::getQuadrantCurves(ByteStream data,
+                                                     uint32 split_row,
+                                                     uint32 split_col) const {
   std::array<uint32, 9> shared_x_coords;
 
   // Read the middle seven points from the file
@@ -313,33 +384,32 @@ void IiqDecoder::CorrectQuadrantMultipliersCombined(ByteStream data,
     }
   }
 
+  PhaseOneQuadrantCurves curves;
+  curves.splitRow = split_row;
+  curves.splitCol = split_col;
+
   for (int quadRow = 0; quadRow < 2; quadRow++) {
     for (int quadCol = 0; quadCol < 2; quadCol++) {
       const Spline<> s(control_points[quadRow][quadCol]);
       const std::vector<ushort16> curve = s.calculateCurve();
 
-      int row_start = quadRow == 0 ? 0 : split_row;
-      int row_end = quadRow == 0 ? split_row : mRaw->dim.y;
-      int col_start = quadCol == 0 ? 0 : split_col;
-      int col_end = quadCol == 0 ? split_col : mRaw->dim.x;
-
-      for (int row = row_start; row < row_end; row++) {
-        auto* pixel =
-            reinterpret_cast<ushort16*>(mRaw->getData(col_start, row));
-        for (int col = col_start; col < col_end; col++, pixel++) {
-          // This adjustment is expected to be made with the
-          // black-level already subtracted from the pixel values.
-          // Because this is kept as metadata and not subtracted at
-          // this point, to make the correction work we subtract the
-          // appropriate amount before indexing into the curve and
-          // then add it back so that subtracting the black level
-          // later will work as expected
-          const ushort16 diff = *pixel < black_level ? *pixel : black_level;
-          *pixel = curve[*pixel - diff] + diff;
-        }
+      std::vector<ushort16>& table = curves.tables[quadRow][quadCol];
+      table.resize(curve.size());
+      for (int pixel = 0; pixel < static_cast<int>(table.size()); pixel++) {
+        // This adjustment is expected to be made with the
+        // black-level already subtracted from the pixel values.
+        // Because this is kept as metadata and not subtracted at
+        // this point, to make the correction work we subtract the
+        // appropriate amount before indexing into the curve and
+        // then add it back so that subtracting the black level
+        // later will work as expected
+        const int diff = std::min<int>(pixel, black_level);
+        table[pixel] = curve[pixel - diff] + diff;
       }
     }
   }
+
+  return curves;
 }
 
 void IiqDecoder::checkSupportInternal(const CameraMetaData* meta) {
@@ -360,7 +430,9 @@ void IiqDecoder::decodeMetaDataInternal(const CameraMetaData* meta) {
     mRaw->blackLevel = black_level;
 }
 
-void IiqDecoder::correctSensorDefects(ByteStream data) {
+std::vector<ushort16> IiqDecoder::handleSensorDefects(ByteStream data) {
+  std::vector<ushort16> badColumns;
+
   while (data.getRemainSize() != 0) {
     const ushort16 col = data.getU16();
     const ushort16 row = data.getU16();
@@ -372,7 +444,7 @@ void IiqDecoder::correctSensorDefects(ByteStream data) {
     switch (type) {
     case 131: // bad column
     case 137: // bad column
-      correctBadColumn(col);
+      badColumns.emplace_back(col);
       break;
     case 129: // bad pixel
       handleBadPixel(col, row);
@@ -381,6 +453,8 @@ void IiqDecoder::correctSensorDefects(ByteStream data) {
       break;
     }
   }
+
+  return badColumns;
 }
 
 void IiqDecoder::handleBadPixel(const ushort16 col, const ushort16 row) {
@@ -394,7 +468,9 @@ void IiqDecoder::correctBadColumn(const ushort16 col) {
                                  mRaw->dim.x, mRaw->dim.y,
                                  mRaw->pitch / sizeof(uint16_t));
 
-  for (int row = 2; row < mRaw->dim.y - 2; row++) {
+  // The rows are independent, the other columns are only read.
+  const int rowEnd = std::max(2, mRaw->dim.y - 2);
+  parallelFor(mRaw->parallelism, 2, rowEnd, [&](int row) {
     if (mRaw->cfa.getColorAt(col, row) == CFA_GREEN) {
       /* Do green pixels. Let's pretend we are in "G" pixel, in the middle:
        *   G=G
@@ -437,7 +513,7 @@ void IiqDecoder::correctBadColumn(const ushort16 col) {
       // But this is not just averaging, we bias towards the horizontal pixels.
       img(col, row) = std::lround(diags * 0.0732233 + horiz * 0.3535534);
     }
-  }
+  });
 }
 
 } // namespace rawspeed
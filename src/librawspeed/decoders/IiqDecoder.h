@@ -24,15 +24,16 @@
 #include "common/Common.h"                // for uint32
 #include "common/RawImage.h"              // for RawImage
 #include "decoders/AbstractTiffDecoder.h" // for AbstractTiffDecoder
+#include "io/ByteStream.h"                // for ByteStream
 #include "tiff/TiffIFD.h"                 // for TiffRootIFD (ptr only)
-#include <utility>                        // for move
+#include <utility>                        // for move, pair
 #include <vector>                         // for vector
 
 namespace rawspeed {
 
 class Buffer;
-class ByteStream;
 class CameraMetaData;
+struct PhaseOneQuadrantCurves;
 struct PhaseOneStrip;
 
 class IiqDecoder final : public AbstractTiffDecoder {
@@ -59,15 +60,25 @@ public:
   RawImage decodeRawInternal() override;
   void checkSupportInternal(const CameraMetaData* meta) override;
   void decodeMetaDataInternal(const CameraMetaData* meta) override;
+  bool isIntraFileParallel() const override { return true; }
 
 protected:
   int getDecoderVersion() const override { return 0; }
   uint32 black_level = 0;
-  void CorrectPhaseOneC(ByteStream meta_data, uint32 split_row,
-                        uint32 split_col);
-  void CorrectQuadrantMultipliersCombined(ByteStream data, uint32 split_row,
-                                          uint32 split_col);
-  void correctSensorDefects(ByteStream data);
+
+  // The entries of the correction metadata that we handle.
+  struct CorrectionEntries {
+    ByteStream sensorDefects;
+    bool haveQuadrantMultipliers = false;
+    ByteStream quadrantMultipliers;
+    // The corrections are to be applied in the order of the entries.
+    bool sensorDefectsFirst = false;
+  };
+
+  CorrectionEntries getCorrectionEntries(ByteStream meta_data) const;
+  PhaseOneQuadrantCurves getQuadrantCurves(ByteStream data, uint32 split_row,
+                                           uint32 split_col) const;
+  std::vector<ushort16> handleSensorDefects(ByteStream data);
   void correctBadColumn(ushort16 col);
   void handleBadPixel(ushort16 col, ushort16 row);
 };
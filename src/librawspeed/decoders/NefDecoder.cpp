@@ -121,7 +121,7 @@ RawImage NefDecoder::decodeRawInternal() {
   ByteStream rawData(mFile, offsets->getU32(), counts->getU32());
 
   NikonDecompressor n(mRaw, meta->getData(), bitPerPixel);
-  mRaw->createData();
+  mRaw->createBinnedData();
   n.decompress(rawData, uncorrectedRawValues);
 
   return mRaw;
@@ -650,7 +650,8 @@ void NefDecoder::DecodeNikonSNef(ByteStream* input, uint32 w, uint32 h) {
 
   curve.resize(4095);
 
-  RawImageCurveGuard curveHandler(&mRaw, curve, false);
+  // The curve is applied to the luma, the stored values are computed from it.
+  RawImageCurveGuard curveHandler(&mRaw, curve, false, /*canDefer=*/false);
 
   ushort16 tmp;
   auto* tmpch = reinterpret_cast<uchar8*>(&tmp);
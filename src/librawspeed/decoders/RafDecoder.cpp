@@ -21,6 +21,7 @@
 
 #include "decoders/RafDecoder.h"
 #include "common/Common.h"                          // for uint32, ushort16
+#include "common/DecodeStatistics.h"                // for StageTimer, Decode...
 #include "common/Point.h"                           // for iPoint2D, iRecta...
 #include "decoders/RawDecoderException.h"           // for ThrowRDE
 #include "decompressors/FujiDecompressor.h"         // for FujiDecompressor
@@ -224,6 +225,9 @@ void RafDecoder::decodeMetaDataInternal(const CameraMetaData* meta) {
 
   // Rotate 45 degrees - could be multithreaded.
   if (rotate && !this->uncorrectedRawValues) {
+    StageTimer timer(mRaw->statistics.get(), DecodeStage::FujiRotate,
+                     static_cast<uint64>(mRaw->pitch) * new_size.y);
+
     // Calculate the 45 degree rotated size;
     uint32 rotatedsize;
     uint32 rotationPos;
@@ -237,9 +241,17 @@ void RafDecoder::decodeMetaDataInternal(const CameraMetaData* meta) {
     }
 
     iPoint2D final_size(rotatedsize, rotatedsize-1);
-    RawImage rotated = RawImage::create(final_size, TYPE_USHORT16, 1);
+    RawImage rotated = RawImage::create(TYPE_USHORT16);
+    rotated->bufferProvider = mRaw->bufferProvider;
+    rotated->allocationPolicy = mRaw->allocationPolicy;
+    rotated->prefaultData = mRaw->prefaultData;
+    rotated->parallelism = mRaw->parallelism;
+    rotated->dim = final_size;
+    rotated->isCFA = true;
+    rotated->createData();
     rotated->clearArea(iRectangle2D(iPoint2D(0,0), rotated->dim));
     rotated->metadata = mRaw->metadata;
+    rotated->statistics = mRaw->statistics;
     rotated->metadata.fujiRotationPos = rotationPos;
 
     int dest_pitch = static_cast<int>(rotated->pitch) / 2;
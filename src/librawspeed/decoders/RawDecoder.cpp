@@ -20,7 +20,9 @@
 */
 
 #include "decoders/RawDecoder.h"
+#include "common/CfaBinner.h"                       // for CfaBinner
 #include "common/Common.h"                          // for uint32, roundUpD...
+#include "common/DecodeStatistics.h"                // for StageTimer, Decode...
 #include "common/Point.h"                           // for iPoint2D, iRecta...
 #include "decoders/RawDecoderException.h"           // for ThrowRDE
 #include "decompressors/UncompressedDecompressor.h" // for UncompressedDeco...
@@ -38,6 +40,7 @@
 #include "tiff/TiffTag.h"                           // for BITSPERSAMPLE
 #include <array>                                    // for array
 #include <cassert>                                  // for assert
+#include <memory>                                   // for unique_ptr, make...
 #include <string>                                   // for string, basic_st...
 #include <vector>                                   // for vector
 
@@ -54,6 +57,10 @@ RawDecoder::RawDecoder(const Buffer* file)
   applyCrop = true;
   uncorrectedRawValues = false;
   fujiRotate = true;
+  deferCurves = false;
+  binning = 1;
+  allocationPolicy = LargeAllocationPolicy::Default;
+  prefaultData = false;
 }
 
 void RawDecoder::decodeUncompressed(const TiffIFD *rawIFD, BitOrder order) {
@@ -120,11 +127,16 @@ void RawDecoder::decodeUncompressed(const TiffIFD *rawIFD, BitOrder order) {
   assert(height <= offY);
   assert(slices.size() == counts->count);
 
-  mRaw->createData();
+  mRaw->createBinnedData();
 
   // Default white level is (2 ** BitsPerSample) - 1
   mRaw->whitePoint = (1UL << bitPerPixel) - 1UL;
 
+  // The strips are decoded in order, so they can share it.
+  std::unique_ptr<CfaBinner> binner;
+  if (mRaw->isBinned())
+    binner = std::make_unique<CfaBinner>(mRaw);
+
   offY = 0;
   for (const RawSlice& slice : slices) {
     UncompressedDecompressor u(*mFile, slice.offset, slice.count, mRaw);
@@ -137,7 +149,8 @@ void RawDecoder::decodeUncompressed(const TiffIFD *rawIFD, BitOrder order) {
     if (!inputPitch)
       ThrowRDE("Bad input pitch. Can not decode anything.");
 
-    u.readUncompressedRaw(size, pos, inputPitch, bitPerPixel, order);
+    u.readUncompressedRaw(size, pos, inputPitch, bitPerPixel, order,
+                          binner.get());
 
     offY += slice.h;
   }
@@ -208,23 +221,34 @@ void RawDecoder::setMetaData(const CameraMetaData* meta, const string& make,
   mRaw->metadata.model = model;
   mRaw->metadata.mode = mode;
 
+  // The camera's crop and black areas are in full-resolution pixels.
+  const iPoint2D fullDim = mRaw->getUnbinnedDim();
+
   if (applyCrop) {
     iPoint2D new_size = cam->cropSize;
 
     // If crop size is negative, use relative cropping
     if (new_size.x <= 0)
-      new_size.x = mRaw->dim.x - cam->cropPos.x + new_size.x;
+      new_size.x = fullDim.x - cam->cropPos.x + new_size.x;
 
     if (new_size.y <= 0)
-      new_size.y = mRaw->dim.y - cam->cropPos.y + new_size.y;
+      new_size.y = fullDim.y - cam->cropPos.y + new_size.y;
 
-    mRaw->subFrame(iRectangle2D(cam->cropPos, new_size));
+    mRaw->subFrame(mRaw->getBinnedRect({cam->cropPos, new_size}));
   }
 
   const CameraSensorInfo *sensor = cam->getSensorInfo(iso_speed);
   mRaw->blackLevel = sensor->mBlackLevel;
   mRaw->whitePoint = sensor->mWhiteLevel;
   mRaw->blackAreas = cam->blackAreas;
+  if (mRaw->isBinned()) {
+    for (BlackArea& area : mRaw->blackAreas) {
+      const int end = CfaBinner::getBinnedPos(area.offset + area.size,
+                                              mRaw->binning);
+      area.offset = CfaBinner::getBinnedPos(area.offset, mRaw->binning);
+      area.size = end - area.offset;
+    }
+  }
   if (mRaw->blackAreas.empty() && !sensor->mBlackLevelSeparate.empty()) {
     auto cfaArea = mRaw->cfa.getSize().area();
     if (mRaw->isCFA && cfaArea <= sensor->mBlackLevelSeparate.size()) {
@@ -257,7 +281,21 @@ void RawDecoder::setMetaData(const CameraMetaData* meta, const string& make,
 
 rawspeed::RawImage RawDecoder::decodeRaw() {
   try {
-    RawImage raw = decodeRawInternal();
+    // So that maxThreads holds for the whole decode, nested loops included.
+    parallelism = parallelism.getLimited();
+    mRaw->parallelism = parallelism;
+    mRaw->deferCurves = deferCurves;
+    mRaw->binning = binning;
+    mRaw->bufferProvider = bufferProvider;
+    mRaw->allocationPolicy = allocationPolicy;
+    mRaw->prefaultData = prefaultData;
+    RawImage raw = [this]() {
+      // NOTE: the decoder may replace mRaw, but it keeps the statistics.
+      StageTimer timer(mRaw->statistics.get(), DecodeStage::Decompress,
+                       mFile->getSize());
+      return decodeRawInternal();
+    }();
+    raw->parallelism = parallelism;
     raw->checkMemIsInitialized();
 
     raw->metadata.pixelAspectRatio =
@@ -279,6 +317,8 @@ rawspeed::RawImage RawDecoder::decodeRaw() {
 
 void RawDecoder::decodeMetaData(const CameraMetaData* meta) {
   try {
+    parallelism = parallelism.getLimited();
+    mRaw->parallelism = parallelism;
     decodeMetaDataInternal(meta);
   } catch (TiffParserException &e) {
     ThrowRDE("%s", e.what());
@@ -21,10 +21,13 @@
 
 #pragma once
 
-#include "common/Common.h"   // for uint32, BitOrder
-#include "common/RawImage.h" // for RawImage
-#include "metadata/Camera.h" // for Hints
-#include <string>            // for string
+#include "common/Common.h"          // for uint32, BitOrder
+#include "common/ImageBuffer.h"     // for ImageBufferProvider
+#include "common/LargeAllocation.h" // for LargeAllocationPolicy
+#include "common/RawImage.h"        // for RawImage
+#include "common/TaskScheduler.h"   // for Parallelism
+#include "metadata/Camera.h"        // for Hints
+#include <string>                   // for string
 
 namespace rawspeed {
 
@@ -65,6 +68,13 @@ public:
   /* compensation is not expected to be applied to the image */
   void decodeMetaData(const CameraMetaData* meta);
 
+  /* Can decodeRaw() make use of more than one thread for this image? */
+  /* This is only a scheduling hint, e.g. for BatchDecoder. */
+  virtual bool isIntraFileParallel() const { return false; }
+
+  /* Where the time was spent, by stage, see DecodeStatistics. */
+  const DecodeStatistics& getStatistics() const { return *mRaw->statistics; }
+
   /* Allows access to the root IFD structure */
   /* If image isn't TIFF based NULL will be returned */
   virtual TiffIFD *getRootIFD() { return nullptr; }
@@ -100,6 +110,17 @@ public:
   /* Should Fuji images be rotated? */
   bool fujiRotate;
 
+  /* Should the compression curves be applied after the decompression, */
+  /* to the whole image at once, instead of to each pixel as it is decoded? */
+  /* The result then does not depend on the number of threads, */
+  /* but its dithering differs from the default one. */
+  bool deferCurves;
+
+  /* For previews: bin the image by this factor, i.e. to 1/2 or 1/4 of the */
+  /* resolution, while decompressing it, if the decoder supports that, */
+  /* see RawImageData::binning. The default is 1, i.e. no binning. */
+  int binning;
+
   struct {
     /* Should Quadrant Multipliers be applied to the IIQ raws? */
     bool quadrantMultipliers = true;
@@ -108,6 +129,22 @@ public:
     explicit operator bool() const { return quadrantMultipliers /*|| ...*/; }
   } iiq;
 
+  /* How many threads may be used to decode this image, and on what executor. */
+  /* The default is all of rawspeed_get_number_of_processor_cores(). */
+  /* The decode replaces it with getLimited(), so the limit is a hard one. */
+  Parallelism parallelism;
+
+  /* If set, the image is decoded into the memory it provides, if it does. */
+  /* It is asked once per image, and the decode may need several images, */
+  /* e.g. for Fuji images that get rotated. */
+  ImageBufferProvider bufferProvider;
+
+  /* Otherwise, how to allocate the memory of the image: with huge pages, */
+  /* and should the pages be faulted in in parallel right away? */
+  /* See RawImageData::allocationPolicy. The default is malloc(). */
+  LargeAllocationPolicy allocationPolicy;
+  bool prefaultData;
+
   /* Retrieve the main RAW chunk */
   /* Returns NULL if unknown */
   virtual Buffer* getCompressedData() { return nullptr; }
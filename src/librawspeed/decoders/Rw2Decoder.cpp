@@ -101,7 +101,7 @@ RawImage Rw2Decoder::decodeRawInternal() {
       PanasonicDecompressor p(mRaw, ByteStream(mFile, offset),
                               hints.has("zero_is_not_bad"),
                               section_split_offset);
-      mRaw->createData();
+      mRaw->createBinnedData();
       p.decompress();
     }
   } else {
@@ -127,13 +127,13 @@ RawImage Rw2Decoder::decodeRawInternal() {
 
     if (v5Processing) {
       PanasonicDecompressorV5 v5(mRaw, bs, bitsPerSample);
-      mRaw->createData();
+      mRaw->createBinnedData();
       v5.decompress();
     } else {
       uint32 section_split_offset = 0x1FF8;
       PanasonicDecompressor p(mRaw, bs, hints.has("zero_is_not_bad"),
                               section_split_offset);
-      mRaw->createData();
+      mRaw->createBinnedData();
       p.decompress();
     }
   }
@@ -232,7 +232,8 @@ std::string Rw2Decoder::guessMode() {
   if (!mRaw->isAllocated())
     return "";
 
-  ratio = static_cast<float>(mRaw->dim.x) / static_cast<float>(mRaw->dim.y);
+  const iPoint2D dim = mRaw->getUnbinnedDim();
+  ratio = static_cast<float>(dim.x) / static_cast<float>(dim.y);
 
   float min_diff = fabs(ratio - 16.0F / 9.0F);
   std::string closest_match = "16:9";
@@ -42,6 +42,7 @@ public:
 
   RawImage decodeRawInternal() override;
   void decodeMetaDataInternal(const CameraMetaData* meta) override;
+  bool isIntraFileParallel() const override { return true; }
   void checkSupportInternal(const CameraMetaData* meta) override;
 
 protected:
@@ -21,9 +21,11 @@
 
 #include "rawspeedconfig.h"
 #include "decompressors/AbstractDngDecompressor.h"
+#include "common/CfaBinner.h"                       // for CfaBinner
 #include "common/Common.h"                          // for BitOrder_LSB
 #include "common/Point.h"                           // for iPoint2D
 #include "common/RawImage.h"                        // for RawImageData
+#include "common/TaskScheduler.h"                   // for parallelForChunks
 #include "decoders/RawDecoderException.h"           // for RawDecoderException
 #include "decompressors/DeflateDecompressor.h"      // for DeflateDecompressor
 #include "decompressors/JpegDecompressor.h"         // for JpegDecompressor
@@ -36,16 +38,15 @@
 #include <cassert>                                  // for assert
 #include <cstdio>                                   // for size_t
 #include <limits>                                   // for numeric_limits
-#include <memory>                                   // for unique_ptr
+#include <memory>                                   // for unique_ptr, make...
 #include <vector>                                   // for vector
 
 namespace rawspeed {
 
-template <> void AbstractDngDecompressor::decompressThread<1>() const noexcept {
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
-#endif
-  for (auto e = slices.cbegin(); e < slices.cend(); ++e) {
+template <>
+void AbstractDngDecompressor::decompressThread<1>(int begin,
+                                                  int end) const noexcept {
+  for (auto e = slices.cbegin() + begin; e < slices.cbegin() + end; ++e) {
     UncompressedDecompressor decompressor(e->bs, mRaw);
 
     iPoint2D tileSize(e->width, e->height);
@@ -76,9 +77,13 @@ template <> void AbstractDngDecompressor::decompressThread<1>() const noexcept {
       if (inputPitch == 0)
         ThrowRDE("Data input pitch is too short. Can not decode!");
 
-      decompressor.readUncompressedRaw(tileSize, pos, inputPitch, mBps,
-                                       big_endian ? BitOrder_MSB
-                                                  : BitOrder_LSB);
+      std::unique_ptr<CfaBinner> binner;
+      if (mRaw->isBinned())
+        binner = std::make_unique<CfaBinner>(mRaw, e->offX, e->width);
+
+      decompressor.readUncompressedRaw(
+          tileSize, pos, inputPitch, mBps,
+          big_endian ? BitOrder_MSB : BitOrder_LSB, binner.get());
     } catch (RawDecoderException& err) {
       mRaw->setError(err.what());
     } catch (IOException& err) {
@@ -87,14 +92,18 @@ template <> void AbstractDngDecompressor::decompressThread<1>() const noexcept {
   }
 }
 
-template <> void AbstractDngDecompressor::decompressThread<7>() const noexcept {
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
-#endif
-  for (auto e = slices.cbegin(); e < slices.cend(); ++e) {
+template <>
+void AbstractDngDecompressor::decompressThread<7>(int begin,
+                                                  int end) const noexcept {
+  for (auto e = slices.cbegin() + begin; e < slices.cbegin() + end; ++e) {
     try {
+      // The tiles start at whole bands, see DngDecoder::canBin().
+      std::unique_ptr<CfaBinner> binner;
+      if (mRaw->isBinned())
+        binner = std::make_unique<CfaBinner>(mRaw, e->offX, e->width);
+
       LJpegDecompressor d(e->bs, mRaw);
-      d.decode(e->offX, e->offY, e->width, e->height, mFixLjpeg);
+      d.decode(e->offX, e->offY, e->width, e->height, mFixLjpeg, binner.get());
     } catch (RawDecoderException& err) {
       mRaw->setError(err.what());
     } catch (IOException& err) {
@@ -104,13 +113,12 @@ template <> void AbstractDngDecompressor::decompressThread<7>() const noexcept {
 }
 
 #ifdef HAVE_ZLIB
-template <> void AbstractDngDecompressor::decompressThread<8>() const noexcept {
+template <>
+void AbstractDngDecompressor::decompressThread<8>(int begin,
+                                                  int end) const noexcept {
   std::unique_ptr<unsigned char[]> uBuffer; // NOLINT
 
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
-#endif
-  for (auto e = slices.cbegin(); e < slices.cend(); ++e) {
+  for (auto e = slices.cbegin() + begin; e < slices.cbegin() + end; ++e) {
     DeflateDecompressor z(e->bs, mRaw, mPredictor, mBps);
     try {
       z.decode(&uBuffer, iPoint2D(e->dsc.tileW, e->dsc.tileH),
@@ -124,11 +132,10 @@ template <> void AbstractDngDecompressor::decompressThread<8>() const noexcept {
 }
 #endif
 
-template <> void AbstractDngDecompressor::decompressThread<9>() const noexcept {
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
-#endif
-  for (auto e = slices.cbegin(); e < slices.cend(); ++e) {
+template <>
+void AbstractDngDecompressor::decompressThread<9>(int begin,
+                                                  int end) const noexcept {
+  for (auto e = slices.cbegin() + begin; e < slices.cbegin() + end; ++e) {
     try {
       VC5Decompressor d(e->bs, mRaw);
       d.decode(e->offX, e->offY, e->width, e->height);
@@ -142,11 +149,9 @@ template <> void AbstractDngDecompressor::decompressThread<9>() const noexcept {
 
 #ifdef HAVE_JPEG
 template <>
-void AbstractDngDecompressor::decompressThread<0x884c>() const noexcept {
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
-#endif
-  for (auto e = slices.cbegin(); e < slices.cend(); ++e) {
+void AbstractDngDecompressor::decompressThread<0x884c>(
+    int begin, int end) const noexcept {
+  for (auto e = slices.cbegin() + begin; e < slices.cbegin() + end; ++e) {
     JpegDecompressor j(e->bs, mRaw);
     try {
       j.decode(e->offX, e->offY);
@@ -159,7 +164,8 @@ void AbstractDngDecompressor::decompressThread<0x884c>() const noexcept {
 }
 #endif
 
-void AbstractDngDecompressor::decompressThread() const noexcept {
+void AbstractDngDecompressor::decompressThread(int begin,
+                                               int end) const noexcept {
   assert(mRaw->dim.x > 0);
   assert(mRaw->dim.y > 0);
   assert(mRaw->getCpp() > 0 && mRaw->getCpp() <= 4);
@@ -167,14 +173,14 @@ void AbstractDngDecompressor::decompressThread() const noexcept {
 
   if (compression == 1) {
     /* Uncompressed */
-    decompressThread<1>();
+    decompressThread<1>(begin, end);
   } else if (compression == 7) {
     /* Lossless JPEG */
-    decompressThread<7>();
+    decompressThread<7>(begin, end);
   } else if (compression == 8) {
     /* Deflate compression */
 #ifdef HAVE_ZLIB
-    decompressThread<8>();
+    decompressThread<8>(begin, end);
 #else
 #pragma message                                                                \
     "ZLIB is not present! Deflate compression will not be supported!"
@@ -182,11 +188,11 @@ void AbstractDngDecompressor::decompressThread() const noexcept {
 #endif
   } else if (compression == 9) {
     /* GOPRO VC-5 */
-    decompressThread<9>();
+    decompressThread<9>(begin, end);
   } else if (compression == 0x884c) {
     /* Lossy DNG */
 #ifdef HAVE_JPEG
-    decompressThread<0x884c>();
+    decompressThread<0x884c>(begin, end);
 #else
 #pragma message "JPEG is not present! Lossy JPEG DNG will not be supported!"
     mRaw->setError("jpeg support is disabled.");
@@ -196,11 +202,9 @@ void AbstractDngDecompressor::decompressThread() const noexcept {
 }
 
 void AbstractDngDecompressor::decompress() const {
-#ifdef HAVE_OPENMP
-#pragma omp parallel default(none) num_threads(                                \
-    rawspeed_get_number_of_processor_cores()) if (slices.size() > 1)
-#endif
-  decompressThread();
+  parallelForChunks(
+      mRaw->parallelism, 0, slices.size(),
+      [this](int begin, int end) { decompressThread(begin, end); });
 
   std::string firstErr;
   if (mRaw->isTooManyErrors(1, &firstErr)) {
@@ -119,9 +119,10 @@ struct DngSliceElement final {
 class AbstractDngDecompressor final : public AbstractDecompressor {
   RawImage mRaw;
 
-  template <int compression> void decompressThread() const noexcept;
+  template <int compression>
+  void decompressThread(int begin, int end) const noexcept;
 
-  void decompressThread() const noexcept;
+  void decompressThread(int begin, int end) const noexcept;
 
 public:
   AbstractDngDecompressor(const RawImage& img, DngTilingDescription dsc_,
@@ -26,6 +26,7 @@
 #include "common/Common.h"                // for ushort16
 #include "common/Point.h"                 // for iPoint2D
 #include "common/RawImage.h"              // for RawImage
+#include "common/TaskScheduler.h"         // for parallelForChunks
 #include "decoders/RawDecoderException.h" // for ThrowRDE
 #include "io/Endianness.h"                // for Endianness
 #include "metadata/ColorFilterArray.h"    // for CFA_BLUE
@@ -756,30 +757,26 @@ void FujiDecompressor::fuji_compressed_load_raw() {
   }
 }
 
-void FujiDecompressor::decompressThread() const noexcept {
+void FujiDecompressor::decompressThread(int begin, int end) const noexcept {
   fuji_compressed_block block_info;
 
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
-#endif
-  for (auto strip = strips.cbegin(); strip < strips.cend(); ++strip) {
+  for (auto strip = strips.cbegin() + begin; strip < strips.cbegin() + end;
+       ++strip) {
     block_info.reset(&common_info);
     block_info.pump = BitPumpMSB(strip->bs);
     try {
       fuji_decode_strip(&block_info, *strip);
     } catch (RawspeedException& err) {
-      // Propagate the exception out of OpenMP magic.
+      // Propagate the exception out of the worker thread.
       mRaw->setError(err.what());
     }
   }
 }
 
 void FujiDecompressor::decompress() const {
-#ifdef HAVE_OPENMP
-#pragma omp parallel default(none)                                             \
-    num_threads(rawspeed_get_number_of_processor_cores())
-#endif
-  decompressThread();
+  parallelForChunks(
+      mRaw->parallelism, 0, strips.size(),
+      [this](int begin, int end) { decompressThread(begin, end); });
 
   std::string firstErr;
   if (mRaw->isTooManyErrors(1, &firstErr)) {
@@ -39,7 +39,7 @@ class RawImage;
 class FujiDecompressor final : public AbstractDecompressor {
   RawImage mRaw;
 
-  void decompressThread() const noexcept;
+  void decompressThread(int begin, int end) const noexcept;
 
 public:
   struct FujiHeader {
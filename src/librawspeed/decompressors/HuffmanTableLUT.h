@@ -25,6 +25,7 @@
 #include "decoders/RawDecoderException.h"       // for ThrowRDE
 #include "decompressors/AbstractHuffmanTable.h" // for AbstractHuffmanTable
 #include "io/BitStream.h"                       // for BitStreamTraits
+#include <algorithm>                            // for max
 #include <cassert>                              // for assert
 #include <cstddef>                              // for size_t
 #include <memory>                               // for allocator_traits<>::...
@@ -80,27 +81,55 @@ class HuffmanTableLUT final : public AbstractHuffmanTable {
   // The payload may be the fully decoded diff or the length of the diff.
   // The len field contains the number of bits, this lookup consumed.
   // A lookup value of 0 means the code was too big to fit into the table.
-  // The optimal LookupDepth is also likely to depend on the CPU architecture.
+  // The optimal MaxLookupDepth is also likely to depend on the CPU
+  // architecture.
   static constexpr unsigned PayloadShift = 16;
   static constexpr unsigned FlagMask = 0x100;
   static constexpr unsigned LenMask = 0xff;
-  static constexpr unsigned LookupDepth = 11;
+  static constexpr unsigned MaxLookupDepth = 11;
   std::vector<int32> decodeLookup;
 #else
   // lookup table containing 2 fields: payload:4|len:4
   // the payload is the length of the diff, len is the length of the code
-  static constexpr unsigned LookupDepth = 15;
+  static constexpr unsigned MaxLookupDepth = 15;
   static constexpr unsigned PayloadShift = 4;
   static constexpr unsigned FlagMask = 0;
   static constexpr unsigned LenMask = 0x0f;
   std::vector<uchar8> decodeLookup;
 #endif
 
+  // The lookup depth can also be forced, up to this. (Limited by the ushort16
+  // arithmetic of setup().)
+  static constexpr unsigned MaxForcedLookupDepth = 15;
+
+  // How many bits are looked up at once, i.e. log2 of decodeLookup's size.
+  // Chosen per table by setup(), see chooseLookupDepth().
+  unsigned lookupDepth = MaxLookupDepth;
+
   bool fullDecode = true;
   bool fixDNGBug16 = false;
 
+  // The smallest depth at which every code (and, if fully decoding, every
+  // difference too) is resolved by the first lookup, but no more than
+  // MaxLookupDepth. Tables with only short codes thus get a smaller table,
+  // that is both faster to build and friendlier to the cache, while the
+  // decoding itself does not get any slower.
+  unsigned chooseLookupDepth(const std::vector<CodeSymbol>& symbols) const {
+    unsigned depth = 1;
+    for (size_t i = 0; i < symbols.size(); i++) {
+      unsigned len = symbols[i].code_len;
+      // A 16-bit difference has no bits to look up, see decode().
+      if (FlagMask && fullDecode && codeValues[i] != 16)
+        len += codeValues[i];
+      depth = std::max(depth, len);
+    }
+    return depth < MaxLookupDepth ? depth : MaxLookupDepth;
+  }
+
 public:
-  void setup(bool fullDecode_, bool fixDNGBug16_) {
+  // lookupDepth_ of 0 means it is to be chosen for this table, else it
+  // forces the lookup depth, 1..MaxForcedLookupDepth (e.g. for benchmarking).
+  void setup(bool fullDecode_, bool fixDNGBug16_, unsigned lookupDepth_ = 0) {
     this->fullDecode = fullDecode_;
     this->fixDNGBug16 = fixDNGBug16_;
 
@@ -129,22 +158,27 @@ public:
       }
     }
 
+    if (lookupDepth_ > MaxForcedLookupDepth)
+      ThrowRDE("Lookup depth %u is too big", lookupDepth_);
+    lookupDepth = lookupDepth_ ? lookupDepth_ : chooseLookupDepth(symbols);
+
     // Generate lookup table for fast decoding lookup.
     // See definition of decodeLookup above
-    decodeLookup.resize(1 << LookupDepth);
+    decodeLookup.clear();
+    decodeLookup.resize(1 << lookupDepth);
     for (size_t i = 0; i < symbols.size(); i++) {
       uchar8 code_l = symbols[i].code_len;
-      if (code_l > static_cast<int>(LookupDepth))
+      if (code_l > static_cast<int>(lookupDepth))
         break;
 
-      ushort16 ll = symbols[i].code << (LookupDepth - code_l);
-      ushort16 ul = ll | ((1 << (LookupDepth - code_l)) - 1);
+      ushort16 ll = symbols[i].code << (lookupDepth - code_l);
+      ushort16 ul = ll | ((1 << (lookupDepth - code_l)) - 1);
       ushort16 diff_l = codeValues[i];
       for (ushort16 c = ll; c <= ul; c++) {
         if (!(c < decodeLookup.size()))
           ThrowRDE("Corrupt Huffman");
 
-        if (!FlagMask || !fullDecode || diff_l + code_l > LookupDepth) {
+        if (!FlagMask || !fullDecode || diff_l + code_l > lookupDepth) {
           // lookup bit depth is too small to fit both the encoded length
           // and the final difference value.
           // -> store only the length and do a normal sign extension later
@@ -155,7 +189,7 @@ public:
           decodeLookup[c] = (code_l + diff_l) | FlagMask;
 
           if (diff_l) {
-            uint32 diff = (c >> (LookupDepth - code_l - diff_l)) & ((1 << diff_l) - 1);
+            uint32 diff = (c >> (lookupDepth - code_l - diff_l)) & ((1 << diff_l) - 1);
             decodeLookup[c] |= static_cast<int32>(
                 static_cast<uint32>(signExtended(diff, diff_l))
                 << PayloadShift);
@@ -165,6 +199,8 @@ public:
     }
   }
 
+  unsigned getLookupDepth() const { return lookupDepth; }
+
   template<typename BIT_STREAM> inline int decodeLength(BIT_STREAM& bs) const {
     static_assert(BitStreamTraits<BIT_STREAM>::canUseWithHuffmanTable,
                   "This BitStream specialization is not marked as usable here");
@@ -195,7 +231,7 @@ public:
     // for processors supporting bmi2 instructions, using maxCodePlusDiffLength()
     // might be benifitial
 
-    uint32 code = bs.peekBitsNoFill(LookupDepth);
+    uint32 code = bs.peekBitsNoFill(lookupDepth);
     assert(code < decodeLookup.size());
     auto val = static_cast<unsigned>(decodeLookup[code]);
     int len = val & LenMask;
@@ -221,7 +257,7 @@ public:
       return FULL_DECODE ? signExtended(bs.getBitsNoFill(l_diff), l_diff) : l_diff;
     }
 
-    uint32 code_l = LookupDepth;
+    uint32 code_l = lookupDepth;
     bs.skipBitsNoFill(code_l);
     while (code_l < maxCodeOL.size() &&
            (0xFFFFFFFF == maxCodeOL[code_l] || code > maxCodeOL[code_l])) {
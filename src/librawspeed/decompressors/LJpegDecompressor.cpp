@@ -20,6 +20,7 @@
 */
 
 #include "decompressors/LJpegDecompressor.h"
+#include "common/CfaBinner.h"             // for CfaBinner
 #include "common/Common.h"                // for unroll_loop, uint32, ushort16
 #include "common/Point.h"                 // for iPoint2D
 #include "common/RawImage.h"              // for RawImage, RawImageData
@@ -54,26 +55,32 @@ LJpegDecompressor::LJpegDecompressor(const ByteStream& bs, const RawImage& img)
 }
 
 void LJpegDecompressor::decode(uint32 offsetX, uint32 offsetY, uint32 width,
-                               uint32 height, bool fixDng16Bug_) {
-  if (offsetX >= static_cast<unsigned>(mRaw->dim.x))
+                               uint32 height, bool fixDng16Bug_,
+                               CfaBinner* binner_) {
+  assert(!binner_ || (mRaw->isBinned() && mRaw->getCpp() == 1));
+
+  const iPoint2D dim = mRaw->getUnbinnedDim();
+
+  if (offsetX >= static_cast<unsigned>(dim.x))
     ThrowRDE("X offset outside of image");
-  if (offsetY >= static_cast<unsigned>(mRaw->dim.y))
+  if (offsetY >= static_cast<unsigned>(dim.y))
     ThrowRDE("Y offset outside of image");
 
-  if (width > static_cast<unsigned>(mRaw->dim.x))
+  if (width > static_cast<unsigned>(dim.x))
     ThrowRDE("Tile wider than image");
-  if (height > static_cast<unsigned>(mRaw->dim.y))
+  if (height > static_cast<unsigned>(dim.y))
     ThrowRDE("Tile taller than image");
 
-  if (offsetX + width > static_cast<unsigned>(mRaw->dim.x))
+  if (offsetX + width > static_cast<unsigned>(dim.x))
     ThrowRDE("Tile overflows image horizontally");
-  if (offsetY + height > static_cast<unsigned>(mRaw->dim.y))
+  if (offsetY + height > static_cast<unsigned>(dim.y))
     ThrowRDE("Tile overflows image vertically");
 
   offX = offsetX;
   offY = offsetY;
   w = width;
   h = height;
+  binner = binner_;
 
   fixDng16Bug = fixDng16Bug_;
 
@@ -91,8 +98,9 @@ void LJpegDecompressor::decodeScan()
     if (frame.compInfo[i].superH != 1 || frame.compInfo[i].superV != 1)
       ThrowRDE("Unsupported subsampling");
 
-  assert(static_cast<unsigned>(mRaw->dim.x) > offX);
-  if ((mRaw->getCpp() * (mRaw->dim.x - offX)) < frame.cps)
+  const iPoint2D dim = mRaw->getUnbinnedDim();
+  assert(static_cast<unsigned>(dim.x) > offX);
+  if ((mRaw->getCpp() * (dim.x - offX)) < frame.cps)
     ThrowRDE("Got less pixels than the components per sample");
 
   // How many output pixels are we expected to produce, as per DNG tiling?
@@ -156,8 +164,8 @@ template <int N_COMP, bool WeirdWidth> void LJpegDecompressor::decodeN() {
   assert(N_COMP >= mRaw->getCpp());
   assert((N_COMP / mRaw->getCpp()) > 0);
 
-  assert(mRaw->dim.x >= N_COMP);
-  assert((mRaw->getCpp() * (mRaw->dim.x - offX)) >= N_COMP);
+  assert(mRaw->getUnbinnedDim().x >= N_COMP);
+  assert((mRaw->getCpp() * (mRaw->getUnbinnedDim().x - offX)) >= N_COMP);
 
   auto ht = getHuffmanTables<N_COMP>();
   auto pred = getInitialPredictors<N_COMP>();
@@ -172,14 +180,17 @@ template <int N_COMP, bool WeirdWidth> void LJpegDecompressor::decodeN() {
   assert(frame.h >= h);
   assert(frame.cps * frame.w >= mRaw->getCpp() * w);
 
-  assert(offY + h <= static_cast<unsigned>(mRaw->dim.y));
-  assert(offX + w <= static_cast<unsigned>(mRaw->dim.x));
+  assert(offY + h <= static_cast<unsigned>(mRaw->getUnbinnedDim().y));
+  assert(offX + w <= static_cast<unsigned>(mRaw->getUnbinnedDim().x));
 
   // For y, we can simply stop decoding when we reached the border.
   for (unsigned y = 0; y < h; ++y) {
     auto destY = offY + y;
+    // NOTE: if binned, the previous row (the predictor) is still in the band.
     auto dest =
-        reinterpret_cast<ushort16*>(mRaw->getDataUncropped(offX, destY));
+        binner ? binner->getRow(destY)
+               : reinterpret_cast<ushort16*>(
+                     mRaw->getDataUncropped(offX, destY));
 
     copy_n(predNext, N_COMP, pred.data());
     // the predictor for the next line is the start of this line
@@ -221,6 +232,9 @@ template <int N_COMP, bool WeirdWidth> void LJpegDecompressor::decodeN() {
         ht[i]->decodeNext(bitStream);
       });
     }
+
+    if (binner)
+      binner->rowDone(destY);
   }
 }
 
@@ -26,6 +26,7 @@
 namespace rawspeed {
 
 class ByteStream;
+class CfaBinner;
 class RawImage;
 
 // Decompresses Lossless JPEGs, with 2-4 components
@@ -40,6 +41,9 @@ class LJpegDecompressor final : public AbstractLJpegDecompressor
   uint32 w = 0;
   uint32 h = 0;
 
+  // If the image is binned, the rows are stored here instead.
+  CfaBinner* binner = nullptr;
+
   uint32 fullBlocks = 0;
   uint32 trailingPixels = 0;
 
@@ -47,7 +51,7 @@ public:
   LJpegDecompressor(const ByteStream& bs, const RawImage& img);
 
   void decode(uint32 offsetX, uint32 offsetY, uint32 width, uint32 height,
-              bool fixDng16Bug_);
+              bool fixDng16Bug_, CfaBinner* binner_ = nullptr);
 };
 
 } // namespace rawspeed
@@ -19,6 +19,7 @@
 */
 
 #include "decompressors/NikonDecompressor.h"
+#include "common/CfaBinner.h"             // for CfaBinner
 #include "common/Common.h"                // for uint32, clampBits, ushort16
 #include "common/Point.h"                 // for iPoint2D
 #include "common/RawImage.h"              // for RawImage, RawImageData
@@ -29,6 +30,7 @@
 #include "io/ByteStream.h"                // for ByteStream
 #include <cassert>                        // for assert
 #include <cstdio>                         // for size_t
+#include <memory>                         // for unique_ptr, make_unique
 #include <vector>                         // for vector
 
 namespace rawspeed {
@@ -439,10 +441,10 @@ NikonDecompressor::NikonDecompressor(const RawImage& raw, ByteStream metadata,
       mRaw->getBpp() != 2)
     ThrowRDE("Unexpected component count / data type");
 
-  if (mRaw->dim.x == 0 || mRaw->dim.y == 0 || mRaw->dim.x % 2 != 0 ||
-      mRaw->dim.x > 8288 || mRaw->dim.y > 5520)
-    ThrowRDE("Unexpected image dimensions found: (%u; %u)", mRaw->dim.x,
-             mRaw->dim.y);
+  const iPoint2D dim = mRaw->getUnbinnedDim();
+  if (dim.x == 0 || dim.y == 0 || dim.x % 2 != 0 || dim.x > 8288 ||
+      dim.y > 5520)
+    ThrowRDE("Unexpected image dimensions found: (%u; %u)", dim.x, dim.y);
 
   switch (bitsPS) {
   case 12:
@@ -473,12 +475,13 @@ NikonDecompressor::NikonDecompressor(const RawImage& raw, ByteStream metadata,
   curve = createCurve(&metadata, bitsPS, v0, v1, &split);
 
   // If the 'split' happens outside of the image, it does not actually happen.
-  if (split >= static_cast<unsigned>(mRaw->dim.y))
+  if (split >= static_cast<unsigned>(dim.y))
     split = 0;
 }
 
 template <typename Huffman>
-void NikonDecompressor::decompress(BitPumpMSB* bits, int start_y, int end_y) {
+void NikonDecompressor::decompress(BitPumpMSB* bits, int start_y, int end_y,
+                                   CfaBinner* binner) {
   Huffman ht = createHuffmanTable<Huffman>(huffSelect);
 
   uchar8* draw = mRaw->getData();
@@ -490,12 +493,13 @@ void NikonDecompressor::decompress(BitPumpMSB* bits, int start_y, int end_y) {
   // allow gcc to devirtualize the calls below
   auto* rawdata = reinterpret_cast<RawImageDataU16*>(mRaw.get());
 
-  const iPoint2D& size = mRaw->dim;
+  const iPoint2D size = mRaw->getUnbinnedDim();
   assert(size.x % 2 == 0);
   assert(size.x >= 2);
   for (uint32 y = start_y; y < static_cast<uint32>(end_y); y++) {
-    auto* dest =
-        reinterpret_cast<ushort16*>(&draw[y * pitch]); // Adjust destination
+    auto* const row = binner ? binner->getRow(y)
+                             : reinterpret_cast<ushort16*>(&draw[y * pitch]);
+    auto* dest = row; // Adjust destination
     pUp1[y & 1] += ht.decodeNext(*bits);
     pUp2[y & 1] += ht.decodeNext(*bits);
     pLeft1 = pUp1[y & 1];
@@ -519,26 +523,40 @@ void NikonDecompressor::decompress(BitPumpMSB* bits, int start_y, int end_y) {
 
       dest += 2;
     }
+
+    if (binner)
+      binner->rowDone(y);
+    else
+      mRaw->pixelStatistics.addRow(y, row);
   }
 }
 
 void NikonDecompressor::decompress(const ByteStream& data,
                                    bool uncorrectedRawValues) {
-  RawImageCurveGuard curveHandler(&mRaw, curve, uncorrectedRawValues);
+  // The binned pixels are the averages of the looked-up values.
+  RawImageCurveGuard curveHandler(&mRaw, curve, uncorrectedRawValues,
+                                  /*canDefer=*/!mRaw->isBinned());
 
   BitPumpMSB bits(data);
 
   random = bits.peekBits(24);
 
-  assert(split == 0 || split < static_cast<unsigned>(mRaw->dim.y));
+  const int height = mRaw->getUnbinnedDim().y;
+  assert(split == 0 || split < static_cast<unsigned>(height));
+
+  std::unique_ptr<CfaBinner> binner;
+  if (mRaw->isBinned())
+    binner = std::make_unique<CfaBinner>(mRaw);
 
   if (!split) {
-    decompress<HuffmanTable>(&bits, 0, mRaw->dim.y);
+    decompress<HuffmanTable>(&bits, 0, height, binner.get());
   } else {
-    decompress<HuffmanTable>(&bits, 0, split);
+    decompress<HuffmanTable>(&bits, 0, split, binner.get());
     huffSelect += 1;
-    decompress<NikonLASDecompressor>(&bits, split, mRaw->dim.y);
+    decompress<NikonLASDecompressor>(&bits, split, height, binner.get());
   }
+
+  curveHandler.finish();
 }
 
 } // namespace rawspeed
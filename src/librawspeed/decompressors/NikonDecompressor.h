@@ -30,6 +30,8 @@ namespace rawspeed {
 
 class ByteStream;
 
+class CfaBinner;
+
 class NikonDecompressor final : public AbstractDecompressor {
   RawImage mRaw;
   uint32 bitsPS;
@@ -49,13 +51,16 @@ public:
 
   void decompress(const ByteStream& data, bool uncorrectedRawValues);
 
-private:
+  // Public for the HuffmanTable benchmark.
   static const std::array<std::array<std::array<uchar8, 16>, 2>, 6> nikon_tree;
+
+private:
   static std::vector<ushort16> createCurve(ByteStream* metadata, uint32 bitsPS,
                                            uint32 v0, uint32 v1, uint32* split);
 
   template <typename Huffman>
-  void decompress(BitPumpMSB* bits, int start_y, int end_y);
+  void decompress(BitPumpMSB* bits, int start_y, int end_y,
+                  CfaBinner* binner);
 
   template <typename Huffman>
   static Huffman createHuffmanTable(uint32 huffSelect);
@@ -22,9 +22,12 @@
 
 #include "rawspeedconfig.h"
 #include "decompressors/PanasonicDecompressor.h"
+#include "common/CfaBinner.h"             // for CfaBinner
 #include "common/Mutex.h"                 // for MutexLocker
 #include "common/Point.h"                 // for iPoint2D
 #include "common/RawImage.h"              // for RawImage, RawImageData
+#include "common/RawspeedException.h"     // for RawspeedException
+#include "common/TaskScheduler.h"         // for parallelForChunks
 #include "decoders/RawDecoderException.h" // for ThrowRDE
 #include "io/Buffer.h"                    // for Buffer, Buffer::size_type
 #include <algorithm>                      // for generate_n, min
@@ -45,24 +48,22 @@ PanasonicDecompressor::PanasonicDecompressor(const RawImage& img,
                                              const ByteStream& input_,
                                              bool zero_is_not_bad,
                                              uint32 section_split_offset_)
-    : mRaw(img), zero_is_bad(!zero_is_not_bad),
+    : mRaw(img), dim(mRaw->getUnbinnedDim()), zero_is_bad(!zero_is_not_bad),
       section_split_offset(section_split_offset_) {
   if (mRaw->getCpp() != 1 || mRaw->getDataType() != TYPE_USHORT16 ||
       mRaw->getBpp() != 2)
     ThrowRDE("Unexpected component count / data type");
 
-  if (!mRaw->dim.hasPositiveArea() || mRaw->dim.x % PixelsPerPacket != 0) {
-    ThrowRDE("Unexpected image dimensions found: (%i; %i)", mRaw->dim.x,
-             mRaw->dim.y);
-  }
+  if (!dim.hasPositiveArea() || dim.x % PixelsPerPacket != 0)
+    ThrowRDE("Unexpected image dimensions found: (%i; %i)", dim.x, dim.y);
 
   if (BlockSize < section_split_offset)
     ThrowRDE("Bad section_split_offset: %u, less than BlockSize (%u)",
              section_split_offset, BlockSize);
 
   // Naive count of bytes that given pixel count requires.
-  assert(mRaw->dim.area() % PixelsPerPacket == 0);
-  const auto bytesTotal = (mRaw->dim.area() / PixelsPerPacket) * BytesPerPacket;
+  assert(dim.area() % PixelsPerPacket == 0);
+  const auto bytesTotal = (dim.area() / PixelsPerPacket) * BytesPerPacket;
   assert(bytesTotal > 0);
 
   // If section_split_offset is zero, then that we need to read the normal
@@ -81,14 +82,14 @@ PanasonicDecompressor::PanasonicDecompressor(const RawImage& img,
 }
 
 void PanasonicDecompressor::chopInputIntoBlocks() {
-  auto pixelToCoordinate = [width = mRaw->dim.x](unsigned pixel) {
+  auto pixelToCoordinate = [width = dim.x](unsigned pixel) {
     return iPoint2D(pixel % width, pixel / width);
   };
 
   // If section_split_offset == 0, last block may not be full.
   const auto blocksTotal = roundUpDivision(input.getRemainSize(), BlockSize);
   assert(blocksTotal > 0);
-  assert(blocksTotal * PixelsPerBlock >= mRaw->dim.area());
+  assert(blocksTotal * PixelsPerBlock >= dim.area());
   blocks.reserve(blocksTotal);
 
   unsigned currPixel = 0;
@@ -111,55 +112,71 @@ void PanasonicDecompressor::chopInputIntoBlocks() {
                     return {std::move(bs), beginCoord, endCoord};
                   });
   assert(blocks.size() == blocksTotal);
-  assert(currPixel >= mRaw->dim.area());
+  assert(currPixel >= dim.area());
   assert(input.getRemainSize() == 0);
 
   // Clamp the end coordinate for the last block.
-  blocks.back().endCoord = mRaw->dim;
+  blocks.back().endCoord = dim;
   blocks.back().endCoord.y -= 1;
 }
 
+// Reads the block as if its two sections were swapped around, but in place,
+// without copying the block: the bytes before section_split_offset are
+// logically after the bytes past it.
 class PanasonicDecompressor::ProxyStream {
-  ByteStream block;
-  const uint32 section_split_offset;
-  std::vector<uchar8> buf;
+  // The logical first (i.e. the physical second) section of the block.
+  const uchar8* first;
+  uint32 firstSize;
 
-  int vbits = 0;
+  // The logical second (i.e. the physical first) section of the block.
+  const uchar8* second;
+  uint32 secondSize;
 
-  void parseBlock() {
-    assert(buf.empty());
-    assert(block.getRemainSize() <= BlockSize);
-    assert(section_split_offset <= BlockSize);
+  int vbits = 0;
 
-    Buffer FirstSection = block.getBuffer(section_split_offset);
-    Buffer SecondSection = block.getBuffer(block.getRemainSize());
+  // The byte at the logical position pos. One byte past the end is zero,
+  // so that getBits() does not have to special case the last byte.
+  inline uint32 getByte(uint32 pos) const noexcept {
+    if (pos < firstSize)
+      return first[pos];
+    pos -= firstSize;
+    if (pos < secondSize)
+      return second[pos];
+    return 0;
+  }
 
-    // get one more byte, so the return statement of getBits does not have
-    // to special case for accessing the last byte
-    buf.reserve(BlockSize + 1UL);
+  // The two bytes starting at the logical position pos, the first one being
+  // the low one.
+  inline uint32 getTwoBytes(uint32 pos) const noexcept {
+    // Unless the two bytes straddle the wrap point or the end,
+    // they are both in the same section.
+    if (pos + 1 < firstSize)
+      return first[pos] | first[pos + 1] << 8;
+    if (pos >= firstSize && pos + 1 - firstSize < secondSize)
+      return second[pos - firstSize] | second[pos + 1 - firstSize] << 8;
+    return getByte(pos) | getByte(pos + 1) << 8;
+  }
 
-    // First copy the second section. This makes it the first section.
-    buf.insert(buf.end(), SecondSection.begin(), SecondSection.end());
-    // Now append the original 1'st section right after the new 1'st section.
-    buf.insert(buf.end(), FirstSection.begin(), FirstSection.end());
+public:
+  ProxyStream(ByteStream block, uint32 section_split_offset) {
+    assert(block.getRemainSize() <= BlockSize);
+    assert(section_split_offset <= BlockSize);
 
+    const Buffer FirstSection = block.getBuffer(section_split_offset);
+    const Buffer SecondSection = block.getBuffer(block.getRemainSize());
     assert(block.getRemainSize() == 0);
 
-    // get one more byte, so the return statement of getBits does not have
-    // to special case for accessing the last byte
-    buf.emplace_back(0);
-  }
-
-public:
-  ProxyStream(ByteStream block_, int section_split_offset_)
-      : block(std::move(block_)), section_split_offset(section_split_offset_) {
-    parseBlock();
+    // The second section goes first.
+    first = SecondSection.begin();
+    firstSize = SecondSection.getSize();
+    second = FirstSection.begin();
+    secondSize = FirstSection.getSize();
   }
 
   uint32 getBits(int nbits) noexcept {
     vbits = (vbits - nbits) & 0x1ffff;
     int byte = vbits >> 3 ^ 0x3ff0;
-    return (buf[byte] | buf[byte + 1UL] << 8) >> (vbits & 7) & ~(-(1 << nbits));
+    return getTwoBytes(byte) >> (vbits & 7) & ~(-(1 << nbits));
   }
 };
 
@@ -200,7 +217,7 @@ void PanasonicDecompressor::processPixelPacket(
 
     *dest = pred[c];
 
-    if (zero_is_bad && 0 == pred[c])
+    if (zero_pos && 0 == pred[c])
       zero_pos->push_back((y << 16) | (xbegin + p));
 
     u++;
@@ -209,7 +226,8 @@ void PanasonicDecompressor::processPixelPacket(
 }
 
 void PanasonicDecompressor::processBlock(const Block& block,
-                                         std::vector<uint32>* zero_pos) const
+                                         std::vector<uint32>* zero_pos,
+                                         const BinnedRows* binned) const
     noexcept {
   ProxyStream bits(block.bs, section_split_offset);
 
@@ -219,12 +237,18 @@ void PanasonicDecompressor::processBlock(const Block& block,
     if (block.beginCoord.y == y)
       x = block.beginCoord.x;
 
-    int endx = mRaw->dim.x;
+    int endx = dim.x;
     // Last row may end before the last column.
     if (block.endCoord.y == y)
       endx = block.endCoord.x;
 
-    auto* dest = reinterpret_cast<ushort16*>(mRaw->getData(x, y));
+    ushort16* dest;
+    if (!binned)
+      dest = reinterpret_cast<ushort16*>(mRaw->getData(x, y));
+    else if (y >= binned->rowBegin && y < binned->rowEnd)
+      dest = binned->binner->getRow(y) + x;
+    else
+      dest = binned->discard + x;
 
     assert(x % PixelsPerPacket == 0);
     assert(endx % PixelsPerPacket == 0);
@@ -235,19 +259,23 @@ void PanasonicDecompressor::processBlock(const Block& block,
       x += PixelsPerPacket;
       dest += PixelsPerPacket;
     }
+
+    // The row may have begun in the previous block.
+    if (binned && y >= binned->rowBegin && y < binned->rowEnd &&
+        endx == dim.x)
+      binned->binner->rowDone(y);
   }
 }
 
-void PanasonicDecompressor::decompressThread() const noexcept {
+void PanasonicDecompressor::decompressThread(int begin,
+                                             int end) const noexcept {
   std::vector<uint32> zero_pos;
 
   assert(!blocks.empty());
 
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
-#endif
-  for (auto block = blocks.cbegin(); block < blocks.cend(); ++block)
-    processBlock(*block, &zero_pos);
+  for (auto block = blocks.cbegin() + begin; block < blocks.cbegin() + end;
+       ++block)
+    processBlock(*block, zero_is_bad ? &zero_pos : nullptr, nullptr);
 
   if (zero_is_bad && !zero_pos.empty()) {
     MutexLocker guard(&mRaw->mBadPixelMutex);
@@ -256,13 +284,47 @@ void PanasonicDecompressor::decompressThread() const noexcept {
   }
 }
 
+// The bands [begin, end) of the binned image, from the blocks that contain
+// their rows. The pixels can only be decoded sequentially within the block,
+// so the rows of the blocks that are not in these bands are still decoded,
+// but only into the discard row. The zeros are not reported in the binned
+// image, the bad pixels would not have full-resolution coordinates anyway.
+void PanasonicDecompressor::decompressBinnedThread(int begin,
+                                                   int end) const noexcept {
+  try {
+    CfaBinner binner(mRaw);
+    std::vector<ushort16> discard(dim.x);
+
+    BinnedRows binned;
+    binned.binner = &binner;
+    binned.rowBegin = begin * binner.getBandHeight();
+    binned.rowEnd = end * binner.getBandHeight();
+    binned.discard = discard.data();
+
+    const auto firstBlock = binned.rowBegin * dim.x / PixelsPerBlock;
+    const auto lastBlock = (binned.rowEnd * dim.x - 1) / PixelsPerBlock;
+    assert(lastBlock < blocks.size());
+
+    for (auto block = firstBlock; block <= lastBlock; block++)
+      processBlock(blocks[block], nullptr, &binned);
+  } catch (RawspeedException& err) {
+    mRaw->setError(err.what());
+  }
+}
+
 void PanasonicDecompressor::decompress() const noexcept {
   assert(!blocks.empty());
-#ifdef HAVE_OPENMP
-#pragma omp parallel default(none)                                             \
-    num_threads(rawspeed_get_number_of_processor_cores())
-#endif
-  decompressThread();
+
+  if (mRaw->isBinned()) {
+    parallelForChunks(
+        mRaw->parallelism, 0, dim.y / (2 * mRaw->binning),
+        [this](int begin, int end) { decompressBinnedThread(begin, end); });
+    return;
+  }
+
+  parallelForChunks(
+      mRaw->parallelism, 0, blocks.size(),
+      [this](int begin, int end) { decompressThread(begin, end); });
 }
 
 } // namespace rawspeed
@@ -20,7 +20,7 @@
 
 #pragma once
 
-#include "common/Common.h"                      // for uint32
+#include "common/Common.h"                      // for uint32, ushort16
 #include "common/Point.h"                       // for iPoint2D
 #include "common/RawImage.h"                    // for RawImage
 #include "decompressors/AbstractDecompressor.h" // for AbstractDecompressor
@@ -30,6 +30,8 @@
 
 namespace rawspeed {
 
+class CfaBinner;
+
 class PanasonicDecompressor final : public AbstractDecompressor {
   static constexpr uint32 BlockSize = 0x4000;
 
@@ -44,6 +46,10 @@ class PanasonicDecompressor final : public AbstractDecompressor {
   class ProxyStream;
 
   RawImage mRaw;
+
+  // Of the full-resolution image, even if it gets binned.
+  const iPoint2D dim;
+
   ByteStream input;
   bool zero_is_bad;
 
@@ -76,10 +82,21 @@ class PanasonicDecompressor final : public AbstractDecompressor {
   void processPixelPacket(ProxyStream* bits, int y, ushort16* dest, int xbegin,
                           std::vector<uint32>* zero_pos) const noexcept;
 
-  void processBlock(const Block& block, std::vector<uint32>* zero_pos) const
-      noexcept;
+  // Where the rows go, when binning.
+  struct BinnedRows {
+    CfaBinner* binner;
+    // The rows that are to be binned, the others go to the discard row.
+    int rowBegin;
+    int rowEnd;
+    ushort16* discard;
+  };
+
+  void processBlock(const Block& block, std::vector<uint32>* zero_pos,
+                    const BinnedRows* binned) const noexcept;
+
+  void decompressThread(int begin, int end) const noexcept;
 
-  void decompressThread() const noexcept;
+  void decompressBinnedThread(int begin, int end) const noexcept;
 
 public:
   PanasonicDecompressor(const RawImage& img, const ByteStream& input_,
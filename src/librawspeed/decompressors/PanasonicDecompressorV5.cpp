@@ -22,18 +22,26 @@
 
 #include "rawspeedconfig.h"
 #include "decompressors/PanasonicDecompressorV5.h"
+#include "common/CfaBinner.h"             // for CfaBinner
+#include "common/Cpuid.h"                 // for Cpuid
 #include "common/Point.h"                 // for iPoint2D
 #include "common/RawImage.h"              // for RawImage, RawImageData
+#include "common/RawspeedException.h"     // for RawspeedException
+#include "common/TaskScheduler.h"         // for parallelFor, parallelForC...
 #include "decoders/RawDecoderException.h" // for ThrowRDE
-#include "io/BitPumpLSB.h"                // for BitPumpLSB
-#include "io/Buffer.h"                    // for Buffer, DataBuffer
-#include <algorithm>                      // for generate_n
+#include "io/Endianness.h"                // for getLE
+#include <algorithm>                      // for copy_n, generate_n, min
+#include <array>                          // for array
 #include <cassert>                        // for assert
 #include <iterator>                       // for back_insert_iterator, back...
 #include <memory>                         // for allocator_traits<>::value_...
 #include <utility>                        // for move
 #include <vector>                         // for vector
 
+#if defined(WITH_SSSE3) || defined(WITH_AVX2)
+#include <immintrin.h> // for __m128i, _mm_shuffle_epi8, _mm_mulhi_epu16
+#endif
+
 namespace rawspeed {
 
 struct PanasonicDecompressorV5::PacketDsc {
@@ -58,7 +66,7 @@ constexpr PanasonicDecompressorV5::PacketDsc
 PanasonicDecompressorV5::PanasonicDecompressorV5(const RawImage& img,
                                                  const ByteStream& input_,
                                                  uint32 bps_)
-    : mRaw(img), bps(bps_) {
+    : mRaw(img), dim(mRaw->getUnbinnedDim()), bps(bps_) {
   if (mRaw->getCpp() != 1 || mRaw->getDataType() != TYPE_USHORT16 ||
       mRaw->getBpp() != 2)
     ThrowRDE("Unexpected component count / data type");
@@ -75,14 +83,12 @@ PanasonicDecompressorV5::PanasonicDecompressorV5(const RawImage& img,
     ThrowRDE("Unsupported bps: %u", bps);
   }
 
-  if (!mRaw->dim.hasPositiveArea() || mRaw->dim.x % dsc->pixelsPerPacket != 0) {
-    ThrowRDE("Unexpected image dimensions found: (%i; %i)", mRaw->dim.x,
-             mRaw->dim.y);
-  }
+  if (!dim.hasPositiveArea() || dim.x % dsc->pixelsPerPacket != 0)
+    ThrowRDE("Unexpected image dimensions found: (%i; %i)", dim.x, dim.y);
 
   // How many pixel packets does the specified pixel count require?
-  assert(mRaw->dim.area() % dsc->pixelsPerPacket == 0);
-  const auto numPackets = mRaw->dim.area() / dsc->pixelsPerPacket;
+  assert(dim.area() % dsc->pixelsPerPacket == 0);
+  const auto numPackets = dim.area() / dsc->pixelsPerPacket;
   assert(numPackets > 0);
 
   // And how many blocks that would be? Last block may not be full, pad it.
@@ -103,7 +109,7 @@ PanasonicDecompressorV5::PanasonicDecompressorV5(const RawImage& img,
 }
 
 void PanasonicDecompressorV5::chopInputIntoBlocks(const PacketDsc& dsc) {
-  auto pixelToCoordinate = [width = mRaw->dim.x](unsigned pixel) {
+  auto pixelToCoordinate = [width = dim.x](unsigned pixel) {
     return iPoint2D(pixel % width, pixel / width);
   };
 
@@ -111,8 +117,8 @@ void PanasonicDecompressorV5::chopInputIntoBlocks(const PacketDsc& dsc) {
   blocks.reserve(numBlocks);
 
   const auto pixelsPerBlock = dsc.pixelsPerPacket * PacketsPerBlock;
-  assert((numBlocks - 1U) * pixelsPerBlock < mRaw->dim.area());
-  assert(numBlocks * pixelsPerBlock >= mRaw->dim.area());
+  assert((numBlocks - 1U) * pixelsPerBlock < dim.area());
+  assert(numBlocks * pixelsPerBlock >= dim.area());
 
   unsigned currPixel = 0;
   std::generate_n(std::back_inserter(blocks), numBlocks,
@@ -125,80 +131,274 @@ void PanasonicDecompressorV5::chopInputIntoBlocks(const PacketDsc& dsc) {
                     return {std::move(bs), beginCoord, endCoord};
                   });
   assert(blocks.size() == numBlocks);
-  assert(currPixel >= mRaw->dim.area());
+  assert(currPixel >= dim.area());
   assert(input.getRemainSize() == 0);
 
   // Clamp the end coordinate for the last block.
-  blocks.back().endCoord = mRaw->dim;
+  blocks.back().endCoord = dim;
   blocks.back().endCoord.y -= 1;
 }
 
 class PanasonicDecompressorV5::ProxyStream {
-  ByteStream block;
-  std::vector<uchar8> buf;
-  ByteStream input;
+  // The size of the section that is to be decoded first, i.e. of the
+  // original second section.
+  static constexpr uint32 firstSectionSize = BlockSize - sectionSplitOffset;
 
-  void parseBlock() {
-    assert(buf.empty());
-    assert(block.getRemainSize() == BlockSize);
+  // sectionSplitOffset is not a multiple of bytesPerPacket, so there is
+  // one packet that begins in one section and ends in the other one.
+  static_assert(firstSectionSize % bytesPerPacket != 0, "");
+  static constexpr uint32 straddlingPacket = firstSectionSize / bytesPerPacket;
 
-    static_assert(BlockSize > sectionSplitOffset, "");
+  const uchar8* block;
 
-    Buffer FirstSection = block.getBuffer(sectionSplitOffset);
-    Buffer SecondSection = block.getBuffer(block.getRemainSize());
-    assert(FirstSection.getSize() < SecondSection.getSize());
+  // The straddling packet, glued back together.
+  std::array<uchar8, bytesPerPacket> straddling;
 
-    buf.reserve(BlockSize);
+public:
+  explicit ProxyStream(ByteStream bs) {
+    assert(bs.getRemainSize() == BlockSize);
+    block = bs.getData(BlockSize);
+
+    // It begins with the end of the original second section,
+    // and ends with the beginning of the original first section.
+    constexpr uint32 head = firstSectionSize % bytesPerPacket;
+    std::copy_n(block + BlockSize - head, head, straddling.begin());
+    std::copy_n(block, bytesPerPacket - head, straddling.begin() + head);
+  }
 
-    // First copy the second section. This makes it the first section.
-    buf.insert(buf.end(), SecondSection.begin(), SecondSection.end());
-    // Now append the original 1'st section right after the new 1'st section.
-    buf.insert(buf.end(), FirstSection.begin(), FirstSection.end());
+  // Returns the packets [packet, packet + *count). If not all of them are
+  // contiguous in memory, *count is reduced to how many of them are.
+  const uchar8* getPackets(uint32 packet, uint32* count) const {
+    assert(*count > 0);
+    assert(packet + *count <= PacketsPerBlock);
 
-    assert(buf.size() == BlockSize);
-    assert(block.getRemainSize() == 0);
+    if (packet < straddlingPacket) {
+      *count = std::min(*count, straddlingPacket - packet);
+      return block + sectionSplitOffset + packet * bytesPerPacket;
+    }
+
+    if (packet == straddlingPacket) {
+      *count = 1;
+      return straddling.data();
+    }
 
-    // And reset the clock.
-    input = ByteStream(DataBuffer(Buffer(buf.data(), buf.size())));
-    // input.setByteOrder(Endianness::big); // does not seem to matter?!
+    return block + packet * bytesPerPacket - firstSectionSize;
   }
+};
 
-public:
-  explicit ProxyStream(ByteStream block_) : block(std::move(block_)) {}
+namespace {
+
+// Within the packet, the bits are consumed LSB-first, so it is effectively one
+// little-endian 128-bit integer, with p'th pixel being in the bits
+// [p * bps, (p + 1) * bps), followed by the padding bits, if any.
+template <int bps> struct PacketLayout final {
+  static_assert(bps > 0 && bps <= 16, "");
+
+  static constexpr int pixelsPerPacket = 128 / bps;
+  static constexpr ushort16 mask = (1U << bps) - 1U;
+
+  static constexpr int firstByte(int p) { return p * bps / 8; }
+  static constexpr int firstBit(int p) { return p * bps % 8; }
+
+  // Pixels [8, pixelsPerPacket) are entirely in the upper half.
+  static_assert(pixelsPerPacket >= 8 && 8 * bps >= 64, "");
 
-  ByteStream& getStream() {
-    parseBlock();
-    return input;
+  static inline void unpackTail(const uchar8* packet, ushort16* dest) {
+    const uint64 hi = getLE<uint64>(packet + 8);
+    for (int p = 8; p < pixelsPerPacket; p++)
+      dest[p] = (hi >> (p * bps - 64)) & mask;
   }
 };
 
-template <const PanasonicDecompressorV5::PacketDsc& dsc>
-void PanasonicDecompressorV5::processPixelPacket(BitPumpLSB* bs,
-                                                 ushort16* dest) const {
-  static_assert(dsc.pixelsPerPacket > 0, "dsc should be compile-time const");
-  static_assert(dsc.bps > 0 && dsc.bps <= 16, "");
+template <int bps>
+inline void unpackPacket(const uchar8* packet, ushort16* dest) {
+  using Layout = PacketLayout<bps>;
+
+  const uint64 lo = getLE<uint64>(packet);
+  const uint64 hi = getLE<uint64>(packet + 8);
+
+  for (int p = 0; p < Layout::pixelsPerPacket; p++) {
+    const int bit = p * bps;
+    uint64 bits;
+    if (bit + bps <= 64)
+      bits = lo >> bit;
+    else if (bit >= 64)
+      bits = hi >> (bit - 64);
+    else
+      bits = (lo >> bit) | (hi << (64 - bit));
+    dest[p] = bits & Layout::mask;
+  }
+}
 
-  assert(bs->getFillLevel() == 0);
+template <int bps>
+void unpackPackets(const uchar8* packets, uint32 count, ushort16* dest) {
+  for (uint32 i = 0; i < count; i++) {
+    unpackPacket<bps>(packets, dest);
+    packets += 16;
+    dest += PacketLayout<bps>::pixelsPerPacket;
+  }
+}
 
-  const ushort16* const endDest = dest + dsc.pixelsPerPacket;
-  for (; dest != endDest;) {
-    bs->fill();
-    for (; bs->getFillLevel() >= dsc.bps; dest++) {
-      assert(dest != endDest);
+#if defined(WITH_SSSE3) || defined(WITH_AVX2)
 
-      *dest = bs->getBitsNoFill(dsc.bps);
-    }
+// The first 8 pixels of the packet are unpacked into the 16-bit lanes.
+// A pixel spans at most 3 bytes, b = firstByte(p) .. b+2. With s = firstBit(p),
+// the pixel is ((bytes b..b+1) >> s) | ((byte b+2) << (16 - s)), masked.
+// Both shifts are done by multiplying by 2^(16 - s), which does not fit into
+// 16 bits for s == 0, so those lanes are passed through separately.
+template <int bps> struct PacketShuffle final {
+  using Layout = PacketLayout<bps>;
+
+  static constexpr char byte(int p, int offset) {
+    return Layout::firstByte(p) + offset < 16
+               ? static_cast<char>(Layout::firstByte(p) + offset)
+               : -128; // zero the byte.
   }
-  bs->skipBitsNoFill(bs->getFillLevel()); // get rid of padding.
+
+  static constexpr short mul(int p) {
+    return Layout::firstBit(p) == 0
+               ? 0
+               : static_cast<short>(1U << (16 - Layout::firstBit(p)));
+  }
+
+  static constexpr short keep(int p) {
+    return Layout::firstBit(p) == 0 ? -1 : 0;
+  }
+};
+
+#define RAWSPEED_PACKET_SHUFFLE(OFFSET0, OFFSET1)                              \
+  S::byte(0, OFFSET0), S::byte(0, OFFSET1), S::byte(1, OFFSET0),               \
+      S::byte(1, OFFSET1), S::byte(2, OFFSET0), S::byte(2, OFFSET1),           \
+      S::byte(3, OFFSET0), S::byte(3, OFFSET1), S::byte(4, OFFSET0),           \
+      S::byte(4, OFFSET1), S::byte(5, OFFSET0), S::byte(5, OFFSET1),           \
+      S::byte(6, OFFSET0), S::byte(6, OFFSET1), S::byte(7, OFFSET0),           \
+      S::byte(7, OFFSET1)
+#define RAWSPEED_PACKET_LANES(F)                                               \
+  S::F(0), S::F(1), S::F(2), S::F(3), S::F(4), S::F(5), S::F(6), S::F(7)
+
+#endif
+
+#ifdef WITH_SSSE3
+
+template <int bps>
+__attribute__((target("ssse3"))) void
+unpackPackets_SSSE3(const uchar8* packets, uint32 count, ushort16* dest) {
+  using Layout = PacketLayout<bps>;
+  using S = PacketShuffle<bps>;
+
+  const __m128i lowBytes = _mm_setr_epi8(RAWSPEED_PACKET_SHUFFLE(0, 1));
+  const __m128i highByte = _mm_setr_epi8(RAWSPEED_PACKET_SHUFFLE(2, 16));
+  const __m128i mul = _mm_setr_epi16(RAWSPEED_PACKET_LANES(mul));
+  const __m128i keep = _mm_setr_epi16(RAWSPEED_PACKET_LANES(keep));
+  const __m128i mask = _mm_set1_epi16(Layout::mask);
+
+  for (uint32 i = 0; i < count; i++) {
+    const __m128i packet =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(packets));
+
+    const __m128i lo = _mm_shuffle_epi8(packet, lowBytes);
+    const __m128i hi = _mm_shuffle_epi8(packet, highByte);
+
+    __m128i pixels =
+        _mm_or_si128(_mm_mulhi_epu16(lo, mul), _mm_and_si128(lo, keep));
+    pixels = _mm_or_si128(pixels, _mm_mullo_epi16(hi, mul));
+    pixels = _mm_and_si128(pixels, mask);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), pixels);
+    Layout::unpackTail(packets, dest);
+
+    packets += 16;
+    dest += Layout::pixelsPerPacket;
+  }
+}
+
+#endif
+
+#ifdef WITH_AVX2
+
+// Same as the SSSE3 one, but two packets at a time, one per 128-bit lane.
+template <int bps>
+__attribute__((target("avx2"))) void
+unpackPackets_AVX2(const uchar8* packets, uint32 count, ushort16* dest) {
+  using Layout = PacketLayout<bps>;
+  using S = PacketShuffle<bps>;
+
+  const __m256i lowBytes = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(RAWSPEED_PACKET_SHUFFLE(0, 1)));
+  const __m256i highByte = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(RAWSPEED_PACKET_SHUFFLE(2, 16)));
+  const __m256i mul =
+      _mm256_broadcastsi128_si256(_mm_setr_epi16(RAWSPEED_PACKET_LANES(mul)));
+  const __m256i keep =
+      _mm256_broadcastsi128_si256(_mm_setr_epi16(RAWSPEED_PACKET_LANES(keep)));
+  const __m256i mask = _mm256_set1_epi16(Layout::mask);
+
+  uint32 i = 0;
+  for (; i + 2 <= count; i += 2) {
+    const __m256i packet =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(packets));
+
+    const __m256i lo = _mm256_shuffle_epi8(packet, lowBytes);
+    const __m256i hi = _mm256_shuffle_epi8(packet, highByte);
+
+    __m256i pixels = _mm256_or_si256(_mm256_mulhi_epu16(lo, mul),
+                                     _mm256_and_si256(lo, keep));
+    pixels = _mm256_or_si256(pixels, _mm256_mullo_epi16(hi, mul));
+    pixels = _mm256_and_si256(pixels, mask);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest),
+                     _mm256_castsi256_si128(pixels));
+    Layout::unpackTail(packets, dest);
+    dest += Layout::pixelsPerPacket;
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest),
+                     _mm256_extracti128_si256(pixels, 1));
+    Layout::unpackTail(packets + 16, dest);
+    dest += Layout::pixelsPerPacket;
+
+    packets += 2 * 16;
+  }
+
+  if (i != count)
+    unpackPacket<bps>(packets, dest);
+}
+
+#endif
+
+#undef RAWSPEED_PACKET_LANES
+#undef RAWSPEED_PACKET_SHUFFLE
+
+} // namespace
+
+template <const PanasonicDecompressorV5::PacketDsc& dsc>
+PanasonicDecompressorV5::PacketUnpacker
+PanasonicDecompressorV5::getPacketUnpacker() {
+  static_assert(dsc.pixelsPerPacket == PacketLayout<dsc.bps>::pixelsPerPacket,
+                "");
+
+#ifdef WITH_AVX2
+  if (Cpuid::AVX2())
+    return &unpackPackets_AVX2<dsc.bps>;
+#endif
+
+#ifdef WITH_SSSE3
+  if (Cpuid::SSSE3())
+    return &unpackPackets_SSSE3<dsc.bps>;
+#endif
+
+  return &unpackPackets<dsc.bps>;
 }
 
 template <const PanasonicDecompressorV5::PacketDsc& dsc>
-void PanasonicDecompressorV5::processBlock(const Block& block) const {
+void PanasonicDecompressorV5::processBlock(const Block& block,
+                                           PacketUnpacker unpack,
+                                           CfaBinner* binner, int rowBegin,
+                                           int rowEnd) const {
   static_assert(dsc.pixelsPerPacket > 0, "dsc should be compile-time const");
   static_assert(BlockSize % bytesPerPacket == 0, "");
 
-  ProxyStream proxy(block.bs);
-  BitPumpLSB bs(proxy.getStream());
+  const ProxyStream proxy(block.bs);
+  uint32 packet = 0;
 
   for (int y = block.beginCoord.y; y <= block.endCoord.y; y++) {
     int x = 0;
@@ -206,33 +406,80 @@ void PanasonicDecompressorV5::processBlock(const Block& block) const {
     if (block.beginCoord.y == y)
       x = block.beginCoord.x;
 
-    int endx = mRaw->dim.x;
+    int endx = dim.x;
     // Last row may end before the last column.
     if (block.endCoord.y == y)
       endx = block.endCoord.x;
 
-    auto* dest = reinterpret_cast<ushort16*>(mRaw->getData(x, y));
-
     assert(x % dsc.pixelsPerPacket == 0);
     assert(endx % dsc.pixelsPerPacket == 0);
 
-    for (; x < endx;) {
-      processPixelPacket<dsc>(&bs, dest);
+    // The packets are of fixed size, so the unwanted rows are just skipped.
+    if (y < rowBegin || y >= rowEnd) {
+      packet += (endx - x) / dsc.pixelsPerPacket;
+      continue;
+    }
+
+    auto* dest = binner ? binner->getRow(y) + x
+                        : reinterpret_cast<ushort16*>(mRaw->getData(x, y));
 
-      x += dsc.pixelsPerPacket;
-      dest += dsc.pixelsPerPacket;
+    for (uint32 count = (endx - x) / dsc.pixelsPerPacket; count > 0;) {
+      uint32 n = count;
+      const uchar8* packets = proxy.getPackets(packet, &n);
+      unpack(packets, n, dest);
+
+      packet += n;
+      count -= n;
+      dest += n * dsc.pixelsPerPacket;
     }
+
+    // The row may have begun in the previous block.
+    if (binner && endx == dim.x)
+      binner->rowDone(y);
+  }
+}
+
+// The bands [begin, end) of the binned image, each from just the blocks that
+// contain its rows. The rows that do not make up a whole band are skipped.
+template <const PanasonicDecompressorV5::PacketDsc& dsc>
+void PanasonicDecompressorV5::processBinnedBands(int begin, int end,
+                                                 PacketUnpacker unpack) const
+    noexcept {
+  try {
+    CfaBinner binner(mRaw);
+    const int bandHeight = binner.getBandHeight();
+    const auto pixelsPerBlock = dsc.pixelsPerPacket * PacketsPerBlock;
+
+    for (int band = begin; band < end; band++) {
+      const int rowBegin = band * bandHeight;
+      const int rowEnd = rowBegin + bandHeight;
+      const auto firstBlock = rowBegin * dim.x / pixelsPerBlock;
+      const auto lastBlock = (rowEnd * dim.x - 1) / pixelsPerBlock;
+      assert(lastBlock < blocks.size());
+
+      for (auto block = firstBlock; block <= lastBlock; block++)
+        processBlock<dsc>(blocks[block], unpack, &binner, rowBegin, rowEnd);
+    }
+  } catch (RawspeedException& err) {
+    mRaw->setError(err.what());
   }
 }
 
 template <const PanasonicDecompressorV5::PacketDsc& dsc>
 void PanasonicDecompressorV5::decompressInternal() const noexcept {
-#ifdef HAVE_OPENMP
-#pragma omp parallel for num_threads(rawspeed_get_number_of_processor_cores()) \
-    schedule(static) default(none)
-#endif
-  for (auto block = blocks.cbegin(); block < blocks.cend(); ++block)
-    processBlock<dsc>(*block);
+  const PacketUnpacker unpack = getPacketUnpacker<dsc>();
+
+  if (mRaw->isBinned()) {
+    parallelForChunks(mRaw->parallelism, 0, dim.y / (2 * mRaw->binning),
+                      [this, unpack](int begin, int end) {
+                        processBinnedBands<dsc>(begin, end, unpack);
+                      });
+    return;
+  }
+
+  parallelFor(mRaw->parallelism, 0, blocks.size(), [this, unpack](int block) {
+    processBlock<dsc>(blocks[block], unpack, nullptr, 0, dim.y);
+  });
 }
 
 void PanasonicDecompressorV5::decompress() const noexcept {
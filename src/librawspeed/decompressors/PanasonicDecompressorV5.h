@@ -21,11 +21,10 @@
 
 #pragma once
 
-#include "common/Common.h"                      // for uint32
+#include "common/Common.h"                      // for uint32, uchar8, ushort16
 #include "common/Point.h"                       // for iPoint2D
 #include "common/RawImage.h"                    // for RawImage
 #include "decompressors/AbstractDecompressor.h" // for AbstractDecompressor
-#include "io/BitPumpLSB.h"                      // for BitPumpLSB
 #include "io/ByteStream.h"                      // for ByteStream
 #include <cstddef>                              // for size_t
 #include <utility>                              // for move
@@ -33,6 +32,8 @@
 
 namespace rawspeed {
 
+class CfaBinner;
+
 class PanasonicDecompressorV5 final : public AbstractDecompressor {
   // The RW2 raw image buffer consists of individual blocks,
   // each one BlockSize bytes in size.
@@ -63,8 +64,18 @@ class PanasonicDecompressorV5 final : public AbstractDecompressor {
   // Takes care of unsplitting&swapping back the block at sectionSplitOffset.
   class ProxyStream;
 
+  // Unpacks count consecutive packets into count * pixelsPerPacket pixels.
+  // There is a plain one, and SSSE3/AVX2 ones, chosen at runtime.
+  using PacketUnpacker = void (*)(const uchar8* packets, uint32 count,
+                                  ushort16* dest);
+
+  template <const PacketDsc& dsc> static PacketUnpacker getPacketUnpacker();
+
   RawImage mRaw;
 
+  // Of the full-resolution image, even if it gets binned.
+  const iPoint2D dim;
+
   // The full input buffer, containing all the blocks.
   ByteStream input;
 
@@ -90,10 +101,14 @@ class PanasonicDecompressorV5 final : public AbstractDecompressor {
 
   void chopInputIntoBlocks(const PacketDsc& dsc);
 
+  // Only the rows [rowBegin, rowEnd) of the block, into the binner if any.
   template <const PacketDsc& dsc>
-  void processPixelPacket(BitPumpLSB* bs, ushort16* dest) const;
+  void processBlock(const Block& block, PacketUnpacker unpack,
+                    CfaBinner* binner, int rowBegin, int rowEnd) const;
 
-  template <const PacketDsc& dsc> void processBlock(const Block& block) const;
+  template <const PacketDsc& dsc>
+  void processBinnedBands(int begin, int end, PacketUnpacker unpack) const
+      noexcept;
 
   template <const PacketDsc& dsc> void decompressInternal() const noexcept;
 
@@ -39,12 +39,13 @@ public:
 
   void decompress(const ByteStream& data) const;
 
+  // Public for the HuffmanTable benchmark.
+  static const std::array<std::array<std::array<uchar8, 16>, 2>, 1> pentax_tree;
+
 private:
   static HuffmanTable SetupHuffmanTable_Legacy();
   static HuffmanTable SetupHuffmanTable_Modern(ByteStream stream);
   static HuffmanTable SetupHuffmanTable(ByteStream* metaData);
-
-  static const std::array<std::array<std::array<uchar8, 16>, 2>, 1> pentax_tree;
 };
 
 } // namespace rawspeed
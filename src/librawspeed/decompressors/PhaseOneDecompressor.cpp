@@ -25,9 +25,10 @@
 #include "common/Common.h"                // for int32, uint32, ushort16
 #include "common/Point.h"                 // for iPoint2D
 #include "common/RawImage.h"              // for RawImage, RawImageData
+#include "common/TaskScheduler.h"         // for parallelForChunks
 #include "decoders/RawDecoderException.h" // for ThrowRDE
 #include "io/BitPumpMSB32.h"              // for BitPumpMSB32
-#include <algorithm>                      // for for_each
+#include <algorithm>                      // for for_each, max, min
 #include <array>                          // for array
 #include <cassert>                        // for assert
 #include <cstddef>                        // for size_t
@@ -54,6 +55,37 @@ PhaseOneDecompressor::PhaseOneDecompressor(const RawImage& img,
   validateStrips();
 }
 
+void PhaseOneQuadrantCurves::apply(const RawImage& img, int row, int colBegin,
+                                   int colEnd) const {
+  assert(row >= 0 && row < img->dim.y);
+  assert(colBegin >= 0 && colBegin <= colEnd && colEnd <= img->dim.x);
+
+  const std::array<std::vector<ushort16>, 2>& quadRow =
+      tables[row < splitRow ? 0 : 1];
+
+  auto* pixel = reinterpret_cast<ushort16*>(img->getData(0, row));
+
+  const int split = std::min(std::max(splitCol, colBegin), colEnd);
+  for (int col = colBegin; col < split; col++)
+    pixel[col] = quadRow[0][pixel[col]];
+  for (int col = split; col < colEnd; col++)
+    pixel[col] = quadRow[1][pixel[col]];
+}
+
+void PhaseOneDecompressor::setQuadrantCurves(
+    const PhaseOneQuadrantCurves* curves_,
+    std::vector<std::pair<int, int>>&& columns) {
+  assert(curves_);
+  for (const auto& range : columns) {
+    if (range.first < 0 || range.first > range.second ||
+        range.second > mRaw->dim.x)
+      ThrowRDE("Bad column range [%i, %i)", range.first, range.second);
+  }
+
+  curves = curves_;
+  curveColumns = std::move(columns);
+}
+
 void PhaseOneDecompressor::validateStrips() const {
   // The 'strips' vector should contain exactly one element per row of image.
 
@@ -142,28 +174,30 @@ void PhaseOneDecompressor::decompressStrip(const PhaseOneStrip& strip) const {
       img[col] = ushort16(pred[col & 1]);
     }
   }
+
+  if (curves) {
+    for (const auto& range : curveColumns)
+      curves->apply(mRaw, strip.n, range.first, range.second);
+  }
 }
 
-void PhaseOneDecompressor::decompressThread() const noexcept {
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
-#endif
-  for (auto strip = strips.cbegin(); strip < strips.cend(); ++strip) {
+void PhaseOneDecompressor::decompressThread(int begin,
+                                            int end) const noexcept {
+  for (auto strip = strips.cbegin() + begin; strip < strips.cbegin() + end;
+       ++strip) {
     try {
       decompressStrip(*strip);
     } catch (RawspeedException& err) {
-      // Propagate the exception out of OpenMP magic.
+      // Propagate the exception out of the worker thread.
       mRaw->setError(err.what());
     }
   }
 }
 
 void PhaseOneDecompressor::decompress() const {
-#ifdef HAVE_OPENMP
-#pragma omp parallel default(none)                                             \
-    num_threads(rawspeed_get_number_of_processor_cores())
-#endif
-  decompressThread();
+  parallelForChunks(
+      mRaw->parallelism, 0, strips.size(),
+      [this](int begin, int end) { decompressThread(begin, end); });
 
   std::string firstErr;
   if (mRaw->isTooManyErrors(1, &firstErr)) {
@@ -22,10 +22,12 @@
 
 #pragma once
 
+#include "common/Common.h"                      // for ushort16
 #include "common/RawImage.h"                    // for RawImage
 #include "decompressors/AbstractDecompressor.h" // for AbstractDecompressor
 #include "io/ByteStream.h"                      // for ByteStream
-#include <utility>                              // for move
+#include <array>                                // for array
+#include <utility>                              // for move, pair
 #include <vector>                               // for vector
 
 namespace rawspeed {
@@ -39,14 +41,33 @@ struct PhaseOneStrip {
   PhaseOneStrip(int block, ByteStream bs_) : n(block), bs(std::move(bs_)) {}
 };
 
+// Maps each pixel through one of the four lookup tables, depending on which
+// quadrant of the image (split at splitCol/splitRow) it is in.
+// These are the IIQ quadrant multipliers, see IiqDecoder.
+struct PhaseOneQuadrantCurves final {
+  int splitRow = 0;
+  int splitCol = 0;
+
+  // [quadRow][quadCol], with 65536 entries each.
+  std::array<std::array<std::vector<ushort16>, 2>, 2> tables;
+
+  // Only the columns [colBegin, colEnd) of the row.
+  void apply(const RawImage& img, int row, int colBegin, int colEnd) const;
+};
+
 class PhaseOneDecompressor final : public AbstractDecompressor {
   RawImage mRaw;
 
   std::vector<PhaseOneStrip> strips;
 
+  // Optional. Applied to these [begin, end) column ranges of each row
+  // right after it was decoded, while it is still in cache.
+  const PhaseOneQuadrantCurves* curves = nullptr;
+  std::vector<std::pair<int, int>> curveColumns;
+
   void decompressStrip(const PhaseOneStrip& strip) const;
 
-  void decompressThread() const noexcept;
+  void decompressThread(int begin, int end) const noexcept;
 
   void validateStrips() const;
 
@@ -54,6 +75,9 @@ public:
   PhaseOneDecompressor(const RawImage& img,
                        std::vector<PhaseOneStrip>&& strips_);
 
+  void setQuadrantCurves(const PhaseOneQuadrantCurves* curves_,
+                         std::vector<std::pair<int, int>>&& columns);
+
   void decompress() const;
 };
 
@@ -21,15 +21,21 @@
 */
 
 #include "decompressors/SamsungV0Decompressor.h"
-#include "common/Common.h"                // for uint32, ushort16, int32
+#include "common/Common.h"                // for uint32, ushort16, roundDown
 #include "common/Point.h"                 // for iPoint2D
 #include "common/RawImage.h"              // for RawImage, RawImageData
+#include "common/RawspeedException.h"     // for RawspeedException
+#include "common/TaskScheduler.h"         // for parallelFor, Schedule
 #include "decoders/RawDecoderException.h" // for ThrowRDE
 #include "io/BitPumpMSB32.h"              // for BitPumpMSB32
 #include "io/ByteStream.h"                // for ByteStream
 #include <algorithm>                      // for max
+#include <atomic>                         // for atomic
 #include <cassert>                        // for assert
 #include <iterator>                       // for advance, begin, end, next
+#include <string>                         // for string
+#include <thread>                         // for yield
+#include <utility>                        // for swap
 #include <vector>                         // for vector
 
 namespace rawspeed {
@@ -83,26 +89,78 @@ void SamsungV0Decompressor::computeStripes(ByteStream bso, ByteStream bsr) {
   assert(stripes.size() == height);
 }
 
-void SamsungV0Decompressor::decompress() const {
-  for (int y = 0; y < mRaw->dim.y; y++)
-    decompressStrip(y, stripes[y]);
+// Each row is predicted from the two rows above it, but only ever from the
+// same 16-pixel block. So row y can decode its block b as soon as row y - 1
+// has decoded it (and thus row y - 2 too), and consecutive rows can be
+// decoded concurrently, each lagging a block or so behind the previous one.
+// Every row publishes how many of its blocks are done. The rows are handed
+// out to the threads in increasing order, so the row that is being waited
+// for is always being worked on by someone, and this can not deadlock.
+class SamsungV0Decompressor::Wavefront final {
+  std::vector<std::atomic<int>> blocksDone;
+  std::atomic<bool> failed{false};
+
+public:
+  explicit Wavefront(int height) : blocksDone(height) {}
+
+  // Returns false if the decoding has failed, and there is no point to go on.
+  bool waitFor(int row, int blocks) const {
+    while (blocksDone[row].load(std::memory_order_acquire) < blocks) {
+      if (hasFailed())
+        return false;
+      std::this_thread::yield();
+    }
+    return true;
+  }
 
-  // Swap red and blue pixels to get the final CFA pattern
-  for (int y = 0; y < mRaw->dim.y - 1; y += 2) {
-    auto* topline = reinterpret_cast<ushort16*>(mRaw->getData(0, y));
-    auto* bottomline = reinterpret_cast<ushort16*>(mRaw->getData(0, y + 1));
+  void publish(int row, int blocks) {
+    blocksDone[row].store(blocks, std::memory_order_release);
+  }
 
-    for (int x = 0; x < mRaw->dim.x - 1; x += 2) {
-      ushort16 temp = topline[1];
-      topline[1] = bottomline[0];
-      bottomline[0] = temp;
+  bool hasFailed() const { return failed.load(std::memory_order_relaxed); }
 
-      topline += 2;
-      bottomline += 2;
-    }
+  void fail() { failed.store(true, std::memory_order_relaxed); }
+};
+
+void SamsungV0Decompressor::decompressRow(uint32 y,
+                                          Wavefront* wavefront) const noexcept {
+  if (wavefront->hasFailed())
+    return;
+
+  try {
+    decompressStrip(y, stripes[y], wavefront);
+  } catch (RawspeedException& err) {
+    // Propagate the exception out of the worker thread.
+    mRaw->setError(err.what());
+    wavefront->fail();
+  }
+}
+
+void SamsungV0Decompressor::decompress() const {
+  Wavefront wavefront(mRaw->dim.y);
+
+  parallelFor(
+      mRaw->parallelism, 0, mRaw->dim.y,
+      [this, &wavefront](int y) { decompressRow(y, &wavefront); },
+      Schedule::Dynamic);
+
+  std::string firstErr;
+  if (mRaw->isTooManyErrors(1, &firstErr)) {
+    ThrowRDE("Too many errors encountered. Giving up. First Error:\n%s",
+             firstErr.c_str());
   }
 }
 
+// Swap red and blue pixels to get the final CFA pattern
+void SamsungV0Decompressor::swapRedBlue(uint32 topRow, uint32 xBegin,
+                                        uint32 xEnd) const {
+  auto* topline = reinterpret_cast<ushort16*>(mRaw->getData(0, topRow));
+  auto* bottomline = reinterpret_cast<ushort16*>(mRaw->getData(0, topRow + 1));
+
+  for (uint32 x = xBegin; x < xEnd && x + 1 < uint32(mRaw->dim.x); x += 2)
+    std::swap(topline[x + 1], bottomline[x]);
+}
+
 int32 SamsungV0Decompressor::calcAdj(BitPumpMSB32* bits, int b) {
   int32 adj = 0;
   if (b)
@@ -110,11 +168,18 @@ int32 SamsungV0Decompressor::calcAdj(BitPumpMSB32* bits, int b) {
   return adj;
 }
 
-void SamsungV0Decompressor::decompressStrip(uint32 y,
-                                            const ByteStream& bs) const {
+void SamsungV0Decompressor::decompressStrip(uint32 y, const ByteStream& bs,
+                                            Wavefront* wavefront) const {
   const uint32 width = mRaw->dim.x;
+  const uint32 height = mRaw->dim.y;
   assert(width > 0);
 
+  // The red/blue swap of the row pair (y - 2, y - 1) is done while decoding
+  // the even row y, which is the last one to read the original values.
+  // The block b - 1 is swapped once the block b of the row y is done, since
+  // by then the row y - 1 no longer needs it for the left prediction either.
+  const bool swapsPairAbove = y >= 2 && y % 2 == 0;
+
   BitPumpMSB32 bits(bs);
 
   std::array<int, 4> len;
@@ -130,7 +195,10 @@ void SamsungV0Decompressor::decompressStrip(uint32 y,
       mRaw->getData(0, std::max(0, static_cast<int>(y) - 2)));
 
   // Image is arranged in groups of 16 pixels horizontally
-  for (uint32 x = 0; x < width; x += 16) {
+  for (uint32 x = 0, block = 0; x < width; x += 16, block++) {
+    if (y > 0 && !wavefront->waitFor(y - 1, block + 1))
+      return;
+
     bits.fill();
     bool dir = !!bits.getBitsNoFill(1);
 
@@ -211,10 +279,21 @@ void SamsungV0Decompressor::decompressStrip(uint32 y,
       }
     }
 
+    wavefront->publish(y, block + 1);
+    if (swapsPairAbove && block > 0)
+      swapRedBlue(y - 2, x - 16, x);
+
     img += 16;
     img_up += 16;
     img_up2 += 16;
   }
+
+  if (swapsPairAbove)
+    swapRedBlue(y - 2, static_cast<uint32>(roundDown(width - 1, 16)), width);
+
+  // The last pair of rows has no row below it to do that.
+  if (y % 2 == 1 && y == height - 1)
+    swapRedBlue(y - 1, 0, width);
 }
 
 } // namespace rawspeed
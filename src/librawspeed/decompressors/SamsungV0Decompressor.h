@@ -34,9 +34,15 @@ class RawImage;
 class SamsungV0Decompressor final : public AbstractSamsungDecompressor {
   std::vector<ByteStream> stripes;
 
+  class Wavefront;
+
   void computeStripes(ByteStream bso, ByteStream bsr);
 
-  void decompressStrip(uint32 y, const ByteStream& bs) const;
+  void decompressStrip(uint32 y, const ByteStream& bs,
+                       Wavefront* wavefront) const;
+  void decompressRow(uint32 y, Wavefront* wavefront) const noexcept;
+
+  void swapRedBlue(uint32 topRow, uint32 xBegin, uint32 xEnd) const;
 
   static int32 calcAdj(BitPumpMSB32* bits, int b);
 
@@ -22,13 +22,22 @@
 
 #include "rawspeedconfig.h"
 #include "decompressors/SonyArw2Decompressor.h"
+#include "common/CfaBinner.h"             // for CfaBinner
 #include "common/Common.h"                // for uint32
+#include "common/Cpuid.h"                 // for Cpuid
 #include "common/Point.h"                 // for iPoint2D
 #include "common/RawImage.h"              // for RawImage
+#include "common/TaskScheduler.h"         // for parallelForChunks
 #include "decoders/RawDecoderException.h" // for ThrowRDE
 #include "io/BitPumpLSB.h"                // for BitPumpLSB
+#include "io/Endianness.h"                // for getLE
+#include <array>                          // for array
 #include <cassert>                        // for assert
 
+#ifdef WITH_AVX2
+#include <immintrin.h> // for __m256i, _mm256_shuffle_epi8, ...
+#endif
+
 namespace rawspeed {
 
 SonyArw2Decompressor::SonyArw2Decompressor(const RawImage& img,
@@ -38,41 +47,62 @@ SonyArw2Decompressor::SonyArw2Decompressor(const RawImage& img,
       mRaw->getBpp() != 2)
     ThrowRDE("Unexpected component count / data type");
 
-  const uint32 w = mRaw->dim.x;
-  const uint32 h = mRaw->dim.y;
+  dim = mRaw->getUnbinnedDim();
+  const uint32 w = dim.x;
+  const uint32 h = dim.y;
 
-  if (w == 0 || h == 0 || w % 32 != 0 || w > 8000 || h > 5320)
+  if (w == 0 || h == 0 || w % 32 != 0 || w > 9600 || h > 6376)
     ThrowRDE("Unexpected image dimensions found: (%u; %u)", w, h);
 
   // 1 byte per pixel
-  input = input_.peekStream(mRaw->dim.x * mRaw->dim.y);
-}
-
-void SonyArw2Decompressor::decompressRow(int row) const {
-  uchar8* data = mRaw->getData();
-  uint32 pitch = mRaw->pitch;
-  int32 w = mRaw->dim.x;
+  input = input_.peekStream(dim.x * dim.y);
 
-  assert(mRaw->dim.x > 0);
-  assert(mRaw->dim.x % 32 == 0);
+#ifdef WITH_AVX2
+  useAVX2 = Cpuid::AVX2();
+#endif
+}
 
-  auto* dest = reinterpret_cast<ushort16*>(&data[row * pitch]);
+void SonyArw2Decompressor::decompressRow(int row, ushort16* dest) const {
+  assert(dim.x > 0);
+  assert(dim.x % 32 == 0);
 
   ByteStream rowBs = input;
-  rowBs.skipBytes(row * mRaw->dim.x);
-  rowBs = rowBs.peekStream(mRaw->dim.x);
+  rowBs.skipBytes(row * dim.x);
+
+  // Unless this is the last row, let the pump read ahead into the next one.
+  // Then this row is validated once, here, and not on each refill.
+  const bool unchecked = rowBs.getRemainSize() >=
+                         static_cast<uint64>(dim.x) +
+                             BitPumpLSB::MaxReadAheadBytes;
+  rowBs = rowBs.peekStream(unchecked ? dim.x + BitPumpLSB::MaxReadAheadBytes
+                                     : dim.x);
 
   BitPumpLSB bits(rowBs);
 
   uint32 random = bits.peekBits(24);
 
+  if (unchecked) {
+    assert(bits.canConsumeUnchecked(dim.x));
+    decompressBlocks(dest, random,
+                     [&bits](uint32 n) { return bits.getBitsUnchecked(n); });
+  } else {
+    decompressBlocks(dest, random,
+                     [&bits](uint32 n) { return bits.getBits(n); });
+  }
+}
+
+template <typename BitReader>
+void SonyArw2Decompressor::decompressBlocks(ushort16* dest, uint32 random,
+                                            BitReader getBits) const {
+  int32 w = dim.x;
+
   // Each loop iteration processes 16 pixels, consuming 128 bits of input.
   for (int32 x = 0; x < w;) {
     // 30 bits.
-    int _max = bits.getBits(11);
-    int _min = bits.getBits(11);
-    int _imax = bits.getBits(4);
-    int _imin = bits.getBits(4);
+    int _max = getBits(11);
+    int _min = getBits(11);
+    int _imax = getBits(4);
+    int _imin = getBits(4);
 
     // 128-30 = 98 bits remaining, still need to decode 16 pixels...
     // Each full pixel consumes 7 bits, thus we can only have 14 full pixels.
@@ -94,7 +124,7 @@ void SonyArw2Decompressor::decompressRow(int row) const {
         if (i == _imin)
           p = _min;
         else {
-          p = (bits.getBits(7) << sh) + _min;
+          p = (getBits(7) << sh) + _min;
           if (p > 0x7ff)
             p = 0x7ff;
         }
@@ -106,33 +136,201 @@ void SonyArw2Decompressor::decompressRow(int row) const {
   }
 }
 
-void SonyArw2Decompressor::decompressThread() const noexcept {
-  assert(mRaw->dim.x > 0);
-  assert(mRaw->dim.x % 32 == 0);
-  assert(mRaw->dim.y > 0);
+#ifdef WITH_AVX2
+
+// Exactly the same as decompressRow(), but two blocks, i.e. 32 pixels, at a
+// time. Each lane handles one pixel: it finds the bits of its delta (skipping
+// the min and max pixels, that have none), scales it, and looks it up in the
+// curve. Only the dithering's random numbers are generated sequentially.
+__attribute__((target("avx2"))) void
+SonyArw2Decompressor::decompressRow_AVX2(int row, ushort16* dest) const {
+  const int32 w = dim.x;
+
+  assert(dim.x > 0);
+  assert(dim.x % 32 == 0);
+
+  ByteStream rowBs = input;
+  rowBs.skipBytes(row * dim.x);
+  const uchar8* in = rowBs.getData(dim.x);
+
+  // Same as BitPumpLSB::peekBits(24)
+  uint32 random = in[0] | in[1] << 8 | in[2] << 16;
+
+  const TableLookUp* table = mRaw->getTable();
+  const auto* lut =
+      table ? reinterpret_cast<const int*>(table->tables.data()) : nullptr;
+
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays): std::array drops the alignment
+  const __m256i pixelIndex[2] = {
+      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+      _mm256_setr_epi32(8, 9, 10, 11, 12, 13, 14, 15)};
+
+  for (int32 x = 0; x < w; x += 32, in += 32) {
+    // The two blocks, each as two halves of 8 pixels.
+    __m256i pix[4]; // NOLINT(modernize-avoid-c-arrays)
+
+    for (int b = 0; b < 2; b++) {
+      const uchar8* block = in + 16 * b;
+
+      const uint32 header = getLE<uint32>(block);
+      const int _max = header & 0x7ff;
+      const int _min = (header >> 11) & 0x7ff;
+      const int _imax = (header >> 22) & 0xf;
+      const int _imin = (header >> 26) & 0xf;
+
+      if (_imax == _imin)
+        ThrowRDE("ARW2 invariant failed, same pixel is both min and max");
+
+      int sh = 0;
+      while ((sh < 4) && ((0x80 << sh) <= (_max - _min)))
+        sh++;
+
+      // The whole block in both of the 128-bit lanes, for the byte shuffle.
+      const __m256i bytes = _mm256_broadcastsi128_si256(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(block)));
+
+      for (int half = 0; half < 2; half++) {
+        const __m256i i = pixelIndex[half];
+        const __m256i isMax = _mm256_cmpeq_epi32(i, _mm256_set1_epi32(_imax));
+        const __m256i isMin = _mm256_cmpeq_epi32(i, _mm256_set1_epi32(_imin));
+
+        // Which delta is that, and where does it start. (cmpgt is -1)
+        __m256i k = _mm256_add_epi32(
+            i, _mm256_cmpgt_epi32(i, _mm256_set1_epi32(_imax)));
+        k = _mm256_add_epi32(k,
+                             _mm256_cmpgt_epi32(i, _mm256_set1_epi32(_imin)));
+        const __m256i bit = _mm256_add_epi32(
+            _mm256_set1_epi32(30), _mm256_mullo_epi32(k, _mm256_set1_epi32(7)));
+
+        // The two bytes containing those 7 bits. For the last delta, the
+        // second byte is past the block, but none of its bits are needed.
+        const __m256i byte = _mm256_srli_epi32(bit, 3);
+        __m256i shuffle = _mm256_or_si256(
+            byte,
+            _mm256_slli_epi32(_mm256_add_epi32(byte, _mm256_set1_epi32(1)), 8));
+        // The upper two bytes of the lane are to be zero.
+        shuffle = _mm256_or_si256(
+            shuffle, _mm256_set1_epi32(static_cast<int>(0x80800000)));
+        const __m256i word = _mm256_shuffle_epi8(bytes, shuffle);
+
+        __m256i p = _mm256_and_si256(
+            _mm256_srlv_epi32(word,
+                              _mm256_and_si256(bit, _mm256_set1_epi32(7))),
+            _mm256_set1_epi32(0x7f));
+        p = _mm256_add_epi32(_mm256_sll_epi32(p, _mm_cvtsi32_si128(sh)),
+                             _mm256_set1_epi32(_min));
+        p = _mm256_min_epi32(p, _mm256_set1_epi32(0x7ff));
+        p = _mm256_blendv_epi8(p, _mm256_set1_epi32(_max), isMax);
+        p = _mm256_blendv_epi8(p, _mm256_set1_epi32(_min), isMin);
+
+        pix[2 * b + half] = _mm256_slli_epi32(p, 1);
+      }
+    }
+
+    // See RawImageDataU16::setWithLookUp()
+    if (table && table->dither) {
+      std::array<uint32, 32> rand;
+      for (auto& r : rand) {
+        r = random;
+        random = 15700 * (random & 65535) + (random >> 16);
+      }
+
+      for (int q = 0; q < 4; q++) {
+        const __m256i lookup = _mm256_i32gather_epi32(lut, pix[q], 4);
+        const __m256i base =
+            _mm256_and_si256(lookup, _mm256_set1_epi32(0xffff));
+        const __m256i delta = _mm256_srli_epi32(lookup, 16);
+        const __m256i r = _mm256_and_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&rand[8 * q])),
+            _mm256_set1_epi32(2047));
+        pix[q] = _mm256_add_epi32(
+            base,
+            _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(delta, r),
+                                               _mm256_set1_epi32(1024)),
+                              12));
+      }
+    } else if (table) {
+      for (auto& p : pix)
+        p = _mm256_i32gather_epi32(lut, p, 2);
+    }
+
+    // The first block goes to the even pixels, the second one to the odd ones.
+    const __m256i mask = _mm256_set1_epi32(0xffff);
+    for (int half = 0; half < 2; half++) {
+      const __m256i out =
+          _mm256_or_si256(_mm256_and_si256(pix[half], mask),
+                          _mm256_slli_epi32(pix[2 + half], 16));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dest[x + 16 * half]),
+                          out);
+    }
+  }
+}
 
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
 #endif
-  for (int y = 0; y < mRaw->dim.y; y++) {
+
+void SonyArw2Decompressor::decompressThread(int begin,
+                                            int end) const noexcept {
+  assert(dim.x > 0);
+  assert(dim.x % 32 == 0);
+  assert(dim.y > 0);
+
+  for (int y = begin; y < end; y++) {
     try {
-      decompressRow(y);
+      auto* row =
+          reinterpret_cast<ushort16*>(&mRaw->getData()[y * mRaw->pitch]);
+#ifdef WITH_AVX2
+      if (useAVX2)
+        decompressRow_AVX2(y, row);
+      else
+        decompressRow(y, row);
+#else
+      decompressRow(y, row);
+#endif
+      mRaw->pixelStatistics.addRow(y, row);
     } catch (RawspeedException& err) {
-      // Propagate the exception out of OpenMP magic.
+      // Propagate the exception out of the worker thread.
       mRaw->setError(err.what());
-#ifdef HAVE_OPENMP
-#pragma omp cancel for
+      // No point in decoding the rest of this chunk.
+      return;
+    }
+  }
+}
+
+// Same as decompressThread(), but for the bands [begin, end) of the binned
+// image. The rows that do not make up a whole band are not decoded at all.
+void SonyArw2Decompressor::decompressBinnedThread(int begin,
+                                                  int end) const noexcept {
+  try {
+    CfaBinner binner(mRaw);
+    const int bandHeight = binner.getBandHeight();
+    for (int y = begin * bandHeight; y < end * bandHeight; y++) {
+      ushort16* row = binner.getRow(y);
+#ifdef WITH_AVX2
+      if (useAVX2)
+        decompressRow_AVX2(y, row);
+      else
+        decompressRow(y, row);
+#else
+      decompressRow(y, row);
 #endif
+      binner.rowDone(y);
     }
+  } catch (RawspeedException& err) {
+    // Propagate the exception out of the worker thread.
+    mRaw->setError(err.what());
   }
 }
 
 void SonyArw2Decompressor::decompress() const {
-#ifdef HAVE_OPENMP
-#pragma omp parallel default(none)                                             \
-    num_threads(rawspeed_get_number_of_processor_cores())
-#endif
-  decompressThread();
+  if (mRaw->isBinned()) {
+    parallelForChunks(
+        mRaw->parallelism, 0, dim.y / (2 * mRaw->binning),
+        [this](int begin, int end) { decompressBinnedThread(begin, end); });
+  } else {
+    parallelForChunks(
+        mRaw->parallelism, 0, dim.y,
+        [this](int begin, int end) { decompressThread(begin, end); });
+  }
 
   std::string firstErr;
   if (mRaw->isTooManyErrors(1, &firstErr)) {
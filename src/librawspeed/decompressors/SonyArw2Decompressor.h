@@ -20,6 +20,9 @@
 
 #pragma once
 
+#include "rawspeedconfig.h"                     // for WITH_AVX2
+#include "common/Common.h"                      // for ushort16, uint32
+#include "common/Point.h"                       // for iPoint2D
 #include "common/RawImage.h"                    // for RawImage
 #include "decompressors/AbstractDecompressor.h" // for AbstractDecompressor
 #include "io/ByteStream.h"                      // for ByteStream
@@ -29,12 +32,27 @@ namespace rawspeed {
 class RawImage;
 
 class SonyArw2Decompressor final : public AbstractDecompressor {
-  void decompressRow(int row) const;
-  void decompressThread() const noexcept;
+  void decompressRow(int row, ushort16* dest) const;
+  template <typename BitReader>
+  void decompressBlocks(ushort16* dest, uint32 random,
+                        BitReader getBits) const;
+#ifdef WITH_AVX2
+  void decompressRow_AVX2(int row, ushort16* dest) const;
+#endif
+  void decompressThread(int begin, int end) const noexcept;
+  void decompressBinnedThread(int begin, int end) const noexcept;
 
   RawImage mRaw;
   ByteStream input;
 
+  // Of the full-resolution image, even if it gets binned.
+  iPoint2D dim;
+
+#ifdef WITH_AVX2
+  // Whether to use decompressRow_AVX2(), chosen at runtime.
+  bool useAVX2 = false;
+#endif
+
 public:
   SonyArw2Decompressor(const RawImage& img, const ByteStream& input);
   void decompress() const;
@@ -21,6 +21,7 @@
 */
 
 #include "decompressors/UncompressedDecompressor.h"
+#include "common/CfaBinner.h"             // for CfaBinner
 #include "common/Common.h"                // for uint32, uchar8, ushort16
 #include "common/Point.h"                 // for iPoint2D
 #include "decoders/RawDecoderException.h" // for ThrowRDE
@@ -38,6 +39,25 @@ using std::min;
 
 namespace rawspeed {
 
+namespace {
+
+// The whole row (plus the read-ahead) is validated once, up front, so unless
+// this is one of the last rows of the input, the per-pixel path is unchecked.
+template <typename Pump>
+inline void unpackRow(Pump* bits, ushort16* dest, uint32 w, int bitPerPixel,
+                      uint32 rowBytes) {
+  if (bits->canConsumeUnchecked(rowBytes)) {
+    for (uint32 x = 0; x < w; x++)
+      dest[x] = bits->getBitsUnchecked(bitPerPixel);
+    return;
+  }
+
+  for (uint32 x = 0; x < w; x++)
+    dest[x] = bits->getBits(bitPerPixel);
+}
+
+} // namespace
+
 void UncompressedDecompressor::sanityCheck(const uint32* h, int bytesPerLine) {
   assert(h != nullptr);
   assert(*h > 0);
@@ -94,7 +114,8 @@ void UncompressedDecompressor::readUncompressedRaw(const iPoint2D& size,
                                                    const iPoint2D& offset,
                                                    int inputPitchBytes,
                                                    int bitPerPixel,
-                                                   BitOrder order) {
+                                                   BitOrder order,
+                                                   CfaBinner* binner) {
   assert(inputPitchBytes > 0);
   assert(bitPerPixel > 0);
 
@@ -109,6 +130,8 @@ void UncompressedDecompressor::readUncompressedRaw(const iPoint2D& size,
   if (bitPerPixel > 16 && mRaw->getDataType() == TYPE_USHORT16)
     ThrowRDE("Unsupported bit depth");
 
+  assert(!binner || (mRaw->isBinned() && cpp == 1));
+
   const int outPixelBits = w * cpp * bitPerPixel;
   assert(outPixelBits > 0);
 
@@ -131,13 +154,14 @@ void UncompressedDecompressor::readUncompressedRaw(const iPoint2D& size,
   assert(inputPitchBytes >= outPixelBytes);
   uint32 skipBytes = inputPitchBytes - outPixelBytes; // Skip per line
 
-  if (oy > static_cast<uint64>(mRaw->dim.y))
+  const iPoint2D dim = mRaw->getUnbinnedDim();
+  if (oy > static_cast<uint64>(dim.y))
     ThrowRDE("Invalid y offset");
-  if (ox + size.x > static_cast<uint64>(mRaw->dim.x))
+  if (ox + size.x > static_cast<uint64>(dim.x))
     ThrowRDE("Invalid x offset");
 
   uint64 y = oy;
-  h = min(h + oy, static_cast<uint64>(mRaw->dim.y));
+  h = min(h + oy, static_cast<uint64>(dim.y));
 
   if (mRaw->getDataType() == TYPE_FLOAT32) {
     if (bitPerPixel != 32)
@@ -152,46 +176,51 @@ void UncompressedDecompressor::readUncompressedRaw(const iPoint2D& size,
     BitPumpMSB bits(input);
     w *= cpp;
     for (; y < h; y++) {
-      auto* dest = reinterpret_cast<ushort16*>(
-          &data[offset.x * sizeof(ushort16) * cpp + y * outPitch]);
-      for (uint32 x = 0; x < w; x++) {
-        uint32 b = bits.getBits(bitPerPixel);
-        dest[x] = b;
-      }
+      auto* dest = binner ? binner->getRow(y)
+                          : reinterpret_cast<ushort16*>(
+                                &data[offset.x * sizeof(ushort16) * cpp +
+                                      y * outPitch]);
+      unpackRow(&bits, dest, w, bitPerPixel, outPixelBytes);
       bits.skipBytes(skipBytes);
+      if (binner)
+        binner->rowDone(y);
     }
   } else if (BitOrder_MSB16 == order) {
     BitPumpMSB16 bits(input);
     w *= cpp;
     for (; y < h; y++) {
-      auto* dest = reinterpret_cast<ushort16*>(
-          &data[offset.x * sizeof(ushort16) * cpp + y * outPitch]);
-      for (uint32 x = 0; x < w; x++) {
-        uint32 b = bits.getBits(bitPerPixel);
-        dest[x] = b;
-      }
+      auto* dest = binner ? binner->getRow(y)
+                          : reinterpret_cast<ushort16*>(
+                                &data[offset.x * sizeof(ushort16) * cpp +
+                                      y * outPitch]);
+      unpackRow(&bits, dest, w, bitPerPixel, outPixelBytes);
       bits.skipBytes(skipBytes);
+      if (binner)
+        binner->rowDone(y);
     }
   } else if (BitOrder_MSB32 == order) {
     BitPumpMSB32 bits(input);
     w *= cpp;
     for (; y < h; y++) {
-      auto* dest = reinterpret_cast<ushort16*>(
-          &data[offset.x * sizeof(ushort16) * cpp + y * outPitch]);
-      for (uint32 x = 0; x < w; x++) {
-        uint32 b = bits.getBits(bitPerPixel);
-        dest[x] = b;
-      }
+      auto* dest = binner ? binner->getRow(y)
+                          : reinterpret_cast<ushort16*>(
+                                &data[offset.x * sizeof(ushort16) * cpp +
+                                      y * outPitch]);
+      unpackRow(&bits, dest, w, bitPerPixel, outPixelBytes);
       bits.skipBytes(skipBytes);
+      if (binner)
+        binner->rowDone(y);
     }
   } else {
-    if (bitPerPixel == 16 && getHostEndianness() == Endianness::little) {
+    if (!binner && bitPerPixel == 16 &&
+        getHostEndianness() == Endianness::little) {
       copyPixels(&data[offset.x * sizeof(ushort16) * cpp + y * outPitch],
                  outPitch, input.getData(inputPitchBytes * (h - y)),
                  inputPitchBytes, w * mRaw->getBpp(), h - y);
       return;
     }
-    if (bitPerPixel == 12 && static_cast<int>(w) == inputPitchBytes * 8 / 12 &&
+    if (!binner && bitPerPixel == 12 &&
+        static_cast<int>(w) == inputPitchBytes * 8 / 12 &&
         getHostEndianness() == Endianness::little) {
       decode12BitRaw<Endianness::little>(w, h);
       return;
@@ -199,13 +228,14 @@ void UncompressedDecompressor::readUncompressedRaw(const iPoint2D& size,
     BitPumpLSB bits(input);
     w *= cpp;
     for (; y < h; y++) {
-      auto* dest = reinterpret_cast<ushort16*>(
-          &data[offset.x * sizeof(ushort16) + y * outPitch]);
-      for (uint32 x = 0; x < w; x++) {
-        uint32 b = bits.getBits(bitPerPixel);
-        dest[x] = b;
-      }
+      auto* dest = binner ? binner->getRow(y)
+                          : reinterpret_cast<ushort16*>(
+                                &data[offset.x * sizeof(ushort16) +
+                                      y * outPitch]);
+      unpackRow(&bits, dest, w, bitPerPixel, outPixelBytes);
       bits.skipBytes(skipBytes);
+      if (binner)
+        binner->rowDone(y);
     }
   }
 }
@@ -32,6 +32,7 @@
 
 namespace rawspeed {
 
+class CfaBinner;
 class iPoint2D;
 
 class UncompressedDecompressor final : public AbstractDecompressor {
@@ -69,9 +70,10 @@ public:
   /* inputPitch: Number of bytes between each line in the input image */
   /* bitPerPixel: Number of bits to read for each input pixel. */
   /* order: Order of the bits - see Common.h for possibilities. */
+  /* binner: if the image is binned, where to store the rows. */
   void readUncompressedRaw(const iPoint2D& size, const iPoint2D& offset,
                            int inputPitchBytes, int bitPerPixel,
-                           BitOrder order);
+                           BitOrder order, CfaBinner* binner = nullptr);
 
   /* Faster versions for unpacking 8 bit data */
   template <bool uncorrectedRawValues> void decode8BitRaw(uint32 w, uint32 h);
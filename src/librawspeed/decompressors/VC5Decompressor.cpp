@@ -34,8 +34,10 @@
 #include "common/Point.h"                 // for iPoint2D
 #include "common/RawspeedException.h"     // for RawspeedException
 #include "common/SimpleLUT.h"             // for SimpleLUT, SimpleLUT<>::va...
+#include "common/TaskScheduler.h"         // for parallelFor
 #include "decoders/RawDecoderException.h" // for ThrowRDE
 #include "io/Endianness.h"                // for Endianness, Endianness::big
+#include <atomic>                         // for atomic
 #include <cassert>                        // for assert
 #include <cmath>                          // for pow
 #include <initializer_list>               // for initializer_list
@@ -176,7 +178,8 @@ constexpr std::array<int, 4> ConvolutionParams::Last::mul_odd;
 } // namespace
 
 void VC5Decompressor::Wavelet::reconstructPass(
-    const Array2DRef<int16_t> dst, const Array2DRef<const int16_t> high,
+    const Parallelism& parallelism, const Array2DRef<int16_t> dst,
+    const Array2DRef<const int16_t> high,
     const Array2DRef<const int16_t> low) const noexcept {
   auto process = [low, high, dst](auto segment, int x, int y) {
     auto lowGetter = [&x, &y, low](int delta) {
@@ -194,10 +197,7 @@ void VC5Decompressor::Wavelet::reconstructPass(
   };
 
   // Vertical reconstruction
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
-#endif
-  for (int y = 0; y < height; ++y) {
+  parallelFor(parallelism, 0, height, [this, &process](int y) {
     if (y == 0) {
       // 1st row
       for (int x = 0; x < width; ++x)
@@ -211,13 +211,13 @@ void VC5Decompressor::Wavelet::reconstructPass(
       for (int x = 0; x < width; ++x)
         process(ConvolutionParams::Last, x, y);
     }
-  }
+  });
 }
 
 void VC5Decompressor::Wavelet::combineLowHighPass(
-    const Array2DRef<int16_t> dst, const Array2DRef<const int16_t> low,
-    const Array2DRef<const int16_t> high, int descaleShift,
-    bool clampUint = false) const noexcept {
+    const Parallelism& parallelism, const Array2DRef<int16_t> dst,
+    const Array2DRef<const int16_t> low, const Array2DRef<const int16_t> high,
+    int descaleShift, bool clampUint = false) const noexcept {
   auto process = [low, high, descaleShift, clampUint, dst](auto segment, int x,
                                                            int y) {
     auto lowGetter = [&x, &y, low](int delta) {
@@ -240,10 +240,7 @@ void VC5Decompressor::Wavelet::combineLowHighPass(
   };
 
   // Horizontal reconstruction
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static)
-#endif
-  for (int y = 0; y < dst.height; ++y) {
+  parallelFor(parallelism, 0, dst.height, [this, &process](int y) {
     // First col
     int x = 0;
     process(ConvolutionParams::First, x, y);
@@ -253,49 +250,37 @@ void VC5Decompressor::Wavelet::combineLowHighPass(
     }
     // last col
     process(ConvolutionParams::Last, x, y);
-  }
+  });
 }
 
 void VC5Decompressor::Wavelet::ReconstructableBand::processLow(
-    const Wavelet& wavelet) noexcept {
-  Array2DRef<int16_t> lowpass;
-#ifdef HAVE_OPENMP
-#pragma omp single copyprivate(lowpass)
-#endif
-  lowpass = Array2DRef<int16_t>::create(&lowpass_storage, wavelet.width,
-                                        2 * wavelet.height);
+    const Wavelet& wavelet, const Parallelism& parallelism) noexcept {
+  const Array2DRef<int16_t> lowpass = Array2DRef<int16_t>::create(
+      &lowpass_storage, wavelet.width, 2 * wavelet.height);
 
   const Array2DRef<const int16_t> highlow = wavelet.bandAsArray2DRef(2);
   const Array2DRef<const int16_t> lowlow = wavelet.bandAsArray2DRef(0);
 
   // Reconstruct the "immediates", the actual low pass ...
-  wavelet.reconstructPass(lowpass, highlow, lowlow);
+  wavelet.reconstructPass(parallelism, lowpass, highlow, lowlow);
 }
 
 void VC5Decompressor::Wavelet::ReconstructableBand::processHigh(
-    const Wavelet& wavelet) noexcept {
-  Array2DRef<int16_t> highpass;
-#ifdef HAVE_OPENMP
-#pragma omp single copyprivate(highpass)
-#endif
-  highpass = Array2DRef<int16_t>::create(&highpass_storage, wavelet.width,
-                                         2 * wavelet.height);
+    const Wavelet& wavelet, const Parallelism& parallelism) noexcept {
+  const Array2DRef<int16_t> highpass = Array2DRef<int16_t>::create(
+      &highpass_storage, wavelet.width, 2 * wavelet.height);
 
   const Array2DRef<const int16_t> highhigh = wavelet.bandAsArray2DRef(3);
   const Array2DRef<const int16_t> lowhigh = wavelet.bandAsArray2DRef(1);
 
-  wavelet.reconstructPass(highpass, highhigh, lowhigh);
+  wavelet.reconstructPass(parallelism, highpass, highhigh, lowhigh);
 }
 
 void VC5Decompressor::Wavelet::ReconstructableBand::combine(
-    const Wavelet& wavelet) noexcept {
+    const Wavelet& wavelet, const Parallelism& parallelism) noexcept {
   int16_t descaleShift = (wavelet.prescale == 2 ? 2 : 0);
 
-  Array2DRef<int16_t> dest;
-#ifdef HAVE_OPENMP
-#pragma omp single copyprivate(dest)
-#endif
-  dest =
+  const Array2DRef<int16_t> dest =
       Array2DRef<int16_t>::create(&data, 2 * wavelet.width, 2 * wavelet.height);
 
   const Array2DRef<int16_t> lowpass(lowpass_storage.data(), wavelet.width,
@@ -304,16 +289,17 @@ void VC5Decompressor::Wavelet::ReconstructableBand::combine(
                                      2 * wavelet.height);
 
   // And finally, combine the low pass, and high pass.
-  wavelet.combineLowHighPass(dest, lowpass, highpass, descaleShift, clampUint);
+  wavelet.combineLowHighPass(parallelism, dest, lowpass, highpass, descaleShift,
+                             clampUint);
 }
 
 void VC5Decompressor::Wavelet::ReconstructableBand::decode(
-    const Wavelet& wavelet) noexcept {
+    const Wavelet& wavelet, const Parallelism& parallelism) noexcept {
   assert(wavelet.allBandsValid());
   assert(data.empty());
-  processLow(wavelet);
-  processHigh(wavelet);
-  combine(wavelet);
+  processLow(wavelet, parallelism);
+  processHigh(wavelet, parallelism);
+  combine(wavelet, parallelism);
 }
 
 VC5Decompressor::VC5Decompressor(ByteStream bs, const RawImage& img)
@@ -525,7 +511,8 @@ VC5Decompressor::Wavelet::LowPassBand::LowPassBand(const Wavelet& wavelet,
   bs = bs.getStream(bytesTotal); // And clamp the size while we are at it.
 }
 
-void VC5Decompressor::Wavelet::LowPassBand::decode(const Wavelet& wavelet) {
+void VC5Decompressor::Wavelet::LowPassBand::decode(
+    const Wavelet& wavelet, const Parallelism& /*parallelism*/) {
   const auto dst =
       Array2DRef<int16_t>::create(&data, wavelet.width, wavelet.height);
 
@@ -536,7 +523,8 @@ void VC5Decompressor::Wavelet::LowPassBand::decode(const Wavelet& wavelet) {
   }
 }
 
-void VC5Decompressor::Wavelet::HighPassBand::decode(const Wavelet& wavelet) {
+void VC5Decompressor::Wavelet::HighPassBand::decode(
+    const Wavelet& wavelet, const Parallelism& /*parallelism*/) {
   auto dequantize = [quant = quant](int16_t val) -> int16_t {
     return val * quant;
   };
@@ -716,10 +704,6 @@ void VC5Decompressor::decode(unsigned int offsetX, unsigned int offsetY,
   prepareDecodingPlan();
 
   bool exceptionThrown = false;
-#ifdef HAVE_OPENMP
-#pragma omp parallel default(none) shared(exceptionThrown)                     \
-    num_threads(rawspeed_get_number_of_processor_cores())
-#endif
   decodeThread(&exceptionThrown);
 
   std::string firstErr;
@@ -733,34 +717,34 @@ void VC5Decompressor::decode(unsigned int offsetX, unsigned int offsetY,
 }
 
 void VC5Decompressor::decodeBands(bool* exceptionThrown) const noexcept {
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(dynamic, 1)
-#endif
-  for (auto decodeableBand = allDecodeableBands.begin();
-       decodeableBand < allDecodeableBands.end(); ++decodeableBand) {
-    try {
-      decodeableBand->band->decode(decodeableBand->wavelet);
-    } catch (RawspeedException& err) {
-      // Propagate the exception out of OpenMP magic.
-      mRaw->setError(err.what());
-#ifdef HAVE_OPENMP
-#pragma omp atomic write
-#endif
-      *exceptionThrown = true;
-#ifdef HAVE_OPENMP
-#pragma omp cancel for
-#endif
-    }
-  }
+  std::atomic<bool> failed{false};
+
+  parallelFor(
+      mRaw->parallelism, 0, allDecodeableBands.size(),
+      [this, &failed](int i) {
+        // Once one of the bands failed to decode, don't bother with the rest.
+        if (failed)
+          return;
+
+        const DecodeableBand& decodeableBand = allDecodeableBands[i];
+        try {
+          decodeableBand.band->decode(decodeableBand.wavelet,
+                                      mRaw->parallelism);
+        } catch (RawspeedException& err) {
+          // Propagate the exception out of the worker thread.
+          mRaw->setError(err.what());
+          failed = true;
+        }
+      },
+      Schedule::Dynamic);
+
+  *exceptionThrown = failed;
 }
 
 void VC5Decompressor::reconstructLowpassBands() const noexcept {
   for (const ReconstructionStep& step : reconstructionSteps) {
-    step.band.decode(step.wavelet);
+    step.band.decode(step.wavelet, mRaw->parallelism);
 
-#ifdef HAVE_OPENMP
-#pragma omp single nowait
-#endif
     step.wavelet.clear(); // we no longer need it.
   }
 }
@@ -783,10 +767,7 @@ void VC5Decompressor::combineFinalLowpassBands() const noexcept {
       channels[3].band.data.data(), channels[3].width, channels[3].height);
 
   // Convert to RGGB output
-#ifdef HAVE_OPENMP
-#pragma omp for schedule(static) collapse(2)
-#endif
-  for (int row = 0; row < height; ++row) {
+  parallelFor(mRaw->parallelism, 0, height, [&](int row) {
     for (int col = 0; col < width; ++col) {
       const int mid = 2048;
 
@@ -805,7 +786,7 @@ void VC5Decompressor::combineFinalLowpassBands() const noexcept {
       out(2 * col + 0, 2 * row + 1) = static_cast<uint16_t>(mVC5LogTable[g2]);
       out(2 * col + 1, 2 * row + 1) = static_cast<uint16_t>(mVC5LogTable[b]);
     }
-  }
+  });
 }
 
 inline void VC5Decompressor::getRLV(BitPumpMSB* bits, int* value,
@@ -27,6 +27,7 @@
 #include "common/Optional.h"                    // for Optional
 #include "common/RawImage.h"                    // for RawImage
 #include "common/SimpleLUT.h"                   // for SimpleLUT, SimpleLUT...
+#include "common/TaskScheduler.h"               // for Parallelism
 #include "decompressors/AbstractDecompressor.h" // for AbstractDecompressor
 #include "io/BitPumpMSB.h"                      // for BitPumpMSB
 #include "io/ByteStream.h"                      // for ByteStream
@@ -123,7 +124,8 @@ class VC5Decompressor final : public AbstractDecompressor {
     struct AbstractBand {
       std::vector<int16_t, DefaultInitAllocatorAdaptor<int16_t>> data;
       virtual ~AbstractBand() = default;
-      virtual void decode(const Wavelet& wavelet) = 0;
+      virtual void decode(const Wavelet& wavelet,
+                          const Parallelism& parallelism) = 0;
     };
     struct ReconstructableBand final : AbstractBand {
       bool clampUint;
@@ -133,10 +135,14 @@ class VC5Decompressor final : public AbstractDecompressor {
           highpass_storage;
       explicit ReconstructableBand(bool clampUint_ = false)
           : clampUint(clampUint_) {}
-      void processLow(const Wavelet& wavelet) noexcept;
-      void processHigh(const Wavelet& wavelet) noexcept;
-      void combine(const Wavelet& wavelet) noexcept;
-      void decode(const Wavelet& wavelet) noexcept final;
+      void processLow(const Wavelet& wavelet,
+                      const Parallelism& parallelism) noexcept;
+      void processHigh(const Wavelet& wavelet,
+                       const Parallelism& parallelism) noexcept;
+      void combine(const Wavelet& wavelet,
+                   const Parallelism& parallelism) noexcept;
+      void decode(const Wavelet& wavelet,
+                  const Parallelism& parallelism) noexcept final;
     };
     struct AbstractDecodeableBand : AbstractBand {
       ByteStream bs;
@@ -146,13 +152,15 @@ class VC5Decompressor final : public AbstractDecompressor {
       ushort16 lowpassPrecision;
       LowPassBand(const Wavelet& wavelet, ByteStream bs_,
                   ushort16 lowpassPrecision_);
-      void decode(const Wavelet& wavelet) final;
+      void decode(const Wavelet& wavelet,
+                  const Parallelism& parallelism) final;
     };
     struct HighPassBand final : AbstractDecodeableBand {
       int16_t quant;
       HighPassBand(ByteStream bs_, int16_t quant_)
           : AbstractDecodeableBand(std::move(bs_)), quant(quant_) {}
-      void decode(const Wavelet& wavelet) final;
+      void decode(const Wavelet& wavelet,
+                  const Parallelism& parallelism) final;
     };
 
     static constexpr uint16_t numBands = 4;
@@ -168,11 +176,13 @@ class VC5Decompressor final : public AbstractDecompressor {
     uint32_t getValidBandMask() const { return mDecodedBandMask; }
     bool allBandsValid() const;
 
-    void reconstructPass(Array2DRef<int16_t> dst,
+    void reconstructPass(const Parallelism& parallelism,
+                         Array2DRef<int16_t> dst,
                          Array2DRef<const int16_t> high,
                          Array2DRef<const int16_t> low) const noexcept;
 
-    void combineLowHighPass(Array2DRef<int16_t> dst,
+    void combineLowHighPass(const Parallelism& parallelism,
+                            Array2DRef<int16_t> dst,
                             Array2DRef<const int16_t> low,
                             Array2DRef<const int16_t> high, int descaleShift,
                             bool clampUint /*= false*/) const noexcept;
@@ -0,0 +1,147 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#pragma once
+
+#include "common/Common.h" // for uchar8, uint32, uint64
+#include <cassert>         // for assert
+#include <vector>          // for vector
+
+namespace rawspeed {
+
+struct JPEGBitPumpTag;
+struct LSBBitPumpTag;
+struct MSBBitPumpTag;
+struct MSB16BitPumpTag;
+struct MSB32BitPumpTag;
+
+// How the bits are laid out in the bytes, for each of the BitPump's.
+template <typename Tag> struct BitPumpWriterTraits;
+
+template <> struct BitPumpWriterTraits<MSBBitPumpTag> final {
+  static constexpr bool MSBFirst = true;
+  static constexpr int ChunkBits = 8;
+  static constexpr bool ByteStuffing = false;
+};
+
+template <> struct BitPumpWriterTraits<MSB16BitPumpTag> final {
+  static constexpr bool MSBFirst = true;
+  static constexpr int ChunkBits = 16; // stored little-endian
+  static constexpr bool ByteStuffing = false;
+};
+
+template <> struct BitPumpWriterTraits<MSB32BitPumpTag> final {
+  static constexpr bool MSBFirst = true;
+  static constexpr int ChunkBits = 32; // stored little-endian
+  static constexpr bool ByteStuffing = false;
+};
+
+template <> struct BitPumpWriterTraits<LSBBitPumpTag> final {
+  static constexpr bool MSBFirst = false;
+  static constexpr int ChunkBits = 8;
+  static constexpr bool ByteStuffing = false;
+};
+
+// Each 0xFF byte is followed by a 0x00, so that it is not taken for a marker.
+template <> struct BitPumpWriterTraits<JPEGBitPumpTag> final {
+  static constexpr bool MSBFirst = true;
+  static constexpr int ChunkBits = 8;
+  static constexpr bool ByteStuffing = true;
+};
+
+// The inverse of the BitPump with the same tag: appends the bits to a byte
+// vector, such that the BitPump reads them back in the same order.
+// Only the complete chunks are written as they fill up, flush() the rest!
+template <typename Tag> class BitPumpWriter final {
+  using Traits = BitPumpWriterTraits<Tag>;
+
+  std::vector<uchar8>* out;
+
+  uint64 cache = 0;
+  int fillLevel = 0;
+
+  static uint64 mask(int bits) { return (uint64(1) << bits) - 1; }
+
+  void writeChunk() {
+    assert(fillLevel >= Traits::ChunkBits);
+
+    uint64 chunk;
+    if (Traits::MSBFirst) {
+      fillLevel -= Traits::ChunkBits;
+      chunk = cache >> fillLevel;
+      cache &= mask(fillLevel);
+    } else {
+      chunk = cache & mask(Traits::ChunkBits);
+      cache >>= Traits::ChunkBits;
+      fillLevel -= Traits::ChunkBits;
+    }
+
+    for (int i = 0; i < Traits::ChunkBits; i += 8) {
+      const auto byte = static_cast<uchar8>(chunk >> i);
+      out->push_back(byte);
+      if (Traits::ByteStuffing && byte == 0xFF)
+        out->push_back(0x00);
+    }
+  }
+
+public:
+  explicit BitPumpWriter(std::vector<uchar8>* out_) : out(out_) {
+    assert(out);
+  }
+
+  BitPumpWriter(const BitPumpWriter&) = delete;
+  BitPumpWriter& operator=(const BitPumpWriter&) = delete;
+
+  void put(uint32 bits, int nbits) {
+    assert(nbits >= 0 && nbits <= 32);
+    assert(nbits == 32 || (bits >> nbits) == 0);
+
+    if (Traits::MSBFirst)
+      cache = (cache << nbits) | bits;
+    else
+      cache |= uint64(bits) << fillLevel;
+    fillLevel += nbits;
+
+    while (fillLevel >= Traits::ChunkBits)
+      writeChunk();
+  }
+
+  // Pads the bits written so far to a whole chunk. JPEG pads with ones,
+  // everything else with zeros.
+  void flush() {
+    const int padding =
+        (Traits::ChunkBits - fillLevel % Traits::ChunkBits) % Traits::ChunkBits;
+    if (padding != 0)
+      put(Traits::ByteStuffing ? mask(padding) : 0, padding);
+    assert(fillLevel == 0);
+  }
+
+  // The number of bits since the last chunk boundary.
+  int getPartialBits() const { return fillLevel; }
+};
+
+using BitPumpMSBWriter = BitPumpWriter<MSBBitPumpTag>;
+using BitPumpMSB16Writer = BitPumpWriter<MSB16BitPumpTag>;
+using BitPumpMSB32Writer = BitPumpWriter<MSB32BitPumpTag>;
+using BitPumpLSBWriter = BitPumpWriter<LSBBitPumpTag>;
+using BitPumpJPEGWriter = BitPumpWriter<JPEGBitPumpTag>;
+
+} // namespace rawspeed
@@ -0,0 +1,162 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "encoders/DngWriter.h"
+#include "common/Common.h"            // for uchar8, ushort16, uint32
+#include "common/Point.h"             // for iPoint2D
+#include "common/RawImage.h"          // for RawImage, RawImageData
+#include "common/RawspeedException.h" // for ThrowRSE, RawspeedException
+#include "common/TaskScheduler.h"     // for parallelFor, Schedule
+#include "encoders/BitPumpWriter.h"   // for BitPumpLSBWriter, BitPumpMSBWriter
+#include "encoders/LJpegEncoder.h"    // for LJpegEncoder
+#include "encoders/TiffWriter.h"      // for TiffWriter
+#include "tiff/TiffTag.h"             // for TiffTag
+#include <algorithm>                  // for min
+#include <string>                     // for string
+#include <utility>                    // for move
+#include <vector>                     // for vector
+
+namespace rawspeed {
+
+namespace {
+
+template <typename Writer>
+void pack(std::vector<uchar8>* out, const std::vector<ushort16>& samples,
+          int bitsPerSample) {
+  Writer bits(out);
+  for (const auto sample : samples) {
+    if (sample >> bitsPerSample)
+      ThrowRSE("Sample %u does not fit into %i bits.", sample, bitsPerSample);
+    bits.put(sample, bitsPerSample);
+  }
+  bits.flush();
+}
+
+} // namespace
+
+std::vector<uchar8> DngWriter::write(const RawImage& image) const {
+  if (image->getDataType() != TYPE_USHORT16 || image->getCpp() != 1)
+    ThrowRSE("Only one component 16-bit integer images are supported.");
+  if (bitsPerSample < 1 || bitsPerSample > 16)
+    ThrowRSE("Invalid bits per sample (%i).", bitsPerSample);
+  if (tileWidth < 0 || tileHeight < 0 || rowsPerStrip < 0)
+    ThrowRSE("Invalid strip/tile size.");
+
+  const iPoint2D dim = image->getUncroppedDim();
+  if (!dim.hasPositiveArea())
+    ThrowRSE("Image has zero size");
+
+  // The size of the blocks, i.e. of the strips or the tiles.
+  const bool tiled = tileWidth > 0 && tileHeight > 0;
+  const iPoint2D blockDim =
+      tiled ? iPoint2D(tileWidth, tileHeight)
+            : iPoint2D(dim.x, rowsPerStrip > 0 ? std::min(rowsPerStrip, dim.y)
+                                               : dim.y);
+  const int blocksX = roundUpDivision(dim.x, blockDim.x);
+  const int blocksY = roundUpDivision(dim.y, blockDim.y);
+
+  if (compression == Compression::Uncompressed &&
+      (blockDim.x * bitsPerSample) % 8 != 0) {
+    ThrowRSE("Row of %i %i-bit samples is not a whole number of bytes.",
+             blockDim.x, bitsPerSample);
+  }
+
+  std::vector<std::vector<uchar8>> blocks(blocksX * blocksY);
+  std::vector<std::string> errors(blocks.size());
+
+  parallelFor(
+      image->parallelism, 0, blocks.size(),
+      [&](int i) {
+        const iPoint2D pos(blockDim.x * (i % blocksX),
+                           blockDim.y * (i / blocksX));
+
+        // Strips end at the image's bottom edge, tiles are padded past the
+        // edges by repeating the last row/column.
+        const int height =
+            tiled ? blockDim.y : std::min(blockDim.y, dim.y - pos.y);
+        std::vector<ushort16> samples(blockDim.x * height);
+        for (int y = 0; y < height; ++y) {
+          const auto* row = reinterpret_cast<const ushort16*>(
+              image->getDataUncropped(0, std::min(pos.y + y, dim.y - 1)));
+          for (int x = 0; x < blockDim.x; ++x)
+            samples[y * blockDim.x + x] = row[std::min(pos.x + x, dim.x - 1)];
+        }
+
+        try {
+          if (compression == Compression::LJpeg) {
+            LJpegEncoder encoder;
+            encoder.precision = bitsPerSample;
+            encoder.predictor = predictor;
+            encoder.encode(&blocks[i], samples.data(), blockDim.x, blockDim.x,
+                           height, 1);
+          } else {
+            // DNG spec says that if not 8 or 16 bit/sample, always use
+            // big endian, i.e. MSB-first packing.
+            if (bitsPerSample == 8 || bitsPerSample == 16)
+              pack<BitPumpLSBWriter>(&blocks[i], samples, bitsPerSample);
+            else
+              pack<BitPumpMSBWriter>(&blocks[i], samples, bitsPerSample);
+          }
+        } catch (RawspeedException& e) {
+          errors[i] = e.what();
+        }
+      },
+      Schedule::Dynamic);
+
+  for (const auto& error : errors) {
+    if (!error.empty())
+      ThrowRSE("%s", error.c_str());
+  }
+
+  TiffWriter tiff;
+  tiff.addLongs(NEWSUBFILETYPE, {0});
+  tiff.addLongs(IMAGEWIDTH, {static_cast<uint32>(dim.x)});
+  tiff.addLongs(IMAGELENGTH, {static_cast<uint32>(dim.y)});
+  tiff.addShorts(BITSPERSAMPLE, {static_cast<ushort16>(bitsPerSample)});
+  tiff.addShorts(COMPRESSION, {static_cast<ushort16>(compression)});
+  tiff.addShorts(PHOTOMETRICINTERPRETATION, {32803}); // CFA
+  tiff.addString(MAKE, make);
+  tiff.addString(MODEL, model);
+  tiff.addShorts(SAMPLESPERPIXEL, {1});
+  tiff.addShorts(CFAREPEATPATTERNDIM, {2, 2});
+  tiff.addBytes(CFAPATTERN,
+                std::vector<uchar8>(cfaPattern.begin(), cfaPattern.end()));
+  tiff.addBytes(DNGVERSION, {1, 4, 0, 0});
+  tiff.addString(UNIQUECAMERAMODEL, make + " " + model);
+  tiff.addLongs(BLACKLEVEL, {static_cast<uint32>(blackLevel)});
+  tiff.addLongs(WHITELEVEL,
+                {static_cast<uint32>(whiteLevel > 0 ? whiteLevel
+                                                    : (1 << bitsPerSample) -
+                                                          1)});
+
+  if (tiled) {
+    tiff.addLongs(TILEWIDTH, {static_cast<uint32>(blockDim.x)});
+    tiff.addLongs(TILELENGTH, {static_cast<uint32>(blockDim.y)});
+    tiff.addImageData(TILEOFFSETS, TILEBYTECOUNTS, std::move(blocks));
+  } else {
+    tiff.addLongs(ROWSPERSTRIP, {static_cast<uint32>(blockDim.y)});
+    tiff.addImageData(STRIPOFFSETS, STRIPBYTECOUNTS, std::move(blocks));
+  }
+
+  return tiff.write();
+}
+
+} // namespace rawspeed
@@ -0,0 +1,73 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#pragma once
+
+#include "common/Common.h" // for uchar8
+#include <array>           // for array
+#include <string>          // for string
+#include <vector>          // for vector
+
+namespace rawspeed {
+
+class RawImage;
+
+// Writes a CFA image as a minimal DNG, that DngDecoder can read back.
+// The data is either striped or tiled, and either uncompressed (packed the
+// way DngDecoder expects for little-endian files: LSB-first for 8 and 16 bits,
+// MSB-first otherwise) or compressed as lossless JPEG, one LJpeg frame per
+// strip/tile.
+class DngWriter final {
+public:
+  enum class Compression {
+    Uncompressed = 1,
+    LJpeg = 7,
+  };
+
+  Compression compression = Compression::LJpeg;
+
+  // Of the samples. Any value for Uncompressed, as long as each row of a
+  // strip/tile is a whole number of bytes; 2..16 for LJpeg.
+  int bitsPerSample = 16;
+
+  // Tiles, if both are non-zero. Else strips of rowsPerStrip rows,
+  // or just one strip if that is zero.
+  int tileWidth = 0;
+  int tileHeight = 0;
+  int rowsPerStrip = 0;
+
+  int predictor = 1; // for LJpeg, see LJpegEncoder
+
+  std::string make = "RawSpeed";
+  std::string model = "Synthetic";
+
+  // 2x2, in DNG's CFAPattern encoding, i.e. 0 = red, 1 = green, 2 = blue.
+  std::array<uchar8, 4> cfaPattern = {{0, 1, 1, 2}};
+
+  int blackLevel = 0;
+  int whiteLevel = 0; // 0 means (1 << bitsPerSample) - 1
+
+  // The image must be a one component TYPE_USHORT16 image. The strips/tiles
+  // are encoded in parallel, using the image's parallelism.
+  std::vector<uchar8> write(const RawImage& image) const;
+};
+
+} // namespace rawspeed
@@ -0,0 +1,307 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "encoders/LJpegEncoder.h"
+#include "common/Common.h"            // for uchar8, ushort16, uint32, uint64
+#include "common/RawspeedException.h" // for ThrowRSE
+#include "encoders/BitPumpWriter.h"   // for BitPumpJPEGWriter
+#include <algorithm>                  // for max
+#include <array>                      // for array
+#include <cassert>                    // for assert
+#include <limits>                     // for numeric_limits
+#include <vector>                     // for vector
+
+namespace rawspeed {
+
+namespace {
+
+// The difference magnitude categories (SSSS), 0..16.
+constexpr int numCategories = 17;
+
+struct HuffmanCode final {
+  ushort16 code = 0;
+  int len = 0;
+};
+
+struct HuffmanSpec final {
+  std::array<uchar8, 16> nCodesPerLength{}; // for code lengths 1..16
+  std::vector<uchar8> codeValues;
+  std::array<HuffmanCode, numCategories> codes;
+};
+
+// The optimal length-limited code for the given frequencies, as per section
+// K.2 of the JPEG spec (the code of all ones is never used).
+HuffmanSpec buildHuffmanSpec(const std::array<uint64, numCategories>& freqs) {
+  constexpr int reserved = numCategories; // the dummy symbol for all ones
+  std::array<uint64, numCategories + 1> freq;
+  std::copy(freqs.begin(), freqs.end(), freq.begin());
+  freq[reserved] = 1;
+
+  std::array<int, numCategories + 1> codeSize{};
+  std::array<int, numCategories + 1> others;
+  others.fill(-1);
+
+  for (;;) {
+    // The least frequent symbol (the one with the largest value on a tie),
+    // and the next least frequent one.
+    int c1 = -1;
+    int c2 = -1;
+    for (int i = 0; i <= reserved; ++i) {
+      if (freq[i] == 0)
+        continue;
+      if (c1 < 0 || freq[i] <= freq[c1]) {
+        c2 = c1;
+        c1 = i;
+      } else if (c2 < 0 || freq[i] <= freq[c2])
+        c2 = i;
+    }
+    if (c2 < 0)
+      break;
+
+    freq[c1] += freq[c2];
+    freq[c2] = 0;
+
+    codeSize[c1]++;
+    while (others[c1] >= 0) {
+      c1 = others[c1];
+      codeSize[c1]++;
+    }
+    others[c1] = c2;
+
+    codeSize[c2]++;
+    while (others[c2] >= 0) {
+      c2 = others[c2];
+      codeSize[c2]++;
+    }
+  }
+
+  std::array<int, 2 * (numCategories + 1)> bits{};
+  for (int i = 0; i <= reserved; ++i)
+    bits[codeSize[i]]++;
+  bits[0] = 0;
+
+  // Limit the code lengths to 16 bits.
+  for (int i = bits.size() - 1; i > 16; --i) {
+    while (bits[i] > 0) {
+      int j = i - 2;
+      while (bits[j] == 0)
+        --j;
+      bits[i] -= 2;
+      bits[i - 1]++;
+      bits[j + 1] += 2;
+      bits[j]--;
+    }
+  }
+
+  // Drop the reserved symbol, which has one of the longest codes.
+  int longest = 16;
+  while (bits[longest] == 0)
+    --longest;
+  bits[longest]--;
+
+  HuffmanSpec spec;
+  for (int len = 1; len <= 16; ++len)
+    spec.nCodesPerLength[len - 1] = static_cast<uchar8>(bits[len]);
+
+  // The symbols, ordered by the code length, assigned from shortest.
+  for (int len = 1; len <= 32; ++len) {
+    for (int i = 0; i < numCategories; ++i) {
+      if (codeSize[i] == len)
+        spec.codeValues.push_back(static_cast<uchar8>(i));
+    }
+  }
+  assert(spec.codeValues.size() <= numCategories);
+
+  // And the canonical codes themselves.
+  uint32 code = 0;
+  auto value = spec.codeValues.cbegin();
+  for (int len = 1; len <= 16; ++len) {
+    for (int n = 0; n < bits[len]; ++n, ++value, ++code) {
+      assert(value != spec.codeValues.cend());
+      spec.codes[*value] = {static_cast<ushort16>(code), len};
+    }
+    code <<= 1;
+  }
+
+  return spec;
+}
+
+int getCategory(int diff) {
+  assert(diff >= std::numeric_limits<short16>::min());
+  assert(diff <= std::numeric_limits<short16>::max());
+
+  int category = 0;
+  for (int magnitude = diff < 0 ? -diff : diff; magnitude; magnitude >>= 1)
+    category++;
+  return category;
+}
+
+void putByte(std::vector<uchar8>* out, int v) {
+  out->push_back(static_cast<uchar8>(v));
+}
+
+void putU16(std::vector<uchar8>* out, int v) {
+  putByte(out, v >> 8);
+  putByte(out, v);
+}
+
+} // namespace
+
+void LJpegEncoder::encode(std::vector<uchar8>* out, const ushort16* data,
+                          int pitch, int width, int height,
+                          int components) const {
+  assert(out);
+  assert(data);
+
+  if (precision < 2 || precision > 16)
+    ThrowRSE("Invalid precision (%i).", precision);
+  if (predictor < 1 || predictor > 7)
+    ThrowRSE("Invalid predictor (%i).", predictor);
+  if (components < 1 || components > 4)
+    ThrowRSE("Only from 1 to 4 components are supported (%i).", components);
+  if (width < 1 || width > 65535 || height < 1 || height > 65535)
+    ThrowRSE("Invalid frame size (%i; %i).", width, height);
+  if (pitch < width * components)
+    ThrowRSE("Pitch (%i) is smaller than the row (%i).", pitch,
+             width * components);
+
+  const int maxValue = (1 << precision) - 1;
+
+  // Calls f(diff) for each sample, in the order in which they are coded.
+  const auto forEachDiff = [&](auto f) {
+    for (int y = 0; y < height; ++y) {
+      const ushort16* row = data + static_cast<size_t>(y) * pitch;
+      const ushort16* up = y > 0 ? row - pitch : nullptr;
+      for (int x = 0; x < width; ++x) {
+        for (int c = 0; c < components; ++c) {
+          const int i = x * components + c;
+          const int sample = row[i];
+          if (sample > maxValue)
+            ThrowRSE("Sample %i does not fit into %i bits.", sample, precision);
+
+          int pred;
+          if (x == 0 && y == 0)
+            pred = 1 << (precision - 1);
+          else if (y == 0)
+            pred = row[i - components];
+          else if (x == 0)
+            pred = up[i];
+          else {
+            const int Ra = row[i - components];
+            const int Rb = up[i];
+            const int Rc = up[i - components];
+            switch (predictor) {
+            case 1:
+              pred = Ra;
+              break;
+            case 2:
+              pred = Rb;
+              break;
+            case 3:
+              pred = Rc;
+              break;
+            case 4:
+              pred = Ra + Rb - Rc;
+              break;
+            case 5:
+              pred = Ra + ((Rb - Rc) >> 1);
+              break;
+            case 6:
+              pred = Rb + ((Ra - Rc) >> 1);
+              break;
+            case 7:
+              pred = (Ra + Rb) >> 1;
+              break;
+            default:
+              __builtin_unreachable();
+            }
+          }
+
+          // The decoder works modulo 2^16.
+          f(static_cast<short16>(static_cast<ushort16>(sample - pred)));
+        }
+      }
+    }
+  };
+
+  std::array<uint64, numCategories> freqs{};
+  forEachDiff([&freqs](int diff) { freqs[getCategory(diff)]++; });
+  const HuffmanSpec spec = buildHuffmanSpec(freqs);
+
+  // SOI
+  putU16(out, 0xFFD8);
+
+  // SOF3
+  putU16(out, 0xFFC3);
+  putU16(out, 8 + 3 * components);
+  putByte(out, precision);
+  putU16(out, height);
+  putU16(out, width);
+  putByte(out, components);
+  for (int c = 0; c < components; ++c) {
+    putByte(out, c);    // component id
+    putByte(out, 0x11); // no subsampling
+    putByte(out, 0);    // no quantization
+  }
+
+  // DHT
+  putU16(out, 0xFFC4);
+  putU16(out, 2 + 1 + 16 + spec.codeValues.size());
+  putByte(out, 0x00); // DC table 0
+  for (const auto n : spec.nCodesPerLength)
+    putByte(out, n);
+  for (const auto v : spec.codeValues)
+    putByte(out, v);
+
+  // SOS
+  putU16(out, 0xFFDA);
+  putU16(out, 6 + 2 * components);
+  putByte(out, components);
+  for (int c = 0; c < components; ++c) {
+    putByte(out, c);    // component id
+    putByte(out, 0x00); // table 0
+  }
+  putByte(out, predictor);
+  putByte(out, 0); // Se
+  putByte(out, 0); // Ah/Al, i.e. no point transform
+
+  {
+    BitPumpJPEGWriter bits(out);
+    forEachDiff([&bits, &spec](int diff) {
+      const int category = getCategory(diff);
+      const HuffmanCode& code = spec.codes[category];
+      assert(code.len > 0);
+      bits.put(code.code, code.len);
+
+      // The -32768 is the only value of category 16, and needs no bits.
+      if (category == 0 || category == 16)
+        return;
+      const int value = diff < 0 ? diff + (1 << category) - 1 : diff;
+      bits.put(value, category);
+    });
+    bits.flush();
+  }
+
+  // EOI
+  putU16(out, 0xFFD9);
+}
+
+} // namespace rawspeed
@@ -0,0 +1,49 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#pragma once
+
+#include "common/Common.h" // for uchar8, ushort16
+#include <vector>          // for vector
+
+namespace rawspeed {
+
+// Lossless JPEG (SOF3) encoder, i.e. the inverse of AbstractLJpegDecompressor
+// (and thus of LJpegDecompressor, Cr2Decompressor, ...). Writes SOI, SOF3,
+// one DHT that is optimal for the frame and is used by all the components,
+// one SOS, the entropy-coded data and EOI. No restart intervals, no point
+// transform, no subsampling.
+class LJpegEncoder final {
+public:
+  int precision = 16; // Of the samples, in bits. 2..16
+
+  // See table H.1 of the JPEG spec. 1..7, only 1 is supported by the
+  // decompressors though.
+  int predictor = 1;
+
+  // Appends the encoded frame to *out. The frame is `width` x `height`
+  // pixels, each one consisting of `components` (1..4) interleaved samples.
+  // The first sample of the row y is data[y * pitch].
+  void encode(std::vector<uchar8>* out, const ushort16* data, int pitch,
+              int width, int height, int components) const;
+};
+
+} // namespace rawspeed
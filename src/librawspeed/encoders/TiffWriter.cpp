@@ -0,0 +1,180 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "encoders/TiffWriter.h"
+#include "common/Common.h"            // for uchar8, uint32, ushort16
+#include "common/RawspeedException.h" // for ThrowRSE
+#include "tiff/TiffEntry.h"           // for TiffDataType, TIFF_LONG, ...
+#include "tiff/TiffTag.h"             // for TiffTag
+#include <algorithm>                  // for sort, copy
+#include <cassert>                    // for assert
+#include <string>                     // for string
+#include <utility>                    // for move
+#include <vector>                     // for vector
+
+namespace rawspeed {
+
+namespace {
+
+void putLE(std::vector<uchar8>* out, uint32 value, int bytes) {
+  for (int i = 0; i < bytes; ++i)
+    out->push_back(static_cast<uchar8>(value >> (8 * i)));
+}
+
+void patchLE(std::vector<uchar8>* out, size_t pos, uint32 value) {
+  for (int i = 0; i < 4; ++i)
+    (*out)[pos + i] = static_cast<uchar8>(value >> (8 * i));
+}
+
+std::vector<uchar8> toLE(const std::vector<uint32>& values) {
+  std::vector<uchar8> data;
+  for (const auto v : values)
+    putLE(&data, v, 4);
+  return data;
+}
+
+} // namespace
+
+void TiffWriter::add(TiffTag tag, TiffDataType type, uint32 count,
+                     std::vector<uchar8> data) {
+  entries.push_back({tag, type, count, std::move(data)});
+}
+
+void TiffWriter::addBytes(TiffTag tag, const std::vector<uchar8>& values,
+                          TiffDataType type) {
+  assert(type == TIFF_BYTE || type == TIFF_UNDEFINED || type == TIFF_ASCII);
+  add(tag, type, values.size(), values);
+}
+
+void TiffWriter::addShorts(TiffTag tag, const std::vector<ushort16>& values) {
+  std::vector<uchar8> data;
+  for (const auto v : values)
+    putLE(&data, v, 2);
+  add(tag, TIFF_SHORT, values.size(), std::move(data));
+}
+
+void TiffWriter::addLongs(TiffTag tag, const std::vector<uint32>& values) {
+  add(tag, TIFF_LONG, values.size(), toLE(values));
+}
+
+void TiffWriter::addString(TiffTag tag, const std::string& value) {
+  std::vector<uchar8> data(value.begin(), value.end());
+  data.push_back(0);
+  addBytes(tag, data, TIFF_ASCII);
+}
+
+void TiffWriter::addImageData(TiffTag offsetsTag, TiffTag countsTag,
+                              std::vector<std::vector<uchar8>> blocks) {
+  if (blocks.empty())
+    ThrowRSE("No image data");
+  images.push_back({offsetsTag, countsTag, std::move(blocks)});
+}
+
+std::vector<uchar8> TiffWriter::write() const {
+  // The offsets are not known yet, but the entries are needed for the layout.
+  std::vector<Entry> all = entries;
+  for (const auto& image : images) {
+    std::vector<uint32> counts;
+    for (const auto& block : image.blocks)
+      counts.push_back(block.size());
+    const auto count = static_cast<uint32>(counts.size());
+    all.push_back({image.offsetsTag, TIFF_LONG, count,
+                   toLE(std::vector<uint32>(count))});
+    all.push_back({image.countsTag, TIFF_LONG, count, toLE(counts)});
+  }
+
+  std::sort(all.begin(), all.end(),
+            [](const Entry& a, const Entry& b) { return a.tag < b.tag; });
+  for (size_t i = 1; i < all.size(); ++i) {
+    if (all[i - 1].tag == all[i].tag)
+      ThrowRSE("Duplicate entry for tag 0x%04x", all[i].tag);
+  }
+
+  std::vector<uchar8> out;
+
+  // Header.
+  out.push_back('I');
+  out.push_back('I');
+  putLE(&out, 42, 2);
+  putLE(&out, 8, 4); // IFD0 follows immediately.
+
+  // The IFD, with the values that do not fit into 4 bytes following it.
+  const uint32 ifdSize = 2 + 12 * all.size() + 4;
+  uint32 valuesPos = 8 + ifdSize;
+
+  putLE(&out, all.size(), 2);
+  std::vector<size_t> valuePositions;
+  for (const auto& e : all) {
+    putLE(&out, e.tag, 2);
+    putLE(&out, e.type, 2);
+    putLE(&out, e.count, 4);
+    valuePositions.push_back(out.size());
+    if (e.data.size() <= 4) {
+      out.insert(out.end(), e.data.begin(), e.data.end());
+      putLE(&out, 0, 4 - e.data.size());
+    } else {
+      putLE(&out, valuesPos, 4);
+      valuesPos += e.data.size() + e.data.size() % 2; // word-aligned
+    }
+  }
+  putLE(&out, 0, 4); // No next IFD.
+  assert(out.size() == 8 + ifdSize);
+
+  for (const auto& e : all) {
+    if (e.data.size() <= 4)
+      continue;
+    out.insert(out.end(), e.data.begin(), e.data.end());
+    if (e.data.size() % 2)
+      out.push_back(0);
+  }
+  assert(out.size() == valuesPos);
+
+  // And finally the image data, patching the offsets into the IFD.
+  for (const auto& image : images) {
+    std::vector<uint32> offsets;
+    for (const auto& block : image.blocks) {
+      offsets.push_back(out.size());
+      out.insert(out.end(), block.begin(), block.end());
+      if (out.size() % 2)
+        out.push_back(0);
+    }
+
+    for (size_t i = 0; i < all.size(); ++i) {
+      const Entry& e = all[i];
+      if (e.tag != image.offsetsTag)
+        continue;
+      if (offsets.size() == 1)
+        patchLE(&out, valuePositions[i], offsets[0]);
+      else {
+        const uint32 pos = out[valuePositions[i]] |
+                           out[valuePositions[i] + 1] << 8 |
+                           out[valuePositions[i] + 2] << 16 |
+                           out[valuePositions[i] + 3] << 24;
+        for (size_t j = 0; j < offsets.size(); ++j)
+          patchLE(&out, pos + 4 * j, offsets[j]);
+      }
+    }
+  }
+
+  return out;
+}
+
+} // namespace rawspeed
@@ -0,0 +1,68 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#pragma once
+
+#include "common/Common.h"  // for uchar8, uint32, ushort16
+#include "tiff/TiffEntry.h" // for TiffDataType
+#include "tiff/TiffTag.h"   // for TiffTag
+#include <string>           // for string
+#include <vector>           // for vector
+
+namespace rawspeed {
+
+// Writes a minimal little-endian TIFF file, with just one IFD.
+class TiffWriter final {
+  struct Entry final {
+    TiffTag tag;
+    TiffDataType type;
+    uint32 count;
+    std::vector<uchar8> data; // already little-endian
+  };
+
+  struct ImageData final {
+    TiffTag offsetsTag;
+    TiffTag countsTag;
+    std::vector<std::vector<uchar8>> blocks;
+  };
+
+  std::vector<Entry> entries;
+  std::vector<ImageData> images;
+
+  void add(TiffTag tag, TiffDataType type, uint32 count,
+           std::vector<uchar8> data);
+
+public:
+  void addBytes(TiffTag tag, const std::vector<uchar8>& values,
+                TiffDataType type = TIFF_BYTE);
+  void addShorts(TiffTag tag, const std::vector<ushort16>& values);
+  void addLongs(TiffTag tag, const std::vector<uint32>& values);
+  void addString(TiffTag tag, const std::string& value);
+
+  // The data of strips or tiles. On write(), the offsetsTag and countsTag
+  // entries are created, with the file offsets and the sizes of the blocks.
+  void addImageData(TiffTag offsetsTag, TiffTag countsTag,
+                    std::vector<std::vector<uchar8>> blocks);
+
+  std::vector<uchar8> write() const;
+};
+
+} // namespace rawspeed
@@ -35,6 +35,7 @@ using BitPumpJPEG = BitStream<JPEGBitPumpTag, BitStreamCacheRightInLeftOut>;
 
 template <> struct BitStreamTraits<BitPumpJPEG> final {
   static constexpr bool canUseWithHuffmanTable = true;
+  static constexpr bool hasMarkers = true;
 };
 
 template <>
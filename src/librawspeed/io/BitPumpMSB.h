@@ -35,6 +35,7 @@ using BitPumpMSB = BitStream<MSBBitPumpTag, BitStreamCacheRightInLeftOut>;
 
 template <> struct BitStreamTraits<BitPumpMSB> final {
   static constexpr bool canUseWithHuffmanTable = true;
+  static constexpr bool hasMarkers = false;
 };
 
 template <>
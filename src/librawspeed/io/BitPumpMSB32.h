@@ -35,6 +35,7 @@ using BitPumpMSB32 = BitStream<MSB32BitPumpTag, BitStreamCacheRightInLeftOut>;
 
 template <> struct BitStreamTraits<BitPumpMSB32> final {
   static constexpr bool canUseWithHuffmanTable = true;
+  static constexpr bool hasMarkers = false;
 };
 
 template <>
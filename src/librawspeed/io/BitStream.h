@@ -89,6 +89,11 @@ struct BitStreamCacheRightInLeftOut : BitStreamCacheBase
 
 template <typename BIT_STREAM> struct BitStreamTraits final {
   static constexpr bool canUseWithHuffmanTable = false;
+
+  // Whether the input may contain bytes that are not part of the bitstream
+  // (i.e. JPEG's byte stuffing and markers), so fillCache() may consume more
+  // than 4 bytes of input per 32 bits, and may stop at the end marker.
+  static constexpr bool hasMarkers = false;
 };
 
 template <typename Tag, typename Cache>
@@ -165,6 +170,34 @@ public:
     }
   }
 
+  // How many bytes past the ones that are actually consumed fill() may read.
+  static constexpr size_type MaxReadAheadBytes =
+      Cache::MaxGetBits / 8 + BitStreamCacheBase::MaxProcessBytes;
+
+  // Whether the next 'nbytes' bytes of the input, plus the read-ahead, are
+  // all there. If so, the *Unchecked() variants can be used to consume up to
+  // that many bytes, without them having to check anything themselves.
+  // This allows to validate the input once per row/strip/slice, instead of
+  // on each refill of the cache.
+  inline bool canConsumeUnchecked(size_type nbytes) const {
+    static_assert(!BitStreamTraits<BitStream>::hasMarkers,
+                  "the stream may be consuming more bytes than bits");
+    return static_cast<uint64>(getBufferPosition()) + nbytes +
+               MaxReadAheadBytes <=
+           size;
+  }
+
+  inline void fillUnchecked(uint32 nbits = Cache::MaxGetBits) {
+    static_assert(!BitStreamTraits<BitStream>::hasMarkers,
+                  "the stream may be consuming more bytes than bits");
+    assert(data);
+    assert(nbits <= Cache::MaxGetBits);
+    if (cache.fillLevel < nbits) {
+      assert(pos + BitStreamCacheBase::MaxProcessBytes <= size);
+      pos += fillCache(data + pos, size, &pos);
+    }
+  }
+
   // these methods might be specialized by implementations that support it
   inline size_type getBufferPosition() const {
     return pos - (cache.fillLevel >> 3);
@@ -209,6 +242,16 @@ public:
     return getBitsNoFill(nbits);
   }
 
+  inline uint32 peekBitsUnchecked(uint32 nbits) {
+    fillUnchecked(nbits);
+    return peekBitsNoFill(nbits);
+  }
+
+  inline uint32 getBitsUnchecked(uint32 nbits) {
+    fillUnchecked(nbits);
+    return getBitsNoFill(nbits);
+  }
+
   inline void skipBits(uint32 nbits) {
     if (nbits > cache.fillLevel)
       ThrowIOE("skipBits overflow");
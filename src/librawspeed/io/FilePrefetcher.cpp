@@ -0,0 +1,249 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "io/FilePrefetcher.h"
+#include "io/Buffer.h"          // for Buffer
+#include "io/FileIOException.h" // for ThrowFIE
+#include "io/FileReader.h"      // for FileReader
+#include <algorithm>            // for max
+#include <cassert>              // for assert
+#include <chrono>               // for steady_clock, duration
+#include <utility>              // for move
+
+#if defined(__linux__)
+#include <fcntl.h>  // for open, posix_fadvise, POSIX_FADV_DONTNEED, O_RDONLY
+#include <unistd.h> // for close
+#endif
+
+namespace rawspeed {
+
+namespace {
+
+#if defined(__linux__)
+void adviseFile(const std::string& fileName, int advice) {
+  const int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+    return; // The read itself will report the problem.
+
+  // This is only a hint, failure is not a problem.
+  (void)posix_fadvise(fd, 0, 0, advice);
+  close(fd);
+}
+#endif
+
+// Start reading the file into the page cache, without waiting for it.
+void adviseWillNeed(const std::string& fileName) {
+#if defined(__linux__)
+  adviseFile(fileName, POSIX_FADV_WILLNEED);
+#else
+  (void)fileName;
+#endif
+}
+
+// Drop the (clean) pages of the file from the page cache.
+void adviseDontNeed(const std::string& fileName) {
+#if defined(__linux__)
+  adviseFile(fileName, POSIX_FADV_DONTNEED);
+#else
+  (void)fileName;
+#endif
+}
+
+} // namespace
+
+FileIOMode parseFileIOMode(const std::string& mode) {
+  if (mode == "cold")
+    return FileIOMode::Cold;
+  if (mode == "warm")
+    return FileIOMode::Warm;
+  if (mode == "overlapped")
+    return FileIOMode::Overlapped;
+
+  ThrowFIE("Unknown I/O mode \"%s\".", mode.c_str());
+}
+
+bool canDropFromPageCache() {
+#if defined(__linux__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+FilePrefetcher::FilePrefetcher(const std::vector<std::string>& fileNames,
+                               FileIOMode mode_, int depth_, bool dropCaches_)
+    : mode(mode_), depth(std::max(1, depth_)), dropCaches(dropCaches_),
+      entries(fileNames.size()) {
+  for (int i = 0; i < static_cast<int>(fileNames.size()); ++i)
+    entries[i].fileName = fileNames[i];
+
+  if (mode == FileIOMode::Overlapped)
+    reader = std::thread([this]() { readerLoop(); });
+}
+
+FilePrefetcher::~FilePrefetcher() {
+  if (!reader.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  reader.join();
+}
+
+std::unique_ptr<const Buffer>
+FilePrefetcher::readNow(const std::string& fileName) {
+  switch (mode) {
+  case FileIOMode::Cold:
+    adviseDontNeed(fileName);
+    break;
+  case FileIOMode::Warm: {
+    FileReader warmup(fileName.c_str());
+    (void)warmup.readFile();
+    break;
+  }
+  case FileIOMode::Overlapped:
+    if (dropCaches)
+      adviseDontNeed(fileName);
+    break;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  FileReader reader(fileName.c_str());
+  auto buffer = reader.readFile();
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::lock_guard<std::mutex> guard(mutex);
+  waitSeconds += elapsed.count();
+
+  return buffer;
+}
+
+void FilePrefetcher::readerLoop() {
+  const int numEntries = entries.size();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    // Skip over what was already taken (or skipped) by the consumers.
+    while (next < numEntries && entries[next].state != Entry::State::Pending)
+      ++next;
+
+    if (stopping || next == numEntries)
+      return;
+
+    if (numReady >= depth) {
+      changed.wait(lock);
+      continue;
+    }
+
+    Entry& e = entries[next];
+    e.state = Entry::State::Reading;
+    const std::string fileName = e.fileName;
+    const int afterNext = next + 1;
+    ++next;
+
+    lock.unlock();
+
+    if (dropCaches) {
+      // Any read-ahead of it would be dropped anyway.
+      adviseDontNeed(fileName);
+    } else if (afterNext < numEntries) {
+      // Let the kernel start on the one after this one while we read this
+      // one.
+      adviseWillNeed(entries[afterNext].fileName);
+    }
+
+    std::unique_ptr<const Buffer> buffer;
+    std::exception_ptr error;
+    try {
+      FileReader fileReader(fileName.c_str());
+      buffer = fileReader.readFile();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    lock.lock();
+
+    if (e.state == Entry::State::Taken)
+      continue; // It was skipped while we were reading it.
+
+    e.buffer = std::move(buffer);
+    e.error = error;
+    e.state = Entry::State::Ready;
+    ++numReady;
+    changed.notify_all();
+  }
+}
+
+std::unique_ptr<const Buffer> FilePrefetcher::take(int i) {
+  assert(i >= 0 && i < static_cast<int>(entries.size()));
+
+  std::unique_lock<std::mutex> lock(mutex);
+  Entry& e = entries[i];
+  assert(e.state != Entry::State::Taken);
+
+  // The reader did not get to it (yet), just read it ourselves.
+  if (e.state == Entry::State::Pending) {
+    e.state = Entry::State::Taken;
+    lock.unlock();
+    return readNow(e.fileName);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  changed.wait(lock, [&e]() { return e.state == Entry::State::Ready; });
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  waitSeconds += elapsed.count();
+
+  e.state = Entry::State::Taken;
+  --numReady;
+  changed.notify_all();
+
+  if (e.error)
+    std::rethrow_exception(e.error);
+
+  return std::move(e.buffer);
+}
+
+void FilePrefetcher::skip(int i) {
+  assert(i >= 0 && i < static_cast<int>(entries.size()));
+
+  std::lock_guard<std::mutex> guard(mutex);
+  Entry& e = entries[i];
+  assert(e.state != Entry::State::Taken);
+
+  if (e.state == Entry::State::Ready) {
+    e.buffer.reset();
+    --numReady;
+    changed.notify_all();
+  }
+  e.state = Entry::State::Taken;
+}
+
+double FilePrefetcher::getWaitSeconds() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return waitSeconds;
+}
+
+} // namespace rawspeed
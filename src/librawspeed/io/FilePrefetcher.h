@@ -0,0 +1,108 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#pragma once
+
+#include <condition_variable> // for condition_variable
+#include <exception>          // for exception_ptr
+#include <memory>             // for unique_ptr
+#include <mutex>              // for mutex
+#include <string>             // for string
+#include <thread>             // for thread
+#include <vector>             // for vector
+
+namespace rawspeed {
+
+class Buffer;
+
+// How the files get into memory. This allows to measure the decoding with and
+// without the I/O, and how much of the I/O can be hidden behind the decoding.
+enum class FileIOMode {
+  // Each file is evicted from the page cache, and then read, synchronously.
+  Cold,
+  // Each file is read twice, synchronously, and only the second read counts.
+  Warm,
+  // A background thread reads the next few files while the current ones are
+  // being decoded.
+  Overlapped,
+};
+
+// Parses "cold", "warm" or "overlapped". Throws on anything else.
+FileIOMode parseFileIOMode(const std::string& mode);
+
+// Can the files be dropped from the page cache on this platform? If not, the
+// cold reads (and the ones with FilePrefetcher's dropCaches) are just as warm
+// as the others, if the files were read recently.
+bool canDropFromPageCache();
+
+// Reads a known list of files, possibly ahead of time. The files are read in
+// the order of the list, so they should be consumed in roughly that order.
+// At most `depth` files that have been read but not yet taken are kept
+// in memory at any time. With dropCaches, each file is dropped from the page
+// cache right before it is read in the overlapped mode too, so that the reads
+// come from the storage even if the list names the same file several times.
+class FilePrefetcher final {
+  struct Entry {
+    enum class State { Pending, Reading, Ready, Taken };
+
+    std::string fileName;
+    State state = State::Pending;
+    std::unique_ptr<const Buffer> buffer;
+    std::exception_ptr error;
+  };
+
+  const FileIOMode mode;
+  const int depth;
+  const bool dropCaches;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<Entry> entries;
+  int next = 0;     // the first entry the reader has not looked at.
+  int numReady = 0; // read, but not yet taken.
+  bool stopping = false;
+
+  double waitSeconds = 0; // guarded by mutex
+
+  std::thread reader;
+
+  void readerLoop();
+  std::unique_ptr<const Buffer> readNow(const std::string& fileName);
+
+public:
+  FilePrefetcher(const std::vector<std::string>& fileNames, FileIOMode mode_,
+                 int depth_ = 2, bool dropCaches_ = false);
+  FilePrefetcher(const FilePrefetcher&) = delete;
+  FilePrefetcher& operator=(const FilePrefetcher&) = delete;
+  ~FilePrefetcher();
+
+  // Returns the contents of the i'th file, blocking until they are read.
+  // Throws FileIOException just like FileReader::readFile() does.
+  // May be called from several threads at once, but only once per file.
+  std::unique_ptr<const Buffer> take(int i);
+
+  // The i'th file will not be needed after all.
+  void skip(int i);
+
+  // How long the callers of take() were blocked on the I/O, in total.
+  double getWaitSeconds();
+};
+
+} // namespace rawspeed
@@ -41,6 +41,8 @@ public:
 
   void parseData();
 
+  const CiffIFD* getRootIFD() const { return mRootIFD.get(); }
+
   std::unique_ptr<RawDecoder>
   getDecoder(const CameraMetaData* meta = nullptr) override;
 };
@@ -0,0 +1,277 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "parsers/PreviewParser.h"
+#include "common/RawspeedException.h"                // for RawspeedException
+#include "decoders/CrwDecoder.h"                     // for CrwDecoder
+#include "decoders/MrwDecoder.h"                     // for MrwDecoder
+#include "decoders/RafDecoder.h"                     // for RafDecoder
+#include "decompressors/AbstractLJpegDecompressor.h" // for JpegMarker
+#include "io/Buffer.h"                               // for Buffer, DataBuffer
+#include "io/ByteStream.h"                           // for ByteStream
+#include "io/Endianness.h"                           // for Endianness, Endi...
+#include "parsers/CiffParser.h"                      // for CiffParser
+#include "parsers/RawParserException.h"              // for ThrowRPE
+#include "parsers/TiffParser.h"                      // for TiffParser
+#include "tiff/CiffEntry.h"                          // for CiffEntry
+#include "tiff/CiffIFD.h"                            // for CiffIFD
+#include "tiff/CiffTag.h"                            // for CIFF_IMAGEINFO
+#include "tiff/TiffEntry.h"                          // for TiffEntry
+#include "tiff/TiffIFD.h"                            // for TiffIFD, TiffRoo...
+#include "tiff/TiffTag.h"                            // for JPEGINTERCHANGEF...
+#include <algorithm>                                 // for any_of, stable_sort
+#include <cassert>                                   // for assert
+
+namespace rawspeed {
+
+namespace {
+
+// The dimensions, as per the frame header, or nothing if this is not a JPEG,
+// or a lossless one.
+iPoint2D getJpegDim(const Buffer& jpeg) {
+  ByteStream bs(DataBuffer(jpeg, Endianness::big));
+  if (bs.getByte() != 0xFF || bs.getByte() != M_SOI)
+    return {};
+
+  while (bs.getRemainSize() > 0) {
+    if (bs.getByte() != 0xFF)
+      return {};
+    uchar8 m = bs.getByte();
+    while (m == 0xFF) // fill bytes
+      m = bs.getByte();
+
+    if (m == M_SOS || m == M_EOI)
+      return {};
+
+    const ushort16 length = bs.getU16();
+    if (length < 2)
+      return {};
+    ByteStream segment = bs.getStream(length - 2);
+
+    switch (m) {
+    case M_SOF0:
+    case M_SOF1:
+    case M_SOF2:
+    case M_SOF5:
+    case M_SOF6:
+    case M_SOF9:
+    case M_SOF10:
+    case M_SOF13:
+    case M_SOF14: {
+      segment.skipBytes(1); // precision
+      const int height = segment.getU16();
+      const int width = segment.getU16();
+      return {width, height};
+    }
+    case M_SOF3:
+    case M_SOF7:
+    case M_SOF11:
+    case M_SOF15:
+      return {};
+    default:
+      break;
+    }
+  }
+
+  return {};
+}
+
+int getOrientation(const TiffIFD* root) {
+  const TiffEntry* entry = root->getEntryRecursive(ORIENTATION);
+  if (!entry)
+    return 0;
+
+  const uint32 orientation = entry->getU32();
+  return orientation >= 1 && orientation <= 8 ? orientation : 0;
+}
+
+} // namespace
+
+PreviewParser::PreviewParser(const Buffer* input) : mInput(input) {
+  if (MrwDecoder::isMRW(mInput))
+    parseMrw();
+  else if (RafDecoder::isRAF(mInput))
+    parseRaf();
+  else if (CrwDecoder::isCRW(mInput)) {
+    CiffParser p(mInput);
+    p.parseData();
+    parseCiff(p.getRootIFD());
+  } else
+    parseTiff(*mInput);
+
+  std::stable_sort(previews.begin(), previews.end(),
+                   [](const EmbeddedPreview& a, const EmbeddedPreview& b) {
+                     return a.dim.area() < b.dim.area();
+                   });
+}
+
+const EmbeddedPreview& PreviewParser::getSmallest() const {
+  if (previews.empty())
+    ThrowRPE("No embedded preview found");
+  return previews.front();
+}
+
+const EmbeddedPreview& PreviewParser::getLargest() const {
+  if (previews.empty())
+    ThrowRPE("No embedded preview found");
+  return previews.back();
+}
+
+void PreviewParser::addPreview(const Buffer& jpeg, int orientation) {
+  assert(jpeg.begin() >= mInput->begin() && jpeg.end() <= mInput->end());
+
+  EmbeddedPreview preview;
+  preview.offset = static_cast<uint32>(jpeg.begin() - mInput->begin());
+  preview.size = jpeg.getSize();
+  preview.orientation = orientation;
+
+  // The same one may be referenced from more than one place.
+  if (std::any_of(previews.cbegin(), previews.cend(),
+                  [&preview](const EmbeddedPreview& p) {
+                    return p.offset == preview.offset;
+                  }))
+    return;
+
+  try {
+    preview.dim = getJpegDim(jpeg);
+  } catch (RawspeedException&) {
+    return;
+  }
+
+  if (preview.dim.hasPositiveArea())
+    previews.push_back(preview);
+}
+
+void PreviewParser::parseTiff(const TiffIFD* ifd, int orientation) {
+  // The offsets are relative to the TIFF the IFD belongs to, which is not
+  // necessarily at the start of the file (e.g. for the maker notes).
+  if (ifd->hasEntry(JPEGINTERCHANGEFORMAT) &&
+      ifd->hasEntry(JPEGINTERCHANGEFORMATLENGTH)) {
+    try {
+      const TiffEntry* start = ifd->getEntry(JPEGINTERCHANGEFORMAT);
+      const TiffEntry* length = ifd->getEntry(JPEGINTERCHANGEFORMATLENGTH);
+      addPreview(start->getRootIfdData().getSubView(start->getU32(),
+                                                    length->getU32()),
+                 orientation);
+    } catch (RawspeedException&) {
+      // Just a broken reference, there may be other previews.
+    }
+  }
+
+  // E.g. for DNG and CR2, a JPEG-compressed image of just one strip.
+  // The lossless ones are the raw data, getJpegDim() rejects them.
+  if (ifd->hasEntry(COMPRESSION) && ifd->hasEntry(STRIPOFFSETS) &&
+      ifd->hasEntry(STRIPBYTECOUNTS)) {
+    try {
+      const uint32 compression = ifd->getEntry(COMPRESSION)->getU32();
+      const TiffEntry* offsets = ifd->getEntry(STRIPOFFSETS);
+      const TiffEntry* counts = ifd->getEntry(STRIPBYTECOUNTS);
+      if ((compression == 6 || compression == 7) && offsets->count == 1 &&
+          counts->count == 1) {
+        addPreview(offsets->getRootIfdData().getSubView(offsets->getU32(),
+                                                        counts->getU32()),
+                   orientation);
+      }
+    } catch (RawspeedException&) {
+      // Just a broken reference, there may be other previews.
+    }
+  }
+
+  for (const auto& subIFD : ifd->getSubIFDs())
+    parseTiff(subIFD.get(), orientation);
+}
+
+void PreviewParser::parseTiff(const Buffer& tiff) {
+  const TiffRootIFDOwner root = TiffParser::parse(nullptr, tiff);
+  parseTiff(root.get(), getOrientation(root.get()));
+}
+
+void PreviewParser::parseCiff(const CiffIFD* root) {
+  // Width, height, pixel aspect ratio, rotation (in degrees).
+  int orientation = 0;
+  const CiffEntry* info = root->getEntryRecursive(CIFF_IMAGEINFO);
+  if (info && info->count >= 4) {
+    switch (static_cast<int>(info->getU32(3))) {
+    case 0:
+      orientation = 1;
+      break;
+    case 90:
+      orientation = 6;
+      break;
+    case 180:
+      orientation = 3;
+      break;
+    case 270:
+    case -90:
+      orientation = 8;
+      break;
+    default:
+      break;
+    }
+  }
+
+  const CiffEntry* jpeg = root->getEntryRecursive(CIFF_JPEGIMAGE);
+  if (jpeg)
+    addPreview(jpeg->getData(), orientation);
+}
+
+void PreviewParser::parseMrw() {
+  // See MrwDecoder::parseHeader(). Only the TTW block (a TIFF) is of interest.
+  ByteStream bs(DataBuffer(*mInput, Endianness::big));
+  bs.skipBytes(4); // magic
+  const uint32 headerSize = bs.getU32();
+  bs = bs.getSubStream(bs.getPosition(), headerSize);
+
+  while (bs.getRemainSize() > 0) {
+    const uint32 tag = bs.getU32();
+    const uint32 len = bs.getU32();
+    if (tag == 0x545457) { // TTW
+      parseTiff(bs.getBuffer(len));
+      return;
+    }
+    bs.skipBytes(len);
+  }
+}
+
+void PreviewParser::parseRaf() {
+  // The header has the offset and the size of the JPEG at a fixed position.
+  ByteStream bs(DataBuffer(*mInput, Endianness::big));
+  bs.skipBytes(0x54);
+  const uint32 offset = bs.getU32();
+  const uint32 size = bs.getU32();
+  const Buffer jpeg = mInput->getSubView(offset, size);
+
+  // Its EXIF (a TIFF) follows the APP1 marker, see FiffParser::parseData().
+  // That has both the orientation and the thumbnail.
+  int orientation = 0;
+  try {
+    const TiffRootIFDOwner exif =
+        TiffParser::parse(nullptr, jpeg.getSubView(12));
+    orientation = getOrientation(exif.get());
+    parseTiff(exif.get(), orientation);
+  } catch (RawspeedException&) {
+    // No EXIF, the JPEG itself may still be fine.
+  }
+
+  addPreview(jpeg, orientation);
+}
+
+} // namespace rawspeed
@@ -0,0 +1,73 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#pragma once
+
+#include "common/Common.h" // for uint32
+#include "common/Point.h"  // for iPoint2D
+#include <vector>          // for vector
+
+namespace rawspeed {
+
+class Buffer;
+class CiffIFD;
+class TiffIFD;
+
+// A JPEG preview that is embedded into a raw file.
+struct EmbeddedPreview final {
+  // The JPEG stream, in bytes from the start of the file.
+  uint32 offset = 0;
+  uint32 size = 0;
+
+  // As per the frame header of the JPEG.
+  iPoint2D dim;
+
+  // Of the raw, as in EXIF (1 to 8), or 0 if unknown.
+  int orientation = 0;
+};
+
+// Finds the embedded previews by looking only at the headers of the file
+// (the TIFF IFDs, the CIFF entries, the RAF header, the MRW blocks), and at
+// the headers of the JPEGs themselves, without setting up a decoder.
+// Only the DCT JPEGs are reported, i.e. not the lossless-JPEG raw data.
+class PreviewParser final {
+  const Buffer* mInput;
+  std::vector<EmbeddedPreview> previews;
+
+  void addPreview(const Buffer& jpeg, int orientation);
+  void parseTiff(const TiffIFD* ifd, int orientation);
+  void parseTiff(const Buffer& tiff);
+  void parseCiff(const CiffIFD* root);
+  void parseMrw();
+  void parseRaf();
+
+public:
+  explicit PreviewParser(const Buffer* input);
+
+  // From the smallest one to the largest one.
+  const std::vector<EmbeddedPreview>& getPreviews() const { return previews; }
+
+  // These throw if there are none.
+  const EmbeddedPreview& getSmallest() const;
+  const EmbeddedPreview& getLargest() const;
+};
+
+} // namespace rawspeed
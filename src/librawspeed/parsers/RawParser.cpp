@@ -20,6 +20,8 @@
 */
 
 #include "parsers/RawParser.h"
+#include "common/DecodeStatistics.h"      // for StageTimer, DecodeStage
+#include "decoders/CrwDecoder.h"          // for CrwDecoder
 #include "decoders/MrwDecoder.h"          // for MrwDecoder
 #include "decoders/NakedDecoder.h"        // for NakedDecoder
 #include "decoders/RafDecoder.h"          // for RafDecoder
@@ -28,63 +30,110 @@
 #include "io/Buffer.h"                    // for Buffer
 #include "metadata/CameraMetaData.h"      // for CameraMetaData
 #include "parsers/CiffParser.h"           // for CiffParser
-#include "parsers/CiffParserException.h"  // for CiffParserException
 #include "parsers/FiffParser.h"           // for FiffParser
-#include "parsers/FiffParserException.h"  // for FiffParserException
 #include "parsers/TiffParser.h"           // for TiffParser
-#include "parsers/TiffParserException.h"  // for TiffParserException
+#include <cassert>                        // for assert
+#include <exception>                      // for exception
+#include <memory>                         // for unique_ptr, make_shared
+#include <string>                         // for string
+#include <utility>                        // for move
 
 namespace rawspeed {
 
 class Camera;
 
 std::unique_ptr<RawDecoder> RawParser::getDecoder(const CameraMetaData* meta) {
+  auto statistics = std::make_shared<DecodeStatistics>();
+
+  std::unique_ptr<RawDecoder> decoder;
+  {
+    StageTimer timer(statistics.get(), DecodeStage::Parse, mInput->getSize());
+    decoder = findDecoder(meta);
+  }
+
+  decoder->mRaw->statistics = std::move(statistics);
+  return decoder;
+}
+
+RawFormat RawParser::probe(const Buffer* input) noexcept {
   // We need some data.
   // For now it is 104 bytes for RAF/FUJIFIM images.
   // FIXME: each decoder/parser should check it on their own.
-  if (mInput->getSize() <=  104)
-    ThrowRDE("File too small");
+  if (input->getSize() <= 104)
+    return RawFormat::Unknown;
 
-  // MRW images are easy to check for, let's try that first
-  if (MrwDecoder::isMRW(mInput)) {
-    try {
-      return std::make_unique<MrwDecoder>(mInput);
-    } catch (RawDecoderException &) {
-    }
-  }
+  // The headers are all much smaller than that, so the checks can't throw.
+  if (MrwDecoder::isMRW(input))
+    return RawFormat::Mrw;
 
   // FUJI has pointers to IFD's at fixed byte offsets
   // So if camera is FUJI, we cannot use ordinary TIFF parser
-  if (RafDecoder::isRAF(mInput)) {
-    try {
-      FiffParser p(mInput);
-      return p.getDecoder(meta);
-    } catch (FiffParserException&) {
-    }
+  if (RafDecoder::isRAF(input))
+    return RawFormat::Fiff;
+
+  if (TiffParser::isTIFF(*input))
+    return RawFormat::Tiff;
+
+  if (CrwDecoder::isCRW(input))
+    return RawFormat::Ciff;
+
+  return RawFormat::Unknown;
+}
+
+std::unique_ptr<RawDecoder>
+RawParser::tryGetDecoder(const CameraMetaData* meta, Status* status,
+                         std::string* error) {
+  assert(status);
+
+  if (probe(mInput) == RawFormat::Unknown &&
+      !(meta != nullptr && meta->hasChdkCamera(mInput->getSize()))) {
+    *status = Status::UnknownFormat;
+    if (error)
+      *error = "Unknown file format";
+    return nullptr;
   }
 
-  // Ordinary TIFF images
   try {
+    std::unique_ptr<RawDecoder> decoder = getDecoder(meta);
+    *status = Status::OK;
+    return decoder;
+  } catch (std::exception& e) {
+    *status = Status::Failed;
+    if (error)
+      *error = e.what();
+    return nullptr;
+  }
+}
+
+std::unique_ptr<RawDecoder>
+RawParser::findDecoder(const CameraMetaData* meta) {
+  if (mInput->getSize() <=  104)
+    ThrowRDE("File too small");
+
+  // Only the parser for the format that the file looks like is tried.
+  switch (probe(mInput)) {
+  case RawFormat::Mrw:
+    return std::make_unique<MrwDecoder>(mInput);
+  case RawFormat::Fiff: {
+    FiffParser p(mInput);
+    return p.getDecoder(meta);
+  }
+  case RawFormat::Tiff: {
     TiffParser p(mInput);
     return p.getDecoder(meta);
-  } catch (TiffParserException &) {
   }
-
-  // CIFF images
-  try {
+  case RawFormat::Ciff: {
     CiffParser p(mInput);
     return p.getDecoder(meta);
-  } catch (CiffParserException &) {
+  }
+  case RawFormat::Unknown:
+    break;
   }
 
   // Detect camera on filesize (CHDK).
   if (meta != nullptr && meta->hasChdkCamera(mInput->getSize())) {
     const Camera* c = meta->getChdkCamera(mInput->getSize());
-
-    try {
-      return std::make_unique<NakedDecoder>(mInput, c);
-    } catch (RawDecoderException &) {
-    }
+    return std::make_unique<NakedDecoder>(mInput, c);
   }
 
   // File could not be decoded, so no further options for now.
@@ -21,6 +21,7 @@
 #pragma once
 
 #include <memory> // for unique_ptr
+#include <string> // for string
 
 namespace rawspeed {
 
@@ -30,16 +31,45 @@ class CameraMetaData;
 
 class RawDecoder;
 
+// Which of the parsers (or the decoder, for MRW) handles the file.
+enum class RawFormat {
+  Unknown, // maybe a headerless (CHDK) raw, or not a raw at all
+  Mrw,
+  Fiff,
+  Tiff,
+  Ciff,
+};
+
 class RawParser {
 public:
   explicit RawParser(const Buffer* inputData) : mInput(inputData) {}
   virtual ~RawParser() = default;
 
+  // Just looks at the magic of the file, never throws.
+  static RawFormat probe(const Buffer* input) noexcept;
+
   virtual std::unique_ptr<RawDecoder>
   getDecoder(const CameraMetaData* meta = nullptr);
 
+  enum class Status {
+    OK,
+    UnknownFormat, // not a raw file, as far as the probe can tell
+    Failed,        // looks like a raw file, but no decoder could be created
+  };
+
+  // Like getDecoder(), but reports the failures via the status instead of an
+  // exception, and for the files that are not raws at all (i.e. most of the
+  // files when scanning directories) no exception is thrown internally either.
+  // If it failed, the reason is stored into error, if it is given.
+  std::unique_ptr<RawDecoder> tryGetDecoder(const CameraMetaData* meta,
+                                            Status* status,
+                                            std::string* error = nullptr);
+
 protected:
   const Buffer* mInput;
+
+private:
+  std::unique_ptr<RawDecoder> findDecoder(const CameraMetaData* meta);
 };
 
 } // namespace rawspeed
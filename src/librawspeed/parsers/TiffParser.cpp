@@ -41,7 +41,9 @@
 #include "decoders/Rw2Decoder.h"         // for Rw2Decoder
 #include "decoders/SrwDecoder.h"         // for SrwDecoder
 #include "decoders/ThreefrDecoder.h"     // for ThreefrDecoder
+#include "io/Buffer.h"                   // for Buffer
 #include "io/ByteStream.h"               // for ByteStream
+#include "io/Endianness.h"               // for getU16BE, getU16LE
 #include "parsers/TiffParserException.h" // for ThrowTPE
 #include <cassert>                       // for assert
 #include <cstdint>                       // for UINT32_MAX
@@ -61,6 +63,23 @@ std::unique_ptr<RawDecoder> TiffParser::getDecoder(const CameraMetaData* meta) {
   return TiffParser::makeDecoder(TiffParser::parse(nullptr, *mInput), *mInput);
 }
 
+bool TiffParser::isTIFF(const Buffer& data) noexcept {
+  if (!data.isValid(0, 4))
+    return false;
+
+  const uchar8* header = data.begin();
+  ushort16 magic;
+  if (header[0] == 'I' && header[1] == 'I')
+    magic = getU16LE(header + 2);
+  else if (header[0] == 'M' && header[1] == 'M')
+    magic = getU16BE(header + 2);
+  else
+    return false;
+
+  // See parse().
+  return magic == 42 || magic == 0x4f52 || magic == 0x5352 || magic == 0x55;
+}
+
 TiffRootIFDOwner TiffParser::parse(TiffIFD* parent, const Buffer& data) {
   ByteStream bs(data, 0);
   bs.setByteOrder(getTiffByteOrder(bs, 0, "TIFF header"));
@@ -40,6 +40,9 @@ public:
   std::unique_ptr<RawDecoder>
   getDecoder(const CameraMetaData* meta = nullptr) override;
 
+  // Whether it starts with a TIFF header (including the ORF and RW2 variants).
+  static bool isTIFF(const Buffer& data) noexcept;
+
   // TiffRootIFDOwner contains pointers into 'data' but if is is non-owning, it
   // may be deleted immediately
   static TiffRootIFDOwner parse(TiffIFD* parent, const Buffer& data);
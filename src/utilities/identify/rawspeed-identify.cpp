@@ -117,6 +117,7 @@ std::string find_cameras_xml(const char *argv0) {
 
 using rawspeed::CameraMetaData;
 using rawspeed::FileReader;
+using rawspeed::PreviewParser;
 using rawspeed::RawParser;
 using rawspeed::RawImage;
 using rawspeed::uchar8;
@@ -127,43 +128,48 @@ using rawspeed::TYPE_FLOAT32;
 using rawspeed::RawspeedException;
 using rawspeed::identify::find_cameras_xml;
 
+// Only looks at the headers, does not set up a decoder.
+int printPreviews(const char* imageFileName) {
+  FileReader f(imageFileName);
+  auto m(f.readFile());
+
+  const PreviewParser p(m.get());
+  for (const auto& preview : p.getPreviews()) {
+    fprintf(stdout, "preview: %dx%d offset: %u size: %u orientation: %d\n",
+            preview.dim.x, preview.dim.y, preview.offset, preview.size,
+            preview.orientation);
+  }
+
+  return 0;
+}
+
 int main(int argc, char* argv[]) { // NOLINT
 
-  if (argc != 2) {
-    fprintf(stderr, "Usage: darktable-rs-identify <file>\n");
+  const bool previewsOnly =
+      argc == 3 && std::string(argv[1]) == "--previews"; // NOLINT
+  if (argc != 2 && !previewsOnly) {
+    fprintf(stderr, "Usage: darktable-rs-identify [--previews] <file>\n");
     return 0;
   }
+  const char* const fileArg = argv[argc - 1]; // NOLINT
 
-  const std::string camfile = find_cameras_xml(argv[0]);
-  if (camfile.empty()) {
+  const std::string camfile = previewsOnly ? "" : find_cameras_xml(argv[0]);
+  if (!previewsOnly && camfile.empty()) {
     // fprintf(stderr, "ERROR: Couldn't find cameras.xml\n");
     return 2;
   }
   // fprintf(stderr, "Using cameras.xml from '%s'\n", camfile.c_str());
 
   try {
-    std::unique_ptr<const CameraMetaData> meta;
-
-#ifdef HAVE_PUGIXML
-    meta = std::make_unique<CameraMetaData>(camfile.c_str());
-#else
-    meta = std::make_unique<CameraMetaData>();
-#endif
-
-    if (!meta) {
-      fprintf(stderr, "ERROR: Couldn't get a CameraMetaData instance\n");
-      return 2;
-    }
-
 #ifndef _WIN32
-    char* imageFileName = argv[1];
+    const char* imageFileName = fileArg;
 #else
     // turn the locale ANSI encoded string into UTF-8 so that FileReader can
     // turn it into UTF-16 later
-    int size = MultiByteToWideChar(CP_ACP, 0, argv[1], -1, NULL, 0);
+    int size = MultiByteToWideChar(CP_ACP, 0, fileArg, -1, NULL, 0);
     std::wstring wImageFileName;
     wImageFileName.resize(size);
-    MultiByteToWideChar(CP_ACP, 0, argv[1], -1, &wImageFileName[0], size);
+    MultiByteToWideChar(CP_ACP, 0, fileArg, -1, &wImageFileName[0], size);
     size = WideCharToMultiByte(CP_UTF8, 0, &wImageFileName[0], -1, NULL, 0,
                                NULL, NULL);
     std::string _imageFileName;
@@ -173,6 +179,22 @@ int main(int argc, char* argv[]) { // NOLINT
                         NULL, NULL);
 #endif
 
+    if (previewsOnly)
+      return printPreviews(imageFileName);
+
+    std::unique_ptr<const CameraMetaData> meta;
+
+#ifdef HAVE_PUGIXML
+    meta = std::make_unique<CameraMetaData>(camfile.c_str());
+#else
+    meta = std::make_unique<CameraMetaData>();
+#endif
+
+    if (!meta) {
+      fprintf(stderr, "ERROR: Couldn't get a CameraMetaData instance\n");
+      return 2;
+    }
+
     fprintf(stderr, "Loading file: \"%s\"\n", imageFileName);
 
     FileReader f(imageFileName);
@@ -18,25 +18,33 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
-#include "RawSpeed-API.h"        // for RawDecoder, FileReader, RawImage
-#include "common/ChecksumFile.h" // for ChecksumFileEntry, ReadChecksumFile
-#include <benchmark/benchmark.h> // for State, DoNotOptimize, Initialize
-#include <chrono>                // for duration, high_resolution_clock
-#include <ctime>                 // for clock, clock_t
-#include <memory>                // for unique_ptr
-#include <ratio>                 // for ratio
-#include <string>                // for string, operator!=, to_string
-#include <sys/time.h>            // for CLOCKS_PER_SEC
-#include <vector>                // for vector
-
-#ifdef HAVE_OPENMP
-#include <omp.h>
-#endif
+#include "RawSpeed-API.h"           // for RawDecoder, FileReader, RawImage
+#include "common/ChecksumFile.h"    // for ChecksumFileEntry, ReadChecksumFile
+#include "common/Common.h"          // for rawspeed_get_number_of_processor...
+#include "common/LargeAllocation.h" // for LargeAllocationPolicy, getLarge...
+#include "common/Numa.h"            // for getNumaNodeCpus, getNumaNodePag...
+#include "common/TaskScheduler.h"   // for Executor, ThreadPool
+#include "io/FilePrefetcher.h"      // for FilePrefetcher, FileIOMode
+#include <algorithm>                // for max
+#include <array>                    // for array
+#include <benchmark/benchmark.h>    // for State, DoNotOptimize, Initialize
+#include <chrono>                   // for duration, high_resolution_clock
+#include <ctime>                    // for clock, clock_t
+#include <iostream>                 // for cerr, endl
+#include <memory>                   // for unique_ptr, make_unique
+#include <ratio>                    // for ratio
+#include <string>                   // for string, operator!=, to_string
+#include <sys/time.h>               // for CLOCKS_PER_SEC
+#include <vector>                   // for vector
 
 #define HAVE_STEADY_CLOCK
 
+using rawspeed::Buffer;
 using rawspeed::CameraMetaData;
+using rawspeed::FileIOMode;
+using rawspeed::FilePrefetcher;
 using rawspeed::FileReader;
+using rawspeed::LargeAllocationPolicy;
 using rawspeed::RawImage;
 using rawspeed::RawParser;
 
@@ -87,17 +95,23 @@ template <typename Clock, typename period = std::ratio<1, 1>> struct Timer {
   }
 };
 
-} // namespace
+struct BenchOptions final {
+  FileIOMode ioMode = FileIOMode::Warm;
+  LargeAllocationPolicy allocationPolicy = LargeAllocationPolicy::Default;
+  bool prefaultData = false;
 
-static int currThreadCount;
+  // If set, the decodes run there, instead of on the default executor.
+  std::shared_ptr<rawspeed::Executor> executor;
 
-extern "C" int __attribute__((pure)) rawspeed_get_number_of_processor_cores() {
-  return currThreadCount;
-}
+  // Should the placement of the image's pages on the NUMA nodes be reported?
+  bool numaStatistics = false;
+};
+
+} // namespace
 
 static inline void BM_RawSpeed(benchmark::State& state, const char* fileName,
-                               int threads) {
-  currThreadCount = threads;
+                               int threads, const BenchOptions* options) {
+  const FileIOMode ioMode = options->ioMode;
 
 #ifdef HAVE_PUGIXML
   static const CameraMetaData metadata(RAWSPEED_SOURCE_DIR "/data/cameras.xml");
@@ -105,18 +119,52 @@ static inline void BM_RawSpeed(benchmark::State& state, const char* fileName,
   static const CameraMetaData metadata{};
 #endif
 
-  FileReader reader(fileName);
-  const auto map(reader.readFile());
+  // In the warm mode, the file is read once, and only the decoding is timed.
+  std::unique_ptr<const Buffer> warmMap;
+  if (ioMode == FileIOMode::Warm) {
+    FileReader reader(fileName);
+    warmMap = reader.readFile();
+  }
+
+  // Otherwise it is read anew for each iteration, and the reading is timed too.
+  // In the overlapped mode, the next copy is read while this one is decoded.
+  // Each copy is dropped from the page cache before it is read.
+  static constexpr int batchSize = 8;
+  std::unique_ptr<FilePrefetcher> files;
+  int fileIndex = batchSize;
+  double IOWaitTime = 0;
 
   Timer<ChooseClockType::type> WT;
   Timer<CPUClock> TT;
 
+  // Where the time went, summed over all the iterations.
+  std::array<double, rawspeed::numDecodeStages> stageWallTime{};
+
   unsigned pixels = 0;
+  LargeAllocationPolicy usedPolicy = options->allocationPolicy;
+  std::vector<rawspeed::uint64> nodePages;
   for (auto _ : state) {
-    RawParser parser(map.get());
+    std::unique_ptr<const Buffer> map;
+    if (!warmMap) {
+      if (fileIndex == batchSize) {
+        if (files)
+          IOWaitTime += files->getWaitSeconds();
+        files = std::make_unique<FilePrefetcher>(
+            std::vector<std::string>(batchSize, fileName), ioMode,
+            /*depth=*/2, /*dropCaches=*/true);
+        fileIndex = 0;
+      }
+      map = files->take(fileIndex++);
+    }
+
+    RawParser parser(warmMap ? warmMap.get() : map.get());
     auto decoder(parser.getDecoder(&metadata));
 
     decoder->failOnUnknown = false;
+    decoder->parallelism.maxThreads = threads;
+    decoder->parallelism.executor = options->executor;
+    decoder->allocationPolicy = options->allocationPolicy;
+    decoder->prefaultData = options->prefaultData;
     decoder->checkSupport(&metadata);
 
     decoder->decodeRaw();
@@ -125,12 +173,31 @@ static inline void BM_RawSpeed(benchmark::State& state, const char* fileName,
 
     benchmark::DoNotOptimize(raw);
 
+    for (int stage = 0; stage < rawspeed::numDecodeStages; ++stage) {
+      stageWallTime[stage] +=
+          decoder->getStatistics()
+              .get(static_cast<rawspeed::DecodeStage>(stage))
+              .wallSeconds;
+    }
+
     pixels = raw->getUncroppedDim().area();
+    usedPolicy = raw->getAllocationPolicy();
+    if (options->numaStatistics) {
+      nodePages = rawspeed::getNumaNodePageCounts(
+          raw->getDataUncropped(0, 0),
+          static_cast<size_t>(raw->pitch) * raw->getUncroppedDim().y);
+    }
   }
 
+  // The policy may have been unavailable, say what was actually used.
+  state.SetLabel(std::string("alloc:") +
+                 rawspeed::getLargeAllocationPolicyName(usedPolicy));
+
   // These are total over all the `state.iterations()` iterations.
   const double CPUTime = TT().count();
   const double WallTime = WT().count();
+  if (files)
+    IOWaitTime += files->getWaitSeconds();
 
   // For each iteration:
   state.counters.insert({
@@ -144,15 +211,37 @@ static inline void BM_RawSpeed(benchmark::State& state, const char* fileName,
       {"Raws/CPUTime", state.iterations() / CPUTime},
       {"Raws/WallTime", state.iterations() / WallTime},
   });
+  if (ioMode != FileIOMode::Warm)
+    state.counters.insert({{"IOWaitTime,s", IOWaitTime / state.iterations()}});
+
+  // Where the pages of the (last) image ended up.
+  rawspeed::uint64 totalPages = 0;
+  for (auto pages : nodePages)
+    totalPages += pages;
+  for (int node = 0; totalPages && node < static_cast<int>(nodePages.size());
+       ++node) {
+    state.counters.insert({{"Node" + std::to_string(node) + "Pages,%",
+                            100.0 * nodePages[node] / totalPages}});
+  }
+
+#ifdef WITH_STAGE_TIMING
+  for (int stage = 0; stage < rawspeed::numDecodeStages; ++stage) {
+    const std::string name = rawspeed::getDecodeStageName(
+        static_cast<rawspeed::DecodeStage>(stage));
+    state.counters.insert(
+        {{name + "Time,s", stageWallTime[stage] / state.iterations()}});
+  }
+#endif
   // Could also have counters wrt. the filesize,
   // but i'm not sure they are interesting.
 }
 
-static void addBench(const char* fName, std::string tName, int threads) {
+static void addBench(const char* fName, std::string tName, int threads,
+                     const BenchOptions* options) {
   tName += std::to_string(threads);
 
-  auto* b =
-      benchmark::RegisterBenchmark(tName.c_str(), &BM_RawSpeed, fName, threads);
+  auto* b = benchmark::RegisterBenchmark(tName.c_str(), &BM_RawSpeed, fName,
+                                         threads, options);
   b->Unit(benchmark::kMillisecond);
   b->UseRealTime();
 }
@@ -173,14 +262,84 @@ int main(int argc, char** argv) {
 
   bool threading = hasFlag("-t");
 
-#ifdef HAVE_OPENMP
-  const auto threadsMax = omp_get_max_threads();
-#else
-  const auto threadsMax = 1;
-#endif
+  auto threadsMax = std::max(1, rawspeed_get_number_of_processor_cores());
 
   const auto threadsMin = threading ? 1 : threadsMax;
 
+  // How to read the files: cold, warm (the default) or overlapped.
+  BenchOptions options;
+  FileIOMode& ioMode = options.ioMode;
+  std::string ioModeName;
+  int ioModeFlag = hasFlag("-i");
+  if (ioModeFlag && ioModeFlag + 1 < argc && argv[ioModeFlag + 1]) {
+    ioModeName = argv[ioModeFlag + 1];
+    try {
+      ioMode = rawspeed::parseFileIOMode(ioModeName);
+    } catch (rawspeed::RawspeedException& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    argv[ioModeFlag + 1] = nullptr;
+
+    // The same file is read again and again, so unless it is dropped from the
+    // page cache each time, all but the first read are not really I/O.
+    if (ioMode != FileIOMode::Warm && !rawspeed::canDropFromPageCache()) {
+      std::cerr << "I/O mode \"" << ioModeName
+                << "\" is not supported on this platform" << std::endl;
+      return 1;
+    }
+  }
+
+  // How to allocate the images: default (malloc), thp or hugetlb.
+  // And, with -P, should their pages be faulted in in parallel right away?
+  LargeAllocationPolicy& allocationPolicy = options.allocationPolicy;
+  std::string allocationPolicyName;
+  int allocationPolicyFlag = hasFlag("-p");
+  if (allocationPolicyFlag && allocationPolicyFlag + 1 < argc &&
+      argv[allocationPolicyFlag + 1]) {
+    allocationPolicyName = argv[allocationPolicyFlag + 1];
+    try {
+      allocationPolicy =
+          rawspeed::parseLargeAllocationPolicy(allocationPolicyName);
+    } catch (rawspeed::RawspeedException& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    argv[allocationPolicyFlag + 1] = nullptr;
+  }
+  options.prefaultData = hasFlag("-P");
+
+  // Run on (and allocate the images on) these NUMA nodes only, e.g. "0" or
+  // "0-1". The images are then first-touched by rows, by the pool's threads,
+  // see RawImageData::prefaultData.
+  std::string numaNodesName;
+  int numaNodesFlag = hasFlag("-n");
+  if (numaNodesFlag && numaNodesFlag + 1 < argc && argv[numaNodesFlag + 1]) {
+    numaNodesName = argv[numaNodesFlag + 1];
+    std::vector<int> cpus;
+    try {
+      cpus = rawspeed::getNumaNodeCpus(rawspeed::parseIndexList(numaNodesName));
+    } catch (rawspeed::RawspeedException& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    if (cpus.empty()) {
+      std::cerr << "No CPUs on the NUMA node(s) " << numaNodesName
+                << std::endl;
+      return 1;
+    }
+    argv[numaNodesFlag + 1] = nullptr;
+
+    // The benchmarking thread participates in the decodes too.
+    (void)rawspeed::pinCurrentThread(cpus);
+    options.executor =
+        std::make_shared<rawspeed::ThreadPool>(cpus.size(), cpus);
+    options.prefaultData = true;
+    options.numaStatistics = true;
+    threadsMax = static_cast<int>(cpus.size());
+  }
+  options.numaStatistics |= rawspeed::getNumaNodeCount() > 1;
+
   // Were we told to use the repo (i.e. filelist.sha1 in that directory)?
   int useChecksumFile = hasFlag("-r");
   std::vector<rawspeed::ChecksumFileEntry> ChecksumFileEntries;
@@ -209,10 +368,18 @@ int main(int argc, char** argv) {
   for (const auto& Entry : ChecksumFileEntries) {
     const char* fName = Entry.RelFileName.c_str();
     std::string tName(fName);
+    if (ioMode != FileIOMode::Warm)
+      tName += "/io:" + ioModeName;
+    if (allocationPolicy != LargeAllocationPolicy::Default)
+      tName += "/alloc:" + allocationPolicyName;
+    if (!numaNodesName.empty())
+      tName += "/numa:" + numaNodesName;
+    else if (options.prefaultData)
+      tName += "/prefault";
     tName += "/threads:";
 
     for (auto threads = threadsMin; threads <= threadsMax; threads++)
-      addBench(Entry.FullFileName.c_str(), tName, threads);
+      addBench(Entry.FullFileName.c_str(), tName, threads, &options);
   }
 
   benchmark::RunSpecifiedBenchmarks();
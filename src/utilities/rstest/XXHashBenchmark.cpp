@@ -0,0 +1,53 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "xxhash.h"              // for xxh64
+#include <benchmark/benchmark.h> // for State, Benchmark, BENCHMARK
+#include <cstdint>               // for uint8_t, uint64_t
+#include <vector>                // for vector
+
+static inline void BM_XXH64(benchmark::State& state) {
+  const size_t bufsize = state.range(0);
+  const std::vector<uint8_t> buf(bufsize);
+
+  for (auto _ : state) {
+    uint64_t hash = rawspeed::xxhash::xxh64(buf.data(), buf.size());
+    benchmark::DoNotOptimize(hash);
+  }
+
+  state.SetComplexityN(state.range(0));
+  state.SetItemsProcessed(state.complexity_length_n() * state.iterations());
+  state.SetBytesProcessed(state.items_processed());
+}
+
+static inline void CustomArguments(benchmark::internal::Benchmark* b) {
+  b->RangeMultiplier(2);
+#if 1
+  b->Arg(256 << 20);
+#else
+  b->Range(1, 1024 << 20)->Complexity(benchmark::oN);
+#endif
+  b->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_XXH64)->Apply(CustomArguments);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,84 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "xxhash.h"      // for xxh64, hash_to_string
+#include <cstdint>       // for UINT64_C, uint8_t, uint64_t
+#include <cstring>       // for strlen
+#include <gtest/gtest.h> // for ParamIteratorInterface, ParamGeneratorInt...
+#include <string>        // for string
+#include <vector>        // for vector
+
+namespace rawspeed_test {
+
+struct XXHashTestcase {
+  uint64_t seed;
+  uint64_t answer;
+  const char* message;
+};
+
+class XXHashTest : public ::testing::TestWithParam<XXHashTestcase> {};
+
+// Reference results of XXH64.
+static const XXHashTestcase testCases[] = {
+    {0, UINT64_C(0xEF46DB3751D8E999), ""},
+    {0, UINT64_C(0xD24EC4F1A98C6E5B), "a"},
+    {0, UINT64_C(0x44BC2CF5AD770999), "abc"},
+    {0, UINT64_C(0xFBCEA83C8A378BF1),
+     "Nobody inspects the spammish repetition"},
+};
+
+INSTANTIATE_TEST_CASE_P(XXHashTests, XXHashTest,
+                        ::testing::ValuesIn(testCases));
+
+TEST_P(XXHashTest, CheckTestCaseSet) {
+  const XXHashTestcase& p = GetParam();
+  ASSERT_EQ(rawspeed::xxhash::xxh64(
+                reinterpret_cast<const uint8_t*>(p.message),
+                strlen(p.message), p.seed),
+            p.answer);
+}
+
+TEST(XXHashBasicTest, HashToString) {
+  ASSERT_EQ(rawspeed::xxhash::hash_to_string(UINT64_C(0xEF46DB3751D8E999)),
+            std::string("ef46db3751d8e999"));
+  ASSERT_EQ(rawspeed::xxhash::hash_to_string(1),
+            std::string("0000000000000001"));
+}
+
+// Any change of the input, regardless of where, changes the hash.
+TEST(XXHashBasicTest, EveryByteMatters) {
+  std::vector<uint8_t> buf(100);
+  for (size_t i = 0; i < buf.size(); ++i)
+    buf[i] = i;
+
+  const uint64_t reference = rawspeed::xxhash::xxh64(buf.data(), buf.size());
+  for (size_t i = 0; i < buf.size(); ++i) {
+    buf[i] ^= 1;
+    ASSERT_NE(rawspeed::xxhash::xxh64(buf.data(), buf.size()), reference)
+        << "     Where i: " << i;
+    buf[i] ^= 1;
+  }
+
+  ASSERT_NE(rawspeed::xxhash::xxh64(buf.data(), buf.size(), 1), reference);
+  ASSERT_NE(rawspeed::xxhash::xxh64(buf.data(), buf.size() - 1), reference);
+}
+
+} // namespace rawspeed_test
@@ -19,19 +19,24 @@
 */
 
 #include "RawSpeed-API.h"
+#include "common/TaskScheduler.h" // for Parallelism, ThreadPool, parallelFor
+#include "io/FilePrefetcher.h"    // for FilePrefetcher, FileIOMode
 
 #include "md5.h"       // for md5_state, md5_hash, hash_to_string, md5_init
+#include "xxhash.h"    // for xxh64, hash_to_string
+#include <algorithm>   // for max
 #include <array>       // for array
 #include <cassert>     // for assert
 #include <chrono>      // for milliseconds, steady_clock, duration_cast
 #include <cstdarg>     // for va_end, va_list, va_start
-#include <cstdint>     // for uint8_t
+#include <cstdint>     // for uint8_t, uint64_t
 #include <cstdio>      // for fprintf, fclose, size_t, fopen, ftell, fwrite
-#include <cstdlib>     // for system
+#include <cstdlib>     // for atoi, system
 #include <fstream>     // IWYU pragma: keep
 #include <iostream>    // for cout, left, cerr, internal
 #include <map>         // for map
-#include <memory>      // for allocator, unique_ptr
+#include <memory>      // for allocator, unique_ptr, make_shared
+#include <mutex>       // for mutex, lock_guard
 #include <sstream>     // IWYU pragma: keep
 #include <string>      // for string, operator+, operator<<, char_traits
 #include <utility>     // for pair
@@ -42,10 +47,6 @@
 #include <iomanip> // for operator<<, setw
 #endif
 
-#ifdef HAVE_OPENMP
-#include <omp.h>
-#endif
-
 using std::chrono::steady_clock;
 using std::string;
 using std::ostringstream;
@@ -58,7 +59,9 @@ using std::endl;
 using std::map;
 using std::cerr;
 using rawspeed::CameraMetaData;
-using rawspeed::FileReader;
+using rawspeed::FileIOMode;
+using rawspeed::FilePrefetcher;
+using rawspeed::Parallelism;
 using rawspeed::RawParser;
 using rawspeed::RawImage;
 using rawspeed::uchar8;
@@ -70,6 +73,7 @@ using rawspeed::getU16BE;
 using rawspeed::getU32LE;
 using rawspeed::roundUp;
 using rawspeed::RawspeedException;
+using rawspeed::ThreadPool;
 
 #if !defined(__has_feature) || !__has_feature(thread_sanitizer)
 using std::setw;
@@ -81,12 +85,28 @@ namespace rawspeed {
 
 namespace rstest {
 
-std::string img_hash(const rawspeed::RawImage& r);
+enum class HashFormat {
+  // The original one, md5 of the per-line md5's of the image.
+  MD5,
+  // Same, but with xxh64 instead of md5, which is many times faster.
+  // Such hashes start with the xxh64HashHeader line.
+  XXH64,
+};
+
+static constexpr const char xxh64HashHeader[] = "hashFormat: 2 (xxh64)\n";
+
+HashFormat getHashFormat(const std::string& hash);
+
+std::string img_hash(const rawspeed::RawImage& r, HashFormat format,
+                     const rawspeed::Parallelism& parallelism);
 
 void writePPM(const rawspeed::RawImage& raw, const std::string& fn);
 void writePFM(const rawspeed::RawImage& raw, const std::string& fn);
 
-md5::md5_state imgDataHash(const rawspeed::RawImage& raw);
+md5::md5_state imgDataHash(const rawspeed::RawImage& raw,
+                           const rawspeed::Parallelism& parallelism);
+uint64_t imgDataXXH64(const rawspeed::RawImage& raw,
+                      const rawspeed::Parallelism& parallelism);
 
 void writeImage(const rawspeed::RawImage& raw, const std::string& fn);
 
@@ -94,10 +114,22 @@ struct options {
   bool create;
   bool force;
   bool dump;
+
+  // Of the newly created hashes. The existing ones are checked in whatever
+  // format they are in.
+  HashFormat format = HashFormat::MD5;
+
+  // Shared by all the files, each one is decoded and hashed with the whole
+  // budget, and the threads that are idle steal work from the others.
+  rawspeed::Parallelism parallelism;
 };
 
+// Serializes the progress output of the concurrently processed files.
+static std::mutex ioMutex;
+
 size_t process(const std::string& filename,
-               const rawspeed::CameraMetaData* metadata, const options& o);
+               const rawspeed::CameraMetaData* metadata, const options& o,
+               rawspeed::FilePrefetcher* files, int index);
 
 class RstestHashMismatch final : public rawspeed::RawspeedException {
 public:
@@ -123,7 +155,8 @@ struct Timer {
 
 // yes, this is not cool. but i see no way to compute the hash of the
 // full image, without duplicating image, and copying excluding padding
-md5::md5_state imgDataHash(const RawImage& raw) {
+md5::md5_state imgDataHash(const RawImage& raw,
+                           const Parallelism& parallelism) {
   md5::md5_state ret = md5::md5_init;
 
   const iPoint2D dimUncropped = raw->getUncroppedDim();
@@ -131,10 +164,12 @@ md5::md5_state imgDataHash(const RawImage& raw) {
   vector<md5::md5_state> line_hashes;
   line_hashes.resize(dimUncropped.y, md5::md5_init);
 
-  for (int j = 0; j < dimUncropped.y; j++) {
-    auto* d = raw->getDataUncropped(0, j);
-    md5::md5_hash(d, raw->pitch - raw->padding, &line_hashes[j]);
-  }
+  rawspeed::parallelFor(parallelism, 0, dimUncropped.y,
+                        [&raw, &line_hashes](int j) {
+                          auto* d = raw->getDataUncropped(0, j);
+                          md5::md5_hash(d, raw->pitch - raw->padding,
+                                        &line_hashes[j]);
+                        });
 
   md5::md5_hash(reinterpret_cast<const uint8_t*>(&line_hashes[0]),
                 sizeof(line_hashes[0]) * line_hashes.size(), &ret);
@@ -142,6 +177,30 @@ md5::md5_state imgDataHash(const RawImage& raw) {
   return ret;
 }
 
+uint64_t imgDataXXH64(const RawImage& raw, const Parallelism& parallelism) {
+  const iPoint2D dimUncropped = raw->getUncroppedDim();
+
+  // Stored little-endian, so that the hash does not depend on the host.
+  vector<uchar8> line_hashes(sizeof(uint64_t) * dimUncropped.y);
+
+  rawspeed::parallelFor(
+      parallelism, 0, dimUncropped.y, [&raw, &line_hashes](int j) {
+        auto* d = raw->getDataUncropped(0, j);
+        const uint64_t h = xxhash::xxh64(d, raw->pitch - raw->padding);
+        for (int k = 0; k < static_cast<int>(sizeof(h)); ++k)
+          line_hashes[sizeof(h) * j + k] = h >> (8 * k);
+      });
+
+  return xxhash::xxh64(line_hashes.data(), line_hashes.size());
+}
+
+HashFormat getHashFormat(const string& hash) {
+  const string header(xxh64HashHeader);
+  if (hash.compare(0, header.size(), header) == 0)
+    return HashFormat::XXH64;
+  return HashFormat::MD5;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpragmas"
 #pragma GCC diagnostic ignored "-Wunknown-warning-option"
@@ -161,9 +220,13 @@ APPEND(ostringstream* oss, const char* format, ...) {
   *oss << line.data();
 }
 
-string img_hash(const RawImage& r) {
+string img_hash(const RawImage& r, HashFormat format,
+                const Parallelism& parallelism) {
   ostringstream oss;
 
+  if (format == HashFormat::XXH64)
+    APPEND(&oss, "%s", xxh64HashHeader);
+
   APPEND(&oss, "make: %s\n", r->metadata.make.c_str());
   APPEND(&oss, "model: %s\n", r->metadata.model.c_str());
   APPEND(&oss, "mode: %s\n", r->metadata.mode.c_str());
@@ -221,9 +284,18 @@ string img_hash(const RawImage& r) {
 
   APPEND(&oss, "\n");
 
-  rawspeed::md5::md5_state hash_of_line_hashes = imgDataHash(r);
-  APPEND(&oss, "md5sum of per-line md5sums: %s\n",
-         rawspeed::md5::hash_to_string(hash_of_line_hashes).c_str());
+  switch (format) {
+  case HashFormat::MD5: {
+    rawspeed::md5::md5_state hash_of_line_hashes = imgDataHash(r, parallelism);
+    APPEND(&oss, "md5sum of per-line md5sums: %s\n",
+           rawspeed::md5::hash_to_string(hash_of_line_hashes).c_str());
+    break;
+  }
+  case HashFormat::XXH64:
+    APPEND(&oss, "xxh64 of per-line xxh64s: %s\n",
+           xxhash::hash_to_string(imgDataXXH64(r, parallelism)).c_str());
+    break;
+  }
 
   const auto errors = r->getErrors();
   for (const string& e : errors)
@@ -325,7 +397,7 @@ void writeImage(const RawImage& raw, const string& fn) {
 }
 
 size_t process(const string& filename, const CameraMetaData* metadata,
-               const options& o) {
+               const options& o, FilePrefetcher* files, int index) {
 
   const string hashfile(filename + ".hash");
 
@@ -335,27 +407,23 @@ size_t process(const string& filename, const CameraMetaData* metadata,
   ifstream hf(hashfile);
   if (hf.good() == o.create && !o.force) {
 #if !defined(__has_feature) || !__has_feature(thread_sanitizer)
-#ifdef HAVE_OPENMP
-#pragma omp critical(io)
-#endif
+    std::lock_guard<std::mutex> guard(ioMutex);
     cout << left << setw(55) << filename << ": hash "
          << (o.create ? "exists" : "missing") << ", skipping" << endl;
 #endif
+    files->skip(index);
     return 0;
   }
 
 // to narrow down the list of files that could have causes the crash
 #if !defined(__has_feature) || !__has_feature(thread_sanitizer)
-#ifdef HAVE_OPENMP
-#pragma omp critical(io)
-#endif
-  cout << left << setw(55) << filename << ": starting decoding ... " << endl;
+  {
+    std::lock_guard<std::mutex> guard(ioMutex);
+    cout << left << setw(55) << filename << ": starting decoding ... " << endl;
+  }
 #endif
 
-  FileReader reader(filename.c_str());
-
-  auto map(reader.readFile());
-  // Buffer* map = readFile( argv[1] );
+  auto map(files->take(index));
 
   Timer t;
 
@@ -363,6 +431,7 @@ size_t process(const string& filename, const CameraMetaData* metadata,
   auto decoder(parser.getDecoder(metadata));
   // RawDecoder* decoder = parseRaw( map );
 
+  decoder->parallelism = o.parallelism;
   decoder->failOnUnknown = false;
   decoder->checkSupport(metadata);
 
@@ -373,30 +442,34 @@ size_t process(const string& filename, const CameraMetaData* metadata,
 
   auto time = t();
 #if !defined(__has_feature) || !__has_feature(thread_sanitizer)
-#ifdef HAVE_OPENMP
-#pragma omp critical(io)
-#endif
-  cout << left << setw(55) << filename << ": " << internal << setw(3)
-       << map->getSize() / 1000000 << " MB / " << setw(4) << time << " ms"
-       << endl;
+  {
+    std::lock_guard<std::mutex> guard(ioMutex);
+    cout << left << setw(55) << filename << ": " << internal << setw(3)
+         << map->getSize() / 1000000 << " MB / " << setw(4) << time << " ms"
+         << endl;
+  }
 #endif
 
   if (o.create) {
     // write the hash. if force is set, then we are potentially overwriting here
     ofstream f(hashfile);
-    f << img_hash(raw);
+    f << img_hash(raw, o.format, o.parallelism);
     if (o.dump)
       writeImage(raw, filename);
   } else {
-    // do generate the hash string regardless.
-    string h = img_hash(raw);
+    string truth;
+    if (hf.good())
+      truth.assign(istreambuf_iterator<char>(hf), istreambuf_iterator<char>());
+
+    // do generate the hash string regardless, in the format of the old one.
+    string h = img_hash(raw, hf.good() ? getHashFormat(truth) : o.format,
+                        o.parallelism);
 
     // normally, here we would compare the old hash with the new one
     // but if the force is set, and the hash does not exist, do nothing.
     if (!hf.good() && o.force)
       return time;
 
-    string truth((istreambuf_iterator<char>(hf)), istreambuf_iterator<char>());
     if (h != truth) {
       ofstream f(filename + ".hash.failed");
       f << h;
@@ -466,6 +539,16 @@ static int usage(const char* progname) {
        If -c is not set, and the hash does not exist, then just decode,
        but do not write the hash!
   [-d] store decoded image as PPM
+  [-i cold|warm|overlapped] how to read the files (default: overlapped)
+       cold:       drop each file from the page cache, then read it
+       warm:       read each file twice, only the second read is timed
+       overlapped: read the next files in the background while decoding
+  [-j N] use at most N threads in total (default: all the cores).
+       They are shared between decoding several files at once, and decoding
+       and hashing each one of them.
+  [-x] if -c is set, create the hashes using xxh64 instead of md5, which is
+       much faster. The existing hashes are always checked in the format
+       they were created with.
   <FILE[S]> the file[s] to work on.
 
   With no options given, each raw with an accompanying hash will be decoded
@@ -493,16 +576,13 @@ using rawspeed::rstest::process;
 using rawspeed::rstest::results;
 
 int main(int argc, char **argv) {
-  int remaining_argc = argc;
-
-  auto hasFlag = [argc, &remaining_argc, argv](const string& flag) {
+  auto hasFlag = [argc, argv](const string& flag) {
     bool found = false;
     for (int i = 1; i < argc; ++i) {
       if (!argv[i] || argv[i] != flag)
         continue;
       found = true;
       argv[i] = nullptr;
-      remaining_argc--;
     }
     return found;
   };
@@ -514,6 +594,50 @@ int main(int argc, char **argv) {
   o.create = hasFlag("-c");
   o.force = hasFlag("-f");
   o.dump = hasFlag("-d");
+  if (hasFlag("-x"))
+    o.format = rawspeed::rstest::HashFormat::XXH64;
+
+  FileIOMode ioMode = FileIOMode::Overlapped;
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (!argv[i] || argv[i] != string("-i") || !argv[i + 1])
+      continue;
+    try {
+      ioMode = rawspeed::parseFileIOMode(argv[i + 1]);
+    } catch (RawspeedException& e) {
+      cerr << e.what() << endl;
+      return usage(argv[0]);
+    }
+    argv[i] = argv[i + 1] = nullptr;
+  }
+
+  int numThreads = 0;
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (!argv[i] || argv[i] != string("-j") || !argv[i + 1])
+      continue;
+    numThreads = atoi(argv[i + 1]);
+    if (numThreads <= 0) {
+      cerr << "Bad number of threads: " << argv[i + 1] << endl;
+      return usage(argv[0]);
+    }
+    argv[i] = argv[i + 1] = nullptr;
+  }
+  if (numThreads == 0)
+    numThreads = std::max(1, rawspeed_get_number_of_processor_cores());
+
+  vector<string> fileNames;
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i])
+      fileNames.emplace_back(argv[i]);
+  }
+  const int numFiles = fileNames.size();
+
+  // One pool for everything, so that the files and the work within each of
+  // them compete for the same threads, instead of oversubscribing the machine,
+  // or leaving it idle while the last, large, files are being decoded.
+  o.parallelism = Parallelism(0, std::make_shared<ThreadPool>(numThreads));
+
+  // Keep one file ready for each of the threads, and one more.
+  FilePrefetcher files(fileNames, ioMode, numThreads + 1);
 
 #ifdef HAVE_PUGIXML
   const CameraMetaData metadata(RAWSPEED_SOURCE_DIR "/data/cameras.xml");
@@ -523,36 +647,35 @@ int main(int argc, char **argv) {
 
   size_t time = 0;
   map<string, string> failedTests;
-#ifdef HAVE_OPENMP
-#pragma omp parallel for default(shared) schedule(dynamic, 1) \
-  reduction(+ : time) if(remaining_argc > 2)
-#endif
-  for (int i = 1; i < argc; ++i) {
-    if (!argv[i])
-      continue;
-
-    try {
-      try {
-        time += process(argv[i], &metadata, o);
-      } catch (rawspeed::rstest::RstestHashMismatch& e) {
-        time += e.time;
-        throw;
-      }
-    } catch (RawspeedException& e) {
-#ifdef HAVE_OPENMP
-#pragma omp critical(io)
-#endif
-      {
-        string msg = string(argv[i]) + " failed: " + e.what();
+  rawspeed::parallelFor(
+      o.parallelism, 0, numFiles,
+      [&](int i) {
+        size_t fileTime = 0;
+        try {
+          try {
+            fileTime = process(fileNames[i], &metadata, o, &files, i);
+          } catch (rawspeed::rstest::RstestHashMismatch& e) {
+            fileTime = e.time;
+            throw;
+          }
+        } catch (RawspeedException& e) {
+          std::lock_guard<std::mutex> guard(rawspeed::rstest::ioMutex);
+          string msg = fileNames[i] + " failed: " + e.what();
 #if !defined(__has_feature) || !__has_feature(thread_sanitizer)
-        cerr << msg << endl;
+          cerr << msg << endl;
 #endif
-        failedTests.emplace(argv[i], msg);
-      }
-    }
-  }
+          failedTests.emplace(fileNames[i], msg);
+        }
+
+        std::lock_guard<std::mutex> guard(rawspeed::rstest::ioMutex);
+        time += fileTime;
+      },
+      rawspeed::Schedule::Dynamic);
 
-  cout << "Total decoding time: " << time / 1000.0 << "s" << endl << endl;
+  cout << "Total decoding time: " << time / 1000.0 << "s" << endl;
+  cout << "Total time waiting for I/O: " << files.getWaitSeconds() << "s"
+       << endl
+       << endl;
 
   return results(failedTests, o);
 }
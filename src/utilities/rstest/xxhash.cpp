@@ -0,0 +1,131 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "xxhash.h"
+#include <array>     // for array
+#include <cinttypes> // for PRIx64
+#include <cstdio>    // for snprintf
+#include <cstring>   // for memcpy
+
+namespace rawspeed {
+
+namespace xxhash {
+
+namespace {
+
+constexpr uint64_t Prime1 = UINT64_C(0x9E3779B185EBCA87);
+constexpr uint64_t Prime2 = UINT64_C(0xC2B2AE3D27D4EB4F);
+constexpr uint64_t Prime3 = UINT64_C(0x165667B19E3779F9);
+constexpr uint64_t Prime4 = UINT64_C(0x85EBCA77C2B2AE63);
+constexpr uint64_t Prime5 = UINT64_C(0x27D4EB2F165667C5);
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// The input is always read as little-endian.
+template <typename T> inline T read(const uint8_t* p) {
+  T v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  if (sizeof(T) == 8)
+    v = __builtin_bswap64(v);
+  else
+    v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+  acc += input * Prime2;
+  acc = rotl(acc, 31);
+  return acc * Prime1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+  acc ^= round(0, val);
+  return acc * Prime1 + Prime4;
+}
+
+} // namespace
+
+uint64_t xxh64(const uint8_t* message, size_t len, uint64_t seed) {
+  const uint8_t* p = message;
+  const uint8_t* const end = message + len;
+
+  uint64_t h;
+  if (len >= 32) {
+    uint64_t v1 = seed + Prime1 + Prime2;
+    uint64_t v2 = seed + Prime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - Prime1;
+
+    // Four independent lanes of 8 bytes each.
+    for (; end - p >= 32; p += 32) {
+      v1 = round(v1, read<uint64_t>(p + 0));
+      v2 = round(v2, read<uint64_t>(p + 8));
+      v3 = round(v3, read<uint64_t>(p + 16));
+      v4 = round(v4, read<uint64_t>(p + 24));
+    }
+
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = mergeRound(h, v1);
+    h = mergeRound(h, v2);
+    h = mergeRound(h, v3);
+    h = mergeRound(h, v4);
+  } else
+    h = seed + Prime5;
+
+  h += len;
+
+  for (; end - p >= 8; p += 8) {
+    h ^= round(0, read<uint64_t>(p));
+    h = rotl(h, 27) * Prime1 + Prime4;
+  }
+
+  if (end - p >= 4) {
+    h ^= static_cast<uint64_t>(read<uint32_t>(p)) * Prime1;
+    h = rotl(h, 23) * Prime2 + Prime3;
+    p += 4;
+  }
+
+  for (; p < end; ++p) {
+    h ^= *p * Prime5;
+    h = rotl(h, 11) * Prime1;
+  }
+
+  // Final avalanche.
+  h ^= h >> 33;
+  h *= Prime2;
+  h ^= h >> 29;
+  h *= Prime3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+std::string hash_to_string(uint64_t hash) {
+  std::array<char, 2 * sizeof(hash) + 1> res;
+  snprintf(res.data(), res.size(), "%016" PRIx64, hash);
+  return res.data();
+}
+
+} // namespace xxhash
+
+} // namespace rawspeed
@@ -0,0 +1,177 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/CfaBinner.h" // for CfaBinner
+#include "common/Common.h"    // for ushort16
+#include "common/Point.h"     // for iPoint2D, iRectangle2D
+#include "common/RawImage.h"  // for RawImage, RawImageData
+#include <gtest/gtest.h>      // for Test, ASSERT_EQ, TEST, ...
+#include <random>             // for minstd_rand
+#include <vector>             // for vector
+
+using rawspeed::CfaBinner;
+using rawspeed::iPoint2D;
+using rawspeed::iRectangle2D;
+using rawspeed::RawImage;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+TEST(CfaBinnerBasicTest, Geometry) {
+  ASSERT_EQ(CfaBinner::getBinnedDim({37, 29}, 2), iPoint2D(18, 14));
+  ASSERT_EQ(CfaBinner::getBinnedDim({37, 29}, 3), iPoint2D(12, 8));
+  ASSERT_EQ(CfaBinner::getBinnedDim({37, 29}, 4), iPoint2D(8, 6));
+
+  // The CFA phase is kept.
+  ASSERT_EQ(CfaBinner::getBinnedPos(0, 2), 0);
+  ASSERT_EQ(CfaBinner::getBinnedPos(1, 2), 1);
+  ASSERT_EQ(CfaBinner::getBinnedPos(4, 2), 2);
+  ASSERT_EQ(CfaBinner::getBinnedPos(7, 2), 3);
+  ASSERT_EQ(CfaBinner::getBinnedPos(13, 3), 5);
+
+  const iRectangle2D rect =
+      CfaBinner::getBinnedRect(iRectangle2D(4, 9, 16, 8), 2);
+  ASSERT_EQ(rect.pos, iPoint2D(2, 5));
+  ASSERT_EQ(rect.dim, iPoint2D(8, 4));
+
+  ASSERT_TRUE(CfaBinner::canBin({8, 8}, 4));
+  ASSERT_FALSE(CfaBinner::canBin({7, 8}, 4));
+  ASSERT_FALSE(CfaBinner::canBin({64, 64}, 1));
+  ASSERT_FALSE(CfaBinner::canBin({64, 64}, 5));
+}
+
+class CfaBinnerTest : public ::testing::TestWithParam<int> {
+protected:
+  const iPoint2D dim{37, 29};
+  int factor = 0;
+  std::vector<ushort16> input;
+
+  void SetUp() override {
+    factor = GetParam();
+
+    std::minstd_rand gen(factor);
+    input.resize(static_cast<size_t>(dim.area()));
+    for (auto& v : input)
+      v = gen() & 0x3FFF;
+  }
+
+  // Each binned pixel is the rounded average of the factor x factor pixels
+  // of its colour in its block.
+  ushort16 expected(int x, int y) const {
+    const int x0 = 2 * factor * (x / 2) + x % 2;
+    const int y0 = 2 * factor * (y / 2) + y % 2;
+    unsigned sum = 0;
+    for (int j = 0; j < factor; j++) {
+      for (int i = 0; i < factor; i++)
+        sum += input[static_cast<size_t>(y0 + 2 * j) * dim.x + x0 + 2 * i];
+    }
+    const int divisor = factor * factor;
+    return (sum + divisor / 2) / divisor;
+  }
+
+  RawImage create() const {
+    RawImage img = RawImage::create();
+    img->dim = dim;
+    img->isCFA = true;
+    img->binning = factor;
+    img->createBinnedData();
+    return img;
+  }
+
+  void store(CfaBinner* binner, int row, int offX, int width) const {
+    ushort16* dest = binner->getRow(row);
+    for (int x = 0; x < width; x++)
+      dest[x] = input[static_cast<size_t>(row) * dim.x + offX + x];
+    binner->rowDone(row);
+  }
+
+  void check(const RawImage& img) const {
+    for (int y = 0; y < img->dim.y; y++) {
+      const auto* row = reinterpret_cast<const ushort16*>(img->getData(0, y));
+      for (int x = 0; x < img->dim.x; x++)
+        ASSERT_EQ(row[x], expected(x, y)) << x << ", " << y;
+    }
+  }
+};
+
+INSTANTIATE_TEST_CASE_P(Factors, CfaBinnerTest,
+                        ::testing::Range(CfaBinner::minFactor,
+                                         CfaBinner::maxFactor + 1));
+
+TEST_P(CfaBinnerTest, WholeRows) {
+  const RawImage img = create();
+  ASSERT_TRUE(img->isBinned());
+  ASSERT_EQ(img->getUnbinnedDim(), dim);
+  ASSERT_EQ(img->dim, CfaBinner::getBinnedDim(dim, factor));
+
+  CfaBinner binner(img);
+  ASSERT_EQ(binner.getBandHeight(), 2 * factor);
+  for (int y = 0; y < dim.y; y++)
+    store(&binner, y, 0, dim.x);
+
+  check(img);
+}
+
+TEST_P(CfaBinnerTest, Stripes) {
+  const RawImage img = create();
+  ASSERT_TRUE(img->isBinned());
+
+  // As for the tiles of a DNG: the stripes start at whole blocks.
+  const int split = 2 * factor * 3;
+  CfaBinner left(img, 0, split);
+  CfaBinner right(img, split, dim.x - split);
+  for (int y = 0; y < dim.y; y++) {
+    store(&right, y, split, dim.x - split);
+    store(&left, y, 0, split);
+  }
+
+  check(img);
+}
+
+TEST_P(CfaBinnerTest, BadStripe) {
+  const RawImage img = create();
+  ASSERT_ANY_THROW(CfaBinner(img, 1, 2 * factor));
+  ASSERT_ANY_THROW(CfaBinner(img, 0, dim.x + 1));
+  ASSERT_ANY_THROW(CfaBinner(img, 0, 0));
+}
+
+TEST_P(CfaBinnerTest, NotBinnedIfNotCFA) {
+  RawImage img = RawImage::create();
+  img->dim = dim;
+  img->isCFA = false;
+  img->binning = factor;
+  img->createBinnedData();
+  ASSERT_FALSE(img->isBinned());
+  ASSERT_EQ(img->dim, dim);
+  ASSERT_ANY_THROW(CfaBinner{img});
+}
+
+TEST(CfaBinnerBasicTest, NotBinnedByDefault) {
+  RawImage img = RawImage::create();
+  img->dim = {64, 64};
+  img->isCFA = true;
+  img->createBinnedData();
+  ASSERT_FALSE(img->isBinned());
+  ASSERT_EQ(img->dim, iPoint2D(64, 64));
+  ASSERT_EQ(img->getUnbinnedDim(), iPoint2D(64, 64));
+}
+
+} // namespace rawspeed_test
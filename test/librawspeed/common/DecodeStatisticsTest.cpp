@@ -0,0 +1,108 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "rawspeedconfig.h"          // for WITH_STAGE_TIMING
+#include "common/DecodeStatistics.h" // for DecodeStatistics, StageTimer
+#include <chrono>                    // for milliseconds, steady_clock
+#include <gtest/gtest.h>             // for Test, ASSERT_EQ, TEST
+#include <string>                    // for string
+#include <thread>                    // for sleep_for
+
+using rawspeed::DecodeStage;
+using rawspeed::DecodeStatistics;
+using rawspeed::getDecodeStageName;
+using rawspeed::numDecodeStages;
+using rawspeed::StageTimer;
+
+namespace rawspeed_test {
+
+TEST(DecodeStatisticsTest, StageNamesAreUnique) {
+  for (int a = 0; a < numDecodeStages; ++a) {
+    for (int b = 0; b < a; ++b) {
+      ASSERT_NE(std::string(getDecodeStageName(static_cast<DecodeStage>(a))),
+                std::string(getDecodeStageName(static_cast<DecodeStage>(b))));
+    }
+  }
+}
+
+TEST(DecodeStatisticsTest, DefaultIsZero) {
+  const DecodeStatistics stats;
+  for (int i = 0; i < numDecodeStages; ++i) {
+    const auto& s = stats.get(static_cast<DecodeStage>(i));
+    ASSERT_EQ(s.calls, 0);
+    ASSERT_EQ(s.wallSeconds, 0);
+    ASSERT_EQ(s.cpuSeconds, 0);
+    ASSERT_EQ(s.bytes, 0);
+  }
+  ASSERT_EQ(stats.getWallSeconds(), 0);
+}
+
+#ifdef WITH_STAGE_TIMING
+
+TEST(DecodeStatisticsTest, NestedStagesAreExclusive) {
+  DecodeStatistics stats;
+  const auto start = std::chrono::steady_clock::now();
+  {
+    StageTimer outer(&stats, DecodeStage::Decompress, 100);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (int i = 0; i < 2; ++i) {
+      StageTimer inner(&stats, DecodeStage::DngOpcodes);
+      inner.addBytes(5);
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+  const std::chrono::duration<double> total =
+      std::chrono::steady_clock::now() - start;
+
+  const auto& outer = stats.get(DecodeStage::Decompress);
+  const auto& inner = stats.get(DecodeStage::DngOpcodes);
+
+  ASSERT_EQ(outer.calls, 1);
+  ASSERT_EQ(outer.bytes, 100);
+  ASSERT_EQ(inner.calls, 2);
+  ASSERT_EQ(inner.bytes, 10);
+
+  ASSERT_GE(outer.wallSeconds, 0.010);
+  ASSERT_GE(inner.wallSeconds, 0.040);
+  // The inner stage's time was not counted for the outer one.
+  ASSERT_LE(outer.wallSeconds + inner.wallSeconds, total.count());
+
+  ASSERT_DOUBLE_EQ(stats.getWallSeconds(),
+                   outer.wallSeconds + inner.wallSeconds);
+
+  stats.reset();
+  ASSERT_EQ(stats.get(DecodeStage::Decompress).calls, 0);
+}
+
+#else
+
+TEST(DecodeStatisticsTest, NothingIsRecorded) {
+  DecodeStatistics stats;
+  {
+    StageTimer timer(&stats, DecodeStage::Decompress, 100);
+    timer.addBytes(1);
+  }
+  ASSERT_EQ(stats.get(DecodeStage::Decompress).calls, 0);
+  ASSERT_EQ(stats.get(DecodeStage::Decompress).bytes, 0);
+}
+
+#endif
+
+} // namespace rawspeed_test
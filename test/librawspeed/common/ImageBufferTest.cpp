@@ -0,0 +1,183 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/ImageBuffer.h"       // for ImageBuffer, ImageBufferProvider
+#include "common/Common.h"            // for uchar8, ushort16, uint32
+#include "common/Memory.h"            // for alignedFree, alignedMallocArray
+#include "common/Point.h"             // for iPoint2D
+#include "common/RawImage.h"          // for RawImage, RawImageData, TYPE_...
+#include "common/RawspeedException.h" // for RawspeedException
+#include <gtest/gtest.h>              // for Test, ASSERT_EQ, TEST
+#include <memory>                     // for unique_ptr
+
+using rawspeed::alignedFree;
+using rawspeed::alignedMallocArray;
+using rawspeed::ImageBuffer;
+using rawspeed::ImageBufferProvider;
+using rawspeed::iPoint2D;
+using rawspeed::RawImage;
+using rawspeed::TYPE_FLOAT32;
+using rawspeed::TYPE_USHORT16;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+namespace {
+
+// Hands out one buffer of the given pitch, and keeps track of its use.
+class Provider final {
+public:
+  uint32 pitch;
+  uint32 offset;
+  std::unique_ptr<uchar8, decltype(&alignedFree)> storage;
+
+  int provided = 0;
+  int released = 0;
+  iPoint2D dim;
+  uint32 bpp = 0;
+
+  Provider(uint32 pitch_, int height, uint32 offset_ = 0)
+      : pitch(pitch_), offset(offset_),
+        // The (deliberately bad) pitches need not add up to a multiple of 16.
+        storage(alignedMallocArray<uchar8, 16, /*doRoundUp=*/true>(
+                    height, pitch_ + offset_),
+                &alignedFree) {}
+
+  uchar8* data() const { return storage.get() + offset; }
+
+  ImageBufferProvider get() {
+    return [this](const iPoint2D& dim_, uint32 bpp_) {
+      provided++;
+      dim = dim_;
+      bpp = bpp_;
+      ImageBuffer buf;
+      buf.data = data();
+      buf.pitch = pitch;
+      buf.release = [this]() { released++; };
+      return buf;
+    };
+  }
+};
+
+} // namespace
+
+TEST(ImageBufferTest, CreatesInProvidedBuffer) {
+  const iPoint2D dim(10, 7);
+  Provider p(64, dim.y);
+  {
+    RawImage img = RawImage::create(dim, TYPE_USHORT16, 1, p.get());
+    ASSERT_EQ(p.provided, 1);
+    ASSERT_EQ(p.dim, dim);
+    ASSERT_EQ(p.bpp, 2);
+    ASSERT_EQ(img->dim, dim);
+    ASSERT_TRUE(img->isCFA);
+    ASSERT_EQ(img->pitch, p.pitch);
+    ASSERT_EQ(img->getData(), p.data());
+    ASSERT_EQ(img->getData(3, 5), p.data() + 5 * p.pitch + 3 * 2);
+
+    *reinterpret_cast<ushort16*>(img->getData(9, 6)) = 0x1234;
+    ASSERT_EQ(*reinterpret_cast<const ushort16*>(p.data() + 6 * 64 + 18),
+              0x1234);
+    ASSERT_EQ(p.released, 0);
+  }
+  ASSERT_EQ(p.released, 1);
+}
+
+TEST(ImageBufferTest, ComponentsPerPixel) {
+  const iPoint2D dim(10, 7);
+  Provider p(128, dim.y);
+  {
+    RawImage img = RawImage::create(dim, TYPE_FLOAT32, 3, p.get());
+    ASSERT_EQ(p.bpp, 12);
+    ASSERT_EQ(img->getCpp(), 3);
+    ASSERT_FALSE(img->isCFA);
+    ASSERT_EQ(img->getData(1, 1), p.data() + 128 + 12);
+  }
+  ASSERT_EQ(p.released, 1);
+}
+
+TEST(ImageBufferTest, TightPitch) {
+  const iPoint2D dim(8, 3);
+  Provider p(16, dim.y);
+  {
+    RawImage img = RawImage::create(dim, TYPE_USHORT16, 1, p.get());
+    ASSERT_EQ(img->padding, 0);
+  }
+  ASSERT_EQ(p.released, 1);
+}
+
+TEST(ImageBufferTest, EmptyBufferFallsBackToAllocation) {
+  int provided = 0;
+  RawImage img = RawImage::create(
+      iPoint2D(10, 7), TYPE_USHORT16, 1, [&provided](const iPoint2D&, uint32) {
+        provided++;
+        return ImageBuffer();
+      });
+  ASSERT_EQ(provided, 1);
+  ASSERT_TRUE(img->isAllocated());
+  ASSERT_GE(img->pitch, 10 * 2);
+}
+
+TEST(ImageBufferTest, UnusableBufferIsReleased) {
+  const iPoint2D dim(10, 7);
+  {
+    // Too small.
+    Provider p(16, dim.y);
+    ASSERT_THROW(RawImage::create(dim, TYPE_USHORT16, 1, p.get()),
+                 rawspeed::RawspeedException);
+    ASSERT_EQ(p.provided, 1);
+    ASSERT_EQ(p.released, 1);
+  }
+  {
+    // Pitch not aligned.
+    Provider p(40, dim.y);
+    ASSERT_THROW(RawImage::create(dim, TYPE_USHORT16, 1, p.get()),
+                 rawspeed::RawspeedException);
+    ASSERT_EQ(p.released, 1);
+  }
+  {
+    // Data not aligned.
+    Provider p(32, dim.y, 8);
+    ASSERT_THROW(RawImage::create(dim, TYPE_USHORT16, 1, p.get()),
+                 rawspeed::RawspeedException);
+    ASSERT_EQ(p.released, 1);
+  }
+}
+
+TEST(ImageBufferTest, ReleasedOnDestroyData) {
+  const iPoint2D dim(10, 7);
+  Provider p(32, dim.y);
+  RawImage img = RawImage::create(dim, TYPE_USHORT16, 1, p.get());
+  img->destroyData();
+  ASSERT_EQ(p.released, 1);
+  ASSERT_FALSE(img->isAllocated());
+
+  // And it may be asked again.
+  img->createData();
+  ASSERT_EQ(p.provided, 2);
+  ASSERT_EQ(img->getData(), p.data());
+  img->destroyData();
+  ASSERT_EQ(p.released, 2);
+}
+
+} // namespace rawspeed_test
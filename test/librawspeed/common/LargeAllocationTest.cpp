@@ -0,0 +1,90 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "common/LargeAllocation.h"   // for LargeAllocation, largeFree
+#include "common/Common.h"            // for uchar8
+#include "common/RawspeedException.h" // for RawspeedException
+#include "common/TaskScheduler.h"     // for Parallelism
+#include <cstddef>                    // for size_t
+#include <cstdint>                    // for uintptr_t
+#include <gtest/gtest.h>              // for ParamIteratorInterface, TEST_P
+
+using rawspeed::largeFree;
+using rawspeed::LargeAllocation;
+using rawspeed::LargeAllocationPolicy;
+using rawspeed::largeMallocArray;
+using rawspeed::Parallelism;
+using rawspeed::uchar8;
+
+namespace rawspeed_test {
+
+class LargeAllocationTest
+    : public ::testing::TestWithParam<LargeAllocationPolicy> {};
+
+INSTANTIATE_TEST_CASE_P(
+    Policies, LargeAllocationTest,
+    ::testing::Values(LargeAllocationPolicy::Default,
+                      LargeAllocationPolicy::TransparentHugePages,
+                      LargeAllocationPolicy::HugeTLB));
+
+TEST_P(LargeAllocationTest, NameRoundTrips) {
+  const LargeAllocationPolicy policy = GetParam();
+  ASSERT_EQ(rawspeed::parseLargeAllocationPolicy(
+                rawspeed::getLargeAllocationPolicyName(policy)),
+            policy);
+}
+
+TEST_P(LargeAllocationTest, AllocatesWithFallback) {
+  // Whatever the platform supports, the allocation itself must succeed,
+  // but possibly with a lesser policy.
+  const size_t rows = 1000;
+  const size_t pitch = 4096 + 16;
+  LargeAllocation a = largeMallocArray(rows, pitch, GetParam());
+  ASSERT_NE(a.ptr, nullptr);
+  ASSERT_GE(a.size, rows * pitch);
+  ASSERT_LE(static_cast<int>(a.policy), static_cast<int>(GetParam()));
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(a.ptr) % 16, 0);
+
+  rawspeed::prefault(a, Parallelism());
+
+  auto* data = static_cast<uchar8*>(a.ptr);
+  if (a.isZeroed()) {
+    for (size_t i = 0; i < a.size; i++)
+      ASSERT_EQ(data[i], 0);
+  }
+
+  for (size_t i = 0; i < rows * pitch; i++)
+    data[i] = static_cast<uchar8>(i);
+  for (size_t i = 0; i < rows * pitch; i++)
+    ASSERT_EQ(data[i], static_cast<uchar8>(i));
+
+  largeFree(a);
+}
+
+TEST(LargeAllocationTest, UnknownNameThrows) {
+  ASSERT_THROW(rawspeed::parseLargeAllocationPolicy("huge"),
+               rawspeed::RawspeedException);
+}
+
+TEST(LargeAllocationTest, FreeOfNothingIsNoop) {
+  ASSERT_NO_THROW(largeFree(LargeAllocation()));
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,96 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "common/Numa.h"              // for parseIndexList, getNumaNodeCount
+#include "common/Common.h"            // for uint64, uchar8
+#include "common/LargeAllocation.h"   // for largeMallocArray, prefaultRows
+#include "common/RawspeedException.h" // for RawspeedException
+#include "common/TaskScheduler.h"     // for Parallelism, ThreadPool
+#include <gtest/gtest.h>              // for Message, TestPartResult, TEST
+#include <memory>                     // for make_shared
+#include <string>                     // for string
+#include <vector>                     // for vector
+
+using rawspeed::getNumaNodeCount;
+using rawspeed::getNumaNodeCpus;
+using rawspeed::LargeAllocation;
+using rawspeed::LargeAllocationPolicy;
+using rawspeed::Parallelism;
+using rawspeed::parseIndexList;
+using rawspeed::uint64;
+using std::vector;
+
+namespace rawspeed_test {
+
+TEST(NumaTest, ParseIndexList) {
+  ASSERT_EQ(parseIndexList(""), vector<int>());
+  ASSERT_EQ(parseIndexList("0"), vector<int>({0}));
+  ASSERT_EQ(parseIndexList("0\n"), vector<int>({0}));
+  ASSERT_EQ(parseIndexList("0-3"), vector<int>({0, 1, 2, 3}));
+  ASSERT_EQ(parseIndexList("8,0-1,10-11"), vector<int>({0, 1, 8, 10, 11}));
+  ASSERT_EQ(parseIndexList("1,1,0-1"), vector<int>({0, 1}));
+}
+
+TEST(NumaTest, ParseIndexListMalformed) {
+  for (const char* list : {"-", "a", "1-", "3-1", "1;2", "0,,1", "-1"}) {
+    ASSERT_THROW(parseIndexList(list), rawspeed::RawspeedException) << list;
+  }
+}
+
+TEST(NumaTest, ThereIsAlwaysANode) {
+  ASSERT_GE(getNumaNodeCount(), 1);
+  ASSERT_FALSE(getNumaNodeCpus(0).empty());
+  ASSERT_EQ(getNumaNodeCpus(vector<int>({0})), getNumaNodeCpus(0));
+  ASSERT_THROW(getNumaNodeCpus(getNumaNodeCount()),
+               rawspeed::RawspeedException);
+}
+
+TEST(NumaTest, PrefaultRowsPlacesAllPages) {
+  const int rows = 256;
+  const size_t pitch = 16 * 1024;
+  const LargeAllocation a = rawspeed::largeMallocArray(
+      rows, pitch, LargeAllocationPolicy::TransparentHugePages);
+  ASSERT_NE(a.ptr, nullptr);
+
+  const vector<int> cpus = getNumaNodeCpus(0);
+  const Parallelism parallelism(
+      0, std::make_shared<rawspeed::ThreadPool>(4, cpus));
+  rawspeed::prefaultRows(a, rows, pitch, parallelism);
+
+  const vector<uint64> counts =
+      rawspeed::getNumaNodePageCounts(a.ptr, rows * pitch);
+  if (!counts.empty()) {
+    ASSERT_EQ(counts.size(), getNumaNodeCount());
+    uint64 total = 0;
+    for (auto pages : counts)
+      total += pages;
+    // Whatever the page size, all of them were faulted in.
+    ASSERT_GT(total, 0);
+  }
+
+  // And it is still all zeros.
+  const auto* data = static_cast<const rawspeed::uchar8*>(a.ptr);
+  for (size_t i = 0; i < rows * pitch; i++)
+    ASSERT_EQ(data[i], 0);
+
+  rawspeed::largeFree(a);
+}
+
+} // namespace rawspeed_test
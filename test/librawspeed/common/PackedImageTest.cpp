@@ -0,0 +1,166 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "common/PackedImage.h"       // for PackedImage
+#include "common/Common.h"            // for ushort16, uchar8
+#include "common/Point.h"             // for iPoint2D, iRectangle2D
+#include "common/RawImage.h"          // for RawImage, RawImageData, TYPE_...
+#include "common/RawspeedException.h" // for RawspeedException
+#include "common/TaskScheduler.h"     // for Parallelism
+#include "io/BitPumpLSB.h"            // for BitPumpLSB
+#include "io/Buffer.h"                // for Buffer, DataBuffer
+#include "io/ByteStream.h"            // for ByteStream
+#include "io/Endianness.h"            // for Endianness, Endianness::little
+#include <gtest/gtest.h>              // for ParamIteratorInterface, TEST_P
+#include <random>                     // for minstd_rand, uniform_int_dis...
+#include <tuple>                      // for make_tuple, get, tuple
+#include <vector>                     // for vector
+
+using rawspeed::BitPumpLSB;
+using rawspeed::Buffer;
+using rawspeed::ByteStream;
+using rawspeed::DataBuffer;
+using rawspeed::Endianness;
+using rawspeed::iPoint2D;
+using rawspeed::iRectangle2D;
+using rawspeed::PackedImage;
+using rawspeed::Parallelism;
+using rawspeed::RawImage;
+using rawspeed::TYPE_FLOAT32;
+using rawspeed::TYPE_USHORT16;
+using rawspeed::ushort16;
+using std::vector;
+
+namespace rawspeed_test {
+
+// bits, width, components per pixel
+using PackedImageParam = std::tuple<int, int, int>;
+
+class PackedImageTest : public ::testing::TestWithParam<PackedImageParam> {
+protected:
+  int bits;
+  iPoint2D dim;
+  int cpp;
+
+  virtual void SetUp() override {
+    bits = std::get<0>(GetParam());
+    dim = iPoint2D(std::get<1>(GetParam()), 5);
+    cpp = std::get<2>(GetParam());
+  }
+
+  RawImage makeImage() const {
+    RawImage img = RawImage::create(dim, TYPE_USHORT16, cpp);
+    std::minstd_rand gen(dim.x * 16 + bits + cpp);
+    std::uniform_int_distribution<int> dist(0, (1 << bits) - 1);
+    for (int y = 0; y < dim.y; y++) {
+      auto* row = reinterpret_cast<ushort16*>(img->getData(0, y));
+      for (int x = 0; x < dim.x * cpp; x++)
+        row[x] = dist(gen);
+    }
+    return img;
+  }
+};
+
+// Widths around the 8-sample groups and the 16-byte padding of the rows.
+INSTANTIATE_TEST_CASE_P(Sizes, PackedImageTest,
+                        ::testing::Combine(::testing::Values(12, 14),
+                                           ::testing::Range(1, 42),
+                                           ::testing::Values(1, 3)));
+
+TEST_P(PackedImageTest, RoundTrip) {
+  const RawImage img = makeImage();
+  const PackedImage packed = PackedImage::pack(img, bits, Parallelism());
+  ASSERT_EQ(packed.getDim(), dim);
+  ASSERT_EQ(packed.getPitch() % 16, 0);
+  ASSERT_GE(8 * packed.getPitch(), static_cast<size_t>(dim.x * cpp * bits));
+
+  const RawImage unpacked = packed.unpack(Parallelism());
+  ASSERT_EQ(unpacked->dim, dim);
+  ASSERT_EQ(unpacked->getCpp(), cpp);
+  for (int y = 0; y < dim.y; y++) {
+    const auto* a = reinterpret_cast<const ushort16*>(img->getData(0, y));
+    const auto* b = reinterpret_cast<const ushort16*>(unpacked->getData(0, y));
+    for (int x = 0; x < dim.x * cpp; x++)
+      ASSERT_EQ(a[x], b[x]) << "at " << x << ", " << y;
+  }
+}
+
+TEST_P(PackedImageTest, LayoutIsLSBBitPacked) {
+  const RawImage img = makeImage();
+  const PackedImage packed = PackedImage::pack(img, bits, Parallelism());
+
+  for (int y = 0; y < dim.y; y++) {
+    const Buffer b(packed.getRow(y), packed.getPitch());
+    BitPumpLSB pump{ByteStream(DataBuffer(b, Endianness::little))};
+    const auto* row = reinterpret_cast<const ushort16*>(img->getData(0, y));
+    for (int x = 0; x < dim.x * cpp; x++)
+      ASSERT_EQ(pump.getBits(bits), row[x]) << "at " << x << ", " << y;
+  }
+}
+
+TEST_P(PackedImageTest, UnusedBitsAreDropped) {
+  RawImage img = makeImage();
+  auto* row = reinterpret_cast<ushort16*>(img->getData(0, 0));
+  vector<ushort16> expected(row, row + dim.x * cpp);
+  // Set all the unused bits of the first and the last sample.
+  const auto unused = static_cast<ushort16>(0xFFFF << bits);
+  row[0] |= unused;
+  row[dim.x * cpp - 1] |= unused;
+
+  PackedImage packed(dim, cpp, bits);
+  packed.packRow(0, row);
+  vector<ushort16> unpacked(dim.x * cpp);
+  packed.unpackRow(0, unpacked.data());
+  ASSERT_EQ(unpacked, expected);
+}
+
+TEST(PackedImageTest, Cropped) {
+  RawImage img = RawImage::create({64, 16}, TYPE_USHORT16, 1);
+  for (int y = 0; y < 16; y++) {
+    auto* row = reinterpret_cast<ushort16*>(img->getData(0, y));
+    for (int x = 0; x < 64; x++)
+      row[x] = y * 64 + x;
+  }
+  img->subFrame(iRectangle2D(3, 2, 50, 11));
+
+  const RawImage unpacked =
+      PackedImage::pack(img, 12, Parallelism()).unpack(Parallelism());
+  ASSERT_EQ(unpacked->dim, iPoint2D(50, 11));
+  for (int y = 0; y < 11; y++) {
+    const auto* row =
+        reinterpret_cast<const ushort16*>(unpacked->getData(0, y));
+    for (int x = 0; x < 50; x++)
+      ASSERT_EQ(row[x], (y + 2) * 64 + x + 3);
+  }
+}
+
+TEST(PackedImageTest, Unsupported) {
+  ASSERT_TRUE(PackedImage::isSupported(12));
+  ASSERT_TRUE(PackedImage::isSupported(14));
+  ASSERT_FALSE(PackedImage::isSupported(16));
+  ASSERT_THROW(PackedImage({8, 8}, 1, 16), rawspeed::RawspeedException);
+  ASSERT_THROW(PackedImage({0, 8}, 1, 12), rawspeed::RawspeedException);
+
+  const RawImage img = RawImage::create({8, 8}, TYPE_FLOAT32, 1);
+  ASSERT_THROW(PackedImage::pack(img, 12, Parallelism()),
+               rawspeed::RawspeedException);
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,147 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/PixelStatistics.h" // for PixelStatistics
+#include "common/Common.h"          // for ushort16
+#include "common/Point.h"           // for iPoint2D, iRectangle2D
+#include "common/RawImage.h"        // for RawImage, RawImageData
+#include <algorithm>                // for max, min
+#include <gtest/gtest.h>            // for ParamIteratorInterface, Param...
+#include <random>                   // for minstd_rand, uniform_int_distri...
+#include <tuple>                    // for tuple, get
+#include <vector>                   // for vector
+
+using rawspeed::iPoint2D;
+using rawspeed::iRectangle2D;
+using rawspeed::PixelStatistics;
+using rawspeed::RawImage;
+using rawspeed::TYPE_USHORT16;
+using rawspeed::ushort16;
+using std::vector;
+
+namespace rawspeed_test {
+
+TEST(PixelStatisticsTest, Tiles) {
+  static constexpr int width = 3 * PixelStatistics::tileSize - 5;
+
+  PixelStatistics stats;
+  stats.init(width, 4);
+  ASSERT_FALSE(stats.haveRows(0, 1));
+  ASSERT_TRUE(stats.haveRows(2, 2));
+
+  std::minstd_rand gen(width);
+  std::uniform_int_distribution<int> dist(0, 65535);
+
+  vector<ushort16> row(width);
+  for (auto& v : row)
+    v = dist(gen);
+  stats.addRow(1, row.data());
+
+  ASSERT_FALSE(stats.haveRows(0, 2));
+  ASSERT_TRUE(stats.haveRows(1, 2));
+
+  for (int tile = 0; tile < 3; tile++) {
+    const auto begin = row.begin() + tile * PixelStatistics::tileSize;
+    const auto end = tile == 2 ? row.end() : begin + PixelStatistics::tileSize;
+    ASSERT_EQ(stats.getTile(1, tile).min, *std::min_element(begin, end));
+    ASSERT_EQ(stats.getTile(1, tile).max, *std::max_element(begin, end));
+  }
+
+  stats.invalidate();
+  ASSERT_FALSE(stats.haveRows(1, 2));
+}
+
+// crop x, crop y, cpp
+using EstimateType = std::tuple<int, int, int>;
+
+class PixelStatisticsEstimateTest
+    : public ::testing::TestWithParam<EstimateType> {
+protected:
+  PixelStatisticsEstimateTest() = default;
+  virtual void SetUp() {
+    const auto& p = GetParam();
+    crop = {std::get<0>(p), std::get<1>(p)};
+    cpp = std::get<2>(p);
+  }
+
+  // Random values, with the extremes somewhere in the image, including in
+  // the skipped border, where they must not be found.
+  RawImage makeImage() const {
+    static const iPoint2D dim(1024, 560);
+
+    RawImage img = RawImage::create(dim, TYPE_USHORT16, cpp);
+    std::minstd_rand gen(crop.x * 1000 + crop.y * 10 + cpp);
+    std::uniform_int_distribution<int> dist(1000, 5000);
+    for (int y = 0; y < dim.y; y++) {
+      auto* row = reinterpret_cast<ushort16*>(img->getData(0, y));
+      for (int x = 0; x < dim.x * cpp; x++)
+        row[x] = dist(gen);
+    }
+
+    std::uniform_int_distribution<int> pos(0, dim.area() * cpp - 1);
+    for (int i = 0; i < 64; i++) {
+      const int p = pos(gen);
+      auto* pixel = reinterpret_cast<ushort16*>(
+          img->getData(0, p / (dim.x * cpp)));
+      pixel[p % (dim.x * cpp)] = i % 2 ? 100 + i : 60000 - i;
+    }
+
+    img->subFrame(iRectangle2D(crop, dim - crop - crop));
+    return img;
+  }
+
+  iPoint2D crop;
+  int cpp;
+};
+
+INSTANTIATE_TEST_CASE_P(Crops, PixelStatisticsEstimateTest,
+                        ::testing::Combine(::testing::Values(0, 1, 37),
+                                           ::testing::Values(0, 3),
+                                           ::testing::Values(1, 3)));
+
+TEST_P(PixelStatisticsEstimateTest, SameEstimate) {
+  RawImage expected = makeImage();
+  expected->scaleBlackWhite();
+
+  RawImage img = makeImage();
+  const iPoint2D dim = img->getUncroppedDim();
+  for (int y = 0; y < dim.y; y++) {
+    img->pixelStatistics.addRow(
+        y, reinterpret_cast<ushort16*>(img->getDataUncropped(0, y)));
+  }
+  ASSERT_TRUE(img->pixelStatistics.haveRows(0, dim.y));
+
+  // The image is not read anywhere but at the ends of the rows.
+  const int begin = (img->getCropOffset().x + 250 + 64) * cpp;
+  for (int y = 0; y < dim.y; y++) {
+    auto* row = reinterpret_cast<ushort16*>(img->getDataUncropped(0, y));
+    for (int x = begin; x < begin + 64 * cpp; x++)
+      row[x] = 0;
+  }
+
+  img->scaleBlackWhite();
+
+  ASSERT_EQ(img->blackLevel, expected->blackLevel);
+  ASSERT_EQ(img->whitePoint, expected->whitePoint);
+  ASSERT_FALSE(img->pixelStatistics.haveRows(0, 1));
+}
+
+} // namespace rawspeed_test
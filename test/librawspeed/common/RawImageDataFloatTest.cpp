@@ -0,0 +1,175 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/Point.h"       // for iPoint2D
+#include "common/RawImage.h"    // for RawImage, RawImageData, TYPE_FLOAT32
+#include "metadata/BlackArea.h" // for BlackArea
+#include <algorithm>            // for max, min, nth_element
+#include <array>                // for array
+#include <cmath>                // for isnan, NAN
+#include <gtest/gtest.h>        // for ParamIteratorInterface, Param...
+#include <random>               // for minstd_rand, uniform_real_distri...
+#include <tuple>                // for tuple, get
+#include <vector>               // for vector
+
+using rawspeed::BlackArea;
+using rawspeed::iPoint2D;
+using rawspeed::RawImage;
+using rawspeed::TYPE_FLOAT32;
+using std::vector;
+
+namespace rawspeed_test {
+
+// width, height, cpp, threads
+using FloatType = std::tuple<int, int, int, int>;
+
+class RawImageDataFloatTest : public ::testing::TestWithParam<FloatType> {
+protected:
+  RawImageDataFloatTest() = default;
+  virtual void SetUp() {
+    const auto& p = GetParam();
+    dim = {std::get<0>(p), std::get<1>(p)};
+    cpp = std::get<2>(p);
+    threads = std::get<3>(p);
+  }
+
+  // Random values, and a few NaN's.
+  RawImage makeImage(float lo, float hi) const {
+    RawImage img = RawImage::create(dim, TYPE_FLOAT32, cpp);
+    img->parallelism.maxThreads = threads;
+
+    std::minstd_rand gen(dim.area() * cpp + threads);
+    std::uniform_real_distribution<float> dist(lo, hi);
+    for (int y = 0; y < dim.y; y++) {
+      auto* row = getRow(img, y);
+      for (int x = 0; x < dim.x * cpp; x++)
+        row[x] = gen() % 1000 == 0 ? NAN : dist(gen);
+    }
+    return img;
+  }
+
+  static float* getRow(const RawImage& img, int y) {
+    return reinterpret_cast<float*>(img->getData(0, y));
+  }
+
+  iPoint2D dim;
+  int cpp;
+  int threads;
+};
+
+INSTANTIATE_TEST_CASE_P(
+    Images, RawImageDataFloatTest,
+    ::testing::Combine(::testing::Values(1, 17, 320, 333), // width
+                       ::testing::Values(2, 16, 310),      // height
+                       ::testing::Values(1, 3),            // cpp
+                       ::testing::Values(1, 4)));          // threads
+
+TEST_P(RawImageDataFloatTest, ScaleValues) {
+  RawImage img = makeImage(-1.0F, 2.0F);
+  RawImage expected = makeImage(-1.0F, 2.0F);
+
+  img->blackLevel = 0;
+  img->blackLevelSeparate = {{1, 2, 3, 4}};
+  img->whitePoint = 100;
+  img->scaleBlackWhite();
+
+  for (int y = 0; y < dim.y; y++) {
+    const float* row = getRow(img, y);
+    const float* ref = getRow(expected, y);
+    for (int x = 0; x < dim.x * cpp; x++) {
+      const int black = img->blackLevelSeparate[((y & 1) << 1) | (x & 1)];
+      const float mul = 65535.0F / static_cast<float>(100 - black);
+      const float want = (ref[x] - static_cast<float>(black)) * mul;
+      if (std::isnan(want))
+        ASSERT_TRUE(std::isnan(row[x]));
+      else
+        ASSERT_EQ(row[x], want) << "at x " << x << ", y " << y;
+    }
+  }
+}
+
+TEST_P(RawImageDataFloatTest, Estimate) {
+  static constexpr int skipBorder = 150;
+
+  RawImage img = makeImage(-1000.0F, 70000.0F);
+
+  float b = 100000000;
+  float m = -10000000;
+  const int width = (dim.x - skipBorder) * cpp - skipBorder;
+  for (int y = skipBorder * cpp; y < dim.y - skipBorder; y++) {
+    const float* row = getRow(img, y) + skipBorder * cpp;
+    for (int x = 0; x < width; x++) {
+      if (std::isnan(row[x]))
+        continue;
+      b = std::min(b, row[x]);
+      m = std::max(m, row[x]);
+    }
+  }
+
+  img->scaleBlackWhite();
+
+  ASSERT_EQ(img->blackLevel, static_cast<int>(b));
+  ASSERT_EQ(img->whitePoint, static_cast<int>(m));
+}
+
+TEST_P(RawImageDataFloatTest, BlackAreasMedian) {
+  if (dim.x < 8 || dim.y < 4)
+    return;
+
+  RawImage img = makeImage(0.0F, 0.1F);
+  img->blackAreas.emplace_back(0, 4, false);
+  img->blackAreas.emplace_back(0, 8, true);
+  img->whitePoint = 70000;
+
+  std::array<vector<float>, 4> values;
+  for (int y = 0; y < dim.y; y++) {
+    const float* row = getRow(img, y);
+    for (int x = 0; x < (y < 4 ? dim.x : 8); x++) {
+      if (!std::isnan(row[x]))
+        values[((y & 1) << 1) | (x & 1)].push_back(row[x]);
+    }
+    // The first rows are in both of the areas.
+    for (int x = 0; y < 4 && x < 8; x++) {
+      if (!std::isnan(row[x]))
+        values[((y & 1) << 1) | (x & 1)].push_back(row[x]);
+    }
+  }
+
+  img->scaleBlackWhite();
+
+  std::array<int, 4> expected;
+  for (int i = 0; i < 4; i++) {
+    auto& v = values[i];
+    const auto median = v.begin() + v.size() / 2;
+    std::nth_element(v.begin(), median, v.end());
+    expected[i] = static_cast<int>(65535.0F * *median);
+  }
+
+  // Not a CFA image, the black levels are averaged.
+  if (cpp != 1) {
+    const int total = expected[0] + expected[1] + expected[2] + expected[3];
+    expected.fill((total + 2) >> 2);
+  }
+
+  ASSERT_EQ(img->blackLevelSeparate, expected);
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,190 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/Common.h"      // for ushort16, uint32, clampBits
+#include "common/Point.h"       // for iPoint2D
+#include "common/RawImage.h"    // for RawImage, RawImageCurveGuard
+#include "common/TableLookUp.h" // for TableLookUp
+#include <gtest/gtest.h>        // for ParamIteratorInterface, Param...
+#include <random>               // for minstd_rand, uniform_int_distri...
+#include <stdexcept>            // for runtime_error
+#include <tuple>                // for tuple, get
+#include <vector>               // for vector
+
+using rawspeed::clampBits;
+using rawspeed::iPoint2D;
+using rawspeed::RawImage;
+using rawspeed::RawImageCurveGuard;
+using rawspeed::TableLookUp;
+using rawspeed::TYPE_USHORT16;
+using rawspeed::uint32;
+using rawspeed::ushort16;
+using std::vector;
+
+namespace rawspeed_test {
+
+namespace {
+
+vector<ushort16> makeCurve() {
+  // Something not quite linear, and not covering all of the 16-bit values.
+  vector<ushort16> curve(4096);
+  for (int i = 0; i < static_cast<int>(curve.size()); i++)
+    curve[i] = static_cast<ushort16>((i * i) / 256 + 3 * i);
+  return curve;
+}
+
+RawImage makeImage(const iPoint2D& dim, int cpp, int seed) {
+  RawImage img = RawImage::create(dim, TYPE_USHORT16, cpp);
+  std::minstd_rand gen(seed);
+  std::uniform_int_distribution<int> dist(0, 65535);
+  for (int y = 0; y < dim.y; y++) {
+    auto* row = reinterpret_cast<ushort16*>(img->getData(0, y));
+    for (int x = 0; x < dim.x * cpp; x++)
+      row[x] = dist(gen);
+  }
+  return img;
+}
+
+// The plain description of what RawImageData::sixteenBitLookup() does.
+void applyReference(const RawImage& img, const vector<ushort16>& curve,
+                    bool dither) {
+  TableLookUp table(1, dither);
+  table.setTable(0, curve);
+  const ushort16* t = table.getTable(0);
+
+  const iPoint2D dim = img->getUncroppedDim();
+  for (int y = 0; y < dim.y; y++) {
+    auto* row = reinterpret_cast<ushort16*>(img->getDataUncropped(0, y));
+    uint32 v = (dim.x + y * 13) ^ 0x45694584;
+    for (int x = 0; x < dim.x * static_cast<int>(img->getCpp()); x++) {
+      if (!dither) {
+        row[x] = t[row[x]];
+        continue;
+      }
+      const uint32 base = t[2 * row[x]];
+      const uint32 delta = t[2 * row[x] + 1];
+      v = 15700 * (v & 65535) + (v >> 16);
+      row[x] = clampBits(base + ((delta * (v & 2047) + 1024) >> 12), 16);
+    }
+  }
+}
+
+void expectSameImages(const RawImage& a, const RawImage& b) {
+  const iPoint2D dim = a->getUncroppedDim();
+  ASSERT_EQ(dim, b->getUncroppedDim());
+  for (int y = 0; y < dim.y; y++) {
+    const auto* rowA = reinterpret_cast<ushort16*>(a->getDataUncropped(0, y));
+    const auto* rowB = reinterpret_cast<ushort16*>(b->getDataUncropped(0, y));
+    for (int x = 0; x < dim.x * static_cast<int>(a->getCpp()); x++)
+      ASSERT_EQ(rowA[x], rowB[x]) << "at x " << x << ", y " << y;
+  }
+}
+
+} // namespace
+
+// width, height, cpp, dither, threads
+using LookupType = std::tuple<int, int, int, bool, int>;
+
+class RawImageLookupTest : public ::testing::TestWithParam<LookupType> {
+protected:
+  RawImageLookupTest() = default;
+  virtual void SetUp() {
+    const auto& p = GetParam();
+    dim = {std::get<0>(p), std::get<1>(p)};
+    cpp = std::get<2>(p);
+    dither = std::get<3>(p);
+    threads = std::get<4>(p);
+  }
+
+  iPoint2D dim;
+  int cpp;
+  bool dither;
+  int threads;
+};
+
+INSTANTIATE_TEST_CASE_P(
+    Lookup, RawImageLookupTest,
+    ::testing::Combine(::testing::Values(1, 7, 8, 17, 64), // width
+                       ::testing::Values(1, 8, 13, 35),    // height
+                       ::testing::Values(1, 3),            // cpp
+                       ::testing::Bool(),                  // dither
+                       ::testing::Values(1, 2, 5)));       // threads
+
+TEST_P(RawImageLookupTest, SixteenBitLookup) {
+  const vector<ushort16> curve = makeCurve();
+
+  RawImage expected = makeImage(dim, cpp, dim.area() + cpp);
+  applyReference(expected, curve, dither);
+
+  RawImage img = makeImage(dim, cpp, dim.area() + cpp);
+  img->parallelism.maxThreads = threads;
+  img->setTable(curve, dither);
+  img->sixteenBitLookup();
+
+  ASSERT_FALSE(img->isTooManyErrors(1));
+  expectSameImages(expected, img);
+}
+
+TEST_P(RawImageLookupTest, DeferredCurveGuard) {
+  if (!dither)
+    return;
+
+  const vector<ushort16> curve = makeCurve();
+
+  RawImage expected = makeImage(dim, cpp, dim.area() + cpp);
+  applyReference(expected, curve, /*dither=*/true);
+
+  RawImage img = makeImage(dim, cpp, dim.area() + cpp);
+  img->parallelism.maxThreads = threads;
+  img->deferCurves = true;
+  {
+    RawImageCurveGuard curveHandler(&img, curve, false);
+    // The decompressor would store the raw codes.
+    ASSERT_EQ(img->getTable(), nullptr);
+    curveHandler.finish();
+  }
+  ASSERT_EQ(img->getTable(), nullptr);
+
+  ASSERT_FALSE(img->isTooManyErrors(1));
+  expectSameImages(expected, img);
+}
+
+TEST_P(RawImageLookupTest, DeferredCurveGuardNotFinished) {
+  const vector<ushort16> curve = makeCurve();
+
+  RawImage expected = makeImage(dim, cpp, dim.area() + cpp);
+
+  RawImage img = makeImage(dim, cpp, dim.area() + cpp);
+  img->parallelism.maxThreads = threads;
+  img->deferCurves = true;
+  try {
+    RawImageCurveGuard curveHandler(&img, curve, false);
+    // The decompressor failed half-way.
+    throw std::runtime_error("decompressor failed");
+  } catch (std::runtime_error&) {
+  }
+  ASSERT_EQ(img->getTable(), nullptr);
+
+  // The curve was not applied.
+  expectSameImages(expected, img);
+}
+
+} // namespace rawspeed_test
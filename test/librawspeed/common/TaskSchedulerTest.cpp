@@ -0,0 +1,213 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "common/TaskScheduler.h" // for ThreadPool, parallelFor, Executor
+#include <algorithm>              // for min
+#include <atomic>                 // for atomic
+#include <functional>             // for function
+#include <gtest/gtest.h>          // for Message, TestPartResult, TestPartR...
+#include <memory>                 // for make_shared
+#include <thread>                 // for yield
+#include <vector>                 // for vector
+
+using rawspeed::Executor;
+using rawspeed::Parallelism;
+using rawspeed::parallelFor;
+using rawspeed::parallelForChunks;
+using rawspeed::Schedule;
+using rawspeed::setExecutor;
+using rawspeed::ThreadPool;
+
+namespace rawspeed_test {
+
+class ThreadPoolTest : public ::testing::TestWithParam<int> {
+protected:
+  ThreadPoolTest() = default;
+  virtual void SetUp() { threads = GetParam(); }
+
+  int threads;
+};
+INSTANTIATE_TEST_CASE_P(Threads, ThreadPoolTest,
+                        ::testing::Values(1, 2, 3, 4, 8, 17));
+
+TEST_P(ThreadPoolTest, EachTaskRunsExactlyOnce) {
+  ThreadPool pool(threads);
+  ASSERT_EQ(pool.getConcurrency(), threads);
+
+  for (int numTasks : {0, 1, 2, 3, 7, 16, 100, 1000}) {
+    std::vector<std::atomic<int>> hits(numTasks);
+    for (auto& h : hits)
+      h = 0;
+
+    pool.execute(numTasks, [&hits](int i) { ++hits[i]; });
+
+    for (const auto& h : hits)
+      ASSERT_EQ(h, 1);
+  }
+}
+
+TEST_P(ThreadPoolTest, NestedExecuteDoesNotDeadlock) {
+  ThreadPool pool(threads);
+
+  std::atomic<int> total{0};
+  pool.execute(16, [&pool, &total](int) {
+    pool.execute(16, [&total](int) { ++total; });
+  });
+
+  ASSERT_EQ(total, 16 * 16);
+}
+
+TEST_P(ThreadPoolTest, ParallelForCoversRange) {
+  setExecutor(std::make_shared<ThreadPool>(threads));
+
+  for (const Schedule schedule : {Schedule::Static, Schedule::Dynamic}) {
+    for (int size : {0, 1, 2, 5, 64, 1001}) {
+      std::vector<std::atomic<int>> hits(size);
+      for (auto& h : hits)
+        h = 0;
+
+      parallelFor(Parallelism(), 10, 10 + size,
+                  [&hits](int i) { ++hits[i - 10]; }, schedule);
+
+      for (const auto& h : hits)
+        ASSERT_EQ(h, 1);
+    }
+  }
+
+  setExecutor(nullptr);
+}
+
+TEST_P(ThreadPoolTest, ParallelForChunksAreContiguous) {
+  setExecutor(std::make_shared<ThreadPool>(threads));
+
+  std::atomic<int> chunks{0};
+  std::atomic<int> total{0};
+  parallelForChunks(Parallelism(), 0, 1000,
+                    [&chunks, &total](int begin, int end) {
+                      ASSERT_LT(begin, end);
+                      ++chunks;
+                      total += end - begin;
+                    });
+
+  ASSERT_LE(chunks, threads);
+  ASSERT_EQ(total, 1000);
+
+  setExecutor(nullptr);
+}
+
+TEST_P(ThreadPoolTest, MaxThreadsIsHonored) {
+  // Note that the budget is smaller than the executor's concurrency.
+  const Parallelism parallelism(threads, std::make_shared<ThreadPool>(8));
+  ASSERT_EQ(parallelism.getNumThreads(1000), std::min(threads, 8));
+
+  for (const Schedule schedule : {Schedule::Static, Schedule::Dynamic}) {
+    std::atomic<int> running{0};
+    std::atomic<int> maxRunning{0};
+    std::atomic<int> total{0};
+    parallelFor(
+        parallelism, 0, 1000,
+        [&running, &maxRunning, &total](int) {
+          const int now = ++running;
+          int prev = maxRunning;
+          while (prev < now && !maxRunning.compare_exchange_weak(prev, now))
+            ;
+          ++total;
+          std::this_thread::yield();
+          --running;
+        },
+        schedule);
+
+    ASSERT_LE(maxRunning, threads);
+    ASSERT_EQ(total, 1000);
+  }
+}
+
+TEST_P(ThreadPoolTest, LimitedHoldsForNestedLoops) {
+  const Parallelism parallelism =
+      Parallelism(threads, std::make_shared<ThreadPool>(8)).getLimited();
+  // Copies share the limit, and limiting again changes nothing.
+  ASSERT_EQ(parallelism.getLimited().executor, parallelism.executor);
+  ASSERT_EQ(parallelism.getNumThreads(1000), std::min(threads, 8));
+
+  std::atomic<int> running{0};
+  std::atomic<int> maxRunning{0};
+  std::atomic<int> total{0};
+  parallelFor(
+      parallelism, 0, 8,
+      [parallelism, &running, &maxRunning, &total](int) {
+        parallelFor(parallelism, 0, 100, [&running, &maxRunning, &total](int) {
+          const int now = ++running;
+          int prev = maxRunning;
+          while (prev < now && !maxRunning.compare_exchange_weak(prev, now))
+            ;
+          ++total;
+          std::this_thread::yield();
+          --running;
+        });
+      },
+      Schedule::Dynamic);
+
+  ASSERT_LE(maxRunning, threads);
+  ASSERT_EQ(total, 800);
+}
+
+TEST_P(ThreadPoolTest, PinnedPoolRunsEverything) {
+  // CPU 0 always exists, and pinning failures are not fatal anyway.
+  const Parallelism parallelism(
+      0, std::make_shared<ThreadPool>(threads, std::vector<int>{0}));
+
+  std::vector<std::atomic<int>> hits(100);
+  for (auto& h : hits)
+    h = 0;
+
+  parallelFor(parallelism, 0, 100, [&hits](int i) { ++hits[i]; });
+
+  for (const auto& h : hits)
+    ASSERT_EQ(h, 1);
+}
+
+class CountingExecutor final : public Executor {
+public:
+  int batches = 0;
+
+  int getConcurrency() const override { return 4; }
+
+  void execute(int numTasks, const std::function<void(int)>& task) override {
+    ++batches;
+    for (int i = numTasks - 1; i >= 0; --i)
+      task(i);
+  }
+};
+
+TEST(TaskSchedulerTest, CustomExecutorIsUsed) {
+  auto executor = std::make_shared<CountingExecutor>();
+  setExecutor(executor);
+
+  std::vector<int> hits(100, 0);
+  parallelFor(Parallelism(), 0, 100, [&hits](int i) { ++hits[i]; });
+
+  for (const auto& h : hits)
+    ASSERT_EQ(h, 1);
+  ASSERT_EQ(executor->batches, 1);
+
+  setExecutor(nullptr);
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,233 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "decoders/BatchDecoder.h"   // for BatchDecoder, BatchDecodeResult
+#include "common/Common.h"           // for uchar8, ushort16, uint32
+#include "common/Point.h"            // for iPoint2D
+#include "common/RawImage.h"         // for RawImage, RawImageData
+#include "encoders/DngWriter.h"      // for DngWriter
+#include "encoders/TiffWriter.h"     // for TiffWriter
+#include "io/Buffer.h"               // for Buffer
+#include "metadata/CameraMetaData.h" // for CameraMetaData
+#include "tiff/TiffTag.h"            // for IMAGEWIDTH, IMAGELENGTH, ...
+#include <gtest/gtest.h>             // for Test, ASSERT_EQ, TEST
+#include <random>                    // for minstd_rand
+#include <string>                    // for string
+#include <vector>                    // for vector
+
+using rawspeed::BatchDecoder;
+using rawspeed::Buffer;
+using rawspeed::CameraMetaData;
+using rawspeed::DngWriter;
+using rawspeed::iPoint2D;
+using rawspeed::RawImage;
+using rawspeed::TiffWriter;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+namespace {
+
+RawImage genImage(const iPoint2D& dim, int seed) {
+  RawImage mRaw = RawImage::create(dim);
+  std::minstd_rand gen(seed);
+  for (int y = 0; y < dim.y; ++y) {
+    auto* row = reinterpret_cast<ushort16*>(mRaw->getData(0, y));
+    for (int x = 0; x < dim.x; ++x)
+      row[x] = gen() & 0xFFF;
+  }
+  return mRaw;
+}
+
+// DngDecoder is intra-file parallel.
+std::vector<uchar8> genDng(const RawImage& image, DngWriter::Compression c) {
+  DngWriter writer;
+  writer.compression = c;
+  writer.bitsPerSample = 12;
+  writer.rowsPerStrip = 8;
+  return writer.write(image);
+}
+
+// MefDecoder is not: one strip of 12-bit big-endian packed samples.
+std::vector<uchar8> genMef(const RawImage& image) {
+  const iPoint2D dim = image->dim;
+  std::vector<uchar8> strip;
+  for (int y = 0; y < dim.y; ++y) {
+    const auto* row = reinterpret_cast<const ushort16*>(image->getData(0, y));
+    for (int x = 0; x < dim.x; x += 2) {
+      strip.push_back(row[x] >> 4);
+      strip.push_back(((row[x] & 0xF) << 4) | (row[x + 1] >> 8));
+      strip.push_back(row[x + 1] & 0xFF);
+    }
+  }
+
+  TiffWriter tiff;
+  tiff.addString(rawspeed::MAKE, "Mamiya-OP Co.,Ltd.");
+  tiff.addString(rawspeed::MODEL, "Synthetic");
+  tiff.addLongs(rawspeed::IMAGEWIDTH, {static_cast<uint32>(dim.x)});
+  tiff.addLongs(rawspeed::IMAGELENGTH, {static_cast<uint32>(dim.y)});
+  tiff.addImageData(rawspeed::STRIPOFFSETS, rawspeed::STRIPBYTECOUNTS,
+                    {strip});
+  return tiff.write();
+}
+
+void checkImage(const RawImage& orig, const RawImage& decoded) {
+  ASSERT_EQ(decoded->getUncroppedDim(), orig->dim);
+  for (int y = 0; y < orig->dim.y; ++y) {
+    const auto* a = reinterpret_cast<const ushort16*>(orig->getData(0, y));
+    const auto* b =
+        reinterpret_cast<const ushort16*>(decoded->getDataUncropped(0, y));
+    for (int x = 0; x < orig->dim.x; ++x)
+      ASSERT_EQ(a[x], b[x]) << x << ", " << y;
+  }
+}
+
+} // namespace
+
+TEST(BatchDecoderTest, Empty) {
+  const CameraMetaData meta;
+  BatchDecoder batch(&meta);
+
+  const auto results = batch.decode(std::vector<const Buffer*>());
+  ASSERT_TRUE(results.empty());
+  ASSERT_EQ(batch.getStatistics().files, 0);
+  ASSERT_EQ(batch.getStatistics().failed, 0);
+}
+
+TEST(BatchDecoderTest, EachFailureIsReportedSeparately) {
+  const CameraMetaData meta;
+  BatchDecoder batch(&meta);
+  batch.parallelism.maxThreads = 3;
+
+  // None of these is a raw, but each one of them has to get its own error.
+  std::vector<std::vector<uchar8>> storage;
+  for (int i = 1; i <= 10; ++i)
+    storage.emplace_back(100 * i, static_cast<uchar8>(i));
+
+  std::vector<Buffer> buffers;
+  buffers.reserve(storage.size());
+  for (const auto& s : storage)
+    buffers.emplace_back(s.data(), s.size());
+
+  std::vector<const Buffer*> inputs;
+  for (const auto& b : buffers)
+    inputs.emplace_back(&b);
+
+  const auto results = batch.decode(inputs);
+  ASSERT_EQ(results.size(), inputs.size());
+  for (const auto& result : results) {
+    ASSERT_FALSE(result.isOk());
+    ASSERT_FALSE(result.error.empty());
+    ASSERT_TRUE(result.unknownFormat);
+  }
+
+  const auto& stats = batch.getStatistics();
+  ASSERT_EQ(stats.files, 10);
+  ASSERT_EQ(stats.failed, 10);
+  ASSERT_EQ(stats.unknownFormat, 10);
+  ASSERT_EQ(stats.bytes, 100 * (10 * 11) / 2);
+  ASSERT_EQ(stats.pixels, 0);
+  ASSERT_GE(stats.seconds, 0);
+}
+
+TEST(BatchDecoderTest, MixedFormats) {
+  const CameraMetaData meta;
+  BatchDecoder batch(&meta);
+  batch.parallelism.maxThreads = 3;
+
+  // The serial and the parallel formats interleaved, of different sizes, so
+  // that the decoding order differs from the order of the inputs.
+  const std::vector<iPoint2D> dims = {{64, 40}, {96, 72}, {128, 56},
+                                      {48, 96}, {80, 24}};
+  std::vector<RawImage> origs;
+  std::vector<std::vector<uchar8>> storage;
+  for (int i = 0; i < static_cast<int>(dims.size()); ++i) {
+    origs.emplace_back(genImage(dims[i], i));
+    switch (i % 3) {
+    case 0:
+      storage.emplace_back(genMef(origs.back()));
+      break;
+    case 1:
+      storage.emplace_back(genDng(origs.back(), DngWriter::Compression::LJpeg));
+      break;
+    default:
+      storage.emplace_back(
+          genDng(origs.back(), DngWriter::Compression::Uncompressed));
+      break;
+    }
+  }
+  // And one that is not a raw at all.
+  storage.emplace_back(1000, 0);
+
+  std::vector<Buffer> buffers;
+  buffers.reserve(storage.size());
+  for (const auto& s : storage)
+    buffers.emplace_back(s.data(), s.size());
+
+  std::vector<const Buffer*> inputs;
+  for (const auto& b : buffers)
+    inputs.emplace_back(&b);
+
+  const auto results = batch.decode(inputs);
+  ASSERT_EQ(results.size(), inputs.size());
+
+  uint32 bytes = 0;
+  uint32 pixels = 0;
+  for (int i = 0; i < static_cast<int>(origs.size()); ++i) {
+    ASSERT_TRUE(results[i].isOk()) << i << ": " << results[i].error;
+    ASSERT_FALSE(results[i].unknownFormat);
+    ASSERT_GE(results[i].seconds, 0);
+    checkImage(origs[i], results[i].image);
+    bytes += storage[i].size();
+    pixels += dims[i].area();
+  }
+  ASSERT_FALSE(results.back().isOk());
+  ASSERT_TRUE(results.back().unknownFormat);
+  bytes += storage.back().size();
+
+  const auto& stats = batch.getStatistics();
+  ASSERT_EQ(stats.files, 6);
+  ASSERT_EQ(stats.failed, 1);
+  ASSERT_EQ(stats.unknownFormat, 1);
+  ASSERT_EQ(stats.bytes, bytes);
+  ASSERT_EQ(stats.pixels, pixels);
+  ASSERT_GT(stats.seconds, 0);
+  ASSERT_DOUBLE_EQ(stats.getFilesPerSecond(), 6 / stats.seconds);
+  ASSERT_DOUBLE_EQ(stats.getBytesPerSecond(), bytes / stats.seconds);
+  ASSERT_DOUBLE_EQ(stats.getPixelsPerSecond(), pixels / stats.seconds);
+}
+
+TEST(BatchDecoderTest, UnreadableFileIsAnError) {
+  const CameraMetaData meta;
+  BatchDecoder batch(&meta);
+
+  const auto results =
+      batch.decode(std::vector<std::string>{"/this/file/does/not/exist"});
+  ASSERT_EQ(results.size(), 1);
+  ASSERT_FALSE(results[0].isOk());
+  ASSERT_FALSE(results[0].unknownFormat);
+  ASSERT_EQ(batch.getStatistics().failed, 1);
+  ASSERT_EQ(batch.getStatistics().unknownFormat, 0);
+  ASSERT_EQ(batch.getStatistics().bytes, 0);
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,201 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/CfaBinner.h"        // for CfaBinner
+#include "common/Common.h"           // for uchar8, ushort16, uint32
+#include "common/ImageBuffer.h"      // for ImageBuffer
+#include "common/Point.h"            // for iPoint2D
+#include "common/RawImage.h"         // for RawImage, RawImageData
+#include "decoders/RawDecoder.h"     // for RawDecoder
+#include "encoders/DngWriter.h"      // for DngWriter
+#include "io/Buffer.h"               // for Buffer
+#include "metadata/CameraMetaData.h" // for CameraMetaData
+#include "parsers/RawParser.h"       // for RawParser
+#include <gtest/gtest.h>             // for Test, ASSERT_EQ, TEST
+#include <random>                    // for minstd_rand
+#include <tuple>                     // for get, tuple
+#include <vector>                    // for vector
+
+using rawspeed::Buffer;
+using rawspeed::CfaBinner;
+using rawspeed::CameraMetaData;
+using rawspeed::DngWriter;
+using rawspeed::ImageBuffer;
+using rawspeed::iPoint2D;
+using rawspeed::RawImage;
+using rawspeed::RawParser;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+namespace {
+
+RawImage genImage(const iPoint2D& dim, int seed) {
+  RawImage mRaw = RawImage::create(dim);
+  std::minstd_rand gen(seed);
+  for (int y = 0; y < dim.y; ++y) {
+    auto* row = reinterpret_cast<ushort16*>(mRaw->getData(0, y));
+    for (int x = 0; x < dim.x; ++x)
+      row[x] = gen() & 0xFFF;
+  }
+  return mRaw;
+}
+
+RawImage decode(const std::vector<uchar8>& dng, int binning) {
+  const Buffer buf(dng.data(), dng.size());
+  const CameraMetaData meta;
+  RawParser parser(&buf);
+  const auto decoder = parser.getDecoder(&meta);
+  decoder->failOnUnknown = false;
+  decoder->binning = binning;
+  decoder->checkSupport(&meta);
+  return decoder->decodeRaw();
+}
+
+} // namespace
+
+TEST(DngDecoderTest, ReusesProvidedBuffer) {
+  const iPoint2D dim(2 * 8 * 9, 101);
+  const uint32 pitch = 2 * 8 * 9 * 2 + 32;
+
+  // A pool of one buffer, as the application might keep for a video.
+  alignas(16) static uchar8 pool[pitch * 101];
+  bool inUse = false;
+  int provided = 0;
+  const auto provider = [&](const iPoint2D& dim_, uint32 bpp) {
+    ImageBuffer buf;
+    if (inUse || dim_ != dim || bpp != 2)
+      return buf;
+    inUse = true;
+    provided++;
+    buf.data = pool;
+    buf.pitch = pitch;
+    buf.release = [&inUse]() { inUse = false; };
+    return buf;
+  };
+
+  DngWriter writer;
+  writer.compression = DngWriter::Compression::LJpeg;
+  writer.bitsPerSample = 12;
+  writer.rowsPerStrip = 16;
+
+  for (int frame = 0; frame < 3; ++frame) {
+    const RawImage orig = genImage(dim, frame);
+    const std::vector<uchar8> dng = writer.write(orig);
+    const Buffer buf(dng.data(), dng.size());
+
+    {
+      // NOTE: the decoder holds onto the image too.
+      const CameraMetaData meta;
+      RawParser parser(&buf);
+      const auto decoder = parser.getDecoder(&meta);
+      decoder->failOnUnknown = false;
+      decoder->bufferProvider = provider;
+      decoder->checkSupport(&meta);
+
+      const RawImage decoded = decoder->decodeRaw();
+      ASSERT_TRUE(inUse);
+      ASSERT_EQ(decoded->getData(0, 0), pool);
+      ASSERT_EQ(decoded->pitch, pitch);
+
+      for (int y = 0; y < dim.y; ++y) {
+        const auto* a = reinterpret_cast<const ushort16*>(orig->getData(0, y));
+        const auto* b = reinterpret_cast<const ushort16*>(pool + y * pitch);
+        for (int x = 0; x < dim.x; ++x)
+          ASSERT_EQ(a[x], b[x]) << x << ", " << y;
+      }
+    }
+    ASSERT_FALSE(inUse);
+  }
+  ASSERT_EQ(provided, 3);
+}
+
+class DngDecoderBinningTest
+    : public ::testing::TestWithParam<std::tuple<DngWriter::Compression, int>> {
+protected:
+  const iPoint2D dim{2 * 8 * 9 + 4, 101};
+  DngWriter writer;
+  int factor = 0;
+
+  void SetUp() override {
+    writer.compression = std::get<0>(GetParam());
+    writer.bitsPerSample = 12;
+    factor = std::get<1>(GetParam());
+  }
+
+  void check(const RawImage& orig, const RawImage& binned) const {
+    ASSERT_TRUE(binned->isBinned());
+    ASSERT_EQ(binned->getUnbinnedDim(), dim);
+    ASSERT_EQ(binned->dim, CfaBinner::getBinnedDim(dim, factor));
+
+    const int divisor = factor * factor;
+    for (int y = 0; y < binned->dim.y; y++) {
+      const auto* row =
+          reinterpret_cast<const ushort16*>(binned->getData(0, y));
+      for (int x = 0; x < binned->dim.x; x++) {
+        const int x0 = 2 * factor * (x / 2) + x % 2;
+        const int y0 = 2 * factor * (y / 2) + y % 2;
+        unsigned sum = 0;
+        for (int j = 0; j < factor; j++) {
+          const auto* in = reinterpret_cast<const ushort16*>(
+              orig->getData(x0, y0 + 2 * j));
+          for (int i = 0; i < factor; i++)
+            sum += in[2 * i];
+        }
+        ASSERT_EQ(row[x], (sum + divisor / 2) / divisor) << x << ", " << y;
+      }
+    }
+  }
+};
+
+INSTANTIATE_TEST_CASE_P(
+    CompressionsAndFactors, DngDecoderBinningTest,
+    ::testing::Combine(::testing::Values(DngWriter::Compression::Uncompressed,
+                                         DngWriter::Compression::LJpeg),
+                       ::testing::Range(2, 5)));
+
+TEST_P(DngDecoderBinningTest, Strips) {
+  writer.rowsPerStrip = 2 * factor * 3;
+
+  const RawImage orig = genImage(dim, factor);
+  check(orig, decode(writer.write(orig), factor));
+}
+
+TEST_P(DngDecoderBinningTest, Tiles) {
+  writer.tileWidth = 2 * factor * 4;
+  writer.tileHeight = 2 * factor * 2;
+
+  const RawImage orig = genImage(dim, factor);
+  check(orig, decode(writer.write(orig), factor));
+}
+
+TEST_P(DngDecoderBinningTest, UnalignedStripsAreNotBinned) {
+  writer.rowsPerStrip = 2 * factor + 1;
+
+  const RawImage orig = genImage(dim, factor);
+  const RawImage decoded = decode(writer.write(orig), factor);
+  ASSERT_FALSE(decoded->isBinned());
+  ASSERT_EQ(decoded->dim, dim);
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,327 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "decoders/IiqDecoder.h"       // for IiqDecoder
+#include "common/Common.h"             // for uchar8, ushort16, uint32
+#include "common/Point.h"              // for iPoint2D
+#include "common/RawImage.h"           // for RawImage, RawImageData
+#include "common/Spline.h"             // for Spline
+#include "encoders/BitPumpWriter.h"    // for BitPumpMSB32Writer
+#include "io/Buffer.h"                 // for Buffer
+#include "metadata/ColorFilterArray.h" // for CFAColor, ColorFilterArray
+#include <algorithm>                   // for min
+#include <array>                       // for array
+#include <cmath>                       // for lround
+#include <cstdlib>                     // for abs
+#include <gtest/gtest.h>               // for Test, ASSERT_EQ, TEST_P
+#include <random>                      // for minstd_rand
+#include <tuple>                       // for tuple, get
+#include <vector>                      // for vector
+
+using rawspeed::BitPumpMSB32Writer;
+using rawspeed::Buffer;
+using rawspeed::CFA_BLUE;
+using rawspeed::CFA_GREEN;
+using rawspeed::CFA_RED;
+using rawspeed::IiqDecoder;
+using rawspeed::iPoint2D;
+using rawspeed::RawImage;
+using rawspeed::Spline;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+namespace {
+
+constexpr int width = 64;
+constexpr int height = 24;
+constexpr int splitRow = 11;
+constexpr int splitCol = 37;
+
+const std::array<uint32, 7> xCoords = {1000,  2000,  4000, 8000,
+                                       16000, 32000, 48000};
+
+struct Defect {
+  ushort16 col;
+  ushort16 row;
+  ushort16 type;
+};
+
+class Writer final {
+  std::vector<uchar8>* out;
+
+public:
+  explicit Writer(std::vector<uchar8>* out_) : out(out_) {}
+
+  void u16(uint32 v) {
+    out->push_back(v);
+    out->push_back(v >> 8);
+  }
+  void u32(uint32 v) {
+    u16(v & 0xffff);
+    u16(v >> 16);
+  }
+};
+
+// The parameters of the image, and the pixels before any corrections.
+struct Image {
+  std::vector<ushort16> pixels;
+  uint32 blackLevel;
+  std::vector<Defect> defects;
+  // [quadrant][point], in ten-thousandths.
+  std::array<std::array<uint32, 7>, 4> multipliers;
+  bool defectsFirst;
+};
+
+Image genImage(unsigned seed, uint32 blackLevel,
+               const std::vector<ushort16>& badColumns, bool defectsFirst) {
+  std::minstd_rand gen(seed);
+
+  Image img;
+  img.pixels.resize(width * height);
+  for (auto& pixel : img.pixels)
+    pixel = gen() % 16384;
+  img.blackLevel = blackLevel;
+  for (const auto col : badColumns)
+    img.defects.push_back({col, 0, 131});
+  img.defects.push_back({3, 5, 129});     // bad pixel
+  img.defects.push_back({width, 0, 131}); // outside of the image
+  for (auto& quadrant : img.multipliers) {
+    for (auto& m : quadrant)
+      m = 9000 + gen() % 3000;
+  }
+  img.defectsFirst = defectsFirst;
+  return img;
+}
+
+// Just the bits of the IIQ container that IiqDecoder reads, and rows of
+// uncompressed (i.e. 14-bit length) PhaseOne strips.
+std::vector<uchar8> genIiq(const Image& img) {
+  std::vector<uchar8> strips;
+  std::vector<uint32> stripOffsets;
+  for (int row = 0; row < height; row++) {
+    stripOffsets.push_back(strips.size());
+    BitPumpMSB32Writer bits(&strips);
+    for (int col = 0; col < width; col++) {
+      if (col % 8 == 0) {
+        for (int i = 0; i < 2; i++)
+          bits.put(0, 6); // 5 zeros, then the second half of length[8] = 14
+      }
+      bits.put(img.pixels[row * width + col], 16);
+    }
+    bits.flush();
+  }
+
+  std::vector<uchar8> corrections;
+  Writer c(&corrections);
+  c.u32(0);
+  c.u32(0);
+  c.u32(12); // entries
+  c.u32(2);
+  c.u32(0);
+  const uint32 defectsSize = 8 * img.defects.size();
+  const uint32 defects = 12 + 8 + 2 * 12;
+  const uint32 multipliers = defects + defectsSize;
+  const uint32 multipliersSize = 4 * 7 * 5;
+  if (img.defectsFirst) {
+    c.u32(0x400), c.u32(defectsSize), c.u32(defects);
+    c.u32(0x431), c.u32(multipliersSize), c.u32(multipliers);
+  } else {
+    c.u32(0x431), c.u32(multipliersSize), c.u32(multipliers);
+    c.u32(0x400), c.u32(defectsSize), c.u32(defects);
+  }
+  for (const Defect& d : img.defects) {
+    c.u16(d.col);
+    c.u16(d.row);
+    c.u16(d.type);
+    c.u16(0);
+  }
+  for (const uint32 x : xCoords)
+    c.u32(x);
+  for (const auto& quadrant : img.multipliers) {
+    for (const uint32 m : quadrant)
+      c.u32(m);
+  }
+
+  // The offsets are relative to the 8'th byte of the file.
+  std::vector<uchar8> out(8);
+  Writer w(&out);
+  w.u32(0x49494949);
+  w.u32(0);
+  w.u32(12); // entries
+  constexpr int numEntries = 9;
+  w.u32(numEntries);
+  w.u32(0);
+  const uint32 wb = 12 + 8 + numEntries * 16;
+  const uint32 blockOffsets = wb + 12;
+  const uint32 rawData = blockOffsets + 4 * height;
+  const uint32 correctionData = rawData + strips.size();
+  const std::array<std::array<uint32, 3>, numEntries> entries = {{
+      {0x107, 12, wb},
+      {0x108, 0, width},
+      {0x109, 0, height},
+      {0x10f, static_cast<uint32>(strips.size()), rawData},
+      {0x110, static_cast<uint32>(corrections.size()), correctionData},
+      {0x21c, 4 * height, blockOffsets},
+      {0x21d, 0, img.blackLevel << 2},
+      {0x222, 0, splitCol},
+      {0x224, 0, splitRow},
+  }};
+  for (const auto& e : entries) {
+    w.u32(e[0]);
+    w.u32(0);
+    w.u32(e[1]);
+    w.u32(e[2]);
+  }
+  for (int i = 0; i < 3; i++)
+    w.u32(0x3f800000); // 1.0F
+  for (const uint32 offset : stripOffsets)
+    w.u32(offset);
+  out.insert(out.end(), strips.begin(), strips.end());
+  out.insert(out.end(), corrections.begin(), corrections.end());
+  return out;
+}
+
+ushort16& at(std::vector<ushort16>* img, int col, int row) {
+  return (*img)[row * width + col];
+}
+
+bool isGreen(int col, int row) { return (col + row) % 2 == 1; }
+
+// The corrections, as they were originally done: sequentially, one by one,
+// in the order of the entries.
+void correctBadColumn(std::vector<ushort16>* img, int col) {
+  for (int row = 2; row < height - 2; row++) {
+    if (isGreen(col, row)) {
+      std::array<int, 4> val = {at(img, col - 1, row - 1),
+                                at(img, col - 1, row + 1),
+                                at(img, col + 1, row - 1),
+                                at(img, col + 1, row + 1)};
+      const int sum = val[0] + val[1] + val[2] + val[3];
+      int max = 0;
+      for (int i = 0; i < 4; i++) {
+        if (std::abs(val[max] * 4 - sum) < std::abs(val[i] * 4 - sum))
+          max = i;
+      }
+      at(img, col, row) = (sum - val[max] + 1) / 3;
+    } else {
+      const uint32 diags = at(img, col - 2, row + 2) +
+                           at(img, col - 2, row - 2) +
+                           at(img, col + 2, row + 2) +
+                           at(img, col + 2, row - 2);
+      const uint32 horiz = at(img, col - 2, row) + at(img, col + 2, row);
+      at(img, col, row) = std::lround(diags * 0.0732233 + horiz * 0.3535534);
+    }
+  }
+}
+
+void applyMultipliers(std::vector<ushort16>* img, const Image& params) {
+  for (int quadrant = 0; quadrant < 4; quadrant++) {
+    std::vector<iPoint2D> points = {{0, 0}};
+    for (int i = 0; i < 7; i++) {
+      points.emplace_back(xCoords[i],
+                          params.multipliers[quadrant][i] * xCoords[i] / 10000);
+    }
+    points.emplace_back(65535, 65535);
+    const std::vector<ushort16> curve = Spline<>(points).calculateCurve();
+
+    const int quadRow = quadrant / 2;
+    const int quadCol = quadrant % 2;
+    for (int row = quadRow ? splitRow : 0; row < (quadRow ? height : splitRow);
+         row++) {
+      for (int col = quadCol ? splitCol : 0;
+           col < (quadCol ? width : splitCol); col++) {
+        ushort16& pixel = at(img, col, row);
+        const ushort16 diff = std::min<uint32>(pixel, params.blackLevel);
+        pixel = curve[pixel - diff] + diff;
+      }
+    }
+  }
+}
+
+std::vector<ushort16> correctReference(const Image& params) {
+  std::vector<ushort16> img = params.pixels;
+  if (!params.defectsFirst)
+    applyMultipliers(&img, params);
+  for (const Defect& d : params.defects) {
+    if (d.type == 131 && d.col < width)
+      correctBadColumn(&img, d.col);
+  }
+  if (params.defectsFirst)
+    applyMultipliers(&img, params);
+  return img;
+}
+
+RawImage decode(const std::vector<uchar8>& iiq, bool quadrantMultipliers) {
+  const Buffer buf(iiq.data(), iiq.size());
+  IiqDecoder decoder(nullptr, &buf);
+  decoder.iiq.quadrantMultipliers = quadrantMultipliers;
+  decoder.mRaw->cfa.setCFA(iPoint2D(2, 2), CFA_RED, CFA_GREEN, CFA_GREEN,
+                           CFA_BLUE);
+  return decoder.decodeRawInternal();
+}
+
+} // namespace
+
+// bad columns, black level, defects first
+using IiqDecoderParam = std::tuple<std::vector<ushort16>, uint32, bool>;
+
+class IiqDecoderTest : public ::testing::TestWithParam<IiqDecoderParam> {};
+INSTANTIATE_TEST_CASE_P(
+    All, IiqDecoderTest,
+    ::testing::Combine(
+        ::testing::Values(std::vector<ushort16>{},
+                          std::vector<ushort16>{10},
+                          std::vector<ushort16>{40, 10, 12, 36, 61}),
+        ::testing::Values(0, 300), ::testing::Bool()));
+
+TEST_P(IiqDecoderTest, CorrectionsMatchReference) {
+  const Image params =
+      genImage(std::get<1>(GetParam()) + std::get<2>(GetParam()),
+               std::get<1>(GetParam()), std::get<0>(GetParam()),
+               std::get<2>(GetParam()));
+  const std::vector<uchar8> iiq = genIiq(params);
+
+  // Without the corrections, that is just what was encoded.
+  {
+    const RawImage mRaw = decode(iiq, false);
+    for (int row = 0; row < height; row++) {
+      const auto* p = reinterpret_cast<const ushort16*>(mRaw->getData(0, row));
+      for (int col = 0; col < width; col++)
+        ASSERT_EQ(p[col], params.pixels[row * width + col])
+            << col << ", " << row;
+    }
+  }
+
+  const std::vector<ushort16> reference = correctReference(params);
+  const RawImage mRaw = decode(iiq, true);
+  for (int row = 0; row < height; row++) {
+    const auto* p = reinterpret_cast<const ushort16*>(mRaw->getData(0, row));
+    for (int col = 0; col < width; col++)
+      ASSERT_EQ(p[col], reference[row * width + col]) << col << ", " << row;
+  }
+  ASSERT_EQ(mRaw->mBadPixelPositions.size(), 1);
+  ASSERT_EQ(mRaw->mBadPixelPositions[0], (5U << 16) | 3U);
+}
+
+} // namespace rawspeed_test
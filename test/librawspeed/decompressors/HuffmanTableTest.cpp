@@ -27,6 +27,7 @@
 #include <array>                        // for array
 #include <gtest/gtest.h>                // for Test, Message, TestPartResult
 #include <initializer_list>             // for initializer_list<>::const_it...
+#include <random>                       // for minstd_rand
 #include <utility>                      // for move
 #include <vector>                       // for vector
 
@@ -130,4 +131,68 @@ TEST(HuffmanTableTest, DecodeNextBadCodeTest) {
   ASSERT_THROW(ht.decodeNext(p), rawspeed::RawDecoderException);
 }
 
+TEST(HuffmanTableTest, LookupDepthIsChosenPerTable) {
+  auto ht = genHTFull({2}, {4, 8});
+
+  ht.setup(false, false);
+  ASSERT_EQ(ht.getLookupDepth(), 1);
+
+  ht.setup(true, false);
+  ASSERT_EQ(ht.getLookupDepth(), 1 + 8);
+
+  // The 16-bit difference has no difference bits.
+  ht = genHTFull({2}, {4, 16});
+  ht.setup(true, false);
+  ASSERT_EQ(ht.getLookupDepth(), 1 + 4);
+
+  // Too long for the table to fit all the codes.
+  ht = genHTFull({1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1}, {0, 1});
+  ht.setup(false, false);
+  ASSERT_EQ(ht.getLookupDepth(), 11);
+
+  ht.setup(false, false, 15);
+  ASSERT_EQ(ht.getLookupDepth(), 15);
+  ASSERT_THROW(ht.setup(false, false, 16), rawspeed::RawDecoderException);
+}
+
+TEST(HuffmanTableTest, AllLookupDepthsDecodeTheSame) {
+  // A complete code (Nikon's 14-bit lossless one), so any bits are valid.
+  const auto genTable = []() {
+    return genHTFull({0, 1, 4, 2, 2, 3, 1, 2},
+                     {7, 6, 8, 5, 9, 4, 10, 3, 11, 12, 2, 0, 1, 13, 14});
+  };
+
+  std::vector<uchar8> data(4096);
+  std::minstd_rand gen(0);
+  for (auto& byte : data)
+    byte = gen();
+  const Buffer b(data.data(), data.size());
+  const DataBuffer db(b, Endianness::little);
+  const ByteStream bs(db);
+
+  for (const bool fullDecode : {false, true}) {
+    auto reference = genTable();
+    reference.setup(fullDecode, false);
+    BitPumpMSB referencePump(bs);
+
+    std::vector<rawspeed::HuffmanTableLUT> tables;
+    std::vector<BitPumpMSB> pumps;
+    for (unsigned depth = 1; depth <= 15; depth++) {
+      tables.emplace_back(genTable());
+      tables.back().setup(fullDecode, false, depth);
+      pumps.emplace_back(bs);
+    }
+
+    for (int i = 0; i < 1000; i++) {
+      const int expected = fullDecode ? reference.decodeNext(referencePump)
+                                      : reference.decodeLength(referencePump);
+      for (size_t t = 0; t < tables.size(); t++) {
+        ASSERT_EQ(fullDecode ? tables[t].decodeNext(pumps[t])
+                             : tables[t].decodeLength(pumps[t]),
+                  expected);
+      }
+    }
+  }
+}
+
 } // namespace rawspeed_test
@@ -0,0 +1,144 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "decompressors/NikonDecompressor.h" // for NikonDecompressor
+#include "common/Common.h"                   // for uchar8, ushort16
+#include "common/Point.h"                    // for iPoint2D
+#include "common/RawImage.h"                 // for RawImage, RawImageData
+#include "encoders/BitPumpWriter.h"          // for BitPumpMSBWriter
+#include "io/Buffer.h"                       // for Buffer, DataBuffer
+#include "io/ByteStream.h"                   // for ByteStream
+#include "io/Endianness.h"                   // for Endianness
+#include <array>                             // for array
+#include <gtest/gtest.h>                     // for Test, ASSERT_EQ, TEST_P
+#include <vector>                            // for vector
+
+using rawspeed::BitPumpMSBWriter;
+using rawspeed::Buffer;
+using rawspeed::ByteStream;
+using rawspeed::DataBuffer;
+using rawspeed::Endianness;
+using rawspeed::iPoint2D;
+using rawspeed::NikonDecompressor;
+using rawspeed::RawImage;
+using rawspeed::uchar8;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+namespace {
+
+// The initial predictors, {pUp1[0], pUp1[1], pUp2[0], pUp2[1]}. With all the
+// differences being zero, those are the raw codes of the four CFA positions.
+constexpr std::array<ushort16, 4> predictors = {{100, 1000, 2050, 3001}};
+
+// Steps of 16, so that the values around each of the predictors are the same,
+// and dithering does not change the result.
+ushort16 curveAt(int i) { return 4000 - 8 * (i / 16); }
+
+void putU16(std::vector<uchar8>* out, int v) {
+  out->push_back(v >> 8);
+  out->push_back(v & 0xFF);
+}
+
+// Neither a lossless nor a split NEF: version bytes, the predictors, and the
+// explicit 12-bit curve.
+std::vector<uchar8> genMetadata() {
+  std::vector<uchar8> metadata = {0, 0};
+  for (const auto p : predictors)
+    putU16(&metadata, p);
+  putU16(&metadata, 1 << 12);
+  for (int i = 0; i < (1 << 12); i++)
+    putU16(&metadata, curveAt(i));
+  return metadata;
+}
+
+// All the differences are zero. In the 12-bit lossy table, the code of the
+// zero difference length is 11110.
+std::vector<uchar8> genInput(const iPoint2D& dim) {
+  std::vector<uchar8> input;
+  BitPumpMSBWriter bits(&input);
+  for (unsigned i = 0; i < dim.area(); i++)
+    bits.put(0x1E, 5);
+  bits.flush();
+  input.resize(input.size() + 8);
+  return input;
+}
+
+} // namespace
+
+class NikonDecompressorTest : public ::testing::TestWithParam<bool> {};
+INSTANTIATE_TEST_CASE_P(DeferCurves, NikonDecompressorTest,
+                        ::testing::Bool());
+
+TEST_P(NikonDecompressorTest, AppliesCurve) {
+  const iPoint2D dim(64, 6);
+  const std::vector<uchar8> metadata = genMetadata();
+  const std::vector<uchar8> input = genInput(dim);
+
+  RawImage mRaw = RawImage::create(dim);
+  mRaw->deferCurves = GetParam();
+
+  NikonDecompressor n(
+      mRaw,
+      ByteStream(DataBuffer(Buffer(metadata.data(), metadata.size()),
+                            Endianness::big)),
+      12);
+  n.decompress(ByteStream(DataBuffer(Buffer(input.data(), input.size()),
+                                     Endianness::big)),
+               /*uncorrectedRawValues=*/false);
+  ASSERT_EQ(mRaw->getTable(), nullptr);
+
+  for (int y = 0; y < dim.y; y++) {
+    const auto* row = reinterpret_cast<const ushort16*>(mRaw->getData(0, y));
+    for (int x = 0; x < dim.x; x++) {
+      const int code = predictors[2 * (x & 1) + (y & 1)];
+      ASSERT_EQ(row[x], curveAt(code)) << x << ", " << y;
+    }
+  }
+}
+
+TEST(NikonDecompressorTest, UncorrectedRawValues) {
+  const iPoint2D dim(64, 6);
+  const std::vector<uchar8> metadata = genMetadata();
+  const std::vector<uchar8> input = genInput(dim);
+
+  RawImage mRaw = RawImage::create(dim);
+  mRaw->deferCurves = true;
+
+  NikonDecompressor n(
+      mRaw,
+      ByteStream(DataBuffer(Buffer(metadata.data(), metadata.size()),
+                            Endianness::big)),
+      12);
+  n.decompress(ByteStream(DataBuffer(Buffer(input.data(), input.size()),
+                                     Endianness::big)),
+               /*uncorrectedRawValues=*/true);
+  // The curve is left for the application to apply.
+  ASSERT_NE(mRaw->getTable(), nullptr);
+
+  for (int y = 0; y < dim.y; y++) {
+    const auto* row = reinterpret_cast<const ushort16*>(mRaw->getData(0, y));
+    for (int x = 0; x < dim.x; x++)
+      ASSERT_EQ(row[x], predictors[2 * (x & 1) + (y & 1)]) << x << ", " << y;
+  }
+}
+
+} // namespace rawspeed_test
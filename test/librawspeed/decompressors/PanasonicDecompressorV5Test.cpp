@@ -0,0 +1,138 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "decompressors/PanasonicDecompressorV5.h" // for PanasonicDecompres...
+#include "common/Common.h"                         // for uchar8, ushort16
+#include "common/Point.h"                          // for iPoint2D
+#include "common/RawImage.h"                       // for RawImage, RawImag...
+#include "common/RawspeedException.h"              // for RawspeedException
+#include "io/Buffer.h"                             // for Buffer, DataBuffer
+#include "io/ByteStream.h"                         // for ByteStream
+#include "io/Endianness.h"                         // for Endianness
+#include <gtest/gtest.h>                           // for Test, ASSERT_EQ
+#include <random>                                  // for minstd_rand
+#include <tuple>                                   // for tuple, get
+#include <vector>                                  // for vector
+
+using rawspeed::Buffer;
+using rawspeed::ByteStream;
+using rawspeed::DataBuffer;
+using rawspeed::Endianness;
+using rawspeed::iPoint2D;
+using rawspeed::PanasonicDecompressorV5;
+using rawspeed::RawImage;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+namespace {
+
+constexpr int BlockSize = 0x4000;
+constexpr int SectionSplitOffset = 0x1FF8;
+
+std::vector<uchar8> genInput(int numBlocks, unsigned seed) {
+  std::minstd_rand gen(seed);
+  std::vector<uchar8> input(numBlocks * BlockSize);
+  for (auto& byte : input)
+    byte = gen();
+  return input;
+}
+
+// Straight from the description of the format: the two sections of each block
+// are swapped, and then the block is read as a LSB-first bit stream, with each
+// 16-byte packet holding as many bps-bit pixels as fit, and then padding.
+std::vector<ushort16> decodeReference(const std::vector<uchar8>& input,
+                                      int numPixels, int bps) {
+  const int pixelsPerPacket = 128 / bps;
+
+  std::vector<ushort16> out;
+  for (size_t block = 0; block < input.size(); block += BlockSize) {
+    std::vector<uchar8> swapped(&input[block + SectionSplitOffset],
+                                &input[block + BlockSize]);
+    swapped.insert(swapped.end(), &input[block],
+                   &input[block + SectionSplitOffset]);
+
+    for (int packet = 0; packet < BlockSize; packet += 16) {
+      for (int p = 0; p < pixelsPerPacket; p++) {
+        ushort16 v = 0;
+        for (int i = 0; i < bps; i++) {
+          const int pos = 8 * packet + p * bps + i;
+          v |= ((swapped[pos / 8] >> (pos % 8)) & 1U) << i;
+        }
+        out.push_back(v);
+      }
+    }
+  }
+  out.resize(numPixels);
+  return out;
+}
+
+} // namespace
+
+// bps, packets per row, height
+using PanasonicDecompressorV5Param = std::tuple<int, int, int>;
+
+class PanasonicDecompressorV5Test
+    : public ::testing::TestWithParam<PanasonicDecompressorV5Param> {};
+INSTANTIATE_TEST_CASE_P(
+    All, PanasonicDecompressorV5Test,
+    ::testing::Combine(::testing::Values(12, 14),
+                       ::testing::Values(1, 3, 37, 514, 1024),
+                       ::testing::Values(1, 5, 40)));
+
+TEST_P(PanasonicDecompressorV5Test, MatchesReference) {
+  const int bps = std::get<0>(GetParam());
+  const int pixelsPerPacket = 128 / bps;
+  const iPoint2D dim(std::get<1>(GetParam()) * pixelsPerPacket,
+                     std::get<2>(GetParam()));
+
+  const int numPackets = dim.area() / pixelsPerPacket;
+  const int numBlocks = (numPackets + BlockSize / 16 - 1) / (BlockSize / 16);
+  const std::vector<uchar8> input = genInput(numBlocks, dim.area() + bps);
+  const ByteStream bs(
+      DataBuffer(Buffer(input.data(), input.size()), Endianness::little));
+
+  RawImage mRaw = RawImage::create(dim);
+  PanasonicDecompressorV5 d(mRaw, bs, bps);
+  d.decompress();
+
+  const std::vector<ushort16> reference =
+      decodeReference(input, dim.area(), bps);
+  for (int y = 0; y < dim.y; y++) {
+    const auto* row = reinterpret_cast<const ushort16*>(mRaw->getData(0, y));
+    for (int x = 0; x < dim.x; x++)
+      ASSERT_EQ(row[x], reference[y * dim.x + x]) << x << ", " << y;
+  }
+}
+
+TEST(PanasonicDecompressorV5Test, NotEnoughBlocks) {
+  const iPoint2D dim(10 * 1024, 2);
+  const std::vector<uchar8> input = genInput(1, 0);
+  const ByteStream bs(
+      DataBuffer(Buffer(input.data(), input.size()), Endianness::little));
+  RawImage mRaw = RawImage::create(dim);
+  ASSERT_THROW(PanasonicDecompressorV5(mRaw, bs, 12),
+               rawspeed::RawspeedException);
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,223 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2018 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "decompressors/SamsungV0Decompressor.h" // for SamsungV0Decompressor
+#include "common/Common.h"                       // for uint32, ushort16
+#include "common/Point.h"                        // for iPoint2D
+#include "common/RawImage.h"                     // for RawImage, RawImageData
+#include "common/TaskScheduler.h"                // for Parallelism, ThreadPool
+#include "decoders/RawDecoderException.h"        // for RawDecoderException
+#include "io/Buffer.h"                           // for Buffer, DataBuffer
+#include "io/ByteStream.h"                       // for ByteStream
+#include "io/Endianness.h"                       // for Endianness, Endiann...
+#include <gtest/gtest.h>                         // for Test, ASSERT_EQ, TEST_P
+#include <memory>                                // for make_shared
+#include <random>                                // for minstd_rand
+#include <tuple>                                 // for tuple, get
+#include <utility>                               // for swap
+#include <vector>                                // for vector
+
+using rawspeed::Buffer;
+using rawspeed::ByteStream;
+using rawspeed::DataBuffer;
+using rawspeed::Endianness;
+using rawspeed::iPoint2D;
+using rawspeed::Parallelism;
+using rawspeed::RawImage;
+using rawspeed::SamsungV0Decompressor;
+using rawspeed::ThreadPool;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+namespace {
+
+// Writes bits in the order in which BitPumpMSB32 reads them.
+class BitWriterMSB32 final {
+  std::vector<uchar8>* out;
+  uint32 cache = 0;
+  int fill = 0;
+
+public:
+  explicit BitWriterMSB32(std::vector<uchar8>* out_) : out(out_) {}
+
+  void put(uint32 bits, int count) {
+    for (int i = count - 1; i >= 0; --i) {
+      cache = (cache << 1) | ((bits >> i) & 1);
+      if (++fill == 32)
+        flush();
+    }
+  }
+
+  void flush() {
+    if (fill == 0)
+      return;
+    cache <<= 32 - fill;
+    for (int i = 0; i < 4; ++i)
+      out->push_back(static_cast<uchar8>(cache >> (8 * i)));
+    cache = 0;
+    fill = 0;
+  }
+};
+
+// A random, but valid, SamsungV0 image: its encoding, and the expected result.
+struct Sample final {
+  int width;
+  int height;
+  std::vector<uchar8> offsets; // One little-endian uint32 per row.
+  std::vector<uchar8> data;
+  std::vector<ushort16> expected;
+
+  Sample(int width_, int height_, unsigned seed)
+      : width(width_), height(height_), expected(width * height) {
+    std::minstd_rand gen(seed);
+
+    for (int y = 0; y < height; ++y) {
+      const auto offset = static_cast<uint32>(data.size());
+      for (int i = 0; i < 4; ++i)
+        offsets.push_back(static_cast<uchar8>(offset >> (8 * i)));
+      encodeRow(y, &gen);
+    }
+
+    // Swap red and blue pixels, like the decompressor does.
+    for (int y = 0; y + 1 < height; y += 2) {
+      for (int x = 0; x + 1 < width; x += 2)
+        std::swap(at(x + 1, y), at(x, y + 1));
+    }
+  }
+
+  ushort16& at(int x, int y) { return expected[y * width + x]; }
+
+  void encodeRow(int y, std::minstd_rand* gen) {
+    BitWriterMSB32 bits(&data);
+
+    std::vector<int> len(4, y < 2 ? 7 : 4);
+    for (int x = 0; x < width; x += 16) {
+      const bool up = y >= 2 && x + 16 < width && (*gen)() % 2;
+      bits.put(up, 1);
+
+      std::vector<bool> newLen(4);
+      for (int i = 0; i < 4; ++i) {
+        newLen[i] = (*gen)() % 2;
+        bits.put(newLen[i] ? 3 : 0, 2);
+      }
+      for (int i = 0; i < 4; ++i) {
+        if (!newLen[i])
+          continue;
+        len[i] = (*gen)() % 16;
+        bits.put(len[i], 4);
+      }
+
+      for (int parity = 0; parity < 2; ++parity) {
+        const int predLeft =
+            x != 0 ? at(x - 2 + parity, y) : 128; // before the block's pixels
+        for (int c = parity; c < 16; c += 2) {
+          const int b = len[2 * parity | (c >> 3)];
+          const uint32 raw = b ? (*gen)() & ((1U << b) - 1) : 0;
+          bits.put(raw, b);
+
+          // Sign-extend the b-bit value.
+          const int adj = b ? static_cast<int>(raw << (32 - b)) >> (32 - b) : 0;
+          const int pred = up ? at(x + c, y - 1 - parity) : predLeft;
+          if (x + c < width)
+            at(x + c, y) = static_cast<ushort16>(adj + pred);
+        }
+      }
+    }
+
+    bits.flush();
+    // Some padding, so that the row's stream is never empty.
+    for (int i = 0; i < 4; ++i)
+      data.push_back(0);
+  }
+};
+
+} // namespace
+
+// width, height, threads
+using SamsungV0Param = std::tuple<int, int, int>;
+
+class SamsungV0DecompressorTest
+    : public ::testing::TestWithParam<SamsungV0Param> {
+protected:
+  int width = std::get<0>(GetParam());
+  int height = std::get<1>(GetParam());
+  int threads = std::get<2>(GetParam());
+};
+INSTANTIATE_TEST_CASE_P(
+    Wavefront, SamsungV0DecompressorTest,
+    ::testing::Combine(::testing::Values(16, 37, 160),
+                       ::testing::Values(1, 2, 5, 64),
+                       ::testing::Values(1, 2, 3, 8)));
+
+TEST_P(SamsungV0DecompressorTest, DecodesLikeSerialReference) {
+  auto pool = std::make_shared<ThreadPool>(threads);
+
+  for (unsigned seed = 0; seed < 4; ++seed) {
+    const Sample sample(width, height, seed);
+
+    const DataBuffer bso(Buffer(sample.offsets.data(), sample.offsets.size()),
+                         Endianness::little);
+    const DataBuffer bsr(Buffer(sample.data.data(), sample.data.size()),
+                         Endianness::little);
+
+    RawImage mRaw = RawImage::create(iPoint2D(width, height));
+    mRaw->parallelism = Parallelism(threads, pool);
+
+    SamsungV0Decompressor d(mRaw, ByteStream(bso), ByteStream(bsr));
+    d.decompress();
+
+    for (int y = 0; y < height; ++y) {
+      const auto* row = reinterpret_cast<const ushort16*>(mRaw->getData(0, y));
+      for (int x = 0; x < width; ++x)
+        ASSERT_EQ(row[x], sample.expected[y * width + x]) << x << ", " << y;
+    }
+  }
+}
+
+TEST_P(SamsungV0DecompressorTest, CorruptRowFails) {
+  if (height < 2)
+    return;
+
+  auto pool = std::make_shared<ThreadPool>(threads);
+  Sample sample(width, height, 0);
+
+  // Make the first block of the second row predict upwards, which it can not.
+  const uint32 offset = sample.offsets[4] | sample.offsets[5] << 8 |
+                        sample.offsets[6] << 16 | sample.offsets[7] << 24;
+  sample.data[offset + 3] |= 0x80;
+
+  const DataBuffer bso(Buffer(sample.offsets.data(), sample.offsets.size()),
+                       Endianness::little);
+  const DataBuffer bsr(Buffer(sample.data.data(), sample.data.size()),
+                       Endianness::little);
+
+  RawImage mRaw = RawImage::create(iPoint2D(width, height));
+  mRaw->parallelism = Parallelism(threads, pool);
+
+  SamsungV0Decompressor d(mRaw, ByteStream(bso), ByteStream(bsr));
+  // The rows below must not wait for it forever.
+  ASSERT_THROW(d.decompress(), rawspeed::RawDecoderException);
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,191 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "decompressors/SonyArw2Decompressor.h" // for SonyArw2Decompressor
+#include "common/Common.h"                      // for uchar8, ushort16
+#include "common/Point.h"                       // for iPoint2D
+#include "common/RawImage.h"                    // for RawImage, RawImageData
+#include "common/RawspeedException.h"           // for RawspeedException
+#include "io/Buffer.h"                          // for Buffer, DataBuffer
+#include "io/ByteStream.h"                      // for ByteStream
+#include "io/Endianness.h"                      // for Endianness
+#include <algorithm>                            // for min
+#include <gtest/gtest.h>                        // for Test, ASSERT_EQ, TEST_P
+#include <random>                               // for minstd_rand
+#include <tuple>                                // for tuple, get
+#include <vector>                               // for vector
+
+using rawspeed::Buffer;
+using rawspeed::ByteStream;
+using rawspeed::DataBuffer;
+using rawspeed::Endianness;
+using rawspeed::iPoint2D;
+using rawspeed::RawImage;
+using rawspeed::SonyArw2Decompressor;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+namespace {
+
+// Random blocks, that are all valid, i.e. their min and max pixels differ.
+std::vector<uchar8> genInput(const iPoint2D& dim, unsigned seed) {
+  std::minstd_rand gen(seed);
+  std::vector<uchar8> input(dim.area());
+  for (auto& byte : input)
+    byte = gen();
+
+  for (size_t block = 0; block < input.size(); block += 16) {
+    const int imax = gen() % 16;
+    const int imin = (imax + 1 + gen() % 15) % 16;
+    // Bits 22..25 and 26..29.
+    input[block + 2] = (input[block + 2] & 0x3f) | (imax & 3) << 6;
+    input[block + 3] = (input[block + 3] & 0xc0) | imax >> 2 | imin << 2;
+  }
+  return input;
+}
+
+uint32 getBits(const uchar8* block, int pos, int count) {
+  uint32 v = 0;
+  for (int i = 0; i < count; i++)
+    v |= ((block[(pos + i) / 8] >> ((pos + i) % 8)) & 1U) << i;
+  return v;
+}
+
+// The pixel values before the curve, straight from the description of the
+// format: 11-bit max, 11-bit min, their 4-bit indexes, and 14 7-bit deltas.
+// Each 16-byte block is 16 pixels of one parity of the 32 pixels.
+std::vector<ushort16> decodeReference(const std::vector<uchar8>& input,
+                                      const iPoint2D& dim) {
+  std::vector<ushort16> out(dim.area());
+  for (int y = 0; y < dim.y; y++) {
+    for (int x = 0; x < dim.x; x += 16) {
+      const uchar8* block = &input[y * dim.x + x];
+      const int max = getBits(block, 0, 11);
+      const int min = getBits(block, 11, 11);
+      const int imax = getBits(block, 22, 4);
+      const int imin = getBits(block, 26, 4);
+
+      int sh = 0;
+      while (sh < 4 && (0x80 << sh) <= max - min)
+        sh++;
+
+      int pos = 30;
+      for (int i = 0; i < 16; i++) {
+        int p;
+        if (i == imax)
+          p = max;
+        else if (i == imin)
+          p = min;
+        else {
+          p = std::min(0x7ff, (int(getBits(block, pos, 7)) << sh) + min);
+          pos += 7;
+        }
+        const int first = x & ~31;
+        const int parity = (x / 16) & 1;
+        out[y * dim.x + first + 2 * i + parity] = p << 1;
+      }
+    }
+  }
+  return out;
+}
+
+enum class Curve { None, Plain, Dithered };
+
+} // namespace
+
+// width, height, curve
+using SonyArw2DecompressorParam = std::tuple<int, int, Curve>;
+
+class SonyArw2DecompressorTest
+    : public ::testing::TestWithParam<SonyArw2DecompressorParam> {};
+INSTANTIATE_TEST_CASE_P(
+    All, SonyArw2DecompressorTest,
+    ::testing::Combine(::testing::Values(32, 64, 320), ::testing::Values(1, 7),
+                       ::testing::Values(Curve::None, Curve::Plain,
+                                         Curve::Dithered)));
+
+TEST_P(SonyArw2DecompressorTest, MatchesReference) {
+  const iPoint2D dim(std::get<0>(GetParam()), std::get<1>(GetParam()));
+  const Curve curveType = std::get<2>(GetParam());
+
+  const std::vector<uchar8> input = genInput(dim, dim.area());
+  const ByteStream bs(
+      DataBuffer(Buffer(input.data(), input.size()), Endianness::little));
+
+  // Something like the Sony curve: linear, then coarser.
+  std::vector<ushort16> curve(0x1000);
+  for (size_t i = 0; i < curve.size(); i++)
+    curve[i] = i < 0x400 ? i : 0x400 + (i - 0x400) * 3;
+
+  RawImage mRaw = RawImage::create(dim);
+  RawImage reference = RawImage::create(dim);
+  if (curveType != Curve::None) {
+    mRaw->setTable(curve, curveType == Curve::Dithered);
+    reference->setTable(curve, curveType == Curve::Dithered);
+  }
+
+  SonyArw2Decompressor d(mRaw, bs);
+  d.decompress();
+
+  // The curve, and the dithering, as the decompressor is to apply it.
+  const std::vector<ushort16> raw = decodeReference(input, dim);
+  for (int y = 0; y < dim.y; y++) {
+    const uchar8* row = &input[y * dim.x];
+    uint32 random = row[0] | row[1] << 8 | row[2] << 16;
+    // The pixels are dithered in the order they are decoded in.
+    for (int x = 0; x < dim.x; x += 16) {
+      const int first = x & ~31;
+      const int parity = (x / 16) & 1;
+      for (int i = 0; i < 16; i++) {
+        const int col = first + 2 * i + parity;
+        reference->setWithLookUp(raw[y * dim.x + col],
+                                 reference->getData(col, y), &random);
+      }
+    }
+  }
+
+  for (int y = 0; y < dim.y; y++) {
+    const auto* a = reinterpret_cast<const ushort16*>(mRaw->getData(0, y));
+    const auto* b = reinterpret_cast<const ushort16*>(reference->getData(0, y));
+    for (int x = 0; x < dim.x; x++)
+      ASSERT_EQ(a[x], b[x]) << x << ", " << y;
+  }
+}
+
+TEST(SonyArw2DecompressorTest, SamePixelIsMinAndMax) {
+  const iPoint2D dim(64, 4);
+  std::vector<uchar8> input = genInput(dim, 0);
+  // The last block of the third row.
+  uchar8* block = &input[2 * dim.x + 48];
+  block[2] = block[2] & 0x3f;
+  block[3] = block[3] & 0xc0;
+
+  const ByteStream bs(
+      DataBuffer(Buffer(input.data(), input.size()), Endianness::little));
+  RawImage mRaw = RawImage::create(dim);
+  SonyArw2Decompressor d(mRaw, bs);
+  ASSERT_THROW(d.decompress(), rawspeed::RawspeedException);
+}
+
+} // namespace rawspeed_test
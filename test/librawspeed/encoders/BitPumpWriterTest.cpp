@@ -0,0 +1,99 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "encoders/BitPumpWriter.h" // for BitPumpWriter
+#include "common/Common.h"          // for uchar8, uint32
+#include "io/BitPumpJPEG.h"         // for BitPumpJPEG
+#include "io/BitPumpLSB.h"          // for BitPumpLSB
+#include "io/BitPumpMSB.h"          // for BitPumpMSB
+#include "io/BitPumpMSB16.h"        // for BitPumpMSB16
+#include "io/BitPumpMSB32.h"        // for BitPumpMSB32
+#include "io/Buffer.h"              // for Buffer, DataBuffer
+#include "io/ByteStream.h"          // for ByteStream
+#include "io/Endianness.h"          // for Endianness, Endianness::unknown
+#include <gtest/gtest.h>            // for Test, ASSERT_EQ, TYPED_TEST
+#include <random>                   // for minstd_rand
+#include <utility>                  // for pair
+#include <vector>                   // for vector
+
+using rawspeed::BitPumpJPEG;
+using rawspeed::BitPumpLSB;
+using rawspeed::BitPumpMSB;
+using rawspeed::BitPumpMSB16;
+using rawspeed::BitPumpMSB32;
+using rawspeed::Buffer;
+using rawspeed::ByteStream;
+using rawspeed::DataBuffer;
+using rawspeed::Endianness;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+
+namespace rawspeed_test {
+
+template <typename Pump, typename Tag> struct PumpAndWriter {
+  using BitPump = Pump;
+  using Writer = rawspeed::BitPumpWriter<Tag>;
+};
+
+template <typename T> class BitPumpWriterTest : public ::testing::Test {};
+
+using Pumps = ::testing::Types<
+    PumpAndWriter<BitPumpJPEG, rawspeed::JPEGBitPumpTag>,
+    PumpAndWriter<BitPumpLSB, rawspeed::LSBBitPumpTag>,
+    PumpAndWriter<BitPumpMSB, rawspeed::MSBBitPumpTag>,
+    PumpAndWriter<BitPumpMSB16, rawspeed::MSB16BitPumpTag>,
+    PumpAndWriter<BitPumpMSB32, rawspeed::MSB32BitPumpTag>>;
+TYPED_TEST_CASE(BitPumpWriterTest, Pumps);
+
+TYPED_TEST(BitPumpWriterTest, ReadsBackWhatWasWritten) {
+  std::minstd_rand gen(42);
+
+  for (int round = 0; round < 100; ++round) {
+    // Random values of random widths, including the all-ones ones, that would
+    // need to be stuffed for JPEG.
+    std::vector<std::pair<uint32, int>> values;
+    for (int i = 0; i < 1000; ++i) {
+      const int nbits = gen() % 32;
+      uint32 value = gen() & ((1U << nbits) - 1);
+      if (gen() % 4 == 0)
+        value = (1U << nbits) - 1;
+      values.emplace_back(value, nbits);
+    }
+
+    std::vector<uchar8> data;
+    {
+      typename TypeParam::Writer writer(&data);
+      for (const auto& v : values)
+        writer.put(v.first, v.second);
+      writer.flush();
+      ASSERT_EQ(writer.getPartialBits(), 0);
+    }
+
+    const DataBuffer db(Buffer(data.data(), data.size()), Endianness::unknown);
+    typename TypeParam::BitPump pump((ByteStream(db)));
+    for (const auto& v : values) {
+      const uint32 got = v.second ? pump.getBits(v.second) : 0;
+      ASSERT_EQ(got, v.first) << v.second << " bits";
+    }
+  }
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,137 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "encoders/DngWriter.h"       // for DngWriter
+#include "common/Common.h"            // for ushort16, uchar8
+#include "common/Point.h"             // for iPoint2D
+#include "common/RawImage.h"          // for RawImage, RawImageData
+#include "common/RawspeedException.h" // for RawspeedException
+#include "decoders/RawDecoder.h"      // for RawDecoder
+#include "io/Buffer.h"                // for Buffer
+#include "metadata/CameraMetaData.h"  // for CameraMetaData
+#include "parsers/RawParser.h"        // for RawParser
+#include <gtest/gtest.h>              // for Test, ASSERT_EQ, TEST_P
+#include <memory>                     // for unique_ptr
+#include <random>                     // for minstd_rand
+#include <tuple>                      // for tuple, get
+#include <vector>                     // for vector
+
+using rawspeed::Buffer;
+using rawspeed::CameraMetaData;
+using rawspeed::DngWriter;
+using rawspeed::iPoint2D;
+using rawspeed::RawImage;
+using rawspeed::RawParser;
+using rawspeed::uchar8;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+namespace {
+
+RawImage genImage(const iPoint2D& dim, int bps) {
+  RawImage mRaw = RawImage::create(dim);
+  std::minstd_rand gen(42);
+  for (int y = 0; y < dim.y; ++y) {
+    auto* row = reinterpret_cast<ushort16*>(mRaw->getData(0, y));
+    for (int x = 0; x < dim.x; ++x)
+      row[x] = gen() & ((1 << bps) - 1);
+  }
+  return mRaw;
+}
+
+enum class Layout { SingleStrip, Strips, Tiles };
+
+} // namespace
+
+// compression, layout, bits per sample
+using DngWriterParam = std::tuple<DngWriter::Compression, Layout, int>;
+
+class DngWriterTest : public ::testing::TestWithParam<DngWriterParam> {
+protected:
+  DngWriter writer;
+
+  void SetUp() override {
+    writer.compression = std::get<0>(GetParam());
+    switch (std::get<1>(GetParam())) {
+    case Layout::SingleStrip:
+      break;
+    case Layout::Strips:
+      writer.rowsPerStrip = 16;
+      break;
+    case Layout::Tiles:
+      writer.tileWidth = 32;
+      writer.tileHeight = 48;
+      break;
+    }
+    writer.bitsPerSample = std::get<2>(GetParam());
+  }
+};
+INSTANTIATE_TEST_CASE_P(
+    All, DngWriterTest,
+    ::testing::Combine(::testing::Values(DngWriter::Compression::Uncompressed,
+                                         DngWriter::Compression::LJpeg),
+                       ::testing::Values(Layout::SingleStrip, Layout::Strips,
+                                         Layout::Tiles),
+                       ::testing::Values(8, 12, 16)));
+
+TEST_P(DngWriterTest, RoundTrip) {
+  // Odd sizes, so that the last strip is shorter, and the edge tiles are
+  // padded. The width is even though, and a multiple of 8, so that the rows
+  // of an uncompressed image are always a whole number of bytes.
+  const iPoint2D dim(2 * 8 * 9, 101);
+  const RawImage orig = genImage(dim, writer.bitsPerSample);
+
+  const std::vector<uchar8> dng = writer.write(orig);
+  const Buffer buf(dng.data(), dng.size());
+
+  const CameraMetaData meta;
+  RawParser parser(&buf);
+  const auto decoder = parser.getDecoder(&meta);
+  decoder->failOnUnknown = false;
+  decoder->checkSupport(&meta);
+  const RawImage decoded = decoder->decodeRaw();
+
+  ASSERT_EQ(decoded->dim, dim);
+  ASSERT_EQ(decoded->getCpp(), 1);
+  for (int y = 0; y < dim.y; ++y) {
+    const auto* a = reinterpret_cast<const ushort16*>(orig->getData(0, y));
+    const auto* b = reinterpret_cast<const ushort16*>(decoded->getData(0, y));
+    for (int x = 0; x < dim.x; ++x)
+      ASSERT_EQ(a[x], b[x]) << x << ", " << y;
+  }
+}
+
+TEST(DngWriterTest, BadImage) {
+  DngWriter writer;
+  RawImage mRaw = RawImage::create(iPoint2D(16, 16), rawspeed::TYPE_FLOAT32);
+  ASSERT_THROW(writer.write(mRaw), rawspeed::RawspeedException);
+}
+
+TEST(DngWriterTest, PartialBytesPerRow) {
+  DngWriter writer;
+  writer.compression = DngWriter::Compression::Uncompressed;
+  writer.bitsPerSample = 12;
+  ASSERT_THROW(writer.write(genImage(iPoint2D(3, 4), 12)),
+               rawspeed::RawspeedException);
+}
+
+} // namespace rawspeed_test
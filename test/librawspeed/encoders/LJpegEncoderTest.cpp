@@ -0,0 +1,234 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "encoders/LJpegEncoder.h"           // for LJpegEncoder
+#include "common/Common.h"                   // for ushort16, uchar8
+#include "common/Point.h"                    // for iPoint2D
+#include "common/RawImage.h"                 // for RawImage, RawImageData
+#include "common/RawspeedException.h"        // for RawspeedException
+#include "decompressors/Cr2Decompressor.h"   // for Cr2Decompressor
+#include "decompressors/HuffmanTable.h"      // for HuffmanTable
+#include "decompressors/LJpegDecompressor.h" // for LJpegDecompressor
+#include "io/BitPumpJPEG.h"                  // for BitPumpJPEG
+#include "io/Buffer.h"                       // for Buffer, DataBuffer
+#include "io/ByteStream.h"                   // for ByteStream
+#include "io/Endianness.h"                   // for Endianness
+#include <gtest/gtest.h>                     // for Test, ASSERT_EQ, TEST_P
+#include <random>                            // for minstd_rand
+#include <tuple>                             // for tuple, get
+#include <vector>                            // for vector
+
+using rawspeed::Buffer;
+using rawspeed::ByteStream;
+using rawspeed::DataBuffer;
+using rawspeed::Endianness;
+using rawspeed::iPoint2D;
+using rawspeed::LJpegEncoder;
+using rawspeed::RawImage;
+using rawspeed::uchar8;
+using rawspeed::ushort16;
+
+namespace rawspeed_test {
+
+namespace {
+
+// Random samples, with some flat areas and some full-range jumps.
+std::vector<ushort16> genSamples(int count, int precision, unsigned seed) {
+  std::minstd_rand gen(seed);
+  const int maxValue = (1 << precision) - 1;
+
+  std::vector<ushort16> samples(count);
+  for (auto& s : samples) {
+    switch (gen() % 4) {
+    case 0:
+      s = 0;
+      break;
+    case 1:
+      s = maxValue;
+      break;
+    default:
+      s = gen() & maxValue;
+      break;
+    }
+  }
+  return samples;
+}
+
+ByteStream getStream(const std::vector<uchar8>& data) {
+  return ByteStream(
+      DataBuffer(Buffer(data.data(), data.size()), Endianness::big));
+}
+
+// A straightforward decoder of what LJpegEncoder produces, for all the
+// predictors, including the ones the decompressors do not support.
+std::vector<ushort16> referenceDecode(const std::vector<uchar8>& data,
+                                      int width, int height, int components,
+                                      int precision, int predictor) {
+  ByteStream bs = getStream(data);
+  EXPECT_EQ(bs.getU16(), 0xFFD8);
+
+  rawspeed::HuffmanTable ht;
+  for (;;) {
+    const int marker = bs.getU16();
+    ByteStream segment = bs.getStream(bs.getU16() - 2);
+    if (marker == 0xFFC4) {
+      EXPECT_EQ(segment.getByte(), 0);
+      const auto nCodes = ht.setNCodesPerLength(segment.getBuffer(16));
+      ht.setCodeValues(segment.getBuffer(nCodes));
+      ht.setup(true, false);
+    } else if (marker == 0xFFDA)
+      break;
+  }
+
+  std::vector<ushort16> out(width * height * components);
+  rawspeed::BitPumpJPEG pump(bs);
+  const int pitch = width * components;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      for (int c = 0; c < components; ++c) {
+        const int i = y * pitch + x * components + c;
+        int pred;
+        if (x == 0 && y == 0)
+          pred = 1 << (precision - 1);
+        else if (y == 0)
+          pred = out[i - components];
+        else if (x == 0)
+          pred = out[i - pitch];
+        else {
+          const int Ra = out[i - components];
+          const int Rb = out[i - pitch];
+          const int Rc = out[i - pitch - components];
+          const int preds[] = {Ra,
+                               Rb,
+                               Rc,
+                               Ra + Rb - Rc,
+                               Ra + ((Rb - Rc) >> 1),
+                               Rb + ((Ra - Rc) >> 1),
+                               (Ra + Rb) >> 1};
+          pred = preds[predictor - 1];
+        }
+        out[i] = static_cast<ushort16>(pred + ht.decodeNext(pump));
+      }
+    }
+  }
+  return out;
+}
+
+} // namespace
+
+// precision, components, predictor
+using LJpegEncoderParam = std::tuple<int, int, int>;
+
+class LJpegEncoderTest : public ::testing::TestWithParam<LJpegEncoderParam> {
+protected:
+  int precision = std::get<0>(GetParam());
+  int components = std::get<1>(GetParam());
+  int predictor = std::get<2>(GetParam());
+
+  static constexpr int width = 36; // pixels, of `components` samples each
+  static constexpr int height = 17;
+
+  std::vector<ushort16> samples =
+      genSamples(width * height * components, precision, 1337);
+
+  std::vector<uchar8> encode() const {
+    LJpegEncoder encoder;
+    encoder.precision = precision;
+    encoder.predictor = predictor;
+
+    std::vector<uchar8> data;
+    encoder.encode(&data, samples.data(), width * components, width, height,
+                   components);
+    return data;
+  }
+
+  void check(const RawImage& mRaw) const {
+    for (int y = 0; y < height; ++y) {
+      const auto* row = reinterpret_cast<const ushort16*>(mRaw->getData(0, y));
+      for (int x = 0; x < width * components; ++x) {
+        ASSERT_EQ(row[x], samples[y * width * components + x])
+            << x << ", " << y;
+      }
+    }
+  }
+};
+INSTANTIATE_TEST_CASE_P(All, LJpegEncoderTest,
+                        ::testing::Combine(::testing::Values(2, 8, 12, 14, 16),
+                                           ::testing::Range(1, 5),
+                                           ::testing::Range(1, 8)));
+
+TEST_P(LJpegEncoderTest, ReferenceDecode) {
+  ASSERT_EQ(referenceDecode(encode(), width, height, components, precision,
+                            predictor),
+            samples);
+}
+
+TEST_P(LJpegEncoderTest, LJpegDecompressor) {
+  if (predictor != 1)
+    return;
+
+  const auto data = encode();
+  RawImage mRaw = RawImage::create(iPoint2D(width * components, height));
+  rawspeed::LJpegDecompressor d(getStream(data), mRaw);
+  d.decode(0, 0, mRaw->dim.x, mRaw->dim.y, false);
+  check(mRaw);
+}
+
+TEST_P(LJpegEncoderTest, Cr2Decompressor) {
+  if (predictor != 1 || (components != 2 && components != 4))
+    return;
+
+  const auto data = encode();
+  RawImage mRaw = RawImage::create(iPoint2D(width * components, height));
+  rawspeed::Cr2Decompressor d(getStream(data), mRaw);
+  d.decode(rawspeed::Cr2Slicing());
+  check(mRaw);
+}
+
+TEST(LJpegEncoderTest, BadParameters) {
+  const std::vector<ushort16> samples(16, 1);
+  std::vector<uchar8> data;
+
+  LJpegEncoder encoder;
+  encoder.precision = 1;
+  ASSERT_THROW(encoder.encode(&data, samples.data(), 4, 4, 4, 1),
+               rawspeed::RawspeedException);
+
+  encoder = LJpegEncoder();
+  encoder.predictor = 8;
+  ASSERT_THROW(encoder.encode(&data, samples.data(), 4, 4, 4, 1),
+               rawspeed::RawspeedException);
+
+  encoder = LJpegEncoder();
+  ASSERT_THROW(encoder.encode(&data, samples.data(), 4, 4, 4, 5),
+               rawspeed::RawspeedException);
+  ASSERT_THROW(encoder.encode(&data, samples.data(), 3, 4, 4, 1),
+               rawspeed::RawspeedException);
+
+  encoder.precision = 2;
+  const std::vector<ushort16> tooBig(16, 4);
+  ASSERT_THROW(encoder.encode(&data, tooBig.data(), 4, 4, 4, 1),
+               rawspeed::RawspeedException);
+
+  ASSERT_TRUE(data.empty());
+}
+
+} // namespace rawspeed_test
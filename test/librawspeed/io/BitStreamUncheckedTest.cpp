@@ -0,0 +1,96 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "common/Common.h"   // for uchar8, uint32
+#include "io/BitPumpLSB.h"   // for BitPumpLSB
+#include "io/BitPumpMSB.h"   // for BitPumpMSB
+#include "io/BitPumpMSB16.h" // for BitPumpMSB16
+#include "io/BitPumpMSB32.h" // for BitPumpMSB32
+#include "io/Buffer.h"       // for Buffer
+#include "io/ByteStream.h"   // for ByteStream
+#include <gtest/gtest.h>     // for TYPED_TEST, ASSERT_EQ, Types
+#include <vector>            // for vector
+
+using rawspeed::BitPumpLSB;
+using rawspeed::BitPumpMSB;
+using rawspeed::BitPumpMSB16;
+using rawspeed::BitPumpMSB32;
+using rawspeed::Buffer;
+using rawspeed::ByteStream;
+using rawspeed::DataBuffer;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+
+namespace rawspeed_test {
+
+template <typename Pump> class BitStreamUncheckedTest : public ::testing::Test {
+protected:
+  std::vector<uchar8> input;
+  ByteStream bs;
+
+  void SetUp() override {
+    input.resize(256);
+    uint32 state = 1;
+    for (auto& byte : input) {
+      state = state * 1103515245U + 12345U;
+      byte = state >> 24;
+    }
+    bs = ByteStream(DataBuffer(Buffer(input.data(), input.size())));
+  }
+};
+
+using Pumps =
+    ::testing::Types<BitPumpLSB, BitPumpMSB, BitPumpMSB16, BitPumpMSB32>;
+TYPED_TEST_CASE(BitStreamUncheckedTest, Pumps);
+
+TYPED_TEST(BitStreamUncheckedTest, CanConsumeUnchecked) {
+  TypeParam pump(this->bs);
+  const uint32 size = this->input.size();
+  const uint32 readAhead = TypeParam::MaxReadAheadBytes;
+
+  ASSERT_TRUE(pump.canConsumeUnchecked(size - readAhead));
+  ASSERT_FALSE(pump.canConsumeUnchecked(size - readAhead + 1));
+
+  // Only the consumed bits count, not the ones that were already read ahead.
+  pump.fill(32);
+  ASSERT_TRUE(pump.canConsumeUnchecked(size - readAhead));
+  pump.skipBitsNoFill(8);
+  ASSERT_TRUE(pump.canConsumeUnchecked(size - readAhead - 1));
+  ASSERT_FALSE(pump.canConsumeUnchecked(size - readAhead));
+}
+
+TYPED_TEST(BitStreamUncheckedTest, SameAsChecked) {
+  for (uint32 nbits = 1; nbits <= 32; nbits++) {
+    TypeParam checked(this->bs);
+    TypeParam unchecked(this->bs);
+
+    // Consume the whole validated range, exactly.
+    const uint32 nbytes = this->input.size() - TypeParam::MaxReadAheadBytes;
+    ASSERT_TRUE(unchecked.canConsumeUnchecked(nbytes));
+    for (uint32 bits = 0; bits + nbits <= 8 * nbytes; bits += nbits) {
+      ASSERT_EQ(unchecked.peekBitsUnchecked(nbits), checked.peekBits(nbits));
+      ASSERT_EQ(unchecked.getBitsUnchecked(nbits), checked.getBits(nbits))
+          << "     Where nbits: " << nbits << ", bits: " << bits;
+    }
+  }
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,111 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "io/FilePrefetcher.h"  // for FilePrefetcher, FileIOMode
+#include "io/Buffer.h"          // for Buffer
+#include "io/FileIOException.h" // for FileIOException
+#include <cstdio>               // for remove
+#include <fstream>              // for ofstream
+#include <gtest/gtest.h>        // for Test, ASSERT_EQ, TEST_P, TempDir
+#include <string>               // for string, to_string
+#include <vector>               // for vector
+
+using rawspeed::FileIOException;
+using rawspeed::FileIOMode;
+using rawspeed::FilePrefetcher;
+using rawspeed::parseFileIOMode;
+
+namespace rawspeed_test {
+
+class FilePrefetcherTest : public ::testing::TestWithParam<FileIOMode> {
+protected:
+  static constexpr int numFiles = 7;
+
+  std::vector<std::string> fileNames;
+
+  void SetUp() override {
+    for (int i = 0; i < numFiles; ++i) {
+      fileNames.emplace_back(::testing::TempDir() + "FilePrefetcherTest." +
+                             std::to_string(i));
+      std::ofstream f(fileNames.back(), std::ios::binary);
+      // File i is i+1 bytes long, each one of which is i.
+      for (int j = 0; j <= i; ++j)
+        f.put(static_cast<char>(i));
+    }
+  }
+
+  void TearDown() override {
+    for (const auto& fileName : fileNames)
+      std::remove(fileName.c_str());
+  }
+
+  static void check(const rawspeed::Buffer& buf, int i) {
+    ASSERT_EQ(buf.getSize(), i + 1);
+    for (int j = 0; j <= i; ++j)
+      ASSERT_EQ(buf[j], i);
+  }
+};
+INSTANTIATE_TEST_CASE_P(Modes, FilePrefetcherTest,
+                        ::testing::Values(FileIOMode::Cold, FileIOMode::Warm,
+                                          FileIOMode::Overlapped));
+
+TEST_P(FilePrefetcherTest, InOrder) {
+  FilePrefetcher files(fileNames, GetParam());
+  for (int i = 0; i < numFiles; ++i)
+    check(*files.take(i), i);
+  ASSERT_GE(files.getWaitSeconds(), 0);
+}
+
+TEST_P(FilePrefetcherTest, OutOfOrderAndSkipped) {
+  FilePrefetcher files(fileNames, GetParam(), /*depth=*/1);
+  check(*files.take(3), 3);
+  files.skip(0);
+  check(*files.take(1), 1);
+  files.skip(2);
+  files.skip(4);
+  check(*files.take(6), 6);
+  // File 5 is never looked at, that is fine too.
+}
+
+TEST_P(FilePrefetcherTest, MissingFile) {
+  fileNames.emplace_back(::testing::TempDir() + "FilePrefetcherTest.missing");
+
+  FilePrefetcher files(fileNames, GetParam());
+  for (int i = 0; i < numFiles; ++i)
+    check(*files.take(i), i);
+  ASSERT_THROW(files.take(numFiles), FileIOException);
+}
+
+TEST_P(FilePrefetcherTest, SameFileWithDroppedCaches) {
+  // Like rsbench does it.
+  FilePrefetcher files(std::vector<std::string>(5, fileNames[3]), GetParam(),
+                       /*depth=*/2, /*dropCaches=*/true);
+  for (int i = 0; i < 5; ++i)
+    check(*files.take(i), 3);
+}
+
+TEST(FileIOModeTest, Parse) {
+  ASSERT_EQ(parseFileIOMode("cold"), FileIOMode::Cold);
+  ASSERT_EQ(parseFileIOMode("warm"), FileIOMode::Warm);
+  ASSERT_EQ(parseFileIOMode("overlapped"), FileIOMode::Overlapped);
+  ASSERT_THROW(parseFileIOMode("lukewarm"), FileIOException);
+}
+
+} // namespace rawspeed_test
@@ -0,0 +1,170 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "parsers/PreviewParser.h"      // for PreviewParser, EmbeddedPreview
+#include "common/Common.h"              // for uchar8, ushort16, uint32
+#include "common/Point.h"               // for iPoint2D
+#include "common/RawImage.h"            // for RawImage
+#include "encoders/DngWriter.h"         // for DngWriter
+#include "encoders/TiffWriter.h"        // for TiffWriter
+#include "io/Buffer.h"                  // for Buffer
+#include "parsers/RawParserException.h" // for RawParserException
+#include "tiff/TiffTag.h"               // for JPEGINTERCHANGEFORMAT, ...
+#include <algorithm>                    // for equal
+#include <gtest/gtest.h>                // for Test, ASSERT_EQ, TEST
+#include <vector>                       // for vector
+
+using rawspeed::Buffer;
+using rawspeed::DngWriter;
+using rawspeed::EmbeddedPreview;
+using rawspeed::iPoint2D;
+using rawspeed::PreviewParser;
+using rawspeed::RawImage;
+using rawspeed::RawParserException;
+using rawspeed::TiffWriter;
+using rawspeed::uchar8;
+using rawspeed::uint32;
+
+namespace rawspeed_test {
+
+namespace {
+
+void putBE16(std::vector<uchar8>* out, int v) {
+  out->push_back(v >> 8);
+  out->push_back(v & 0xFF);
+}
+
+// Just the headers, that is all that PreviewParser looks at.
+std::vector<uchar8> makeJpeg(int width, int height, uchar8 sof = 0xC0,
+                             const std::vector<uchar8>& exif = {}) {
+  std::vector<uchar8> jpeg = {0xFF, 0xD8};
+  if (!exif.empty()) {
+    jpeg.insert(jpeg.end(), {0xFF, 0xE1});
+    putBE16(&jpeg, 2 + 6 + exif.size());
+    jpeg.insert(jpeg.end(), {'E', 'x', 'i', 'f', 0, 0});
+    jpeg.insert(jpeg.end(), exif.begin(), exif.end());
+  }
+  jpeg.insert(jpeg.end(), {0xFF, sof});
+  putBE16(&jpeg, 8 + 3 * 3);
+  jpeg.push_back(8);
+  putBE16(&jpeg, height);
+  putBE16(&jpeg, width);
+  jpeg.push_back(3);
+  for (uchar8 c = 1; c <= 3; c++)
+    jpeg.insert(jpeg.end(), {c, 0x11, 0});
+  jpeg.insert(jpeg.end(), {0xFF, 0xD9});
+  return jpeg;
+}
+
+void checkPreview(const std::vector<uchar8>& file,
+                  const EmbeddedPreview& preview,
+                  const std::vector<uchar8>& jpeg, const iPoint2D& dim) {
+  ASSERT_EQ(preview.dim, dim);
+  ASSERT_EQ(preview.size, jpeg.size());
+  ASSERT_LE(preview.offset + preview.size, file.size());
+  ASSERT_TRUE(
+      std::equal(jpeg.begin(), jpeg.end(), file.begin() + preview.offset));
+}
+
+} // namespace
+
+TEST(PreviewParserTest, Tiff) {
+  const auto thumbnail = makeJpeg(160, 120);
+  const auto preview = makeJpeg(1600, 1200);
+
+  TiffWriter tiff;
+  tiff.addShorts(rawspeed::ORIENTATION, {6});
+  tiff.addShorts(rawspeed::COMPRESSION, {6});
+  tiff.addImageData(rawspeed::STRIPOFFSETS, rawspeed::STRIPBYTECOUNTS,
+                    {preview});
+  tiff.addImageData(rawspeed::JPEGINTERCHANGEFORMAT,
+                    rawspeed::JPEGINTERCHANGEFORMATLENGTH, {thumbnail});
+  const auto file = tiff.write();
+  const Buffer buf(file.data(), file.size());
+
+  const PreviewParser p(&buf);
+  ASSERT_EQ(p.getPreviews().size(), 2);
+  checkPreview(file, p.getSmallest(), thumbnail, {160, 120});
+  checkPreview(file, p.getLargest(), preview, {1600, 1200});
+  ASSERT_EQ(p.getSmallest().orientation, 6);
+  ASSERT_EQ(p.getLargest().orientation, 6);
+}
+
+TEST(PreviewParserTest, LosslessJpegIsNotAPreview) {
+  const RawImage img = RawImage::create({64, 32});
+  DngWriter writer;
+  writer.compression = DngWriter::Compression::LJpeg;
+  const auto file = writer.write(img);
+  const Buffer buf(file.data(), file.size());
+
+  const PreviewParser p(&buf);
+  ASSERT_TRUE(p.getPreviews().empty());
+  ASSERT_THROW(p.getLargest(), RawParserException);
+  ASSERT_THROW(p.getSmallest(), RawParserException);
+}
+
+TEST(PreviewParserTest, BrokenReferenceIsSkipped) {
+  const auto preview = makeJpeg(1600, 1200);
+
+  TiffWriter tiff;
+  tiff.addLongs(rawspeed::JPEGINTERCHANGEFORMAT, {0x7FFFFFF0});
+  tiff.addLongs(rawspeed::JPEGINTERCHANGEFORMATLENGTH, {1000});
+  tiff.addShorts(rawspeed::COMPRESSION, {7});
+  tiff.addImageData(rawspeed::STRIPOFFSETS, rawspeed::STRIPBYTECOUNTS,
+                    {preview});
+  const auto file = tiff.write();
+  const Buffer buf(file.data(), file.size());
+
+  const PreviewParser p(&buf);
+  ASSERT_EQ(p.getPreviews().size(), 1);
+  checkPreview(file, p.getLargest(), preview, {1600, 1200});
+  ASSERT_EQ(p.getLargest().orientation, 0);
+}
+
+TEST(PreviewParserTest, Raf) {
+  const auto thumbnail = makeJpeg(160, 120);
+
+  TiffWriter exif;
+  exif.addShorts(rawspeed::ORIENTATION, {8});
+  exif.addImageData(rawspeed::JPEGINTERCHANGEFORMAT,
+                    rawspeed::JPEGINTERCHANGEFORMATLENGTH, {thumbnail});
+  const auto preview = makeJpeg(1920, 1280, 0xC2, exif.write());
+
+  // Just the header, the raw data is not needed.
+  std::vector<uchar8> file(0x100);
+  const char magic[] = "FUJIFILMCCD-RAW ";
+  std::copy(magic, magic + 16, file.begin());
+  // The offset and the size of the JPEG, big-endian.
+  const std::vector<uint32> header = {static_cast<uint32>(file.size()),
+                                      static_cast<uint32>(preview.size())};
+  for (int i = 0; i < 8; i++)
+    file[0x54 + i] = header[i / 4] >> (24 - 8 * (i % 4));
+  file.insert(file.end(), preview.begin(), preview.end());
+  const Buffer buf(file.data(), file.size());
+
+  const PreviewParser p(&buf);
+  ASSERT_EQ(p.getPreviews().size(), 2);
+  checkPreview(file, p.getSmallest(), thumbnail, {160, 120});
+  checkPreview(file, p.getLargest(), preview, {1920, 1280});
+  ASSERT_EQ(p.getLargest().orientation, 8);
+}
+
+} // namespace rawspeed_test
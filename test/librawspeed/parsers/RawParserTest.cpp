@@ -0,0 +1,120 @@
+/*
+    RawSpeed - RAW file decoder.
+
+    Copyright (C) 2019 Roman Lebedev
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "parsers/RawParser.h"       // for RawParser, RawFormat
+#include "common/Common.h"           // for uchar8
+#include "common/RawImage.h"         // for RawImage
+#include "decoders/RawDecoder.h"     // for RawDecoder
+#include "encoders/DngWriter.h"      // for DngWriter
+#include "encoders/TiffWriter.h"     // for TiffWriter
+#include "io/Buffer.h"               // for Buffer
+#include "metadata/CameraMetaData.h" // for CameraMetaData
+#include "tiff/TiffTag.h"            // for IMAGEWIDTH
+#include <algorithm>                 // for copy
+#include <gtest/gtest.h>             // for Test, ASSERT_EQ, TEST
+#include <string>                    // for string
+#include <vector>                    // for vector
+
+using rawspeed::Buffer;
+using rawspeed::CameraMetaData;
+using rawspeed::DngWriter;
+using rawspeed::RawFormat;
+using rawspeed::RawImage;
+using rawspeed::RawParser;
+using rawspeed::TiffWriter;
+using rawspeed::uchar8;
+
+namespace rawspeed_test {
+
+namespace {
+
+RawFormat probe(const std::vector<uchar8>& magic, size_t size = 256) {
+  std::vector<uchar8> file(size);
+  std::copy(magic.begin(), magic.end(), file.begin());
+  const Buffer buf(file.data(), file.size());
+  return RawParser::probe(&buf);
+}
+
+} // namespace
+
+TEST(RawParserTest, Probe) {
+  ASSERT_EQ(probe({}), RawFormat::Unknown);
+  ASSERT_EQ(probe({0xFF, 0xD8, 0xFF, 0xE0}), RawFormat::Unknown); // JPEG
+  ASSERT_EQ(probe({'<', '?', 'x', 'm', 'l'}), RawFormat::Unknown);
+
+  ASSERT_EQ(probe({'I', 'I', 42, 0}), RawFormat::Tiff);
+  ASSERT_EQ(probe({'M', 'M', 0, 42}), RawFormat::Tiff);
+  ASSERT_EQ(probe({'I', 'I', 'R', 'O'}), RawFormat::Tiff); // ORF
+  ASSERT_EQ(probe({'I', 'I', 'U', 0}), RawFormat::Tiff);   // RW2
+  ASSERT_EQ(probe({'I', 'I', 43, 0}), RawFormat::Unknown); // BigTIFF
+
+  ASSERT_EQ(probe({0, 'M', 'R', 'M'}), RawFormat::Mrw);
+  ASSERT_EQ(probe({'F', 'U', 'J', 'I', 'F', 'I', 'L', 'M', 'C', 'C', 'D', '-',
+                   'R', 'A', 'W', ' '}),
+            RawFormat::Fiff);
+  ASSERT_EQ(probe({'I', 'I', 0x1a, 0, 0, 0, 'H', 'E', 'A', 'P', 'C', 'C', 'D',
+                   'R'}),
+            RawFormat::Ciff);
+
+  // Too small to be a raw.
+  ASSERT_EQ(probe({'I', 'I', 42, 0}, 100), RawFormat::Unknown);
+}
+
+TEST(RawParserTest, TryGetDecoder) {
+  const CameraMetaData meta;
+  RawParser::Status status;
+  std::string error;
+
+  {
+    const std::vector<uchar8> file(4096, 0xFF);
+    const Buffer buf(file.data(), file.size());
+    RawParser parser(&buf);
+    ASSERT_EQ(parser.tryGetDecoder(&meta, &status, &error), nullptr);
+    ASSERT_EQ(status, RawParser::Status::UnknownFormat);
+    ASSERT_FALSE(error.empty());
+  }
+
+  {
+    // A TIFF, but not a raw one.
+    TiffWriter tiff;
+    tiff.addLongs(rawspeed::IMAGEWIDTH, {1});
+    std::vector<uchar8> file = tiff.write();
+    file.resize(4096);
+    const Buffer buf(file.data(), file.size());
+    RawParser parser(&buf);
+    error.clear();
+    ASSERT_EQ(parser.tryGetDecoder(&meta, &status, &error), nullptr);
+    ASSERT_EQ(status, RawParser::Status::Failed);
+    ASSERT_FALSE(error.empty());
+  }
+
+  {
+    const std::vector<uchar8> file =
+        DngWriter().write(RawImage::create({64, 32}));
+    const Buffer buf(file.data(), file.size());
+    RawParser parser(&buf);
+    const auto decoder = parser.tryGetDecoder(&meta, &status);
+    ASSERT_NE(decoder, nullptr);
+    ASSERT_EQ(status, RawParser::Status::OK);
+  }
+}
+
+} // namespace rawspeed_test